@@ -0,0 +1,94 @@
+#!/bin/bash
+# Find where compiling pays off: run the same program with growing trip
+# counts under -interp, under -tiered and -run (the ORC JIT at -O2) and
+# built ahead of time, and time each from the source to the exit.
+#
+#   bench/interp.sh [trip counts...]
+#
+# The ahead-of-time column adds the compile and link to the run, the run
+# alone is in parentheses. TINYCC, CC, RUNTIME and RUNS override the tools
+# and the number of timed runs of each.
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+TINYCC=${TINYCC:-$ROOT/build/bin/tinycc}
+CC=${CC:-clang}
+RUNTIME=${RUNTIME:-$ROOT/build/lib/libtinycc_rt.a}
+RUNS=${RUNS:-5}
+
+if [ $# -eq 0 ]; then
+  set -- 10 100 1000 10000 100000 1000000
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Collatz steps like bench/collatz.txt, for n trips over 1..10000 so the
+# values stay in `int`.
+generate() {
+  cat <<EOF
+int steps(int n) {
+  int count = 0;
+  for (; n != 1; count = count + 1) {
+    if (n % 2 == 0) {
+      n = n / 2;
+    }
+    else {
+      n = 3 * n + 1;
+    }
+  }
+  return count;
+}
+
+int total = 0;
+for (int i = 0; i < $1; i = i + 1) {
+  total = total + steps(i % 10000 + 1);
+}
+total;
+EOF
+}
+
+# Print the best wall time of RUNS runs of a command in milliseconds.
+best_time() {
+  local best=
+  for _ in $(seq "$RUNS"); do
+    local start=$(date +%s%N)
+    "$@" >/dev/null
+    local elapsed=$((($(date +%s%N) - start) / 1000000))
+    if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then
+      best=$elapsed
+    fi
+  done
+  echo "$best"
+}
+
+build() {
+  "$TINYCC" -O2 -filetype=obj -relocation-model=pic "$1" -o "$2.o"
+  "$CC" "$2.o" "$RUNTIME" -lomp -o "$2"
+}
+
+printf "%-10s %12s %12s %12s %18s\n" trips "interp (ms)" "tiered (ms)" \
+    "JIT (ms)" "AOT (ms)"
+crossover=
+for trips in "$@"; do
+  prog="$WORK/collatz$trips.txt"
+  generate "$trips" > "$prog"
+
+  interp=$(best_time "$TINYCC" -interp "$prog")
+  tiered=$(best_time "$TINYCC" -tiered -O2 "$prog")
+  jit=$(best_time "$TINYCC" -run -O2 "$prog")
+  aotBuild=$(best_time build "$prog" "$WORK/collatz$trips")
+  aotRun=$(best_time "$WORK/collatz$trips")
+  printf "%-10s %12d %12d %12d %10d (%5d)\n" "$trips" "$interp" "$tiered" \
+      "$jit" $((aotBuild + aotRun)) "$aotRun"
+
+  if [ -z "$crossover" ] && [ "$jit" -lt "$interp" ]; then
+    crossover=$trips
+  fi
+done
+
+if [ -n "$crossover" ]; then
+  echo "The JIT overtakes the interpreter from $crossover trips on."
+else
+  echo "The interpreter is faster at every trip count."
+fi
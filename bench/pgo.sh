@@ -0,0 +1,70 @@
+#!/bin/bash
+# Compare the run time of programs built with -O2 and with -O2 plus the
+# profile of a training run.
+#
+#   bench/pgo.sh [program.txt...]
+#
+# The profile runtime comes from clang, so the programs are linked with it.
+# TINYCC, CC, PROFDATA, RUNTIME and RUNS override the tools and the number
+# of timed runs of each binary.
+set -e
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+TINYCC=${TINYCC:-$ROOT/build/bin/tinycc}
+CC=${CC:-clang}
+PROFDATA=${PROFDATA:-llvm-profdata}
+RUNTIME=${RUNTIME:-$ROOT/build/lib/libtinycc_rt.a}
+RUNS=${RUNS:-5}
+
+if [ $# -eq 0 ]; then
+  set -- "$ROOT"/bench/*.txt "$ROOT"/test/*.txt
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# build <program> <binary> [flag], where the flag goes to tinycc and, for
+# -fprofile-generate, to the link of the profile runtime.
+build() {
+  local prog=$1 bin=$2 flag=$3
+  "$TINYCC" -O2 -filetype=obj -relocation-model=pic $flag "$prog" -o "$bin.o" >/dev/null
+  if [ "$flag" = -fprofile-generate ]; then
+    "$CC" -fprofile-generate "$bin.o" "$RUNTIME" -lomp -o "$bin"
+  else
+    "$CC" "$bin.o" "$RUNTIME" -lomp -o "$bin"
+  fi
+}
+
+# Print the best wall time of RUNS runs in milliseconds.
+best_time() {
+  local best=
+  for _ in $(seq "$RUNS"); do
+    local start=$(date +%s%N)
+    "$1" >/dev/null
+    local elapsed=$((($(date +%s%N) - start) / 1000000))
+    if [ -z "$best" ] || [ "$elapsed" -lt "$best" ]; then
+      best=$elapsed
+    fi
+  done
+  echo "$best"
+}
+
+printf "%-24s %10s %10s %8s\n" program "-O2 (ms)" "PGO (ms)" speedup
+for prog in "$@"; do
+  name=$(basename "$prog" .txt)
+  case $name in
+  # Known to crash the compiler, see the README.
+  emptyFor|tmp) continue ;;
+  esac
+
+  build "$prog" "$WORK/$name.base"
+  build "$prog" "$WORK/$name.gen" -fprofile-generate
+  LLVM_PROFILE_FILE="$WORK/$name.profraw" "$WORK/$name.gen" >/dev/null
+  "$PROFDATA" merge "$WORK/$name.profraw" -o "$WORK/$name.profdata"
+  build "$prog" "$WORK/$name.pgo" -fprofile-use="$WORK/$name.profdata"
+
+  base=$(best_time "$WORK/$name.base")
+  pgo=$(best_time "$WORK/$name.pgo")
+  printf "%-24s %10d %10d %7sx\n" "$name" "$base" "$pgo" \
+      "$(awk "BEGIN { printf \"%.2f\", ($base + 0.001) / ($pgo + 0.001) }")"
+done
\ No newline at end of file
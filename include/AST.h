@@ -3,9 +3,11 @@
 
 #include "Type.h"
 #include "Lexer.h"
+#include "Scope.h"
 
 #include "llvm/ADT/StringRef.h"
 #include "llvm/IR/Value.h"
+#include "llvm/Support/Casting.h"
 
 #include <functional>
 #include <memory>
@@ -19,11 +21,21 @@ struct IfStmt;
 struct ForStmt;
 struct BreakStmt;
 struct ContinueStmt;
+struct ReturnStmt;
+struct FunctionDecl;
 struct VariableDecl;
 struct AssignExpr;
 struct BinaryExpr;
+struct UnaryExpr;
+struct ConditionalExpr;
 struct NumberExpr;
+struct FloatExpr;
 struct VariableExpr;
+struct SubscriptExpr;
+struct MemberExpr;
+struct ImplicitCastExpr;
+struct CallExpr;
+struct BuiltinCallExpr;
 
 struct Visitor {
   virtual ~Visitor() {}
@@ -34,18 +46,29 @@ struct Visitor {
   virtual llvm::Value *visitForStmt(ForStmt *) = 0;
   virtual llvm::Value *visitBreakStmt(BreakStmt *) = 0;
   virtual llvm::Value *visitContinueStmt(ContinueStmt *) = 0;
+  virtual llvm::Value *visitReturnStmt(ReturnStmt *) = 0;
+  virtual llvm::Value *visitFunctionDecl(FunctionDecl *) = 0;
   virtual llvm::Value *visitASTNode(ASTNode *) { return nullptr; }
   virtual llvm::Value *visitVariableDecl(VariableDecl *) = 0;
   virtual llvm::Value *visitAssignExpr(AssignExpr *) = 0;
   virtual llvm::Value *visitBinaryExpr(BinaryExpr *) = 0;
+  virtual llvm::Value *visitUnaryExpr(UnaryExpr *) = 0;
+  virtual llvm::Value *visitConditionalExpr(ConditionalExpr *) = 0;
   virtual llvm::Value *visitNumberExpr(NumberExpr *) = 0;
+  virtual llvm::Value *visitFloatExpr(FloatExpr *) = 0;
   virtual llvm::Value *visitVariableExpr(VariableExpr *) = 0;
+  virtual llvm::Value *visitSubscriptExpr(SubscriptExpr *) = 0;
+  virtual llvm::Value *visitMemberExpr(MemberExpr *) = 0;
+  virtual llvm::Value *visitImplicitCastExpr(ImplicitCastExpr *) = 0;
+  virtual llvm::Value *visitCallExpr(CallExpr *) = 0;
+  virtual llvm::Value *visitBuiltinCallExpr(BuiltinCallExpr *) = 0;
 };
 
 struct ASTNode {
   virtual ~ASTNode() {}
   virtual llvm::Value *accept(Visitor *visitor) { return nullptr; }
-  CType *ty;
+  // Statements have no type, and nodes Sema creates have no token.
+  CType *ty = nullptr;
   Token tok;
 
   enum NodeKind {
@@ -55,10 +78,20 @@ struct ASTNode {
     ForStmt,
     BreakStmt,
     ContinueStmt,
+    ReturnStmt,
+    FunctionDecl,
     VariableDecl,
     BinaryExpr,
+    UnaryExpr,
+    ConditionalExpr,
     NumberExpr,
+    FloatExpr,
     VariableExpr,
+    SubscriptExpr,
+    MemberExpr,
+    ImplicitCastExpr,
+    CallExpr,
+    BuiltinCallExpr,
     AssignExpr
   };
 
@@ -114,6 +147,29 @@ struct IfStmt : ASTNode {
   }
 };
 
+enum class OmpSchedule {
+  Static,
+  Dynamic,
+};
+
+/// `#pragma omp parallel for` on a loop `for (i = lower; i < upper;
+/// i = i + step)`, whose iterations are shared out among threads.
+struct OmpParallelFor {
+  // The init part of the loop sets the induction variable to `lower`.
+  std::shared_ptr<Symbol> iv;
+  std::shared_ptr<ASTNode> upper;
+  int step = 1;
+  // `i <= upper` rather than `i < upper`.
+  bool isInclusive = false;
+
+  // Variables of `reduction(+: ...)`, summed over the threads.
+  std::vector<std::shared_ptr<Symbol>> reductions;
+  OmpSchedule schedule = OmpSchedule::Static;
+  // NULL if the clause has none.
+  std::shared_ptr<ASTNode> chunk;
+  std::shared_ptr<ASTNode> numThreads;
+};
+
 struct ForStmt : ASTNode {
   ForStmt() : ASTNode(NodeKind::ForStmt) {}
 
@@ -121,6 +177,8 @@ struct ForStmt : ASTNode {
   std::shared_ptr<ASTNode> condExpr;
   std::shared_ptr<ASTNode> incExpr;
   std::shared_ptr<ASTNode> forBody;
+  // NULL unless the loop has `#pragma omp parallel for`.
+  std::shared_ptr<OmpParallelFor> omp;
 
   llvm::Value *accept(Visitor *visitor) override {
     return visitor->visitForStmt(this);
@@ -161,9 +219,77 @@ struct ContinueStmt : ASTNode {
   }
 };
 
+struct ReturnStmt : ASTNode {
+  ReturnStmt() : ASTNode(NodeKind::ReturnStmt) {}
+
+  // `return;` leaves it NULL.
+  std::shared_ptr<ASTNode> expr;
+
+  llvm::Value *accept(Visitor *visitor) override {
+    return visitor->visitReturnStmt(this);
+  }
+
+  static bool classof(const ASTNode *node) {
+    return node->getNodeKind() == NodeKind::ReturnStmt;
+  }
+};
+
+/// `__attribute__((name(args...)))`, arguments are kept as raw tokens and
+/// interpreted by whoever consumes the attribute.
+struct Attr {
+  Token tok;
+  llvm::StringRef name;
+  std::vector<Token> args;
+};
+
+/// Storage class, function specifiers and attributes leading a declaration.
+struct DeclSpec {
+  CType *ty = nullptr;
+  bool isStatic = false;
+  bool isInline = false;
+  std::vector<Attr> attrs;
+};
+
+struct FunctionDecl : ASTNode {
+  FunctionDecl() : ASTNode(NodeKind::FunctionDecl) {}
+
+  llvm::StringRef name;
+  std::vector<std::shared_ptr<ASTNode>> params;
+  // A prototype has no body.
+  std::shared_ptr<ASTNode> body;
+  std::shared_ptr<Symbol> symbol;
+
+  bool isStatic = false;
+  bool isInline = false;
+  // Set when the body takes the address of a local or decays a local array,
+  // so a callee may be passed a pointer into this function's frame.
+  bool frameAddressTaken = false;
+  std::vector<Attr> attrs;
+  // The targets of `target_clones`, without quotes.
+  std::vector<llvm::StringRef> targetClones;
+
+  bool hasAttr(llvm::StringRef attrName) const {
+    for (const auto &attr: attrs) {
+      if (attr.name == attrName) return true;
+    }
+    return false;
+  }
+
+  llvm::Value *accept(Visitor *visitor) override {
+    return visitor->visitFunctionDecl(this);
+  }
+
+  static bool classof(const ASTNode *node) {
+    return node->getNodeKind() == NodeKind::FunctionDecl;
+  }
+};
+
 struct VariableDecl : ASTNode {
   VariableDecl() : ASTNode(NodeKind::VariableDecl) {}
 
+  std::shared_ptr<Symbol> symbol;
+  bool isStatic = false;
+
   llvm::Value *accept(Visitor *visitor) override {
     return visitor->visitVariableDecl(this);
   }
@@ -190,7 +316,10 @@ struct AssignExpr : ASTNode {
 };
 
 enum class OpCode {
-  add, sub, mul, div,
+  add, sub, mul, div, mod,
+  bitwiseand, bitwiseor, bitwisexor, bitwisenot,
+  addrof, deref,
+  shl, shr,
   equalequal, notequal,
   less, lesseq,
   greater, greatereq
@@ -214,6 +343,38 @@ struct BinaryExpr : ASTNode {
   }
 };
 
+struct UnaryExpr : ASTNode {
+  UnaryExpr() : ASTNode(NodeKind::UnaryExpr) {}
+
+  OpCode op;
+  std::shared_ptr<ASTNode> operand;
+
+  llvm::Value *accept(Visitor *visitor) override {
+    return visitor->visitUnaryExpr(this);
+  }
+
+  static bool classof(const ASTNode *node) {
+    return node->getNodeKind() == NodeKind::UnaryExpr;
+  }
+};
+
+/// `cond ? thenExpr : elseExpr`, only one of the arms is evaluated.
+struct ConditionalExpr : ASTNode {
+  ConditionalExpr() : ASTNode(NodeKind::ConditionalExpr) {}
+
+  std::shared_ptr<ASTNode> condExpr;
+  std::shared_ptr<ASTNode> thenExpr;
+  std::shared_ptr<ASTNode> elseExpr;
+
+  llvm::Value *accept(Visitor *visitor) override {
+    return visitor->visitConditionalExpr(this);
+  }
+
+  static bool classof(const ASTNode *node) {
+    return node->getNodeKind() == NodeKind::ConditionalExpr;
+  }
+};
+
 struct NumberExpr : ASTNode {
   NumberExpr() : ASTNode(NodeKind::NumberExpr) {}
 
@@ -228,10 +389,25 @@ struct NumberExpr : ASTNode {
   }
 };
 
+/// A floating literal, `float` with an `f` suffix and `double` otherwise.
+struct FloatExpr : ASTNode {
+  FloatExpr() : ASTNode(NodeKind::FloatExpr) {}
+
+  double value;
+  llvm::Value *accept(Visitor *visitor) override {
+    return visitor->visitFloatExpr(this);
+  }
+
+  static bool classof(const ASTNode *node) {
+    return node->getNodeKind() == NodeKind::FloatExpr;
+  }
+};
+
 struct VariableExpr : ASTNode {
   VariableExpr() : ASTNode(NodeKind::VariableExpr) {}
 
   llvm::StringRef name;
+  std::shared_ptr<Symbol> symbol;
   llvm::Value *accept(Visitor *visitor) override {
     return visitor->visitVariableExpr(this);
   }
@@ -242,8 +418,148 @@ struct VariableExpr : ASTNode {
   }
 };
 
+/// `base[index]`, where `base` has array, pointer or vector type.
+struct SubscriptExpr : ASTNode {
+  SubscriptExpr() : ASTNode(NodeKind::SubscriptExpr) {}
+
+  std::shared_ptr<ASTNode> base;
+  std::shared_ptr<ASTNode> index;
+
+  llvm::Value *accept(Visitor *visitor) override {
+    return visitor->visitSubscriptExpr(this);
+  }
+
+  static bool classof(const ASTNode *node) {
+    return node->getNodeKind() == NodeKind::SubscriptExpr;
+  }
+};
+
+/// `base.name`, or `base->name` where `base` points to the struct.
+struct MemberExpr : ASTNode {
+  MemberExpr() : ASTNode(NodeKind::MemberExpr) {}
+
+  std::shared_ptr<ASTNode> base;
+  CStructType *structTy;
+  llvm::StringRef name;
+  unsigned fieldIdx;
+  bool isArrow = false;
+
+  const CField &getField() const { return structTy->getFields()[fieldIdx]; }
+
+  llvm::Value *accept(Visitor *visitor) override {
+    return visitor->visitMemberExpr(this);
+  }
+
+  static bool classof(const ASTNode *node) {
+    return node->getNodeKind() == NodeKind::MemberExpr;
+  }
+};
+
+enum class CastKind {
+  ArrayToPointerDecay,
+  NullToPointer,
+  IntegralToFloating,
+  FloatingToIntegral,
+  // Between `float` and `double`.
+  FloatingCast,
+  // A scalar operand of an element-wise vector operator.
+  VectorSplat,
+};
+
+/// A conversion Sema inserts, which has no syntax of its own.
+struct ImplicitCastExpr : ASTNode {
+  ImplicitCastExpr() : ASTNode(NodeKind::ImplicitCastExpr) {}
+
+  CastKind castKind;
+  std::shared_ptr<ASTNode> operand;
+
+  llvm::Value *accept(Visitor *visitor) override {
+    return visitor->visitImplicitCastExpr(this);
+  }
+
+  static bool classof(const ASTNode *node) {
+    return node->getNodeKind() == NodeKind::ImplicitCastExpr;
+  }
+};
+
+/// Only variables, array and vector elements, fields of those and
+/// dereferenced pointers have an address.
+inline bool isLValueExpr(ASTNode *expr) {
+  if (auto *unaryExpr = llvm::dyn_cast<UnaryExpr>(expr)) {
+    return unaryExpr->op == OpCode::deref;
+  }
+  if (auto *memberExpr = llvm::dyn_cast<MemberExpr>(expr)) {
+    // A field of a struct value, like `f().x`, is not.
+    return memberExpr->isArrow || isLValueExpr(memberExpr->base.get());
+  }
+  if (auto *subscriptExpr = llvm::dyn_cast<SubscriptExpr>(expr)) {
+    // An element of a vector value, like `(a + b)[0]`, is not.
+    return !llvm::isa<CVectorType>(subscriptExpr->base->ty) ||
+           isLValueExpr(subscriptExpr->base.get());
+  }
+  return llvm::isa<VariableExpr>(expr);
+}
+
+/// A literal can initialize a global variable statically.
+inline bool isLiteralExpr(ASTNode *expr) {
+  if (auto *castExpr = llvm::dyn_cast<ImplicitCastExpr>(expr)) {
+    return castExpr->castKind != CastKind::ArrayToPointerDecay &&
+           (castExpr->castKind == CastKind::NullToPointer ||
+            isLiteralExpr(castExpr->operand.get()));
+  }
+  return llvm::isa<NumberExpr>(expr) || llvm::isa<FloatExpr>(expr);
+}
+
+struct CallExpr : ASTNode {
+  CallExpr() : ASTNode(NodeKind::CallExpr) {}
+
+  llvm::StringRef callee;
+  // The declaration visible at the call site, owned by the program.
+  struct FunctionDecl *calleeDecl = nullptr;
+  std::vector<std::shared_ptr<ASTNode>> args;
+
+  llvm::Value *accept(Visitor *visitor) override {
+    return visitor->visitCallExpr(this);
+  }
+
+  static bool classof(const ASTNode *node) {
+    return node->getNodeKind() == NodeKind::CallExpr;
+  }
+};
+
+enum class BuiltinKind {
+  ShuffleVector,
+  Splat,
+  ReduceAdd,
+  ReduceMul,
+  ReduceMin,
+  ReduceMax,
+  ReduceAnd,
+  ReduceOr,
+  ReduceXor,
+};
+
+/// A call to a `__builtin_*` function, which is expanded inline.
+struct BuiltinCallExpr : ASTNode {
+  BuiltinCallExpr() : ASTNode(NodeKind::BuiltinCallExpr) {}
+
+  BuiltinKind builtinKind;
+  std::vector<std::shared_ptr<ASTNode>> args;
+
+  llvm::Value *accept(Visitor *visitor) override {
+    return visitor->visitBuiltinCallExpr(this);
+  }
+
+  static bool classof(const ASTNode *node) {
+    return node->getNodeKind() == NodeKind::BuiltinCallExpr;
+  }
+};
+
 struct Program {
   std::vector<std::shared_ptr<ASTNode>> stmtVec;
+  // Statements at file scope run in an implicit `main`, unless the program
+  // defines `main` itself or only holds declarations (a library unit).
+  bool hasImplicitMain = true;
   llvm::Value *accept(Visitor *visitor) {
     return visitor->visitProgram(this);
   }
@@ -0,0 +1,53 @@
+#ifndef AST_FILE_H_
+#define AST_FILE_H_
+
+#include "AST.h"
+#include "Type.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// A warning printed while parsing the program, printed again when its AST
+/// is loaded instead.
+struct SavedDiagnostic {
+  // The offset of the location in the source.
+  uint32_t offset;
+  llvm::SourceMgr::DiagKind kind;
+  llvm::StringRef message;
+};
+
+/// A program read back from an AST file. Its names point into the mapped
+/// file and its types live in `types`, so it must outlive the nodes.
+struct ASTFile {
+  std::unique_ptr<llvm::MemoryBuffer> buffer;
+  TypeContext types;
+  // Every node, including those only reachable as a `calleeDecl`.
+  std::vector<std::shared_ptr<ASTNode>> nodes;
+  std::shared_ptr<Program> program;
+  // Their messages point into the mapped file.
+  std::vector<SavedDiagnostic> diagnostics;
+};
+
+/// Write `prog` after Sema, with its types, symbols, source locations and
+/// the warnings it got, to `path` as fixed size records. `sourceHash`
+/// identifies the source it was parsed from and the options of Sema. The
+/// file is written aside and renamed into place.
+llvm::Error writeASTFile(const Program &prog,
+                         llvm::ArrayRef<SavedDiagnostic> diagnostics,
+                         uint64_t sourceHash, llvm::StringRef path);
+
+/// Map the AST file `path` and rebuild the program, in one pass creating
+/// the nodes and one linking them, without parsing anything. Fail if the
+/// file was written by another version of tinycc or for a source other
+/// than `sourceHash`.
+llvm::Expected<std::unique_ptr<ASTFile>> readASTFile(llvm::StringRef path,
+                                                     uint64_t sourceHash);
+
+#endif // AST_FILE_H_
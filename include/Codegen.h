@@ -2,19 +2,57 @@
 #define CODEGEN_H_
 
 #include "AST.h"
+#include "Interpreter.h"
+#include "ValueRange.h"
 
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Frontend/OpenMP/OMPIRBuilder.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
 #include "llvm/IR/Value.h"
+#include "llvm/Support/raw_ostream.h"
+
+/// The debug info to emit. LocTrackingOnly attaches source locations to
+/// the IR for optimization remarks, without emitting any debug info.
+/// LineTablesOnly emits the line table of `-gline-tables-only`, enough for
+/// profilers, and Full adds the types and variables of `-g`.
+enum class DebugInfoKind {
+  None,
+  LocTrackingOnly,
+  LineTablesOnly,
+  Full,
+};
 
 struct CodegenVisitor : Visitor {
 public:
-  CodegenVisitor(std::shared_ptr<Program> prog);
+  /// The module is printed to `os` once generated.
+  CodegenVisitor(std::shared_ptr<Program> prog, llvm::StringRef fileName = "-",
+                 DebugInfoKind debugInfo = DebugInfoKind::None,
+                 llvm::raw_ostream &os = llvm::outs());
+  /// Compile a chunk of the REPL, whose statements run in a function named
+  /// `entryName`. The globals of the chunks before are declared external,
+  /// they live in the modules of those chunks.
+  CodegenVisitor(std::shared_ptr<Program> chunk,
+                 llvm::ArrayRef<std::shared_ptr<Program>> prevChunks,
+                 llvm::StringRef entryName);
+  /// Compile `loop` of `prog` for -tiered, into a function `entryName`
+  /// which takes the frame of the interpreter and runs the loop from its
+  /// header. The locals declared before the loop are at `frameSlots` in
+  /// the frame, the globals are declared external, and the functions the
+  /// loop may call are internal copies.
+  CodegenVisitor(std::shared_ptr<Program> prog, ForStmt *loop,
+                 llvm::ArrayRef<std::pair<Symbol *, int32_t>> frameSlots,
+                 llvm::StringRef entryName);
 
   llvm::Value *visitProgram(Program *) override;
   llvm::Value *visitBlockStmt(BlockStmt *) override;
@@ -23,28 +61,140 @@ public:
   llvm::Value *visitForStmt(ForStmt *) override;
   llvm::Value *visitBreakStmt(BreakStmt *) override;
   llvm::Value *visitContinueStmt(ContinueStmt *) override;
+  llvm::Value *visitReturnStmt(ReturnStmt *) override;
+  llvm::Value *visitFunctionDecl(FunctionDecl *) override;
   llvm::Value *visitBinaryExpr(BinaryExpr *) override;
+  llvm::Value *visitUnaryExpr(UnaryExpr *) override;
+  llvm::Value *visitConditionalExpr(ConditionalExpr *) override;
   llvm::Value *visitVariableDecl(VariableDecl *) override;
   llvm::Value *visitAssignExpr(AssignExpr *) override;
   llvm::Value *visitNumberExpr(NumberExpr *) override;
+  llvm::Value *visitFloatExpr(FloatExpr *) override;
   llvm::Value *visitVariableExpr(VariableExpr *) override;
+  llvm::Value *visitSubscriptExpr(SubscriptExpr *) override;
+  llvm::Value *visitMemberExpr(MemberExpr *) override;
+  llvm::Value *visitImplicitCastExpr(ImplicitCastExpr *) override;
+  llvm::Value *visitCallExpr(CallExpr *) override;
+  llvm::Value *visitBuiltinCallExpr(BuiltinCallExpr *) override;
 
 public:
   inline llvm::Module *getModule() const  {
     return m.get();
   }
 
+private:
+  /// Attaches the location of a node to the instructions emitted while it
+  /// is alive, and restores the location of the enclosing node after.
+  struct DebugLocScope {
+    DebugLocScope(CodegenVisitor *cg, ASTNode *node);
+    ~DebugLocScope();
+
+    CodegenVisitor *cg;
+    llvm::DebugLoc savedLoc;
+  };
+
+  void declareExternalGlobals(Program *prevChunk);
+  void emitLoopEntry(ForStmt *loop,
+                     llvm::ArrayRef<std::pair<Symbol *, int32_t>> frameSlots);
+  void createCompileUnit(llvm::StringRef fileName, DebugInfoKind debugInfo);
+  llvm::DISubprogram *createSubprogram(llvm::Function *func, unsigned line,
+                                       CFuncType *funcTy);
+  llvm::DIType *getDIType(CType *ty);
+  llvm::DIType *getDIStructType(CStructType *structTy);
+  void emitVariableDebugInfo(VariableDecl *variableDecl, llvm::Value *addr);
+  bool tryIfConversion(IfStmt *ifStmt);
+  llvm::Type *getLLVMType(CType *ty);
+  llvm::Constant *getConstant(CType *ty, const uint8_t *bytes);
+  void declareEvaluatedGlobals(DeclStmt *declStmt);
+  llvm::StructType *getLLVMStructType(CStructType *structTy);
+  unsigned getFieldElemIndex(MemberExpr *memberExpr);
+  llvm::Align getAlign(CType *ty);
+  llvm::Value *createStorage(VariableDecl *variableDecl, llvm::Type *ty,
+                             llvm::Align align, const llvm::Twine &name);
+  llvm::Value *getLValueAddr(ASTNode *lvalue);
+  llvm::Value *emitIndexExt(ASTNode *indexExpr);
+  llvm::Align getLValueAlign(ASTNode *lvalue);
+  llvm::Value *emitArrayElementAddr(SubscriptExpr *subscriptExpr,
+                                    llvm::ArrayType *arrayTy,
+                                    llvm::Value *arrayAddr);
+  llvm::LoadInst *emitLoad(ASTNode *lvalue, const llvm::Twine &name = "");
+  void addRangeMetadata(llvm::LoadInst *load, const ValueRange &range);
+  llvm::StoreInst *emitStore(llvm::Value *value, ASTNode *lvalue);
+  void addAliasMetadata(llvm::Instruction *inst, ASTNode *lvalue);
+  llvm::MDNode *getTBAATag(CType *ty);
+  llvm::Value *emitPointerArithmetic(BinaryExpr *binaryExpr,
+                                     llvm::Value *lhs, llvm::Value *rhs);
+  llvm::Value *emitFloatingBinaryOp(OpCode op, llvm::Value *lhs,
+                                    llvm::Value *rhs);
+  llvm::Value *emitCompareResult(
+      llvm::Value *cmp, const ValueRange &lhsRange = ValueRange::getFull(),
+      const ValueRange &rhsRange = ValueRange::getFull());
+  llvm::Value *emitCondition(ASTNode *expr);
+  void eliminateBoundsChecks(ForStmt *forStmt);
+  void emitBoundsCheck(llvm::Value *inBounds);
+  void emitOmpParallelFor(ForStmt *forStmt);
+  llvm::BasicBlock *beginCallbackBody(llvm::IRBuilderBase::InsertPoint ip);
+  void finalizeOpenMP();
+  void emitMultiversions();
+  void emitTargetClones(llvm::Function *func,
+                        llvm::ArrayRef<llvm::StringRef> targets);
+  llvm::Function *getOrCreateFunction(FunctionDecl *funcDecl);
+  llvm::FunctionCallee getRuntimeFunction(llvm::StringRef name,
+                                          llvm::Type *retTy,
+                                          llvm::ArrayRef<llvm::Type *> paramTys);
+  void emitPrintValue(llvm::StringRef label, llvm::Value *value);
+
 private:
   llvm::LLVMContext context;
   std::shared_ptr<llvm::Module> m;
   llvm::IRBuilder<> builder{context};
 
-  llvm::StringMap<llvm::Value *> varAddrMap;
+  llvm::DenseMap<Symbol *, llvm::Value *> varAddrMap;
+  // The array of each field of a `soa` array, in field order.
+  llvm::DenseMap<Symbol *, llvm::SmallVector<llvm::Value *, 4>> soaFieldAddrs;
+  llvm::DenseMap<CStructType *, llvm::StructType *> structTys;
+  // The LLVM element index of each field, which skips padding elements.
+  llvm::DenseMap<CStructType *, llvm::SmallVector<unsigned, 8>> fieldElemIndices;
   llvm::DenseMap<ASTNode *, llvm::BasicBlock *> breakBBs;
   llvm::DenseMap<ASTNode *, llvm::BasicBlock *> continueBBs;
+  // Subscripts proven in bounds, or checked before their loop.
+  llvm::DenseSet<SubscriptExpr *> checkedSubscripts;
+  ValueRangeAnalysis ranges;
+  // What -fcompile-time-eval computed, nothing unless it is enabled.
+  ProgramEvaluation evaluation;
+
+  // The alias scope of each restrict parameter of the current function.
+  llvm::SmallVector<std::pair<Symbol *, llvm::MDNode *>, 4> restrictScopes;
+  llvm::MDNode *tbaaChar = nullptr;
+  llvm::StringMap<llvm::MDNode *> tbaaTags;
+
+  // Created by the first `#pragma omp parallel for`, which makes the
+  // module depend on the OpenMP runtime.
+  std::unique_ptr<llvm::OpenMPIRBuilder> ompBuilder;
+  // Functions to clone for each of their targets, once the module is done.
+  std::vector<std::pair<llvm::Function *, std::vector<llvm::StringRef>>>
+      multiversioned;
+
+
+  // Null unless debug info or location tracking is enabled.
+  std::unique_ptr<llvm::DIBuilder> diBuilder;
+  llvm::DIFile *diFile = nullptr;
+  DebugInfoKind debugInfoKind = DebugInfoKind::None;
+  llvm::DenseMap<CStructType *, llvm::DIType *> diStructTys;
+
+  // Where the module of the whole program is printed.
+  llvm::raw_ostream *os = &llvm::outs();
+  // Empty unless compiling a chunk of the REPL.
+  std::string replEntry;
+  // Set while declaring the globals of the chunks before.
+  bool declaringExternals = false;
+  // The loop compiled for -tiered, whose init the interpreter has run.
+  ForStmt *entryLoop = nullptr;
 
-  
   llvm::Function *currentFunction;
+  // NULL while generating the implicit main.
+  FunctionDecl *currentFuncDecl = nullptr;
+  llvm::DISubprogram *currentSubprogram = nullptr;
 };
 
 #endif // CODEGEN_H_
\ No newline at end of file
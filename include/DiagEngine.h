@@ -1,9 +1,15 @@
 #ifndef DIAGENGINE_H_
 #define DIAGENGINE_H_
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
 #include "llvm/Support/FormatVariadic.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+#include <functional>
+#include <string>
 #include <utility>
+#include <vector>
 
 namespace diag {
 enum {
@@ -14,18 +20,49 @@ enum {
 
 class DiagEngine {
 public:
-  DiagEngine(llvm::SourceMgr &mgr) : mgr(mgr) {}
+  DiagEngine(llvm::SourceMgr &mgr, llvm::raw_ostream &os = llvm::errs())
+      : mgr(mgr), os(os) {}
+
+  /// Run `handler` after printing an error, instead of exiting right away.
+  /// -j and -repl use it to go on with the other inputs or chunks. It exits
+  /// if the handler returns.
+  void setErrorHandler(std::function<void()> handler) {
+    errorHandler = std::move(handler);
+  }
+
+  /// A diagnostic that didn't stop the compile.
+  struct Diagnostic {
+    llvm::SMLoc loc;
+    llvm::SourceMgr::DiagKind kind;
+    std::string message;
+  };
+
+  /// The warnings reported so far, which -ast-cache saves with the AST.
+  llvm::ArrayRef<Diagnostic> getDiagnostics() const { return diagnostics; }
+
+  /// Print again a warning saved by an earlier compile of the source.
+  void replay(llvm::SMLoc loc, llvm::SourceMgr::DiagKind kind,
+              llvm::StringRef message) {
+    mgr.PrintMessage(os, loc, kind, message);
+    diagnostics.push_back({loc, kind, message.str()});
+  }
 
   template<typename... Args>
   void report(llvm::SMLoc loc, unsigned diagID, Args... args) {
     auto diagKind = getDiagKind(diagID);
     auto diagMsgFmt = getDiagMessage(diagID);
 
-    mgr.PrintMessage(loc, diagKind, llvm::formatv(diagMsgFmt, std::forward<Args>(args)...));
+    std::string message =
+        llvm::formatv(diagMsgFmt, std::forward<Args>(args)...).str();
+    mgr.PrintMessage(os, loc, diagKind, message);
     
     if (diagKind == llvm::SourceMgr::DK_Error) {
+      if (errorHandler) {
+        errorHandler();
+      }
       exit(0);
     }
+    diagnostics.push_back({loc, diagKind, std::move(message)});
   }
 private:
   llvm::SourceMgr::DiagKind getDiagKind(unsigned id);
@@ -33,6 +70,9 @@ private:
 
 private:
   llvm::SourceMgr &mgr;
+  llvm::raw_ostream &os;
+  std::function<void()> errorHandler;
+  std::vector<Diagnostic> diagnostics;
 };
 
 #endif // DIAGENGINE_H_
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef INTERPRETER_H_
+#define INTERPRETER_H_
+
+#include "AST.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/// A loop compiled while the interpreter runs it. It is entered at the loop
+/// header with the frame of the function running the loop, tests the
+/// condition first and returns once the loop exits.
+using CompiledLoop = void (*)(uint8_t *frame);
+
+/// Where the interpreter keeps the variables of a loop it wants compiled.
+struct LoopFrame {
+  // The byte offsets in the frame of the locals declared before the loop,
+  // including the parameters.
+  llvm::ArrayRef<std::pair<Symbol *, int32_t>> locals;
+  // The address of every global.
+  llvm::ArrayRef<std::pair<Symbol *, void *>> globals;
+};
+
+/// Compile a hot loop to run on the frame of the interpreter, or return
+/// null to keep interpreting it.
+using LoopCompiler =
+    std::function<CompiledLoop(ForStmt *loop, const LoopFrame &frame)>;
+
+/// Run `prog` without LLVM: the AST is lowered to a register bytecode, whose
+/// operands are the frame slots of variables and temporaries, and executed
+/// by a threaded dispatch loop. The value of an implicit main is printed to
+/// `os` like the runtime does. Return the exit code, 0 after an implicit
+/// main, or an error for an undefined function or a trap.
+///
+/// With a `compileLoop`, each loop which may be compiled counts its trips,
+/// and once it reaches `hotLoopThreshold` it is handed to `compileLoop`.
+/// From then on the loop runs the compiled code whenever it reaches its
+/// header, then the interpreter goes on after the loop.
+llvm::Expected<int> interpretProgram(Program &prog, llvm::raw_ostream &os,
+                                     LoopCompiler compileLoop = nullptr,
+                                     unsigned hotLoopThreshold = 0);
+
+/// The limits of evaluateProgram.
+struct EvaluationBudget {
+  // Instructions of the bytecode.
+  uint64_t steps;
+  // Bytes of globals and stack.
+  size_t memory;
+};
+
+/// What the file scope statements of a program computed at compile time.
+struct ProgramEvaluation {
+  // The statements before this index of the program ran, and left the
+  // globals with these values.
+  size_t numStmts = 0;
+  llvm::DenseMap<Symbol *, std::vector<uint8_t>> globals;
+  // Set once the whole program ran. The value its implicit main prints is
+  // of type `printedTy`, which is NULL if it prints none.
+  bool finished = false;
+  CType *printedTy = nullptr;
+  std::vector<uint8_t> printedValue;
+};
+
+/// Run the implicit main of `prog`, which takes no input, within `budget`.
+/// A program with `parallel for` isn't run, its reductions may sum in
+/// another order on threads. When a trap or the budget stops the run, the
+/// statements before still count, unless a global holds a pointer, which
+/// the compiled program would not find at the same address.
+ProgramEvaluation evaluateProgram(Program &prog,
+                                  const EvaluationBudget &budget);
+
+#endif // INTERPRETER_H_
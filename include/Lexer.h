@@ -18,21 +18,24 @@ struct Token {
   void dump();
   static llvm::StringRef getSpellingText(TokenType tokenType);
 
-  uint32_t row, col;
-  TokenType tokenType;
-  int32_t value; // save the number literal
+  uint32_t row = 0, col = 0;
+  TokenType tokenType = TokenType::eof;
+  int32_t value = 0; // save the number literal, or the size of a vector type
+  double fvalue = 0; // save the floating literal
   llvm::StringRef content;
   //char *ptr;
   //size_t len;
-  CType *ty;
 };
 
 class Lexer {
 public:
   Lexer(llvm::SourceMgr &mgr, DiagEngine &diagEngine)
+      : Lexer(mgr, diagEngine, mgr.getMainFileID()) {}
+
+  // Lex another buffer of `mgr`, like a line of the REPL.
+  Lexer(llvm::SourceMgr &mgr, DiagEngine &diagEngine, unsigned bufferID)
       : mgr(mgr), diagEngine(diagEngine) {
-    unsigned id = mgr.getMainFileID();
-    llvm::StringRef mainSrc = mgr.getMemoryBuffer(id)->getBuffer();
+    llvm::StringRef mainSrc = mgr.getMemoryBuffer(bufferID)->getBuffer();
     
     LineHeadPtr = mainSrc.begin();
     BufPtr = mainSrc.begin();
@@ -55,6 +58,8 @@ private:
   const char *LineHeadPtr;
   const char *BufEnd;
   uint32_t row;
+  // Inside a `#pragma omp` line, where the newline is a token.
+  bool inDirective = false;
 
 private:
   llvm::SourceMgr &mgr;
@@ -66,6 +71,7 @@ private:
     const char *LineHeadPtr;
     const char *BufEnd;
     uint32_t row;
+    bool inDirective;
   } state;
 };
 
@@ -0,0 +1,64 @@
+#ifndef OBJECT_CACHE_H_
+#define OBJECT_CACHE_H_
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/// A local store of the outputs of tinycc, like ccache. Each output is kept
+/// compressed in a file named after the hash of everything it depends on,
+/// written to a temporary file first and renamed, so concurrent compiles
+/// never see half an entry. The names start with `llvmcache-` for
+/// llvm::pruneCache, which removes the least recently used entries.
+class ObjectCache {
+public:
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t entries = 0;
+    uint64_t bytes = 0;
+  };
+
+  /// Use the cache in `dir`, which is created if needed, and prune it as
+  /// `policy` asks.
+  static llvm::Expected<ObjectCache>
+  open(llvm::StringRef dir, const llvm::CachePruningPolicy &policy = {});
+
+  /// Hash the `parts` a compile depends on into a key. Each part is hashed
+  /// with its length, so they can't run into each other.
+  static std::string computeKey(llvm::ArrayRef<llvm::StringRef> parts);
+
+  /// Return the output stored under `key`, or null on a miss, and count
+  /// either one. A hit becomes the most recently used entry.
+  std::unique_ptr<llvm::MemoryBuffer> lookup(llvm::StringRef key);
+
+  /// Store `output` under `key`.
+  llvm::Error store(llvm::StringRef key, llvm::StringRef output);
+
+  /// Remove the least recently used entries as the policy asks, at most
+  /// once every `Interval` of the policy.
+  void prune();
+
+  /// The hits and misses counted so far, and what the entries take.
+  Stats getStats() const;
+
+  llvm::StringRef getDirectory() const { return dir; }
+
+private:
+  ObjectCache(llvm::StringRef dir, const llvm::CachePruningPolicy &policy)
+      : dir(dir.str()), policy(policy) {}
+
+  std::string getEntryPath(llvm::StringRef key) const;
+  void countLookup(bool hit);
+
+  std::string dir;
+  llvm::CachePruningPolicy policy;
+};
+
+#endif // OBJECT_CACHE_H_
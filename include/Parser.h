@@ -14,31 +14,52 @@ public:
   std::shared_ptr<Program> parseProgram(); 
 
 private:
-  Lexer lexer;
+  Lexer &lexer;
   Token tok;
-  Sema sema;
+  Sema &sema;
 
 private:
   // Record the precursor of break and continue statements.
   std::vector<std::shared_ptr<ASTNode>> breakableStmts;
   std::vector<std::shared_ptr<ASTNode>> continableStmts;
+  // The function whose body is being parsed, NULL at file scope.
+  std::shared_ptr<FunctionDecl> currentFunc;
 
 private:
+  std::shared_ptr<ASTNode> parseExternalDecl();
+  std::shared_ptr<ASTNode> parseFunctionDecl(DeclSpec declSpec);
+  DeclSpec parseDeclSpec();
+  CType *parseTypeSpec();
+  CType *parseStructSpec();
+  void parseAttributes(std::vector<Attr> &attrs);
   std::shared_ptr<ASTNode> parseStmt();
   std::shared_ptr<ASTNode> parseBlockStmt();
   std::shared_ptr<ASTNode> parseDeclStmt();
+  std::shared_ptr<ASTNode> parseDeclStmt(const DeclSpec &declSpec);
+  CType *parsePointer(CType *ty);
+  CType *parseArraySuffix(CType *elemTy);
   std::shared_ptr<ASTNode> parseExprStmt();
   std::shared_ptr<ASTNode> parseIfStmt();
   std::shared_ptr<ASTNode> parseForStmt();
+  std::shared_ptr<ASTNode> parseOmpParallelFor();
   std::shared_ptr<ASTNode> parseBreakStmt();
   std::shared_ptr<ASTNode> parseContinueStmt();
+  std::shared_ptr<ASTNode> parseReturnStmt();
   std::shared_ptr<ASTNode> parseExpr();
+  std::shared_ptr<ASTNode> parseConditionalExpr();
+  std::shared_ptr<ASTNode> parseBitOrExpr();
+  std::shared_ptr<ASTNode> parseBitXorExpr();
+  std::shared_ptr<ASTNode> parseBitAndExpr();
   std::shared_ptr<ASTNode> parseEqualExpr();
   std::shared_ptr<ASTNode> parseRelationExpr();
-  std::shared_ptr<ASTNode> parseAssignExpr();
+  std::shared_ptr<ASTNode> parseShiftExpr();
+  std::shared_ptr<ASTNode> parseAssignExpr(std::shared_ptr<ASTNode> lhs);
   std::shared_ptr<ASTNode> parseAddsubExpr();
   std::shared_ptr<ASTNode> parseMuldivExpr();
+  std::shared_ptr<ASTNode> parseUnaryExpr();
+  std::shared_ptr<ASTNode> parsePostfixExpr();
   std::shared_ptr<ASTNode> parsePrimaryExpr();
+  std::shared_ptr<ASTNode> parseCallExpr(const Token &calleeTok);
 
   bool expect(TokenType tokenType);
   bool consume(TokenType tokenType);
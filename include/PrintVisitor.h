@@ -13,11 +13,21 @@ struct PrintVisitor : Visitor {
   llvm::Value *visitForStmt(ForStmt *) override;
   llvm::Value *visitBreakStmt(BreakStmt *) override;
   llvm::Value *visitContinueStmt(ContinueStmt *) override;
+  llvm::Value *visitReturnStmt(ReturnStmt *) override;
+  llvm::Value *visitFunctionDecl(FunctionDecl *) override;
   llvm::Value *visitVariableDecl(VariableDecl *) override;
   llvm::Value *visitAssignExpr(AssignExpr *) override;
   llvm::Value *visitBinaryExpr(BinaryExpr *) override;
+  llvm::Value *visitUnaryExpr(UnaryExpr *) override;
+  llvm::Value *visitConditionalExpr(ConditionalExpr *) override;
   llvm::Value *visitNumberExpr(NumberExpr *) override;
+  llvm::Value *visitFloatExpr(FloatExpr *) override;
   llvm::Value *visitVariableExpr(VariableExpr *) override;
+  llvm::Value *visitSubscriptExpr(SubscriptExpr *) override;
+  llvm::Value *visitMemberExpr(MemberExpr *) override;
+  llvm::Value *visitImplicitCastExpr(ImplicitCastExpr *) override;
+  llvm::Value *visitCallExpr(CallExpr *) override;
+  llvm::Value *visitBuiltinCallExpr(BuiltinCallExpr *) override;
 };
 
 #endif // PRINTVISITOR_H_
\ No newline at end of file
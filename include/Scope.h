@@ -11,6 +11,8 @@
 
 enum class SymbolKind {
   LocalVariable,  
+  GlobalVariable,
+  Function,
 };
 
 class Symbol {
@@ -19,8 +21,20 @@ public:
       : kind(kind), ty(ty), name(name) {}
 
   CType *getTy() const { return ty; }
+  SymbolKind getKind() const { return kind; }
+  llvm::StringRef getName() const { return name; }
+
+  // Set by `&`, after which pointers may change the variable.
+  bool isAddressTaken() const { return addressTaken; }
+  void setAddressTaken() { addressTaken = true; }
+
+  // An array of structs with the `soa` attribute, stored field by field.
+  bool isSoA() const { return soa; }
+  void setSoA() { soa = true; }
 
 private:
+  bool addressTaken = false;
+  bool soa = false;
   SymbolKind kind;
   CType *ty;
   llvm::StringRef name;  
@@ -38,10 +52,16 @@ public:
   void exitScope();
   std::shared_ptr<Symbol> findVarSymbol(llvm::StringRef name);
   std::shared_ptr<Symbol> findVarSymbolInCurEnv(llvm::StringRef name);
-  void addSymbol(SymbolKind kind, CType *ty, llvm::StringRef name);
+  std::shared_ptr<Symbol> 
+  addSymbol(SymbolKind kind, CType *ty, llvm::StringRef name);
+  bool isGlobalScope() const { return envs.size() == 1; }
+  // A copy of the symbols, which a later restoreState() brings back.
+  void saveState();
+  void restoreState();
 
 private:
   std::vector<std::shared_ptr<Env>> envs;
+  std::vector<Env> savedEnvs;
 
 };
 
@@ -5,26 +5,70 @@
 #include "AST.h"
 #include "DiagEngine.h"
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 
 #include <memory>
+#include <string>
 #include <vector>
 
 class Sema {
 public:
   Sema(DiagEngine &diagEngine) : diagEngine(diagEngine) {}
 
+  /// The options that change what Sema warns about, such as -Wpadding.
+  static std::string getWarningOptions();
+
+  // The function whose body is being parsed, or NULL at file scope.
+  void setCurrentFunction(FunctionDecl *funcDecl) { currentFunc = funcDecl; }
+
+  // The declarations so far, which -repl brings back when a chunk has
+  // errors.
+  void saveState();
+  void restoreState();
+
   std::shared_ptr<ASTNode>
-  semaIfStmtNode(std::shared_ptr<ASTNode> codeExpr,
+  semaIfStmtNode(const Token &tok, std::shared_ptr<ASTNode> codeExpr,
                  std::shared_ptr<ASTNode> thenBody,
                  std::shared_ptr<ASTNode> elseBody);
 
   std::shared_ptr<ASTNode> 
-  semaVariableDeclNode(const Token &tok, CType *ty);
+  semaVariableDeclNode(const Token &tok, CType *ty, bool isStatic = false,
+                       llvm::ArrayRef<Attr> attrs = {});
+
+  // `struct name`, which declares the struct unless it is visible already.
+  CStructType *semaStructDecl(const Token &nameTok, bool isDefinition);
+
+  void semaStructBody(CStructType *structTy, const Token &tok,
+                      llvm::ArrayRef<Token> fieldToks,
+                      llvm::ArrayRef<CType *> fieldTys,
+                      llvm::ArrayRef<Attr> attrs);
+
+  std::shared_ptr<FunctionDecl>
+  semaFunctionDeclNode(const Token &tok, const DeclSpec &declSpec,
+                       llvm::ArrayRef<CType *> paramTys, bool isDefinition);
+
+  std::shared_ptr<ASTNode>
+  semaReturnStmtNode(const Token &tok, std::shared_ptr<ASTNode> expr,
+                     FunctionDecl *funcDecl);
+
+  std::shared_ptr<ASTNode> semaCallExprNode(
+      const Token &tok, std::vector<std::shared_ptr<ASTNode>> args);
+
+  std::shared_ptr<ASTNode> semaBuiltinCallExprNode(
+      const Token &tok, std::vector<std::shared_ptr<ASTNode>> args);
 
   std::shared_ptr<ASTNode> 
   semaVariableExprNode(const Token &tok);
 
+  std::shared_ptr<ASTNode> semaSubscriptExprNode(
+      std::shared_ptr<ASTNode> base, std::shared_ptr<ASTNode> index);
+
+  std::shared_ptr<ASTNode> semaMemberExprNode(
+      std::shared_ptr<ASTNode> base, const Token &memberTok, bool isArrow);
+
   std::shared_ptr<ASTNode> semaAssignExprNode(
       std::shared_ptr<ASTNode> lhs, std::shared_ptr<ASTNode> rhs);
 
@@ -33,15 +77,71 @@ public:
       std::shared_ptr<ASTNode> lhs, 
       std::shared_ptr<ASTNode> rhs);
 
-  std::shared_ptr<ASTNode> semaNumberExprNode(const Token &tok, CType *ty);
+  std::shared_ptr<ASTNode> semaUnaryExprNode(
+      const Token &tok, OpCode op, std::shared_ptr<ASTNode> operand);
+
+  // Arrays used as values become a pointer to their first element.
+  std::shared_ptr<ASTNode> semaDecayNode(std::shared_ptr<ASTNode> expr);
+
+  std::shared_ptr<ASTNode> semaConditionalExprNode(
+      std::shared_ptr<ASTNode> condExpr,
+      std::shared_ptr<ASTNode> thenExpr,
+      std::shared_ptr<ASTNode> elseExpr);
+
+  std::shared_ptr<ASTNode> semaNumberExprNode(const Token &tok);
+
+  std::shared_ptr<ASTNode> semaFloatExprNode(const Token &tok);
+
+  // Attach the clauses of `#pragma omp parallel for` to `loop`.
+  std::shared_ptr<ASTNode> semaOmpParallelForNode(
+      const Token &tok, std::shared_ptr<ASTNode> loop,
+      llvm::ArrayRef<Token> reductionToks, std::shared_ptr<OmpParallelFor> omp);
+
+  // Conditions of `if`, `for` and `?:` must be scalars.
+  void checkCondition(ASTNode *condExpr);
 
 public:
-  void enterScope() { scope.enterScope(); }
-  void exitScope() { scope.enterScope(); }
+  void enterScope() {
+    scope.enterScope();
+    tagScopes.emplace_back();
+  }
+  void exitScope() {
+    scope.exitScope();
+    tagScopes.pop_back();
+  }
+  TypeContext &getTypeContext() { return typeCtx; }
 
 private:
+  std::shared_ptr<ASTNode> createImplicitCast(
+      CastKind castKind, CType *ty, std::shared_ptr<ASTNode> operand);
+  std::shared_ptr<ASTNode> convertForAssignment(
+      CType *ty, std::shared_ptr<ASTNode> expr);
+  std::shared_ptr<ASTNode> convertArithmetic(
+      CType *ty, std::shared_ptr<ASTNode> expr);
+  CType *usualArithmeticConversions(std::shared_ptr<ASTNode> &lhs,
+                                    std::shared_ptr<ASTNode> &rhs);
+  CType *getBinaryExprTy(OpCode op, ASTNode *lhs, ASTNode *rhs);
+  CType *getVectorBinaryExprTy(OpCode op, std::shared_ptr<ASTNode> &lhs,
+                               std::shared_ptr<ASTNode> &rhs);
+  void reportPadding(CStructType *structTy, const Token &tok,
+                     llvm::ArrayRef<Token> fieldToks);
+  void semaTargetClones(const Attr &attr, FunctionDecl *funcDecl);
+  void noteFrameAddress(ASTNode *expr);
+
+private:
+  TypeContext typeCtx;
   Scope scope;
+  // Struct tags live in a namespace of their own, scoped like variables.
+  std::vector<llvm::StringMap<CStructType *>> tagScopes{1};
+  // The latest declaration of each function.
+  llvm::DenseMap<Symbol *, std::shared_ptr<FunctionDecl>> functionDecls;
+  FunctionDecl *currentFunc = nullptr;
   DiagEngine &diagEngine;
+
+  struct State {
+    std::vector<llvm::StringMap<CStructType *>> tagScopes;
+    llvm::DenseMap<Symbol *, std::shared_ptr<FunctionDecl>> functionDecls;
+  } state;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef THIN_LTO_H_
+#define THIN_LTO_H_
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include <vector>
+
+/// Link the bitcode `inputs` written by -flto=thin as one program, entered
+/// only through `main`: import into each module the functions it calls from
+/// the others, then optimize it at `optLevel` and generate its code for the
+/// target of `tm`, each module on its own thread of a pool of `jobs` (0 for
+/// one per core). Return one object per module with a summary, in order,
+/// preceded by one for all the inputs without a summary, if any.
+llvm::Expected<std::vector<llvm::SmallString<0>>>
+thinLink(llvm::ArrayRef<llvm::MemoryBufferRef> inputs,
+         const llvm::TargetMachine &tm, unsigned optLevel, unsigned jobs);
+
+#endif // THIN_LTO_H_
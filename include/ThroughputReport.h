@@ -0,0 +1,16 @@
+#ifndef THROUGHPUT_REPORT_H_
+#define THROUGHPUT_REPORT_H_
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+
+/// Print a static estimate of the throughput of every innermost loop of `m`:
+/// the cycles per iteration, the resource pressure and the bottleneck that
+/// llvm-mca simulates on the scheduling model of the CPU of `tm`. Loops are
+/// keyed by the source line of their `for`.
+llvm::Error reportLoopThroughput(const llvm::Module &m, llvm::TargetMachine &tm,
+                                 llvm::raw_ostream &os);
+
+#endif // THROUGHPUT_REPORT_H_
\ No newline at end of file
@@ -1,22 +1,244 @@
 #ifndef TYPE_H_
 #define TYPE_H_
 
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/FoldingSet.h"
+#include "llvm/ADT/StringRef.h"
+
 #include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 
 enum class TypeKind {
   Int,
+  Float,
+  Double,
+  Pointer,
+  Array,
+  Vector,
+  Struct,
+  Func,
 };
 
 class CType {
 public:
   CType(TypeKind tk, size_t size, size_t align)
       : kind(tk), size(size), align(align) {}
-  // Singleton pattern
-  static CType *getIntTy();
+  virtual ~CType() {}
+
+  TypeKind getKind() const { return kind; }
+  size_t getSize() const { return size; }
+  size_t getAlign() const { return align; }
+
+  bool isInteger() const { return kind == TypeKind::Int; }
+  bool isFloating() const {
+    return kind == TypeKind::Float || kind == TypeKind::Double;
+  }
+  bool isArithmetic() const { return isInteger() || isFloating(); }
+  // The element type of a vector, otherwise the type itself.
+  CType *getScalarTy();
+
+  // The spelling used in diagnostics, like `int *restrict`.
+  std::string getName() const;
+
+protected:
+  void setLayout(size_t newSize, size_t newAlign) {
+    size = newSize;
+    align = newAlign;
+  }
+
 private:
+  TypeKind kind;
   size_t size;
   size_t align;
-  TypeKind kind;
+};
+
+class CPointerType : public CType, public llvm::FoldingSetNode {
+public:
+  CPointerType(CType *pointeeTy, bool isRestrict)
+      : CType(TypeKind::Pointer, 8, 8), pointeeTy(pointeeTy),
+        restrict(isRestrict) {}
+
+  CType *getPointeeTy() const { return pointeeTy; }
+  bool isRestrict() const { return restrict; }
+
+  void Profile(llvm::FoldingSetNodeID &id) const {
+    Profile(id, pointeeTy, restrict);
+  }
+  static void Profile(llvm::FoldingSetNodeID &id, CType *pointeeTy,
+                      bool isRestrict) {
+    id.AddPointer(pointeeTy);
+    id.AddBoolean(isRestrict);
+  }
+
+  static bool classof(const CType *ty) {
+    return ty->getKind() == TypeKind::Pointer;
+  }
+
+private:
+  CType *pointeeTy;
+  bool restrict;
+};
+
+class CArrayType : public CType, public llvm::FoldingSetNode {
+public:
+  CArrayType(CType *elemTy, size_t numElems)
+      : CType(TypeKind::Array, elemTy->getSize() * numElems,
+              elemTy->getAlign()),
+        elemTy(elemTy), numElems(numElems) {}
+
+  CType *getElemTy() const { return elemTy; }
+  size_t getNumElems() const { return numElems; }
+
+  void Profile(llvm::FoldingSetNodeID &id) const {
+    Profile(id, elemTy, numElems);
+  }
+  static void Profile(llvm::FoldingSetNodeID &id, CType *elemTy,
+                      size_t numElems) {
+    id.AddPointer(elemTy);
+    id.AddInteger(numElems);
+  }
+
+  static bool classof(const CType *ty) {
+    return ty->getKind() == TypeKind::Array;
+  }
+
+private:
+  CType *elemTy;
+  size_t numElems;
+};
+
+/// `int4`, `float8`... a SIMD vector, aligned to its size like GCC's
+/// `vector_size` types.
+class CVectorType : public CType, public llvm::FoldingSetNode {
+public:
+  CVectorType(CType *elemTy, size_t numElems)
+      : CType(TypeKind::Vector, elemTy->getSize() * numElems,
+              elemTy->getSize() * numElems),
+        elemTy(elemTy), numElems(numElems) {}
+
+  CType *getElemTy() const { return elemTy; }
+  size_t getNumElems() const { return numElems; }
+
+  void Profile(llvm::FoldingSetNodeID &id) const {
+    Profile(id, elemTy, numElems);
+  }
+  static void Profile(llvm::FoldingSetNodeID &id, CType *elemTy,
+                      size_t numElems) {
+    id.AddPointer(elemTy);
+    id.AddInteger(numElems);
+  }
+
+  // Vectors have 2, 4, 8 or 16 elements.
+  static bool isValidNumElems(int64_t numElems) {
+    return numElems == 2 || numElems == 4 || numElems == 8 || numElems == 16;
+  }
+
+  static bool classof(const CType *ty) {
+    return ty->getKind() == TypeKind::Vector;
+  }
+
+private:
+  CType *elemTy;
+  size_t numElems;
+};
+
+/// A field of a struct, at the byte offset computed by the layout.
+struct CField {
+  llvm::StringRef name;
+  CType *ty;
+  size_t offset = 0;
+};
+
+/// `struct name { ... }`. Each definition is a distinct type, incomplete
+/// until its body is seen, so structs can point to themselves.
+class CStructType : public CType {
+public:
+  CStructType(llvm::StringRef name) : CType(TypeKind::Struct, 0, 1), name(name) {}
+
+  // Empty for an anonymous struct.
+  llvm::StringRef getStructName() const { return name; }
+  bool isComplete() const { return complete; }
+  bool isPacked() const { return packed; }
+  llvm::ArrayRef<CField> getFields() const { return fields; }
+  // Return -1 if there's no such field.
+  int getFieldIndex(llvm::StringRef fieldName) const;
+
+  /// Lay the fields out in order, each at the next multiple of its alignment
+  /// unless the struct is packed. `minAlign` raises the alignment of the
+  /// struct like `aligned(N)`, and the size is rounded up to the alignment.
+  void setBody(std::vector<CField> newFields, bool isPacked, size_t minAlign);
+
+  static bool classof(const CType *ty) {
+    return ty->getKind() == TypeKind::Struct;
+  }
+
+private:
+  llvm::StringRef name;
+  std::vector<CField> fields;
+  bool complete = false;
+  bool packed = false;
+};
+
+class CFuncType : public CType, public llvm::FoldingSetNode {
+public:
+  CFuncType(CType *retTy, llvm::ArrayRef<CType *> paramTys)
+      : CType(TypeKind::Func, 1, 1), retTy(retTy),
+        paramTys(paramTys.begin(), paramTys.end()) {}
+
+  CType *getRetTy() const { return retTy; }
+  llvm::ArrayRef<CType *> getParamTys() const { return paramTys; }
+
+  void Profile(llvm::FoldingSetNodeID &id) const {
+    Profile(id, retTy, paramTys);
+  }
+  static void Profile(llvm::FoldingSetNodeID &id, CType *retTy,
+                      llvm::ArrayRef<CType *> paramTys) {
+    id.AddPointer(retTy);
+    id.AddInteger(paramTys.size());
+    for (CType *paramTy: paramTys) {
+      id.AddPointer(paramTy);
+    }
+  }
+
+  static bool classof(const CType *ty) {
+    return ty->getKind() == TypeKind::Func;
+  }
+
+private:
+  CType *retTy;
+  std::vector<CType *> paramTys;
+};
+
+/// Owns the types of a program and uniques them, so types can be compared
+/// by pointer.
+class TypeContext {
+public:
+  CType *getIntTy() { return &intTy; }
+  CType *getFloatTy() { return &floatTy; }
+  CType *getDoubleTy() { return &doubleTy; }
+  CPointerType *getPointerTy(CType *pointeeTy, bool isRestrict = false);
+  CArrayType *getArrayTy(CType *elemTy, size_t numElems);
+  CVectorType *getVectorTy(CType *elemTy, size_t numElems);
+  CFuncType *getFuncTy(CType *retTy, llvm::ArrayRef<CType *> paramTys);
+  CStructType *createStructTy(llvm::StringRef name);
+
+  /// Drop `restrict` from a pointer type. It only matters to the pointer
+  /// object, not to the values it holds.
+  CType *getUnqualifiedTy(CType *ty);
+
+private:
+  CType intTy{TypeKind::Int, 4, 4};
+  CType floatTy{TypeKind::Float, 4, 4};
+  CType doubleTy{TypeKind::Double, 8, 8};
+
+  llvm::FoldingSet<CPointerType> pointerTys;
+  llvm::FoldingSet<CArrayType> arrayTys;
+  llvm::FoldingSet<CVectorType> vectorTys;
+  llvm::FoldingSet<CFuncType> funcTys;
+  std::vector<std::unique_ptr<CType>> ownedTys;
 };
 
 #endif // TYPE_H_
\ No newline at end of file
@@ -0,0 +1,112 @@
+#ifndef VALUE_RANGE_H_
+#define VALUE_RANGE_H_
+
+#include "AST.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+/// What a `for` body does that matters for bounds check elimination.
+struct LoopBodyInfo {
+  llvm::SmallPtrSet<Symbol *, 8> assignedSymbols;
+  // Subscripts, and whether each one runs on every iteration.
+  std::vector<std::pair<SubscriptExpr *, bool>> subscripts;
+  // `break`, `continue` or `return` may skip the rest of the loop.
+  bool hasEarlyExit = false;
+};
+
+void scanLoopBody(ASTNode *node, ForStmt *loop, bool isConditional,
+                  LoopBodyInfo &info);
+
+/// Match `symbol + c`, `symbol - c` and `symbol`, and return c in `offset`.
+bool getOffsetFrom(ASTNode *expr, Symbol *symbol, int64_t &offset);
+
+/// The values taken by the induction variable of a canonical loop
+/// `for (i = L; i < U; i = i + step)` inside its body.
+struct InductionRange {
+  Symbol *iv = nullptr;
+  int64_t lower = 0;
+  // A literal, or a local variable the body doesn't write.
+  ASTNode *upper = nullptr;
+  // `i <= U` rather than `i < U`.
+  bool isInclusive = false;
+};
+
+bool getInductionRange(ForStmt *forStmt, const LoopBodyInfo &info,
+                       InductionRange &range);
+
+/// The values an `int` expression may take: an interval, and a power of two
+/// every value is a multiple of. `lo > hi` is the empty range, of code that
+/// never runs or a variable that is never assigned.
+struct ValueRange {
+  int64_t lo = INT32_MIN;
+  int64_t hi = INT32_MAX;
+  unsigned trailingZeros = 0;
+
+  static ValueRange getFull() { return ValueRange(); }
+  static ValueRange getEmpty() { return {1, 0, 32}; }
+  static ValueRange getConstant(int64_t value);
+
+  bool isFull() const {
+    return lo <= INT32_MIN && hi >= INT32_MAX && trailingZeros == 0;
+  }
+  bool isEmpty() const { return lo > hi; }
+  bool isNonNegative() const { return lo >= 0; }
+  bool isNegative() const { return hi < 0; }
+
+  ValueRange unionWith(const ValueRange &other) const;
+  ValueRange intersectWith(const ValueRange &other) const;
+
+  bool operator==(const ValueRange &other) const {
+    return lo == other.lo && hi == other.hi &&
+           trailingZeros == other.trailingZeros;
+  }
+  bool operator!=(const ValueRange &other) const { return !(*this == other); }
+};
+
+/// A flow-insensitive interval analysis of the `int` variables whose address
+/// is never taken, refined by the induction variables of canonical loops
+/// inside their bodies. Every expression gets the range of the values it
+/// may evaluate to, which codegen turns into IR flags and metadata.
+class ValueRangeAnalysis {
+public:
+  /// Globals are only tracked in a whole program, whose code can't be
+  /// called by code compiled later, unlike a chunk of the REPL.
+  void analyze(Program *prog, bool wholeProgram);
+
+  /// The full range for unknown expressions and for code that never runs.
+  ValueRange getRange(ASTNode *expr) const;
+
+private:
+  void analyzeStmt(ASTNode *node);
+  ValueRange analyzeExpr(ASTNode *node);
+  ValueRange analyzeBinaryExpr(BinaryExpr *binaryExpr);
+  void declareVariable(VariableDecl *variableDecl);
+  void assignVariable(Symbol *symbol, const ValueRange &range);
+  ValueRange getVariableRange(Symbol *symbol) const;
+  Symbol *getInductionValues(ForStmt *forStmt, ValueRange &values);
+  void untrack(Symbol *symbol);
+
+  // Globals may be changed by other translation units, unless the program
+  // has an implicit main and only calls functions it defines.
+  bool isWholeProgram = false;
+  llvm::DenseSet<Symbol *> definedFunctions;
+  // Set by a round of the analysis that changed a variable.
+  bool changed = false;
+  llvm::DenseMap<Symbol *, ValueRange> varRanges;
+  // How often each variable grew, before its bounds are widened.
+  llvm::DenseMap<Symbol *, unsigned> growCounts;
+  llvm::DenseSet<Symbol *> untracked;
+  // The range of each induction variable in the loop being analyzed.
+  llvm::DenseMap<Symbol *, ValueRange> inductionRanges;
+  llvm::DenseMap<ForStmt *, std::optional<InductionRange>> loopInductions;
+  llvm::DenseMap<ASTNode *, ValueRange> exprRanges;
+};
+
+#endif // VALUE_RANGE_H_
\ No newline at end of file
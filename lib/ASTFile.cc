@@ -0,0 +1,1057 @@
+#include "ASTFile.h"
+#include "Basic.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/bit.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <cstring>
+
+namespace {
+
+using llvm::support::ulittle32_t;
+using llvm::support::ulittle64_t;
+
+// Bump whenever a record or the meaning of a field changes, or the layout
+// of a node, type or symbol it is read into. The build hash below catches
+// most of these, but not a change made outside the hashed sources.
+const uint32_t formatVersion = 3;
+const char fileMagic[8] = {'t', 'i', 'n', 'y', 'c', 'c', 'a', 's'};
+// The index of a missing node, type or symbol.
+const uint32_t noId = ~0u;
+
+// The records are made of unaligned little endian integers, so they are
+// read in place from the mapped file.
+
+/// A slice of the string table.
+struct StringRecord {
+  ulittle32_t offset;
+  ulittle32_t size;
+};
+
+/// A slice of the table of ids, for the lists of a node.
+struct ListRecord {
+  ulittle32_t first;
+  ulittle32_t size;
+};
+
+struct Table {
+  ulittle32_t offset;
+  ulittle32_t count;
+};
+
+struct FileHeader {
+  char magic[8];
+  ulittle32_t version;
+  ulittle32_t hasImplicitMain;
+  ulittle64_t compilerHash;
+  ulittle64_t sourceHash;
+  Table strings, types, fields, symbols, nodes, ids, omps, attrs, tokens,
+      diags;
+  // The statements of the program.
+  ListRecord stmts;
+};
+
+struct TokenRecord {
+  ulittle32_t row;
+  ulittle32_t col;
+  ulittle32_t tokenType;
+  ulittle32_t value;
+  ulittle64_t fvalue;
+  StringRecord content;
+};
+
+/// Pointers, arrays and vectors use `elem` and `numElems`, functions
+/// `elem` for the return type and `list` for the parameter types in the
+/// ids, structs `list` for their fields.
+struct TypeRecord {
+  ulittle32_t kind;
+  ulittle32_t elem;
+  ulittle64_t numElems;
+  ListRecord list;
+  StringRecord name;
+  ulittle32_t align;
+  // Restrict pointers, complete and packed structs.
+  ulittle32_t flags;
+};
+
+struct FieldRecord {
+  StringRecord name;
+  ulittle32_t ty;
+};
+
+struct SymbolRecord {
+  ulittle32_t kind;
+  ulittle32_t ty;
+  StringRecord name;
+  ulittle32_t flags;
+};
+
+/// Each kind of node uses the fields below as listed by writeNode, ids of
+/// nodes in `ops`, of a symbol in `symbol`.
+struct NodeRecord {
+  ulittle32_t kind;
+  ulittle32_t ty;
+  TokenRecord tok;
+  ulittle32_t ops[4];
+  ulittle32_t symbol;
+  ulittle32_t flags;
+  // An OpCode, CastKind, BuiltinKind, field index, or the bits of a
+  // literal.
+  ulittle64_t value;
+  StringRecord name;
+  ListRecord list;
+  // The clauses of `parallel for`, the attributes of a function.
+  ListRecord extra;
+};
+
+struct OmpRecord {
+  ulittle32_t iv;
+  ulittle32_t upper;
+  ulittle32_t step;
+  ulittle32_t flags;
+  ulittle32_t schedule;
+  ulittle32_t chunk;
+  ulittle32_t numThreads;
+  ListRecord reductions;
+};
+
+struct AttrRecord {
+  TokenRecord tok;
+  StringRecord name;
+  // Tokens of the arguments.
+  ListRecord args;
+};
+
+struct DiagRecord {
+  ulittle32_t offset;
+  ulittle32_t kind;
+  StringRecord message;
+};
+
+// Flags of types, symbols and nodes.
+const uint32_t flagRestrict = 1;
+const uint32_t flagComplete = 2;
+const uint32_t flagPacked = 4;
+const uint32_t flagAddressTaken = 1;
+const uint32_t flagSoA = 2;
+const uint32_t flagStatic = 1;
+const uint32_t flagInline = 2;
+const uint32_t flagArrow = 4;
+const uint32_t flagInclusive = 8;
+const uint32_t flagFrameAddressTaken = 16;
+
+/// The version alone stays the same across rebuilds, so the hash of the
+/// sources of the serializer and the nodes, see lib/CMakeLists.txt, makes
+/// another build reject the file.
+uint64_t getCompilerHash() {
+  return llvm::xxHash64(getTinyccVeriosn() + TINYCC_AST_HASH);
+}
+
+class ASTWriter {
+public:
+  void writeProgram(const Program &prog, uint64_t sourceHash) {
+    llvm::SmallVector<uint32_t, 16> stmts;
+    for (const auto &stmt: prog.stmtVec) {
+      stmts.push_back(getNodeId(stmt.get()));
+    }
+    header.stmts = addList(stmts);
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.version = formatVersion;
+    header.hasImplicitMain = prog.hasImplicitMain;
+    header.compilerHash = getCompilerHash();
+    header.sourceHash = sourceHash;
+  }
+
+  void writeDiagnostics(llvm::ArrayRef<SavedDiagnostic> diagnostics) {
+    for (const SavedDiagnostic &diag: diagnostics) {
+      DiagRecord record;
+      record.offset = diag.offset;
+      record.kind = static_cast<uint32_t>(diag.kind);
+      record.message = addString(diag.message);
+      diags.push_back(record);
+    }
+  }
+
+  void emit(llvm::raw_ostream &os) {
+    uint32_t offset = sizeof(FileHeader);
+    auto place = [&offset](Table &table, size_t count, size_t recordSize) {
+      offset = llvm::alignTo(offset, 8);
+      table.offset = offset;
+      table.count = count;
+      offset += count * recordSize;
+    };
+    place(header.strings, strings.size(), 1);
+    place(header.types, types.size(), sizeof(TypeRecord));
+    place(header.fields, fields.size(), sizeof(FieldRecord));
+    place(header.symbols, symbols.size(), sizeof(SymbolRecord));
+    place(header.nodes, nodes.size(), sizeof(NodeRecord));
+    place(header.ids, ids.size(), sizeof(ulittle32_t));
+    place(header.omps, omps.size(), sizeof(OmpRecord));
+    place(header.attrs, attrs.size(), sizeof(AttrRecord));
+    place(header.tokens, tokens.size(), sizeof(TokenRecord));
+    place(header.diags, diags.size(), sizeof(DiagRecord));
+
+    uint64_t pos = 0;
+    auto write = [&](const Table &table, const void *data, size_t size) {
+      os.write_zeros(table.offset - pos);
+      os.write(static_cast<const char *>(data), size);
+      pos = table.offset + size;
+    };
+    os.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    pos = sizeof(header);
+    write(header.strings, strings.data(), strings.size());
+    write(header.types, types.data(), types.size() * sizeof(TypeRecord));
+    write(header.fields, fields.data(), fields.size() * sizeof(FieldRecord));
+    write(header.symbols, symbols.data(),
+          symbols.size() * sizeof(SymbolRecord));
+    write(header.nodes, nodes.data(), nodes.size() * sizeof(NodeRecord));
+    write(header.ids, ids.data(), ids.size() * sizeof(ulittle32_t));
+    write(header.omps, omps.data(), omps.size() * sizeof(OmpRecord));
+    write(header.attrs, attrs.data(), attrs.size() * sizeof(AttrRecord));
+    write(header.tokens, tokens.data(), tokens.size() * sizeof(TokenRecord));
+    write(header.diags, diags.data(), diags.size() * sizeof(DiagRecord));
+  }
+
+private:
+  StringRecord addString(llvm::StringRef str) {
+    auto [it, inserted] = stringOffsets.try_emplace(str, strings.size());
+    if (inserted) {
+      strings.append(str.begin(), str.end());
+    }
+    StringRecord record;
+    record.offset = it->second;
+    record.size = str.size();
+    return record;
+  }
+
+  ListRecord addList(llvm::ArrayRef<uint32_t> list) {
+    ListRecord record;
+    record.first = ids.size();
+    record.size = list.size();
+    ids.insert(ids.end(), list.begin(), list.end());
+    return record;
+  }
+
+  TokenRecord getTokenRecord(const Token &tok) {
+    TokenRecord record;
+    record.row = tok.row;
+    record.col = tok.col;
+    record.tokenType = static_cast<uint32_t>(tok.tokenType);
+    record.value = static_cast<uint32_t>(tok.value);
+    record.fvalue = llvm::bit_cast<uint64_t>(tok.fvalue);
+    record.content = addString(tok.content);
+    return record;
+  }
+
+  uint32_t getTypeId(CType *ty) {
+    if (!ty) {
+      return noId;
+    }
+    auto it = typeIds.find(ty);
+    if (it != typeIds.end()) {
+      return it->second;
+    }
+    // The id is taken before the operands, a struct may point to itself.
+    uint32_t id = types.size();
+    typeIds[ty] = id;
+    types.emplace_back();
+
+    TypeRecord record = {};
+    record.kind = static_cast<uint32_t>(ty->getKind());
+    record.elem = noId;
+    record.align = ty->getAlign();
+    if (auto *pointerTy = llvm::dyn_cast<CPointerType>(ty)) {
+      record.elem = getTypeId(pointerTy->getPointeeTy());
+      record.flags = pointerTy->isRestrict() ? flagRestrict : 0;
+    }
+    else if (auto *arrayTy = llvm::dyn_cast<CArrayType>(ty)) {
+      record.elem = getTypeId(arrayTy->getElemTy());
+      record.numElems = arrayTy->getNumElems();
+    }
+    else if (auto *vectorTy = llvm::dyn_cast<CVectorType>(ty)) {
+      record.elem = getTypeId(vectorTy->getElemTy());
+      record.numElems = vectorTy->getNumElems();
+    }
+    else if (auto *funcTy = llvm::dyn_cast<CFuncType>(ty)) {
+      record.elem = getTypeId(funcTy->getRetTy());
+      llvm::SmallVector<uint32_t, 8> paramTys;
+      for (CType *paramTy: funcTy->getParamTys()) {
+        paramTys.push_back(getTypeId(paramTy));
+      }
+      record.list = addList(paramTys);
+    }
+    else if (auto *structTy = llvm::dyn_cast<CStructType>(ty)) {
+      record.name = addString(structTy->getStructName());
+      record.flags = (structTy->isComplete() ? flagComplete : 0) |
+                     (structTy->isPacked() ? flagPacked : 0);
+      llvm::SmallVector<FieldRecord, 8> structFields;
+      for (const CField &field: structTy->getFields()) {
+        FieldRecord fieldRecord;
+        fieldRecord.name = addString(field.name);
+        fieldRecord.ty = getTypeId(field.ty);
+        structFields.push_back(fieldRecord);
+      }
+      record.list.first = fields.size();
+      record.list.size = structFields.size();
+      fields.insert(fields.end(), structFields.begin(), structFields.end());
+    }
+    types[id] = record;
+    return id;
+  }
+
+  uint32_t getSymbolId(Symbol *symbol) {
+    if (!symbol) {
+      return noId;
+    }
+    auto it = symbolIds.find(symbol);
+    if (it != symbolIds.end()) {
+      return it->second;
+    }
+    SymbolRecord record;
+    record.kind = static_cast<uint32_t>(symbol->getKind());
+    record.ty = getTypeId(symbol->getTy());
+    record.name = addString(symbol->getName());
+    record.flags = (symbol->isAddressTaken() ? flagAddressTaken : 0) |
+                   (symbol->isSoA() ? flagSoA : 0);
+    uint32_t id = symbols.size();
+    symbolIds[symbol] = id;
+    symbols.push_back(record);
+    return id;
+  }
+
+  uint32_t getNodeId(ASTNode *node) {
+    if (!node) {
+      return noId;
+    }
+    auto it = nodeIds.find(node);
+    if (it != nodeIds.end()) {
+      return it->second;
+    }
+    // Loops are numbered before the `break` inside them refers to them.
+    uint32_t id = nodes.size();
+    nodeIds[node] = id;
+    nodes.emplace_back();
+    NodeRecord record = writeNode(node);
+    nodes[id] = record;
+    return id;
+  }
+
+  ListRecord addNodeList(llvm::ArrayRef<std::shared_ptr<ASTNode>> list) {
+    llvm::SmallVector<uint32_t, 8> nodeList;
+    for (const auto &node: list) {
+      nodeList.push_back(getNodeId(node.get()));
+    }
+    return addList(nodeList);
+  }
+
+  NodeRecord writeNode(ASTNode *node) {
+    NodeRecord record = {};
+    record.kind = static_cast<uint32_t>(node->getNodeKind());
+    record.ty = getTypeId(node->ty);
+    record.tok = getTokenRecord(node->tok);
+    for (ulittle32_t &op: record.ops) {
+      op = noId;
+    }
+    record.symbol = noId;
+
+    switch (node->getNodeKind()) {
+    case ASTNode::BlockStmt:
+      record.list = addNodeList(llvm::cast<BlockStmt>(node)->stmtVec);
+      break;
+    case ASTNode::DeclStmt:
+      record.list = addNodeList(llvm::cast<DeclStmt>(node)->exprVec);
+      break;
+    case ASTNode::IfStmt: {
+      auto *ifStmt = llvm::cast<IfStmt>(node);
+      record.ops[0] = getNodeId(ifStmt->condExpr.get());
+      record.ops[1] = getNodeId(ifStmt->thenBody.get());
+      record.ops[2] = getNodeId(ifStmt->elseBody.get());
+      break;
+    }
+    case ASTNode::ForStmt: {
+      auto *forStmt = llvm::cast<ForStmt>(node);
+      record.ops[0] = getNodeId(forStmt->initExpr.get());
+      record.ops[1] = getNodeId(forStmt->condExpr.get());
+      record.ops[2] = getNodeId(forStmt->incExpr.get());
+      record.ops[3] = getNodeId(forStmt->forBody.get());
+      if (forStmt->omp) {
+        record.extra.first = omps.size();
+        record.extra.size = 1;
+        omps.emplace_back();
+        OmpRecord ompRecord = writeOmp(*forStmt->omp);
+        omps[record.extra.first] = ompRecord;
+      }
+      break;
+    }
+    case ASTNode::BreakStmt:
+      record.ops[0] = getNodeId(llvm::cast<BreakStmt>(node)->target.get());
+      break;
+    case ASTNode::ContinueStmt:
+      record.ops[0] = getNodeId(llvm::cast<ContinueStmt>(node)->target.get());
+      break;
+    case ASTNode::ReturnStmt:
+      record.ops[0] = getNodeId(llvm::cast<ReturnStmt>(node)->expr.get());
+      break;
+    case ASTNode::FunctionDecl: {
+      auto *funcDecl = llvm::cast<FunctionDecl>(node);
+      record.name = addString(funcDecl->name);
+      record.list = addNodeList(funcDecl->params);
+      record.ops[0] = getNodeId(funcDecl->body.get());
+      record.symbol = getSymbolId(funcDecl->symbol.get());
+      record.flags = (funcDecl->isStatic ? flagStatic : 0) |
+                     (funcDecl->isInline ? flagInline : 0) |
+                     (funcDecl->frameAddressTaken ? flagFrameAddressTaken : 0);
+      llvm::SmallVector<AttrRecord, 4> funcAttrs;
+      for (const Attr &attr: funcDecl->attrs) {
+        AttrRecord attrRecord;
+        attrRecord.tok = getTokenRecord(attr.tok);
+        attrRecord.name = addString(attr.name);
+        attrRecord.args.first = tokens.size();
+        attrRecord.args.size = attr.args.size();
+        for (const Token &arg: attr.args) {
+          tokens.push_back(getTokenRecord(arg));
+        }
+        funcAttrs.push_back(attrRecord);
+      }
+      record.extra.first = attrs.size();
+      record.extra.size = funcAttrs.size();
+      attrs.insert(attrs.end(), funcAttrs.begin(), funcAttrs.end());
+      // The targets are strings, an offset and a size each.
+      llvm::SmallVector<uint32_t, 8> targets;
+      for (llvm::StringRef target: funcDecl->targetClones) {
+        StringRecord str = addString(target);
+        targets.push_back(str.offset);
+        targets.push_back(str.size);
+      }
+      record.ops[1] = addList(targets).first;
+      record.ops[2] = funcDecl->targetClones.size();
+      break;
+    }
+    case ASTNode::VariableDecl: {
+      auto *variableDecl = llvm::cast<VariableDecl>(node);
+      record.symbol = getSymbolId(variableDecl->symbol.get());
+      record.flags = variableDecl->isStatic ? flagStatic : 0;
+      break;
+    }
+    case ASTNode::AssignExpr: {
+      auto *assignExpr = llvm::cast<AssignExpr>(node);
+      record.ops[0] = getNodeId(assignExpr->lhs.get());
+      record.ops[1] = getNodeId(assignExpr->rhs.get());
+      break;
+    }
+    case ASTNode::BinaryExpr: {
+      auto *binaryExpr = llvm::cast<BinaryExpr>(node);
+      record.value = static_cast<uint64_t>(binaryExpr->op);
+      record.ops[0] = getNodeId(binaryExpr->lhs.get());
+      record.ops[1] = getNodeId(binaryExpr->rhs.get());
+      break;
+    }
+    case ASTNode::UnaryExpr: {
+      auto *unaryExpr = llvm::cast<UnaryExpr>(node);
+      record.value = static_cast<uint64_t>(unaryExpr->op);
+      record.ops[0] = getNodeId(unaryExpr->operand.get());
+      break;
+    }
+    case ASTNode::ConditionalExpr: {
+      auto *conditionalExpr = llvm::cast<ConditionalExpr>(node);
+      record.ops[0] = getNodeId(conditionalExpr->condExpr.get());
+      record.ops[1] = getNodeId(conditionalExpr->thenExpr.get());
+      record.ops[2] = getNodeId(conditionalExpr->elseExpr.get());
+      break;
+    }
+    case ASTNode::NumberExpr:
+      record.value =
+          static_cast<uint32_t>(llvm::cast<NumberExpr>(node)->number);
+      break;
+    case ASTNode::FloatExpr:
+      record.value = llvm::bit_cast<uint64_t>(llvm::cast<FloatExpr>(node)->value);
+      break;
+    case ASTNode::VariableExpr: {
+      auto *variableExpr = llvm::cast<VariableExpr>(node);
+      record.name = addString(variableExpr->name);
+      record.symbol = getSymbolId(variableExpr->symbol.get());
+      break;
+    }
+    case ASTNode::SubscriptExpr: {
+      auto *subscriptExpr = llvm::cast<SubscriptExpr>(node);
+      record.ops[0] = getNodeId(subscriptExpr->base.get());
+      record.ops[1] = getNodeId(subscriptExpr->index.get());
+      break;
+    }
+    case ASTNode::MemberExpr: {
+      auto *memberExpr = llvm::cast<MemberExpr>(node);
+      record.ops[0] = getNodeId(memberExpr->base.get());
+      record.ops[1] = getTypeId(memberExpr->structTy);
+      record.name = addString(memberExpr->name);
+      record.value = memberExpr->fieldIdx;
+      record.flags = memberExpr->isArrow ? flagArrow : 0;
+      break;
+    }
+    case ASTNode::ImplicitCastExpr: {
+      auto *castExpr = llvm::cast<ImplicitCastExpr>(node);
+      record.value = static_cast<uint64_t>(castExpr->castKind);
+      record.ops[0] = getNodeId(castExpr->operand.get());
+      break;
+    }
+    case ASTNode::CallExpr: {
+      auto *callExpr = llvm::cast<CallExpr>(node);
+      record.name = addString(callExpr->callee);
+      record.ops[0] = getNodeId(callExpr->calleeDecl);
+      record.list = addNodeList(callExpr->args);
+      break;
+    }
+    case ASTNode::BuiltinCallExpr: {
+      auto *builtinCallExpr = llvm::cast<BuiltinCallExpr>(node);
+      record.value = static_cast<uint64_t>(builtinCallExpr->builtinKind);
+      record.list = addNodeList(builtinCallExpr->args);
+      break;
+    }
+    }
+    return record;
+  }
+
+  OmpRecord writeOmp(const OmpParallelFor &omp) {
+    OmpRecord record;
+    record.iv = getSymbolId(omp.iv.get());
+    record.upper = getNodeId(omp.upper.get());
+    record.step = static_cast<uint32_t>(omp.step);
+    record.flags = omp.isInclusive ? flagInclusive : 0;
+    record.schedule = static_cast<uint32_t>(omp.schedule);
+    record.chunk = getNodeId(omp.chunk.get());
+    record.numThreads = getNodeId(omp.numThreads.get());
+    llvm::SmallVector<uint32_t, 4> reductions;
+    for (const auto &symbol: omp.reductions) {
+      reductions.push_back(getSymbolId(symbol.get()));
+    }
+    record.reductions = addList(reductions);
+    return record;
+  }
+
+  FileHeader header = {};
+  std::string strings;
+  llvm::StringMap<uint32_t> stringOffsets;
+  std::vector<TypeRecord> types;
+  std::vector<FieldRecord> fields;
+  std::vector<SymbolRecord> symbols;
+  std::vector<NodeRecord> nodes;
+  std::vector<ulittle32_t> ids;
+  std::vector<OmpRecord> omps;
+  std::vector<AttrRecord> attrs;
+  std::vector<TokenRecord> tokens;
+  std::vector<DiagRecord> diags;
+  llvm::DenseMap<CType *, uint32_t> typeIds;
+  llvm::DenseMap<Symbol *, uint32_t> symbolIds;
+  llvm::DenseMap<ASTNode *, uint32_t> nodeIds;
+};
+
+/// Create the AST of a mapped file. An id out of range marks the file
+/// corrupt instead of being followed.
+class ASTReader {
+public:
+  ASTReader(ASTFile &file) : file(file) {}
+
+  llvm::Error read(uint64_t sourceHash) {
+    llvm::StringRef data = file.buffer->getBuffer();
+    if (data.size() < sizeof(FileHeader)) {
+      return corrupt();
+    }
+    auto *header = reinterpret_cast<const FileHeader *>(data.data());
+    if (std::memcmp(header->magic, fileMagic, sizeof(fileMagic)) != 0 ||
+        header->version != formatVersion ||
+        header->compilerHash != getCompilerHash()) {
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "written by another tinycc");
+    }
+    if (header->sourceHash != sourceHash) {
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "the source changed");
+    }
+
+    if (!mapTable(header->strings, strings) ||
+        !mapTable(header->types, types) ||
+        !mapTable(header->fields, fields) ||
+        !mapTable(header->symbols, symbols) ||
+        !mapTable(header->nodes, nodes) || !mapTable(header->ids, ids) ||
+        !mapTable(header->omps, omps) || !mapTable(header->attrs, attrs) ||
+        !mapTable(header->tokens, tokens) ||
+        !mapTable(header->diags, diags)) {
+      return corrupt();
+    }
+
+    typeCache.assign(types.size(), nullptr);
+    symbolCache.resize(symbols.size());
+    for (size_t i = 0; i < symbols.size(); ++i) {
+      const SymbolRecord &record = symbols[i];
+      auto symbol = std::make_shared<Symbol>(
+          static_cast<SymbolKind>(uint32_t(record.kind)), getType(record.ty),
+          getString(record.name));
+      if (record.flags & flagAddressTaken) {
+        symbol->setAddressTaken();
+      }
+      if (record.flags & flagSoA) {
+        symbol->setSoA();
+      }
+      symbolCache[i] = std::move(symbol);
+    }
+
+    // Nodes refer to nodes after them, like `break` to its loop, so they
+    // are all created before any is filled in.
+    file.nodes.reserve(nodes.size());
+    for (const NodeRecord &record: nodes) {
+      file.nodes.push_back(createNode(record.kind));
+      if (!file.nodes.back()) {
+        return corrupt();
+      }
+    }
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      readNode(nodes[i], file.nodes[i].get());
+    }
+
+    file.program = std::make_shared<Program>();
+    file.program->hasImplicitMain = header->hasImplicitMain;
+    file.program->stmtVec = getNodeList(header->stmts);
+    for (const DiagRecord &record: diags) {
+      check(record.kind <= llvm::SourceMgr::DK_Note);
+      file.diagnostics.push_back(
+          {record.offset,
+           static_cast<llvm::SourceMgr::DiagKind>(uint32_t(record.kind)),
+           getString(record.message)});
+    }
+    if (failed) {
+      return corrupt();
+    }
+    return llvm::Error::success();
+  }
+
+private:
+  template <typename T>
+  bool mapTable(const Table &table, llvm::ArrayRef<T> &records) {
+    llvm::StringRef data = file.buffer->getBuffer();
+    uint64_t end = uint64_t(table.offset) + uint64_t(table.count) * sizeof(T);
+    if (end > data.size()) {
+      return false;
+    }
+    records = llvm::ArrayRef<T>(
+        reinterpret_cast<const T *>(data.data() + table.offset), table.count);
+    return true;
+  }
+
+  llvm::Error corrupt() {
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "corrupt AST file");
+  }
+
+  bool check(bool valid) {
+    failed |= !valid;
+    return valid;
+  }
+
+  llvm::StringRef getString(const StringRecord &record) {
+    if (!check(uint64_t(record.offset) + record.size <= strings.size())) {
+      return "";
+    }
+    return llvm::StringRef(strings.data() + record.offset, record.size);
+  }
+
+  llvm::ArrayRef<ulittle32_t> getIds(const ListRecord &list) {
+    if (!check(uint64_t(list.first) + list.size <= ids.size())) {
+      return {};
+    }
+    return ids.slice(list.first, list.size);
+  }
+
+  Token getToken(const TokenRecord &record) {
+    Token tok;
+    tok.row = record.row;
+    tok.col = record.col;
+    tok.tokenType = static_cast<TokenType>(uint32_t(record.tokenType));
+    tok.value = static_cast<int32_t>(uint32_t(record.value));
+    tok.fvalue = llvm::bit_cast<double>(uint64_t(record.fvalue));
+    tok.content = getString(record.content);
+    return tok;
+  }
+
+  CType *getType(uint32_t id) {
+    if (id == noId || !check(id < types.size())) {
+      return nullptr;
+    }
+    if (typeCache[id]) {
+      return typeCache[id];
+    }
+
+    const TypeRecord &record = types[id];
+    TypeContext &ctx = file.types;
+    CType *ty = nullptr;
+    switch (static_cast<TypeKind>(uint32_t(record.kind))) {
+    case TypeKind::Int:
+      ty = ctx.getIntTy();
+      break;
+    case TypeKind::Float:
+      ty = ctx.getFloatTy();
+      break;
+    case TypeKind::Double:
+      ty = ctx.getDoubleTy();
+      break;
+    case TypeKind::Pointer:
+      // A struct in progress is in the cache already, see below.
+      ty = ctx.getPointerTy(getElemType(record), record.flags & flagRestrict);
+      break;
+    case TypeKind::Array:
+      ty = ctx.getArrayTy(getElemType(record), record.numElems);
+      break;
+    case TypeKind::Vector:
+      ty = ctx.getVectorTy(getElemType(record), record.numElems);
+      break;
+    case TypeKind::Func: {
+      llvm::SmallVector<CType *, 8> paramTys;
+      for (uint32_t paramId: getIds(record.list)) {
+        paramTys.push_back(getType(paramId));
+      }
+      ty = ctx.getFuncTy(getElemType(record), paramTys);
+      break;
+    }
+    case TypeKind::Struct: {
+      CStructType *structTy = ctx.createStructTy(getString(record.name));
+      // Fields may point to the struct itself.
+      typeCache[id] = structTy;
+      if ((record.flags & flagComplete) &&
+          check(uint64_t(record.list.first) + record.list.size <=
+                fields.size())) {
+        std::vector<CField> structFields;
+        for (const FieldRecord &field:
+             fields.slice(record.list.first, record.list.size)) {
+          CField newField;
+          newField.name = getString(field.name);
+          newField.ty = getType(field.ty);
+          if (!check(newField.ty)) {
+            return nullptr;
+          }
+          structFields.push_back(newField);
+        }
+        structTy->setBody(std::move(structFields), record.flags & flagPacked,
+                          record.align);
+      }
+      return structTy;
+    }
+    }
+    check(ty);
+    typeCache[id] = ty;
+    return ty;
+  }
+
+  CType *getElemType(const TypeRecord &record) {
+    CType *ty = getType(record.elem);
+    if (!check(ty)) {
+      return file.types.getIntTy();
+    }
+    return ty;
+  }
+
+  std::shared_ptr<Symbol> getSymbol(uint32_t id) {
+    if (id == noId || !check(id < symbolCache.size())) {
+      return nullptr;
+    }
+    return symbolCache[id];
+  }
+
+  std::shared_ptr<ASTNode> getNode(uint32_t id) {
+    if (id == noId || !check(id < file.nodes.size())) {
+      return nullptr;
+    }
+    return file.nodes[id];
+  }
+
+  template <typename T>
+  std::shared_ptr<T> getNodeAs(uint32_t id) {
+    std::shared_ptr<ASTNode> node = getNode(id);
+    if (!node) {
+      return nullptr;
+    }
+    if (!check(llvm::isa<T>(node.get()))) {
+      return nullptr;
+    }
+    return std::static_pointer_cast<T>(node);
+  }
+
+  std::vector<std::shared_ptr<ASTNode>> getNodeList(const ListRecord &list) {
+    std::vector<std::shared_ptr<ASTNode>> nodeList;
+    for (uint32_t id: getIds(list)) {
+      nodeList.push_back(getNode(id));
+      check(nodeList.back() != nullptr);
+    }
+    return nodeList;
+  }
+
+  static std::shared_ptr<ASTNode> createNode(uint32_t kind) {
+    switch (static_cast<ASTNode::NodeKind>(kind)) {
+    case ASTNode::BlockStmt: return std::make_shared<BlockStmt>();
+    case ASTNode::DeclStmt: return std::make_shared<DeclStmt>();
+    case ASTNode::IfStmt: return std::make_shared<IfStmt>();
+    case ASTNode::ForStmt: return std::make_shared<ForStmt>();
+    case ASTNode::BreakStmt: return std::make_shared<BreakStmt>();
+    case ASTNode::ContinueStmt: return std::make_shared<ContinueStmt>();
+    case ASTNode::ReturnStmt: return std::make_shared<ReturnStmt>();
+    case ASTNode::FunctionDecl: return std::make_shared<FunctionDecl>();
+    case ASTNode::VariableDecl: return std::make_shared<VariableDecl>();
+    case ASTNode::BinaryExpr: return std::make_shared<BinaryExpr>();
+    case ASTNode::UnaryExpr: return std::make_shared<UnaryExpr>();
+    case ASTNode::ConditionalExpr: return std::make_shared<ConditionalExpr>();
+    case ASTNode::NumberExpr: return std::make_shared<NumberExpr>();
+    case ASTNode::FloatExpr: return std::make_shared<FloatExpr>();
+    case ASTNode::VariableExpr: return std::make_shared<VariableExpr>();
+    case ASTNode::SubscriptExpr: return std::make_shared<SubscriptExpr>();
+    case ASTNode::MemberExpr: return std::make_shared<MemberExpr>();
+    case ASTNode::ImplicitCastExpr: return std::make_shared<ImplicitCastExpr>();
+    case ASTNode::CallExpr: return std::make_shared<CallExpr>();
+    case ASTNode::BuiltinCallExpr: return std::make_shared<BuiltinCallExpr>();
+    case ASTNode::AssignExpr: return std::make_shared<AssignExpr>();
+    }
+    return nullptr;
+  }
+
+  void readNode(const NodeRecord &record, ASTNode *node) {
+    node->ty = getType(record.ty);
+    node->tok = getToken(record.tok);
+    const ulittle32_t *ops = record.ops;
+
+    switch (node->getNodeKind()) {
+    case ASTNode::BlockStmt:
+      llvm::cast<BlockStmt>(node)->stmtVec = getNodeList(record.list);
+      break;
+    case ASTNode::DeclStmt:
+      llvm::cast<DeclStmt>(node)->exprVec = getNodeList(record.list);
+      break;
+    case ASTNode::IfStmt: {
+      auto *ifStmt = llvm::cast<IfStmt>(node);
+      ifStmt->condExpr = getNode(ops[0]);
+      ifStmt->thenBody = getNode(ops[1]);
+      ifStmt->elseBody = getNode(ops[2]);
+      break;
+    }
+    case ASTNode::ForStmt: {
+      auto *forStmt = llvm::cast<ForStmt>(node);
+      forStmt->initExpr = getNode(ops[0]);
+      forStmt->condExpr = getNode(ops[1]);
+      forStmt->incExpr = getNode(ops[2]);
+      forStmt->forBody = getNode(ops[3]);
+      if (record.extra.size && check(record.extra.first < omps.size())) {
+        forStmt->omp = readOmp(omps[record.extra.first]);
+      }
+      break;
+    }
+    case ASTNode::BreakStmt:
+      llvm::cast<BreakStmt>(node)->target = getNode(ops[0]);
+      break;
+    case ASTNode::ContinueStmt:
+      llvm::cast<ContinueStmt>(node)->target = getNode(ops[0]);
+      break;
+    case ASTNode::ReturnStmt:
+      llvm::cast<ReturnStmt>(node)->expr = getNode(ops[0]);
+      break;
+    case ASTNode::FunctionDecl: {
+      auto *funcDecl = llvm::cast<FunctionDecl>(node);
+      funcDecl->name = getString(record.name);
+      funcDecl->params = getNodeList(record.list);
+      funcDecl->body = getNode(ops[0]);
+      funcDecl->symbol = getSymbol(record.symbol);
+      funcDecl->isStatic = record.flags & flagStatic;
+      funcDecl->isInline = record.flags & flagInline;
+      funcDecl->frameAddressTaken = record.flags & flagFrameAddressTaken;
+      if (check(uint64_t(record.extra.first) + record.extra.size <=
+                attrs.size())) {
+        for (const AttrRecord &attrRecord:
+             attrs.slice(record.extra.first, record.extra.size)) {
+          Attr attr;
+          attr.tok = getToken(attrRecord.tok);
+          attr.name = getString(attrRecord.name);
+          if (check(uint64_t(attrRecord.args.first) + attrRecord.args.size <=
+                    tokens.size())) {
+            for (const TokenRecord &arg:
+                 tokens.slice(attrRecord.args.first, attrRecord.args.size)) {
+              attr.args.push_back(getToken(arg));
+            }
+          }
+          funcDecl->attrs.push_back(std::move(attr));
+        }
+      }
+      ListRecord targets;
+      targets.first = ops[1];
+      targets.size = 2 * ops[2];
+      llvm::ArrayRef<ulittle32_t> targetIds = getIds(targets);
+      for (size_t i = 0; i + 1 < targetIds.size(); i += 2) {
+        StringRecord str;
+        str.offset = targetIds[i];
+        str.size = targetIds[i + 1];
+        funcDecl->targetClones.push_back(getString(str));
+      }
+      break;
+    }
+    case ASTNode::VariableDecl: {
+      auto *variableDecl = llvm::cast<VariableDecl>(node);
+      variableDecl->symbol = getSymbol(record.symbol);
+      variableDecl->isStatic = record.flags & flagStatic;
+      break;
+    }
+    case ASTNode::AssignExpr: {
+      auto *assignExpr = llvm::cast<AssignExpr>(node);
+      assignExpr->lhs = getNode(ops[0]);
+      assignExpr->rhs = getNode(ops[1]);
+      break;
+    }
+    case ASTNode::BinaryExpr: {
+      auto *binaryExpr = llvm::cast<BinaryExpr>(node);
+      binaryExpr->op = static_cast<OpCode>(uint64_t(record.value));
+      binaryExpr->lhs = getNode(ops[0]);
+      binaryExpr->rhs = getNode(ops[1]);
+      break;
+    }
+    case ASTNode::UnaryExpr: {
+      auto *unaryExpr = llvm::cast<UnaryExpr>(node);
+      unaryExpr->op = static_cast<OpCode>(uint64_t(record.value));
+      unaryExpr->operand = getNode(ops[0]);
+      break;
+    }
+    case ASTNode::ConditionalExpr: {
+      auto *conditionalExpr = llvm::cast<ConditionalExpr>(node);
+      conditionalExpr->condExpr = getNode(ops[0]);
+      conditionalExpr->thenExpr = getNode(ops[1]);
+      conditionalExpr->elseExpr = getNode(ops[2]);
+      break;
+    }
+    case ASTNode::NumberExpr:
+      llvm::cast<NumberExpr>(node)->number =
+          static_cast<int32_t>(uint64_t(record.value));
+      break;
+    case ASTNode::FloatExpr:
+      llvm::cast<FloatExpr>(node)->value =
+          llvm::bit_cast<double>(uint64_t(record.value));
+      break;
+    case ASTNode::VariableExpr: {
+      auto *variableExpr = llvm::cast<VariableExpr>(node);
+      variableExpr->name = getString(record.name);
+      variableExpr->symbol = getSymbol(record.symbol);
+      break;
+    }
+    case ASTNode::SubscriptExpr: {
+      auto *subscriptExpr = llvm::cast<SubscriptExpr>(node);
+      subscriptExpr->base = getNode(ops[0]);
+      subscriptExpr->index = getNode(ops[1]);
+      break;
+    }
+    case ASTNode::MemberExpr: {
+      auto *memberExpr = llvm::cast<MemberExpr>(node);
+      memberExpr->base = getNode(ops[0]);
+      memberExpr->structTy =
+          llvm::dyn_cast_or_null<CStructType>(getType(ops[1]));
+      memberExpr->name = getString(record.name);
+      memberExpr->fieldIdx = record.value;
+      memberExpr->isArrow = record.flags & flagArrow;
+      check(memberExpr->structTy &&
+            memberExpr->fieldIdx < memberExpr->structTy->getFields().size());
+      break;
+    }
+    case ASTNode::ImplicitCastExpr: {
+      auto *castExpr = llvm::cast<ImplicitCastExpr>(node);
+      castExpr->castKind = static_cast<CastKind>(uint64_t(record.value));
+      castExpr->operand = getNode(ops[0]);
+      break;
+    }
+    case ASTNode::CallExpr: {
+      auto *callExpr = llvm::cast<CallExpr>(node);
+      callExpr->callee = getString(record.name);
+      callExpr->calleeDecl = getNodeAs<FunctionDecl>(ops[0]).get();
+      callExpr->args = getNodeList(record.list);
+      break;
+    }
+    case ASTNode::BuiltinCallExpr: {
+      auto *builtinCallExpr = llvm::cast<BuiltinCallExpr>(node);
+      builtinCallExpr->builtinKind =
+          static_cast<BuiltinKind>(uint64_t(record.value));
+      builtinCallExpr->args = getNodeList(record.list);
+      break;
+    }
+    }
+  }
+
+  std::shared_ptr<OmpParallelFor> readOmp(const OmpRecord &record) {
+    auto omp = std::make_shared<OmpParallelFor>();
+    omp->iv = getSymbol(record.iv);
+    omp->upper = getNode(record.upper);
+    omp->step = static_cast<int32_t>(uint32_t(record.step));
+    omp->isInclusive = record.flags & flagInclusive;
+    omp->schedule = static_cast<OmpSchedule>(uint32_t(record.schedule));
+    omp->chunk = getNode(record.chunk);
+    omp->numThreads = getNode(record.numThreads);
+    for (uint32_t id: getIds(record.reductions)) {
+      omp->reductions.push_back(getSymbol(id));
+    }
+    return omp;
+  }
+
+  ASTFile &file;
+  llvm::ArrayRef<char> strings;
+  llvm::ArrayRef<TypeRecord> types;
+  llvm::ArrayRef<FieldRecord> fields;
+  llvm::ArrayRef<SymbolRecord> symbols;
+  llvm::ArrayRef<NodeRecord> nodes;
+  llvm::ArrayRef<ulittle32_t> ids;
+  llvm::ArrayRef<OmpRecord> omps;
+  llvm::ArrayRef<AttrRecord> attrs;
+  llvm::ArrayRef<TokenRecord> tokens;
+  llvm::ArrayRef<DiagRecord> diags;
+  std::vector<CType *> typeCache;
+  std::vector<std::shared_ptr<Symbol>> symbolCache;
+  bool failed = false;
+};
+
+} // namespace
+
+llvm::Error writeASTFile(const Program &prog,
+                         llvm::ArrayRef<SavedDiagnostic> diagnostics,
+                         uint64_t sourceHash, llvm::StringRef path) {
+  ASTWriter writer;
+  writer.writeProgram(prog, sourceHash);
+  writer.writeDiagnostics(diagnostics);
+
+  llvm::SmallString<128> model(path);
+  model += "-%%%%%%%%.tmp";
+  llvm::Expected<llvm::sys::fs::TempFile> temp =
+      llvm::sys::fs::TempFile::create(model);
+  if (!temp) {
+    return temp.takeError();
+  }
+  llvm::raw_fd_ostream os(temp->FD, /*shouldClose=*/false);
+  writer.emit(os);
+  os.flush();
+  if (os.has_error()) {
+    std::error_code ec = os.error();
+    os.clear_error();
+    return llvm::joinErrors(llvm::errorCodeToError(ec), temp->discard());
+  }
+  return temp->keep(path);
+}
+
+llvm::Expected<std::unique_ptr<ASTFile>> readASTFile(llvm::StringRef path,
+                                                     uint64_t sourceHash) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer =
+      llvm::MemoryBuffer::getFile(path, /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    return llvm::errorCodeToError(buffer.getError());
+  }
+
+  auto file = std::make_unique<ASTFile>();
+  file->buffer = std::move(*buffer);
+  if (llvm::Error err = ASTReader(*file).read(sourceHash)) {
+    return std::move(err);
+  }
+  return std::move(file);
+}
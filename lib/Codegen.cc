@@ -1,68 +1,1023 @@
 #include "Codegen.h"
 #include "AST.h"
+#include "Basic.h"
+#include "ValueRange.h"
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Frontend/OpenMP/OMPIRBuilder.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalIFunc.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
 #include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 #define DEBUG_TYPE "CodeGen"
 
 using namespace llvm;
 
-CodegenVisitor::CodegenVisitor(std::shared_ptr<Program> program) {
+static llvm::cl::opt<unsigned> IfConversionThreshold(
+    "if-conversion-threshold", llvm::cl::Hidden, llvm::cl::init(8),
+    llvm::cl::desc("Maximum cost of the operands speculated when an "
+                   "`if` statement is turned into a select"));
+
+static llvm::cl::opt<bool> BoundsCheck(
+    "fbounds-check", llvm::cl::init(false),
+    llvm::cl::desc("Trap on out of bounds array subscripts"));
+
+static llvm::cl::opt<bool> CompileTimeEval(
+    "fcompile-time-eval", llvm::cl::init(false),
+    llvm::cl::desc("Run a program at compile time, within a budget, and "
+                   "emit only what it prints, or the globals computed by "
+                   "the statements which ran"));
+
+static llvm::cl::opt<uint64_t> CompileTimeEvalSteps(
+    "compile-time-eval-steps", llvm::cl::init(10000000),
+    llvm::cl::desc("Bytecode instructions -fcompile-time-eval may run"));
+
+static llvm::cl::opt<uint64_t> CompileTimeEvalMemory(
+    "compile-time-eval-memory", llvm::cl::init(16 << 20),
+    llvm::cl::desc("Bytes of globals and stack -fcompile-time-eval may use"));
+
+static llvm::cl::opt<bool> MultiversionHot(
+    "fmultiversion-hot", llvm::cl::init(false),
+    llvm::cl::desc("Clone the implicit main and `hot` functions for AVX2 "
+                   "and AVX-512, and pick a clone when the program loads"));
+
+/// The targets of -fmultiversion-hot.
+static const llvm::StringRef HotTargets[] = {"avx2", "avx512f", "default"};
+
+// `-ffast-math` itself is taken by the Hexagon backend, spell it as
+// `-funsafe-math-optimizations -ffinite-math-only`.
+static llvm::cl::opt<bool> UnsafeMath(
+    "funsafe-math-optimizations", llvm::cl::init(false),
+    llvm::cl::desc("Allow floating-point optimizations that may change "
+                   "results: reassociation, reciprocals, approximate "
+                   "functions, ignoring signed zeros and contraction"));
+
+static llvm::cl::opt<bool> AssociativeMath(
+    "fassociative-math", llvm::cl::init(false),
+    llvm::cl::desc("Allow floating-point operations to be reassociated, so "
+                   "reductions can be vectorized"));
+
+static llvm::cl::opt<bool> ReciprocalMath(
+    "freciprocal-math", llvm::cl::init(false),
+    llvm::cl::desc("Allow `x / y` to be computed as `x * (1 / y)`"));
+
+static llvm::cl::opt<bool> NoSignedZeros(
+    "fno-signed-zeros", llvm::cl::init(false),
+    llvm::cl::desc("Ignore the sign of floating-point zeros"));
+
+static llvm::cl::opt<bool> FiniteMathOnly(
+    "ffinite-math-only", llvm::cl::init(false),
+    llvm::cl::desc("Assume floating-point values are never NaN or infinite"));
+
+enum class FPContractKind { Off, Fast };
+
+static llvm::cl::opt<FPContractKind> FPContract(
+    "ffp-contract", llvm::cl::init(FPContractKind::Off),
+    llvm::cl::desc("Form fused multiply-adds from separate operations"),
+    llvm::cl::values(
+        clEnumValN(FPContractKind::Off, "off", "Never fuse operations"),
+        clEnumValN(FPContractKind::Fast, "fast",
+                   "Fuse operations whenever the target can")));
+
+/// The IR flags for the floating-point options of the command line.
+static llvm::FastMathFlags getFastMathFlags() {
+  llvm::FastMathFlags fmf;
+  fmf.setAllowReassoc(UnsafeMath || AssociativeMath);
+  fmf.setAllowReciprocal(UnsafeMath || ReciprocalMath);
+  fmf.setApproxFunc(UnsafeMath);
+  fmf.setNoSignedZeros(UnsafeMath || NoSignedZeros);
+  fmf.setNoNaNs(FiniteMathOnly);
+  fmf.setNoInfs(FiniteMathOnly);
+  fmf.setAllowContract(UnsafeMath || FPContract == FPContractKind::Fast);
+  return fmf;
+}
+
+/// Instruction selection reads the floating-point model from function
+/// attributes rather than from the instruction flags.
+static void setFPAttributes(llvm::Function *func, llvm::FastMathFlags fmf) {
+  if (fmf.noNaNs()) {
+    func->addFnAttr("no-nans-fp-math", "true");
+  }
+  if (fmf.noInfs()) {
+    func->addFnAttr("no-infs-fp-math", "true");
+  }
+  if (fmf.noSignedZeros()) {
+    func->addFnAttr("no-signed-zeros-fp-math", "true");
+  }
+  if (fmf.allowReassoc() && fmf.allowReciprocal() && fmf.noSignedZeros()) {
+    func->addFnAttr("unsafe-fp-math", "true");
+  }
+}
+
+/// Arrays of at least this many bytes are aligned to it, so vectorized
+/// loops over them can use aligned loads and stores.
+static constexpr unsigned ArrayAlign = 16;
+
+/// Estimate the cost of evaluating `node` unconditionally.
+/// Return -1 if it has side effects or may trap, so it can't be speculated.
+static int getSpeculationCost(ASTNode *node) {
+  switch (node->getNodeKind()) {
+  case ASTNode::NodeKind::NumberExpr:
+  case ASTNode::NodeKind::FloatExpr:
+    return 0;
+  case ASTNode::NodeKind::VariableExpr:
+    return 1;
+  case ASTNode::NodeKind::BinaryExpr: {
+    auto *binaryExpr = llvm::cast<BinaryExpr>(node);
+    if (binaryExpr->lhs->ty->getScalarTy()->isInteger() &&
+        (binaryExpr->op == OpCode::div || binaryExpr->op == OpCode::mod)) {
+      // `sdiv` and `srem` trap on zero and on INT_MIN / -1.
+      auto *divisor = llvm::dyn_cast<NumberExpr>(binaryExpr->rhs.get());
+      if (!divisor || divisor->number == 0 || divisor->number == -1) {
+        return -1;
+      }
+    }
+
+    int lhsCost = getSpeculationCost(binaryExpr->lhs.get());
+    int rhsCost = getSpeculationCost(binaryExpr->rhs.get());
+    if (lhsCost < 0 || rhsCost < 0) {
+      return -1;
+    }
+    return lhsCost + rhsCost + 1;
+  }
+  case ASTNode::NodeKind::UnaryExpr: {
+    // `*p` may trap, and `&a[i]` may need a bounds check.
+    auto *unaryExpr = llvm::cast<UnaryExpr>(node);
+    if (unaryExpr->op != OpCode::bitwisenot) {
+      return -1;
+    }
+    int operandCost = getSpeculationCost(unaryExpr->operand.get());
+    return operandCost < 0 ? -1 : operandCost + 1;
+  }
+  case ASTNode::NodeKind::ImplicitCastExpr: {
+    // The conversions themselves can't trap, but their operand may.
+    auto *castExpr = llvm::cast<ImplicitCastExpr>(node);
+    int operandCost = getSpeculationCost(castExpr->operand.get());
+    if (operandCost < 0) {
+      return -1;
+    }
+    return castExpr->castKind == CastKind::NullToPointer ? operandCost
+                                                         : operandCost + 1;
+  }
+  case ASTNode::NodeKind::ConditionalExpr: {
+    auto *condExpr = llvm::cast<ConditionalExpr>(node);
+    int condCost = getSpeculationCost(condExpr->condExpr.get());
+    int thenCost = getSpeculationCost(condExpr->thenExpr.get());
+    int elseCost = getSpeculationCost(condExpr->elseExpr.get());
+    if (condCost < 0 || thenCost < 0 || elseCost < 0) {
+      return -1;
+    }
+    return condCost + thenCost + elseCost + 1;
+  }
+  default:
+    return -1;
+  }
+}
+
+/// Return log2 of `value` if it is a constant positive power of two that
+/// fits a signed int, otherwise return -1.
+static int getPowerOf2Log2(llvm::Value *value) {
+  auto *constant = llvm::dyn_cast<llvm::ConstantInt>(value);
+  if (!constant || !constant->getValue().isStrictlyPositive() ||
+      !constant->getValue().isPowerOf2()) {
+    return -1;
+  }
+
+  return constant->getValue().logBase2();
+}
+
+/// x / 2^k => (x + (x < 0 ? 2^k - 1 : 0)) >> k, which rounds toward zero.
+static llvm::Value *emitSDivByPowerOf2(llvm::IRBuilder<> &builder,
+                                       llvm::Value *lhs, unsigned log2) {
+  if (log2 == 0) {
+    return lhs;
+  }
+
+  unsigned bits = lhs->getType()->getScalarSizeInBits();
+  llvm::Value *sign = builder.CreateAShr(lhs, bits - 1, "div.sign");
+  llvm::Value *bias = builder.CreateLShr(sign, bits - log2, "div.bias");
+  llvm::Value *biased = builder.CreateAdd(lhs, bias);
+  return builder.CreateAShr(biased, log2, "div");
+}
+
+/// x % 2^k => x - ((x + (x < 0 ? 2^k - 1 : 0)) & -2^k), which keeps the sign
+/// of the dividend like `srem`.
+static llvm::Value *emitSRemByPowerOf2(llvm::IRBuilder<> &builder,
+                                       llvm::Value *lhs, unsigned log2) {
+  if (log2 == 0) {
+    return llvm::ConstantInt::get(lhs->getType(), 0);
+  }
+
+  unsigned bits = lhs->getType()->getScalarSizeInBits();
+  llvm::Value *sign = builder.CreateAShr(lhs, bits - 1, "rem.sign");
+  llvm::Value *bias = builder.CreateLShr(sign, bits - log2, "rem.bias");
+  llvm::Value *biased = builder.CreateAdd(lhs, bias);
+  llvm::Value *rounded = builder.CreateAnd(
+      biased, llvm::ConstantInt::get(lhs->getType(), -(1LL << log2), true));
+  return builder.CreateSub(lhs, rounded, "rem");
+}
+
+/// Look through blocks holding a single statement for an assignment.
+static AssignExpr *getSingleAssignExpr(ASTNode *stmt) {
+  while (auto *blockStmt = llvm::dyn_cast_or_null<BlockStmt>(stmt)) {
+    if (blockStmt->stmtVec.size() != 1) {
+      return nullptr;
+    }
+    stmt = blockStmt->stmtVec.front().get();
+  }
+
+  return llvm::dyn_cast_or_null<AssignExpr>(stmt);
+}
+
+CodegenVisitor::CodegenVisitor(std::shared_ptr<Program> program,
+                               llvm::StringRef fileName,
+                               DebugInfoKind debugInfo, llvm::raw_ostream &os)
+    : os(&os) {
   m = std::make_shared<llvm::Module>("exprmodule", context);
+  builder.setFastMathFlags(getFastMathFlags());
+  if (debugInfo != DebugInfoKind::None) {
+    createCompileUnit(fileName, debugInfo);
+  }
+  ranges.analyze(program.get(), program->hasImplicitMain);
+  if (CompileTimeEval) {
+    evaluation = evaluateProgram(
+        *program, {CompileTimeEvalSteps, size_t(CompileTimeEvalMemory)});
+  }
   visitProgram(program.get());
 }
 
+CodegenVisitor::CodegenVisitor(
+    std::shared_ptr<Program> chunk,
+    llvm::ArrayRef<std::shared_ptr<Program>> prevChunks,
+    llvm::StringRef entryName)
+    : replEntry(entryName) {
+  m = std::make_shared<llvm::Module>(entryName, context);
+  builder.setFastMathFlags(getFastMathFlags());
+  for (auto &prevChunk: prevChunks) {
+    declareExternalGlobals(prevChunk.get());
+  }
+  ranges.analyze(chunk.get(), /*wholeProgram=*/false);
+  visitProgram(chunk.get());
+}
+
+CodegenVisitor::CodegenVisitor(
+    std::shared_ptr<Program> prog, ForStmt *loop,
+    llvm::ArrayRef<std::pair<Symbol *, int32_t>> frameSlots,
+    llvm::StringRef entryName)
+    : replEntry(entryName) {
+  m = std::make_shared<llvm::Module>(entryName, context);
+  builder.setFastMathFlags(getFastMathFlags());
+  // The globals live in the memory of the interpreter.
+  declareExternalGlobals(prog.get());
+  ranges.analyze(prog.get(), prog->hasImplicitMain);
+  for (auto &stmt: prog->stmtVec) {
+    auto *funcDecl = llvm::dyn_cast<FunctionDecl>(stmt.get());
+    if (funcDecl && funcDecl->body) {
+      visitFunctionDecl(funcDecl);
+      getOrCreateFunction(funcDecl)->setLinkage(
+          llvm::GlobalValue::InternalLinkage);
+    }
+  }
+  emitLoopEntry(loop, frameSlots);
+  finalizeOpenMP();
+}
+
+/// The entry of a loop compiled for -tiered. Scalars whose address is never
+/// taken are copied out of the frame before the loop and back after it, so
+/// they can live in registers. Anything else is used in place.
+void CodegenVisitor::emitLoopEntry(
+    ForStmt *loop, llvm::ArrayRef<std::pair<Symbol *, int32_t>> frameSlots) {
+  llvm::Type *i8Ptr = llvm::PointerType::get(builder.getInt8Ty(), 0);
+  llvm::Function *entry = llvm::Function::Create(
+      llvm::FunctionType::get(builder.getVoidTy(), {i8Ptr}, false),
+      llvm::GlobalValue::ExternalLinkage, replEntry, m.get());
+  setFPAttributes(entry, builder.getFastMathFlags());
+  currentFunction = entry;
+  currentFuncDecl = nullptr;
+  currentSubprogram = nullptr;
+
+  llvm::Argument *frame = entry->getArg(0);
+  frame->setName("frame");
+  builder.SetInsertPoint(llvm::BasicBlock::Create(context, "entry", entry));
+
+  llvm::SmallVector<std::pair<llvm::AllocaInst *, llvm::Value *>, 16> copies;
+  for (auto [symbol, slot]: frameSlots) {
+    llvm::Value *slotAddr = builder.CreateConstInBoundsGEP1_64(
+        builder.getInt8Ty(), frame, slot, symbol->getName() + ".slot");
+    CType *ty = symbol->getTy();
+    if (symbol->isAddressTaken() ||
+        !(ty->isArithmetic() || llvm::isa<CPointerType>(ty))) {
+      varAddrMap[symbol] = slotAddr;
+      continue;
+    }
+    llvm::Type *llvmTy = getLLVMType(ty);
+    llvm::AllocaInst *alloca =
+        builder.CreateAlloca(llvmTy, nullptr, symbol->getName());
+    builder.CreateStore(builder.CreateLoad(llvmTy, slotAddr), alloca);
+    varAddrMap[symbol] = alloca;
+    copies.push_back({alloca, slotAddr});
+  }
+
+  entryLoop = loop;
+  loop->accept(this);
+  entryLoop = nullptr;
+
+  for (auto [alloca, slotAddr]: copies) {
+    builder.CreateStore(
+        builder.CreateLoad(alloca->getAllocatedType(), alloca), slotAddr);
+  }
+  builder.CreateRetVoid();
+  verifyFunction(*entry);
+}
+
+/// Declare the file scope variables of an earlier chunk of the REPL, or of
+/// the program the interpreter runs for -tiered.
+void CodegenVisitor::declareExternalGlobals(Program *prevChunk) {
+  declaringExternals = true;
+  for (auto &stmt: prevChunk->stmtVec) {
+    auto *declStmt = llvm::dyn_cast<DeclStmt>(stmt.get());
+    if (!declStmt) {
+      continue;
+    }
+    for (auto &expr: declStmt->exprVec) {
+      if (auto *variableDecl = llvm::dyn_cast<VariableDecl>(expr.get())) {
+        (void)visitVariableDecl(variableDecl);
+      }
+    }
+  }
+  declaringExternals = false;
+}
+
+void CodegenVisitor::createCompileUnit(llvm::StringRef fileName,
+                                       DebugInfoKind debugInfo) {
+  llvm::SmallString<128> path(fileName == "-" ? "<stdin>" : fileName);
+  (void)llvm::sys::fs::make_absolute(path);
+
+  auto emissionKind = llvm::DICompileUnit::NoDebug;
+  if (debugInfo == DebugInfoKind::LineTablesOnly) {
+    emissionKind = llvm::DICompileUnit::LineTablesOnly;
+  }
+  else if (debugInfo == DebugInfoKind::Full) {
+    emissionKind = llvm::DICompileUnit::FullDebug;
+  }
+
+  debugInfoKind = debugInfo;
+  diBuilder = std::make_unique<llvm::DIBuilder>(*m);
+  diFile = diBuilder->createFile(llvm::sys::path::filename(path),
+                                 llvm::sys::path::parent_path(path));
+  (void)diBuilder->createCompileUnit(
+      llvm::dwarf::DW_LANG_C99, diFile,
+      "tinycc " + getTinyccVeriosn(), /*isOptimized=*/false,
+      /*Flags=*/"", /*RV=*/0, /*SplitName=*/"", emissionKind);
+  if (emissionKind != llvm::DICompileUnit::NoDebug) {
+    m->addModuleFlag(llvm::Module::Max, "Dwarf Version", 5);
+  }
+  m->addModuleFlag(llvm::Module::Warning, "Debug Info Version",
+                   llvm::DEBUG_METADATA_VERSION);
+}
+
+/// Give `func` a subprogram, the scope of the locations of its code.
+/// `funcTy` is null for the implicit main, which returns `int`.
+llvm::DISubprogram *CodegenVisitor::createSubprogram(llvm::Function *func,
+                                                     unsigned line,
+                                                     CFuncType *funcTy) {
+  if (!diBuilder) {
+    return nullptr;
+  }
+
+  // Only full debug info describes the signature.
+  llvm::SmallVector<llvm::Metadata *, 8> signature;
+  if (debugInfoKind == DebugInfoKind::Full) {
+    if (funcTy) {
+      signature.push_back(getDIType(funcTy->getRetTy()));
+      for (CType *paramTy: funcTy->getParamTys()) {
+        signature.push_back(getDIType(paramTy));
+      }
+    }
+    else {
+      signature.push_back(
+          diBuilder->createBasicType("int", 32, llvm::dwarf::DW_ATE_signed));
+    }
+  }
+
+  auto spFlags = llvm::DISubprogram::SPFlagDefinition;
+  if (func->hasLocalLinkage()) {
+    spFlags |= llvm::DISubprogram::SPFlagLocalToUnit;
+  }
+  llvm::DISubprogram *subprogram = diBuilder->createFunction(
+      diFile, func->getName(), /*LinkageName=*/"", diFile, line,
+      diBuilder->createSubroutineType(
+          diBuilder->getOrCreateTypeArray(signature)),
+      line, llvm::DINode::FlagPrototyped, spFlags);
+  func->setSubprogram(subprogram);
+  return subprogram;
+}
+
+/// The debug info type of `ty`. Types other than structs are uniqued by
+/// the context, so only structs are cached.
+llvm::DIType *CodegenVisitor::getDIType(CType *ty) {
+  switch (ty->getKind()) {
+  case TypeKind::Int:
+    return diBuilder->createBasicType("int", 32, llvm::dwarf::DW_ATE_signed);
+  case TypeKind::Float:
+    return diBuilder->createBasicType("float", 32, llvm::dwarf::DW_ATE_float);
+  case TypeKind::Double:
+    return diBuilder->createBasicType("double", 64, llvm::dwarf::DW_ATE_float);
+  case TypeKind::Pointer: {
+    auto *pointerTy = llvm::cast<CPointerType>(ty);
+    llvm::DIType *diTy =
+        diBuilder->createPointerType(getDIType(pointerTy->getPointeeTy()), 64);
+    if (pointerTy->isRestrict()) {
+      diTy = diBuilder->createQualifiedType(llvm::dwarf::DW_TAG_restrict_type,
+                                            diTy);
+    }
+    return diTy;
+  }
+  case TypeKind::Array: {
+    auto *arrayTy = llvm::cast<CArrayType>(ty);
+    llvm::Metadata *subrange =
+        diBuilder->getOrCreateSubrange(0, arrayTy->getNumElems());
+    return diBuilder->createArrayType(
+        ty->getSize() * 8, ty->getAlign() * 8,
+        getDIType(arrayTy->getElemTy()),
+        diBuilder->getOrCreateArray(subrange));
+  }
+  case TypeKind::Vector: {
+    auto *vectorTy = llvm::cast<CVectorType>(ty);
+    llvm::Metadata *subrange =
+        diBuilder->getOrCreateSubrange(0, vectorTy->getNumElems());
+    return diBuilder->createVectorType(
+        ty->getSize() * 8, ty->getAlign() * 8,
+        getDIType(vectorTy->getElemTy()),
+        diBuilder->getOrCreateArray(subrange));
+  }
+  case TypeKind::Struct:
+    return getDIStructType(llvm::cast<CStructType>(ty));
+  case TypeKind::Func: {
+    auto *funcTy = llvm::cast<CFuncType>(ty);
+    llvm::SmallVector<llvm::Metadata *, 8> signature;
+    signature.push_back(getDIType(funcTy->getRetTy()));
+    for (CType *paramTy: funcTy->getParamTys()) {
+      signature.push_back(getDIType(paramTy));
+    }
+    return diBuilder->createSubroutineType(
+        diBuilder->getOrCreateTypeArray(signature));
+  }
+  }
+  llvm_unreachable("unknown type kind");
+}
+
+/// A struct may point to itself, so its fields are described after a
+/// placeholder for it is cached, which is then replaced by the struct.
+llvm::DIType *CodegenVisitor::getDIStructType(CStructType *structTy) {
+  auto it = diStructTys.find(structTy);
+  if (it != diStructTys.end()) {
+    return it->second;
+  }
+
+  if (!structTy->isComplete()) {
+    llvm::DIType *fwdDecl = diBuilder->createForwardDecl(
+        llvm::dwarf::DW_TAG_structure_type, structTy->getStructName(),
+        diFile, diFile, 0);
+    diStructTys[structTy] = fwdDecl;
+    return fwdDecl;
+  }
+
+  llvm::DICompositeType *placeholder =
+      diBuilder->createReplaceableCompositeType(
+          llvm::dwarf::DW_TAG_structure_type, structTy->getStructName(),
+          diFile, diFile, 0, 0, structTy->getSize() * 8,
+          structTy->getAlign() * 8);
+  diStructTys[structTy] = placeholder;
+
+  llvm::SmallVector<llvm::Metadata *, 8> members;
+  for (const CField &field: structTy->getFields()) {
+    members.push_back(diBuilder->createMemberType(
+        placeholder, field.name, diFile, 0, field.ty->getSize() * 8,
+        field.ty->getAlign() * 8, field.offset * 8, llvm::DINode::FlagZero,
+        getDIType(field.ty)));
+  }
+  llvm::DICompositeType *diStructTy = diBuilder->createStructType(
+      diFile, structTy->getStructName(), diFile, 0, structTy->getSize() * 8,
+      structTy->getAlign() * 8, llvm::DINode::FlagZero, nullptr,
+      diBuilder->getOrCreateArray(members));
+  diStructTy = diBuilder->replaceTemporary(
+      llvm::TempDICompositeType(placeholder), diStructTy);
+  diStructTys[structTy] = diStructTy;
+  return diStructTy;
+}
+
+/// Describe a variable to the debugger: a global gets an expression for
+/// its address, and a local or parameter gets a `dbg.declare` of its slot.
+void CodegenVisitor::emitVariableDebugInfo(VariableDecl *variableDecl,
+                                           llvm::Value *addr) {
+  if (debugInfoKind != DebugInfoKind::Full) {
+    return;
+  }
+
+  llvm::StringRef name = variableDecl->tok.content;
+  unsigned line = variableDecl->tok.row;
+  llvm::DIType *diTy = getDIType(variableDecl->ty);
+  if (auto *globalVar = llvm::dyn_cast<llvm::GlobalVariable>(addr)) {
+    globalVar->addDebugInfo(diBuilder->createGlobalVariableExpression(
+        diFile, name, /*LinkageName=*/"", diFile, line, diTy,
+        globalVar->hasLocalLinkage()));
+    return;
+  }
+
+  // Parameters are numbered from 1 in the signature.
+  unsigned argNo = 0;
+  if (currentFuncDecl) {
+    for (unsigned i = 0; i < currentFuncDecl->params.size(); ++i) {
+      if (currentFuncDecl->params[i].get() == variableDecl) {
+        argNo = i + 1;
+      }
+    }
+  }
+  llvm::DILocalVariable *diVar =
+      argNo ? diBuilder->createParameterVariable(currentSubprogram, name, argNo,
+                                                 diFile, line, diTy)
+            : diBuilder->createAutoVariable(currentSubprogram, name, diFile,
+                                            line, diTy);
+
+  // The declaration goes right after the alloca.
+  llvm::BasicBlock *bb = builder.GetInsertBlock();
+  if (builder.GetInsertPoint() == bb->end()) {
+    (void)diBuilder->insertDeclare(addr, diVar, diBuilder->createExpression(),
+                                   builder.getCurrentDebugLocation(), bb);
+  }
+  else {
+    (void)diBuilder->insertDeclare(addr, diVar, diBuilder->createExpression(),
+                                   builder.getCurrentDebugLocation(),
+                                   &*builder.GetInsertPoint());
+  }
+}
+
+CodegenVisitor::DebugLocScope::DebugLocScope(CodegenVisitor *cg, ASTNode *node)
+    : cg(cg), savedLoc(cg->builder.getCurrentDebugLocation()) {
+  if (cg->currentSubprogram) {
+    cg->builder.SetCurrentDebugLocation(llvm::DILocation::get(
+        cg->context, node->tok.row, node->tok.col, cg->currentSubprogram));
+  }
+}
+
+CodegenVisitor::DebugLocScope::~DebugLocScope() {
+  cg->builder.SetCurrentDebugLocation(savedLoc);
+}
+
 llvm::Value *CodegenVisitor::visitProgram(Program *prog) {
-  llvm::PointerType *i8Ptr = PointerType::get(builder.getInt8Ty(), 0);
-  llvm::FunctionType *printfType = FunctionType::get(
-      builder.getInt32Ty(), i8Ptr, true);
-  llvm::Function *printfFunc = Function::Create(
-    printfType, GlobalVariable::ExternalLinkage, 
-    "printf", m.get());
+  // A library unit only holds declarations and function definitions.
+  if (!prog->hasImplicitMain) {
+    for (auto &stmt: prog->stmtVec) {
+      stmt->accept(this);
+    }
+    finalizeOpenMP();
+    emitMultiversions();
+    if (diBuilder) {
+      diBuilder->finalize();
+    }
+    return nullptr;
+  }
 
   llvm::FunctionType *mainType = FunctionType::get(builder.getInt32Ty(), false);
   llvm::Function *mainFunc = Function::Create(
       mainType, GlobalVariable::ExternalLinkage, 
-      "main", m.get());
+      replEntry.empty() ? "main" : replEntry, m.get());
+  setFPAttributes(mainFunc, builder.getFastMathFlags());
 
   currentFunction = mainFunc;
+  currentSubprogram = createSubprogram(mainFunc, 1, nullptr);
 
   llvm::BasicBlock *entryBB = BasicBlock::Create(context, "entry", mainFunc);
   builder.SetInsertPoint(entryBB);
   
 
   llvm::Value *finalValue = nullptr;
-  for (auto &expr: prog->stmtVec) {
-    llvm::Value *value = expr->accept(this);
-    finalValue = value;
+  for (size_t i = 0; i < prog->stmtVec.size(); ++i) {
+    ASTNode *stmt = prog->stmtVec[i].get();
+    // Statements run at compile time only leave their globals and functions
+    // behind for the rest, and nothing at all once the whole program ran.
+    if (i < evaluation.numStmts) {
+      if (evaluation.finished) {
+        continue;
+      }
+      if (auto *declStmt = llvm::dyn_cast<DeclStmt>(stmt)) {
+        declareEvaluatedGlobals(declStmt);
+      }
+      else if (llvm::isa<FunctionDecl>(stmt)) {
+        stmt->accept(this);
+      }
+      continue;
+    }
+    llvm::Value *value = stmt->accept(this);
+    // Function definitions are emitted aside and don't produce a value.
+    if (!llvm::isa<FunctionDecl>(stmt)) {
+      finalValue = value;
+    }
+  }
+  if (evaluation.printedTy) {
+    finalValue = getConstant(evaluation.printedTy,
+                             evaluation.printedValue.data());
   }
   
-  if (finalValue) {
-    // To avoid the ConstantFolder in builder by default.
-    (void)builder.CreateCall(printfFunc, {
-        builder.CreateGlobalString("Expr value = %d\n"),
-        finalValue
-    });
+  // The output and the return belong to the last statement.
+  std::optional<DebugLocScope> loc;
+  if (!prog->stmtVec.empty()) {
+    loc.emplace(this, prog->stmtVec.back().get());
   }
-  else {
-    llvm::outs() << "Last statement is not a expression statement\n";
+  // Only `int` and floating values are printed, not pointers or aggregates.
+  if (finalValue && (finalValue->getType()->isIntegerTy() ||
+                     finalValue->getType()->isFloatingPointTy())) {
+    emitPrintValue("Expr value = ", finalValue);
   }
-  
+  else if (replEntry.empty()) {
+    *os << "Last statement is not a expression statement\n";
+  }
+
+  // The runtime buffers the output until the program ends.
+  (void)builder.CreateCall(getRuntimeFunction("__tinycc_flush",
+                                              builder.getVoidTy(), {}));
   (void)builder.CreateRet(builder.getInt32(0));
 
+  if (MultiversionHot) {
+    multiversioned.push_back(
+        {mainFunc, {std::begin(HotTargets), std::end(HotTargets)}});
+  }
+  finalizeOpenMP();
+  emitMultiversions();
+  if (diBuilder) {
+    diBuilder->finalize();
+  }
   verifyFunction(*mainFunc);
-  m->print(llvm::outs(), nullptr);
+  if (replEntry.empty()) {
+    m->print(*os, nullptr);
+  }
+
+  return nullptr;
+}
+
+/// The globals of a statement run by -fcompile-time-eval start with the
+/// values it left.
+void CodegenVisitor::declareEvaluatedGlobals(DeclStmt *declStmt) {
+  for (auto &expr: declStmt->exprVec) {
+    auto *variableDecl = llvm::dyn_cast<VariableDecl>(expr.get());
+    if (!variableDecl) {
+      continue;
+    }
+    auto *globalVar =
+        llvm::cast<llvm::GlobalVariable>(visitVariableDecl(variableDecl));
+    globalVar->setInitializer(getConstant(
+        variableDecl->ty,
+        evaluation.globals[variableDecl->symbol.get()].data()));
+  }
+}
+
+/// The constant of type `ty` whose bytes are `bytes`, as the interpreter
+/// lays them out: like the C types, on a little-endian host.
+llvm::Constant *CodegenVisitor::getConstant(CType *ty, const uint8_t *bytes) {
+  switch (ty->getKind()) {
+  case TypeKind::Int: {
+    int32_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return builder.getInt32(value);
+  }
+  case TypeKind::Float: {
+    float value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return llvm::ConstantFP::get(builder.getFloatTy(), value);
+  }
+  case TypeKind::Double: {
+    double value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return llvm::ConstantFP::get(builder.getDoubleTy(), value);
+  }
+  case TypeKind::Array: {
+    auto *arrayTy = llvm::cast<CArrayType>(ty);
+    CType *elemTy = arrayTy->getElemTy();
+    std::vector<llvm::Constant *> elems;
+    for (size_t i = 0; i < arrayTy->getNumElems(); ++i) {
+      elems.push_back(getConstant(elemTy, bytes + i * elemTy->getSize()));
+    }
+    return llvm::ConstantArray::get(
+        llvm::cast<llvm::ArrayType>(getLLVMType(ty)), elems);
+  }
+  case TypeKind::Vector: {
+    auto *vectorTy = llvm::cast<CVectorType>(ty);
+    CType *elemTy = vectorTy->getElemTy();
+    std::vector<llvm::Constant *> elems;
+    for (size_t i = 0; i < vectorTy->getNumElems(); ++i) {
+      elems.push_back(getConstant(elemTy, bytes + i * elemTy->getSize()));
+    }
+    return llvm::ConstantVector::get(elems);
+  }
+  case TypeKind::Struct: {
+    // Padding elements stay zero.
+    auto *structTy = llvm::cast<CStructType>(ty);
+    llvm::StructType *llvmTy = getLLVMStructType(structTy);
+    std::vector<llvm::Constant *> elems;
+    for (llvm::Type *elemTy: llvmTy->elements()) {
+      elems.push_back(llvm::Constant::getNullValue(elemTy));
+    }
+    for (auto [field, elemIdx]:
+         llvm::zip(structTy->getFields(), fieldElemIndices[structTy])) {
+      elems[elemIdx] = getConstant(field.ty, bytes + field.offset);
+    }
+    return llvm::ConstantStruct::get(llvmTy, elems);
+  }
+  default:
+    llvm_unreachable("No constant of this type");
+  }
+}
+
+/// Declare a function of the tinycc runtime, see runtime/Runtime.c.
+llvm::FunctionCallee CodegenVisitor::getRuntimeFunction(
+    llvm::StringRef name, llvm::Type *retTy,
+    llvm::ArrayRef<llvm::Type *> paramTys) {
+  return m->getOrInsertFunction(
+      name, llvm::FunctionType::get(retTy, paramTys, false));
+}
+
+/// Print `label`, `value` and a newline with the typed print functions of
+/// the runtime. Floats are printed as doubles, like printf("%f") does.
+void CodegenVisitor::emitPrintValue(llvm::StringRef label,
+                                    llvm::Value *value) {
+  llvm::Type *i8Ptr = llvm::PointerType::get(builder.getInt8Ty(), 0);
+  (void)builder.CreateCall(
+      getRuntimeFunction("__tinycc_print_str", builder.getVoidTy(),
+                         {i8Ptr, builder.getInt32Ty()}),
+      {builder.CreateGlobalString(label), builder.getInt32(label.size())});
+
+  if (value->getType()->isFloatingPointTy()) {
+    value = builder.CreateFPExt(value, builder.getDoubleTy());
+    (void)builder.CreateCall(
+        getRuntimeFunction("__tinycc_print_f64", builder.getVoidTy(),
+                           builder.getDoubleTy()),
+        value);
+  }
+  else {
+    (void)builder.CreateCall(
+        getRuntimeFunction("__tinycc_print_i32", builder.getVoidTy(),
+                           builder.getInt32Ty()),
+        value);
+  }
+
+  (void)builder.CreateCall(
+      getRuntimeFunction("__tinycc_print_char", builder.getVoidTy(),
+                         builder.getInt32Ty()),
+      builder.getInt32('\n'));
+}
+
+llvm::Type *CodegenVisitor::getLLVMType(CType *ty) {
+  switch (ty->getKind()) {
+  case TypeKind::Int:
+    return builder.getInt32Ty();
+  case TypeKind::Float:
+    return builder.getFloatTy();
+  case TypeKind::Double:
+    return builder.getDoubleTy();
+  case TypeKind::Pointer:
+    return llvm::PointerType::get(
+        getLLVMType(llvm::cast<CPointerType>(ty)->getPointeeTy()), 0);
+  case TypeKind::Array: {
+    auto *arrayTy = llvm::cast<CArrayType>(ty);
+    return llvm::ArrayType::get(
+        getLLVMType(arrayTy->getElemTy()), arrayTy->getNumElems());
+  }
+  case TypeKind::Vector: {
+    auto *vectorTy = llvm::cast<CVectorType>(ty);
+    return llvm::FixedVectorType::get(
+        getLLVMType(vectorTy->getElemTy()), vectorTy->getNumElems());
+  }
+  case TypeKind::Struct:
+    return getLLVMStructType(llvm::cast<CStructType>(ty));
+  case TypeKind::Func: {
+    auto *funcTy = llvm::cast<CFuncType>(ty);
+    std::vector<llvm::Type *> paramTys;
+    for (CType *paramTy: funcTy->getParamTys()) {
+      paramTys.push_back(getLLVMType(paramTy));
+    }
+    return llvm::FunctionType::get(
+        getLLVMType(funcTy->getRetTy()), paramTys, false);
+  }
+  }
+  llvm_unreachable("Unknown type kind");
+}
+
+/// Lower a struct to a packed LLVM struct with explicit padding, so every
+/// field lands at the offset `CStructType` computed whatever the data layout.
+llvm::StructType *CodegenVisitor::getLLVMStructType(CStructType *structTy) {
+  if (llvm::StructType *llvmTy = structTys.lookup(structTy)) {
+    return llvmTy;
+  }
+
+  llvm::StringRef name = structTy->getStructName();
+  auto *llvmTy = llvm::StructType::create(
+      context, "struct." + (name.empty() ? "anon" : name.str()));
+  // Register it first, fields may point back to the struct.
+  structTys[structTy] = llvmTy;
+
+  std::vector<llvm::Type *> elemTys;
+  llvm::SmallVector<unsigned, 8> elemIndices;
+  size_t end = 0;
+  for (const CField &field: structTy->getFields()) {
+    if (field.offset > end) {
+      elemTys.push_back(llvm::ArrayType::get(builder.getInt8Ty(),
+                                             field.offset - end));
+    }
+    elemIndices.push_back(elemTys.size());
+    elemTys.push_back(getLLVMType(field.ty));
+    end = field.offset + field.ty->getSize();
+  }
+  if (structTy->getSize() > end) {
+    elemTys.push_back(llvm::ArrayType::get(builder.getInt8Ty(),
+                                           structTy->getSize() - end));
+  }
+
+  llvmTy->setBody(elemTys, /*isPacked=*/true);
+  fieldElemIndices[structTy] = elemIndices;
+  return llvmTy;
+}
+
+unsigned CodegenVisitor::getFieldElemIndex(MemberExpr *memberExpr) {
+  getLLVMStructType(memberExpr->structTy);
+  return fieldElemIndices[memberExpr->structTy][memberExpr->fieldIdx];
+}
+
+llvm::Align CodegenVisitor::getAlign(CType *ty) {
+  if (llvm::isa<CArrayType>(ty) && ty->getSize() >= ArrayAlign) {
+    return llvm::Align(std::max<size_t>(ArrayAlign, ty->getAlign()));
+  }
+  return llvm::Align(ty->getAlign());
+}
+
+/// Functions which are not exported can use the fast calling convention,
+/// the optimizer sees all of their callers.
+llvm::Function *CodegenVisitor::getOrCreateFunction(FunctionDecl *funcDecl) {
+  llvm::Function *func = m->getFunction(funcDecl->name);
+  if (!func) {
+    auto *funcTy = llvm::cast<llvm::FunctionType>(getLLVMType(funcDecl->ty));
+    func = llvm::Function::Create(
+        funcTy, llvm::GlobalValue::ExternalLinkage, funcDecl->name, m.get());
+  }
+
+  auto *funcTy = llvm::cast<CFuncType>(funcDecl->ty);
+  for (unsigned i = 0; i < funcTy->getParamTys().size(); ++i) {
+    auto *pointerTy = llvm::dyn_cast<CPointerType>(funcTy->getParamTys()[i]);
+    if (pointerTy && pointerTy->isRestrict()) {
+      func->addParamAttr(i, llvm::Attribute::NoAlias);
+    }
+  }
+
+  setFPAttributes(func, builder.getFastMathFlags());
+
+  // Later chunks of the REPL call the functions of earlier ones.
+  if (funcDecl->isStatic && replEntry.empty()) {
+    func->setLinkage(llvm::GlobalValue::InternalLinkage);
+    func->setCallingConv(llvm::CallingConv::Fast);
+  }
+
+  if (funcDecl->hasAttr("hot")) {
+    func->addFnAttr(llvm::Attribute::Hot);
+  }
+
+  if (funcDecl->hasAttr("noinline")) {
+    func->addFnAttr(llvm::Attribute::NoInline);
+  }
+  else if (funcDecl->hasAttr("always_inline")) {
+    func->addFnAttr(llvm::Attribute::AlwaysInline);
+  }
+  else if (funcDecl->isInline) {
+    func->addFnAttr(llvm::Attribute::InlineHint);
+  }
+
+  return func;
+}
+
+llvm::Value *CodegenVisitor::visitFunctionDecl(FunctionDecl *funcDecl) {
+  llvm::Function *func = getOrCreateFunction(funcDecl);
+  if (!funcDecl->body) {
+    return func;
+  }
+
+  // Function definitions may sit between statements of the implicit main.
+  llvm::IRBuilderBase::InsertPointGuard guard(builder);
+  llvm::Function *savedFunction = currentFunction;
+  FunctionDecl *savedFuncDecl = currentFuncDecl;
+  llvm::DISubprogram *savedSubprogram = currentSubprogram;
+  currentFunction = func;
+  currentFuncDecl = funcDecl;
+  currentSubprogram = createSubprogram(func, funcDecl->tok.row,
+                                       llvm::cast<CFuncType>(funcDecl->ty));
+  // The location of the enclosing statement is out of this scope.
+  builder.SetCurrentDebugLocation(llvm::DebugLoc());
+
+  llvm::BasicBlock *entryBB = BasicBlock::Create(context, "entry", func);
+  builder.SetInsertPoint(entryBB);
+
+  // Each restrict parameter gets an alias scope. Unlike `noalias` on the
+  // argument, the scopes survive when the function is inlined.
+  llvm::MDBuilder mdBuilder(context);
+  llvm::MDNode *domain = nullptr;
+  restrictScopes.clear();
+  for (auto [param, arg]: llvm::zip(funcDecl->params, func->args())) {
+    auto *paramDecl = llvm::cast<VariableDecl>(param.get());
+    arg.setName(paramDecl->tok.content);
+    llvm::Value *paramAddr = paramDecl->accept(this);
+    builder.CreateStore(&arg, paramAddr);
+
+    auto *pointerTy = llvm::dyn_cast<CPointerType>(paramDecl->ty);
+    if (pointerTy && pointerTy->isRestrict()) {
+      if (!domain) {
+        domain = mdBuilder.createAnonymousAliasScopeDomain(funcDecl->name);
+      }
+      restrictScopes.push_back({
+          paramDecl->symbol.get(),
+          mdBuilder.createAnonymousAliasScope(domain, paramDecl->tok.content)});
+    }
+  }
+
+  funcDecl->body->accept(this);
+  restrictScopes.clear();
+
+  // Falling off the end returns 0, as C requires for `main`.
+  if (!builder.GetInsertBlock()->getTerminator()) {
+    builder.CreateRet(llvm::Constant::getNullValue(func->getReturnType()));
+  }
+
+  verifyFunction(*func);
+  if (!funcDecl->targetClones.empty()) {
+    multiversioned.push_back({func, funcDecl->targetClones});
+  }
+  else if (MultiversionHot && funcDecl->hasAttr("hot")) {
+    multiversioned.push_back(
+        {func, {std::begin(HotTargets), std::end(HotTargets)}});
+  }
+  currentFunction = savedFunction;
+  currentFuncDecl = savedFuncDecl;
+  currentSubprogram = savedSubprogram;
+
+  return func;
+}
+
+llvm::Value *CodegenVisitor::visitReturnStmt(ReturnStmt *returnStmt) {
+  DebugLocScope loc(this, returnStmt);
+  llvm::Value *value = llvm::Constant::getNullValue(currentFunction->getReturnType());
+  if (returnStmt->expr) {
+    value = returnStmt->expr->accept(this);
+  }
+
+  // A call right before the return is a tail call. Self recursion has the
+  // same prototype on both sides, so it can be guaranteed with `musttail`
+  // and deep recursion runs in constant stack. Neither holds once a pointer
+  // into the frame may reach the callee, directly or through memory.
+  auto *callInst = llvm::dyn_cast<llvm::CallInst>(value);
+  if (callInst && !currentFuncDecl->frameAddressTaken) {
+    auto *callExpr = llvm::dyn_cast<CallExpr>(returnStmt->expr.get());
+    if (callExpr && callInst->getCalledFunction() == currentFunction &&
+        callExpr->calleeDecl->symbol == currentFuncDecl->symbol) {
+      callInst->setTailCallKind(llvm::CallInst::TCK_MustTail);
+    }
+    else if (callExpr) {
+      callInst->setTailCallKind(llvm::CallInst::TCK_Tail);
+    }
+  }
+  builder.CreateRet(value);
+
+  auto deathBB = llvm::BasicBlock::Create(context, "return.death", currentFunction);
+  builder.SetInsertPoint(deathBB);
 
   return nullptr;
 }
@@ -77,15 +1032,84 @@ llvm::Value *CodegenVisitor::visitBlockStmt(BlockStmt *blockStmt) {
 }
 
 llvm::Value *CodegenVisitor::visitDeclStmt(DeclStmt *declStmt) {
-  llvm::Value *lastValue;
+  // Empty if the statement only declares a struct.
+  llvm::Value *lastValue = nullptr;
   for (auto &expr: declStmt->exprVec) {
+    // Literal initializers of global variables don't need code in main.
+    auto *assignExpr = llvm::dyn_cast<AssignExpr>(expr.get());
+    if (assignExpr && isLiteralExpr(assignExpr->rhs.get())) {
+      auto *varExpr = llvm::cast<VariableExpr>(assignExpr->lhs.get());
+      if (auto *globalVar = llvm::dyn_cast<llvm::GlobalVariable>(
+              varAddrMap[varExpr->symbol.get()])) {
+        lastValue = assignExpr->rhs->accept(this);
+        globalVar->setInitializer(llvm::cast<llvm::Constant>(lastValue));
+        continue;
+      }
+    }
+
     lastValue = expr->accept(this);
+    // A declaration without an initializer has no value, just storage.
+    if (llvm::isa<VariableDecl>(expr.get())) {
+      lastValue = nullptr;
+    }
   }
 
   return lastValue;
 }
 
+/// Turn `if (c) x = a; else x = b;` into `x = c ? a : b` with a select, so
+/// data dependent conditions don't cost a branch misprediction.
+bool CodegenVisitor::tryIfConversion(IfStmt *ifStmt) {
+  AssignExpr *thenAssign = getSingleAssignExpr(ifStmt->thenBody.get());
+  if (!thenAssign || !llvm::isa<VariableExpr>(thenAssign->lhs.get())) {
+    return false;
+  }
+
+  AssignExpr *elseAssign = nullptr;
+  if (ifStmt->elseBody) {
+    elseAssign = getSingleAssignExpr(ifStmt->elseBody.get());
+    if (!elseAssign || !llvm::isa<VariableExpr>(elseAssign->lhs.get())) {
+      return false;
+    }
+  }
+
+  auto *varExpr = llvm::cast<VariableExpr>(thenAssign->lhs.get());
+  ASTNode *elseValue = varExpr; // `if (c) x = a;` keeps the old value of x.
+  if (elseAssign) {
+    if (llvm::cast<VariableExpr>(elseAssign->lhs.get())->symbol != varExpr->symbol) {
+      return false;
+    }
+    elseValue = elseAssign->rhs.get();
+  }
+
+  // Storing to a global unconditionally could race with other threads.
+  if (!elseAssign && (varExpr->symbol->getKind() != SymbolKind::LocalVariable ||
+                      varExpr->symbol->isAddressTaken())) {
+    return false;
+  }
+
+  int thenCost = getSpeculationCost(thenAssign->rhs.get());
+  int elseCost = getSpeculationCost(elseValue);
+  if (thenCost < 0 || elseCost < 0 ||
+      unsigned(thenCost + elseCost) > IfConversionThreshold) {
+    return false;
+  }
+
+  llvm::Value *condVal = emitCondition(ifStmt->condExpr.get());
+  llvm::Value *thenVal = thenAssign->rhs->accept(this);
+  llvm::Value *elseVal = elseValue->accept(this);
+  llvm::Value *selectVal = builder.CreateSelect(condVal, thenVal, elseVal, "if.sel");
+  emitStore(selectVal, varExpr);
+
+  return true;
+}
+
 llvm::Value *CodegenVisitor::visitIfStmt(IfStmt *ifStmt) {
+  DebugLocScope loc(this, ifStmt);
+  if (tryIfConversion(ifStmt)) {
+    return nullptr;
+  }
+
   llvm::BasicBlock *condBB = llvm::BasicBlock::Create(context, "if.cond", currentFunction);
   llvm::BasicBlock *thenBB = llvm::BasicBlock::Create(context, "if.then", currentFunction);
   llvm::BasicBlock *elseBB = nullptr;
@@ -97,8 +1121,7 @@ llvm::Value *CodegenVisitor::visitIfStmt(IfStmt *ifStmt) {
   builder.CreateBr(condBB);
 
   builder.SetInsertPoint(condBB);
-  llvm::Value *val = ifStmt->condExpr->accept(this);
-  llvm::Value *condVal = builder.CreateICmpNE(val, builder.getInt32(0));
+  llvm::Value *condVal = emitCondition(ifStmt->condExpr.get());
   
   if (ifStmt->elseBody) {
     builder.CreateCondBr(condVal, thenBB, elseBB);
@@ -111,7 +1134,7 @@ llvm::Value *CodegenVisitor::visitIfStmt(IfStmt *ifStmt) {
     builder.CreateBr(lastBB); 
   }
   else {
-    builder.CreateCondBr(condBB, thenBB, lastBB);
+    builder.CreateCondBr(condVal, thenBB, lastBB);
 
     builder.SetInsertPoint(thenBB);
     ifStmt->thenBody->accept(this);
@@ -124,6 +1147,12 @@ llvm::Value *CodegenVisitor::visitIfStmt(IfStmt *ifStmt) {
 }
 
 llvm::Value *CodegenVisitor::visitForStmt(ForStmt *forStmt) {
+  DebugLocScope loc(this, forStmt);
+  if (forStmt->omp) {
+    emitOmpParallelFor(forStmt);
+    return nullptr;
+  }
+
   auto initBB = llvm::BasicBlock::Create(context, "for.init", currentFunction);
   auto condBB = llvm::BasicBlock::Create(context, "for.cond", currentFunction);
   auto incBB = llvm::BasicBlock::Create(context, "for.inc", currentFunction);
@@ -135,15 +1164,17 @@ llvm::Value *CodegenVisitor::visitForStmt(ForStmt *forStmt) {
 
   builder.CreateBr(initBB);
   builder.SetInsertPoint(initBB);
-  if (forStmt->initExpr) {
+  if (forStmt->initExpr && forStmt != entryLoop) {
     forStmt->initExpr->accept(this);
   }
+  if (BoundsCheck) {
+    eliminateBoundsChecks(forStmt);
+  }
   builder.CreateBr(condBB);
   
   builder.SetInsertPoint(condBB);
   if (forStmt->condExpr) {
-    llvm::Value *val = forStmt->condExpr->accept(this);
-    llvm::Value *condVal = builder.CreateICmpNE(val, builder.getInt32(0));
+    llvm::Value *condVal = emitCondition(forStmt->condExpr.get());
     builder.CreateCondBr(condVal, bodyBB, lastBB);
   }
   else {
@@ -160,7 +1191,15 @@ llvm::Value *CodegenVisitor::visitForStmt(ForStmt *forStmt) {
   if (forStmt->incExpr) {
     forStmt->incExpr->accept(this);
   }
-  builder.CreateBr(condBB);
+  llvm::BranchInst *latch = builder.CreateBr(condBB);
+  // Loop passes report remarks at the location in the loop ID, which stays
+  // when the header loses the instructions of the condition.
+  if (currentSubprogram) {
+    llvm::MDNode *loopID = llvm::MDNode::getDistinct(
+        context, {nullptr, builder.getCurrentDebugLocation().get()});
+    loopID->replaceOperandWith(0, loopID);
+    latch->setMetadata(llvm::LLVMContext::MD_loop, loopID);
+  }
 
   builder.SetInsertPoint(lastBB);
 
@@ -170,7 +1209,315 @@ llvm::Value *CodegenVisitor::visitForStmt(ForStmt *forStmt) {
   return nullptr;
 }
 
+/// Split the block of an OpenMPIRBuilder callback at `ip` so the callback
+/// can emit any control flow, and return the block it has to end in.
+llvm::BasicBlock *CodegenVisitor::beginCallbackBody(
+    llvm::IRBuilderBase::InsertPoint ip) {
+  llvm::BasicBlock *bodyBB = ip.getBlock();
+  llvm::BasicBlock *contBB = bodyBB->splitBasicBlock(ip.getPoint(),
+                                                     bodyBB->getName() + ".cont");
+  bodyBB->getTerminator()->eraseFromParent();
+  builder.SetInsertPoint(bodyBB);
+  return contBB;
+}
+
+/// Lower `#pragma omp parallel for` with OpenMPIRBuilder. The loop becomes a
+/// canonical loop workshared among the threads of a parallel region, which
+/// finalizeOpenMP() outlines into a function for `__kmpc_fork_call`. Other
+/// variables are shared and captured by address, while the induction
+/// variable and the reduction variables are private to each thread.
+void CodegenVisitor::emitOmpParallelFor(ForStmt *forStmt) {
+  using InsertPointTy = llvm::OpenMPIRBuilder::InsertPointTy;
+  OmpParallelFor *omp = forStmt->omp.get();
+  if (!ompBuilder) {
+    ompBuilder = std::make_unique<llvm::OpenMPIRBuilder>(*m);
+    ompBuilder->initialize();
+  }
+
+  // The bounds and clauses are evaluated once, before the threads start.
+  if (forStmt->initExpr) {
+    forStmt->initExpr->accept(this);
+  }
+  Symbol *iv = omp->iv.get();
+  llvm::Value *start = builder.CreateLoad(builder.getInt32Ty(), varAddrMap[iv],
+                                          "omp.lb");
+  llvm::Value *stop = omp->upper->accept(this);
+  llvm::Value *chunk = omp->chunk ? omp->chunk->accept(this) : nullptr;
+  llvm::Value *numThreads =
+      omp->numThreads ? omp->numThreads->accept(this) : nullptr;
+
+  llvm::BasicBlock &entryBB = currentFunction->getEntryBlock();
+  InsertPointTy outerAllocaIP(&entryBB, entryBB.getFirstInsertionPt());
+  llvm::DenseMap<Symbol *, llvm::Value *> sharedAddrs;
+
+  auto loopBodyGenCB = [&](InsertPointTy codeGenIP, llvm::Value *ivValue) {
+    llvm::BasicBlock *contBB = beginCallbackBody(codeGenIP);
+    builder.CreateStore(ivValue, varAddrMap[iv]);
+
+    continueBBs[forStmt] = contBB;
+    if (forStmt->forBody) {
+      forStmt->forBody->accept(this);
+    }
+    builder.CreateBr(contBB);
+    continueBBs.erase(forStmt);
+  };
+
+  auto bodyGenCB = [&](InsertPointTy allocaIP, InsertPointTy codeGenIP
+#if LLVM_VERSION_MAJOR < 15
+                       , llvm::BasicBlock &
+#endif
+                       ) {
+    llvm::BasicBlock *exitBB = beginCallbackBody(codeGenIP);
+    // Blocks of enclosing statements that aren't linked yet, such as the
+    // increment of an outer `for`, look dead too.
+    llvm::SmallPtrSet<llvm::BasicBlock *, 16> outerBlocks;
+    for (llvm::BasicBlock &bb: *currentFunction) {
+      outerBlocks.insert(&bb);
+    }
+
+    // Each thread gets its own induction variable, and sums the reduction
+    // variables into copies starting from 0.
+    llvm::IRBuilder<> allocaBuilder(allocaIP.getBlock(), allocaIP.getPoint());
+    std::vector<Symbol *> privateSymbols = {iv};
+    for (auto &symbol: omp->reductions) {
+      privateSymbols.push_back(symbol.get());
+    }
+    for (Symbol *symbol: privateSymbols) {
+      llvm::Type *ty = getLLVMType(symbol->getTy());
+      sharedAddrs[symbol] = varAddrMap[symbol];
+      varAddrMap[symbol] = allocaBuilder.CreateAlloca(ty, nullptr,
+                                                      symbol->getName());
+      if (symbol != iv) {
+        builder.CreateStore(llvm::Constant::getNullValue(ty),
+                            varAddrMap[symbol]);
+      }
+    }
+
+    llvm::CanonicalLoopInfo *loopInfo = ompBuilder->createCanonicalLoop(
+        builder, loopBodyGenCB, start, stop, builder.getInt32(omp->step),
+        /*IsSigned=*/true, omp->isInclusive);
+
+    // No barrier, the end of the parallel region waits for all threads.
+    llvm::DebugLoc loc = builder.getCurrentDebugLocation();
+#if LLVM_VERSION_MAJOR >= 15
+    InsertPointTy afterIP = ompBuilder->applyWorkshareLoop(
+        loc, loopInfo, allocaIP, /*NeedsBarrier=*/false,
+        omp->schedule == OmpSchedule::Dynamic ? llvm::omp::OMP_SCHEDULE_Dynamic
+                                              : llvm::omp::OMP_SCHEDULE_Static,
+        chunk);
+#else
+    InsertPointTy afterIP = omp->schedule == OmpSchedule::Dynamic ?
+        ompBuilder->applyDynamicWorkshareLoop(
+            loc, loopInfo, allocaIP, llvm::omp::OMPScheduleType::DynamicChunked,
+            /*NeedsBarrier=*/false, chunk) :
+        ompBuilder->applyStaticWorkshareLoop(
+            loc, loopInfo, allocaIP, /*NeedsBarrier=*/false, chunk);
+#endif
+    builder.restoreIP(afterIP);
+
+    // Add the partial sums of this thread to the shared variables.
+    for (auto &symbol: omp->reductions) {
+      CType *ty = symbol->getTy();
+      llvm::Value *partial = builder.CreateLoad(
+          getLLVMType(ty), varAddrMap[symbol.get()], symbol->getName() + ".partial");
+      builder.CreateAtomicRMW(ty->isFloating() ? llvm::AtomicRMWInst::FAdd
+                                               : llvm::AtomicRMWInst::Add,
+                              sharedAddrs[symbol.get()], partial,
+                              llvm::MaybeAlign(ty->getAlign()),
+                              llvm::AtomicOrdering::Monotonic);
+    }
+    builder.CreateBr(exitBB);
+
+    // The region is outlined from the blocks reachable from its entry, so
+    // blocks left dead by `break` and `continue` must not reach into it.
+    llvm::df_iterator_default_set<llvm::BasicBlock *> reachable;
+    for (llvm::BasicBlock *bb:
+         llvm::depth_first_ext(&currentFunction->getEntryBlock(), reachable)) {
+      (void)bb;
+    }
+    llvm::SmallVector<llvm::BasicBlock *, 8> deadBlocks;
+    for (llvm::BasicBlock &bb: *currentFunction) {
+      if (!outerBlocks.count(&bb) && !reachable.count(&bb)) {
+        deadBlocks.push_back(&bb);
+      }
+    }
+    llvm::DeleteDeadBlocks(deadBlocks);
+
+    for (Symbol *symbol: privateSymbols) {
+      varAddrMap[symbol] = sharedAddrs[symbol];
+    }
+  };
+
+  // Every variable is shared, the body refers to the original.
+  auto privCB = [](InsertPointTy allocaIP, InsertPointTy codeGenIP,
+                   llvm::Value &orig, llvm::Value &inner,
+                   llvm::Value *&replacement) {
+    replacement = &inner;
+    return codeGenIP;
+  };
+  auto finiCB = [](InsertPointTy) {};
+
+  builder.restoreIP(ompBuilder->createParallel(
+      builder, outerAllocaIP, bodyGenCB, privCB, finiCB,
+      /*IfCondition=*/nullptr, numThreads, llvm::omp::OMP_PROC_BIND_default,
+      /*IsCancellable=*/false));
+}
+
+/// Outline the parallel regions into their own functions.
+void CodegenVisitor::finalizeOpenMP() {
+  if (!ompBuilder) {
+    return;
+  }
+  ompBuilder->finalize();
+}
+
+/// The CPU features of `target_clones`, from the least to the most capable.
+static const char *const CPUFeatures[] = {
+#define CPU_FEATURE(NAME) NAME,
+#include "CPUFeature.h.inc"
+};
+
+/// Clone the functions with `target_clones` once their code is final, after
+/// the parallel regions are outlined.
+void CodegenVisitor::emitMultiversions() {
+  for (auto &[func, targets]: multiversioned) {
+    emitTargetClones(func, targets);
+  }
+  multiversioned.clear();
+}
+
+/// Turn `func` into an ifunc, whose resolver picks the clone for the most
+/// capable target the CPU supports when the program is loaded. Each clone
+/// is compiled with the features of its target, and the original function
+/// is the default.
+void CodegenVisitor::emitTargetClones(llvm::Function *func,
+                                      llvm::ArrayRef<llvm::StringRef> targets) {
+  std::string name = func->getName().str();
+  func->setName(name + ".default");
+
+  llvm::Function *resolver = llvm::Function::Create(
+      llvm::FunctionType::get(func->getType(), false),
+      llvm::GlobalValue::InternalLinkage, name + ".resolver", m.get());
+  llvm::GlobalIFunc *ifunc = llvm::GlobalIFunc::create(
+      func->getFunctionType(), func->getAddressSpace(), func->getLinkage(),
+      name, resolver, m.get());
+  // Calls, recursive ones included, all go through the resolver.
+  func->replaceAllUsesWith(ifunc);
+  func->setLinkage(llvm::GlobalValue::InternalLinkage);
+
+  llvm::IRBuilder<> resolverBuilder(
+      llvm::BasicBlock::Create(context, "entry", resolver));
+  llvm::FunctionCallee cpuSupports = getRuntimeFunction(
+      "__tinycc_cpu_supports", builder.getInt32Ty(),
+      llvm::PointerType::get(builder.getInt8Ty(), 0));
+  for (llvm::StringRef feature: llvm::reverse(CPUFeatures)) {
+    if (!llvm::is_contained(targets, feature)) {
+      continue;
+    }
+
+    llvm::ValueToValueMapTy vmap;
+    llvm::Function *clone = llvm::CloneFunction(func, vmap);
+    clone->setName(name + "." + feature);
+    std::string features = "+" + feature.str();
+    if (func->hasFnAttribute("target-features")) {
+      features = func->getFnAttribute("target-features")
+                     .getValueAsString().str() + "," + features;
+    }
+    clone->addFnAttr("target-features", features);
+
+    llvm::Value *isSupported = resolverBuilder.CreateICmpNE(
+        resolverBuilder.CreateCall(
+            cpuSupports, resolverBuilder.CreateGlobalString(feature)),
+        resolverBuilder.getInt32(0));
+    auto cloneBB = llvm::BasicBlock::Create(context, "resolve." + feature,
+                                            resolver);
+    auto nextBB = llvm::BasicBlock::Create(context, "resolve.next", resolver);
+    resolverBuilder.CreateCondBr(isSupported, cloneBB, nextBB);
+    resolverBuilder.SetInsertPoint(cloneBB);
+    resolverBuilder.CreateRet(clone);
+    resolverBuilder.SetInsertPoint(nextBB);
+  }
+  resolverBuilder.CreateRet(func);
+}
+
+/// Prove subscripts by the induction variable of `forStmt` in bounds from
+/// its range. If the upper bound is only known at run time, subscripts that
+/// run on every iteration are checked once before the loop instead; the trap
+/// then fires before the first iteration rather than in the failing one.
+void CodegenVisitor::eliminateBoundsChecks(ForStmt *forStmt) {
+  LoopBodyInfo info;
+  scanLoopBody(forStmt->forBody.get(), forStmt, false, info);
+
+  InductionRange range;
+  if (!getInductionRange(forStmt, info, range)) {
+    return;
+  }
+
+  auto *upperNum = llvm::dyn_cast<NumberExpr>(range.upper);
+  // One past the largest value of i, if it is a literal.
+  int64_t upperEnd = upperNum ? upperNum->number + range.isInclusive : 0;
+  // The largest `offset - size` over hoisted subscripts `a[i + offset]`.
+  std::optional<int64_t> maxExcess;
+  for (auto [subscriptExpr, isUnconditional]: info.subscripts) {
+    int64_t offset = 0;
+    if (!getOffsetFrom(subscriptExpr->index.get(), range.iv, offset) ||
+        range.lower + offset < 0) {
+      continue;
+    }
+
+    auto *arrayTy = llvm::dyn_cast<CArrayType>(subscriptExpr->base->ty);
+    if (!arrayTy) {
+      continue;
+    }
+
+    int64_t size = arrayTy->getNumElems();
+    if (upperNum) {
+      if (upperEnd - 1 + offset < size) {
+        checkedSubscripts.insert(subscriptExpr);
+      }
+    }
+    else if (isUnconditional && !info.hasEarlyExit) {
+      maxExcess = std::max(maxExcess.value_or(INT64_MIN), offset - size);
+      checkedSubscripts.insert(subscriptExpr);
+    }
+  }
+
+  if (!maxExcess) {
+    return;
+  }
+
+  // The loop runs iff lower < upper, and then accesses index
+  // `upper - 1 + offset`, which must be below `size`.
+  llvm::Value *upper = builder.CreateSExt(
+      range.upper->accept(this), builder.getInt64Ty(), "upper");
+  if (range.isInclusive) {
+    upper = builder.CreateNSWAdd(upper, builder.getInt64(1));
+  }
+  llvm::Value *isSkipped = builder.CreateICmpSLE(
+      upper, builder.getInt64(range.lower), "loop.skipped");
+  llvm::Value *fits = builder.CreateICmpSLE(
+      builder.CreateNSWAdd(upper, builder.getInt64(*maxExcess)),
+      builder.getInt64(0), "loop.fits");
+  emitBoundsCheck(builder.CreateOr(isSkipped, fits));
+}
+
+void CodegenVisitor::emitBoundsCheck(llvm::Value *inBounds) {
+  auto contBB = llvm::BasicBlock::Create(context, "bounds.cont", currentFunction);
+  auto trapBB = llvm::BasicBlock::Create(context, "bounds.trap", currentFunction);
+
+  llvm::MDBuilder mdBuilder(context);
+  builder.CreateCondBr(inBounds, contBB, trapBB,
+                       mdBuilder.createBranchWeights(1 << 20, 1));
+
+  builder.SetInsertPoint(trapBB);
+  builder.CreateCall(llvm::Intrinsic::getDeclaration(m.get(), llvm::Intrinsic::trap));
+  builder.CreateUnreachable();
+
+  builder.SetInsertPoint(contBB);
+}
+
 llvm::Value *CodegenVisitor::visitBreakStmt(BreakStmt *breakStmt) {
+  DebugLocScope loc(this, breakStmt);
   auto targetBB = breakBBs[breakStmt->target.get()];
   builder.CreateBr(targetBB);
 
@@ -181,6 +1528,7 @@ llvm::Value *CodegenVisitor::visitBreakStmt(BreakStmt *breakStmt) {
 }
 
 llvm::Value *CodegenVisitor::visitContinueStmt(ContinueStmt *continueStmt) {
+  DebugLocScope loc(this, continueStmt);
   auto targetBB = continueBBs[continueStmt->target.get()];
   builder.CreateBr(targetBB);
 
@@ -191,70 +1539,349 @@ llvm::Value *CodegenVisitor::visitContinueStmt(ContinueStmt *continueStmt) {
 }
 
 llvm::Value *CodegenVisitor::visitBinaryExpr(BinaryExpr *binaryExpr) {
+  DebugLocScope loc(this, binaryExpr);
   auto lhs = binaryExpr->lhs->accept(this);
   auto rhs = binaryExpr->rhs->accept(this);
   llvm::Value *value;
 
+  bool isPointerOp = llvm::isa<CPointerType>(binaryExpr->lhs->ty) ||
+                     llvm::isa<CPointerType>(binaryExpr->rhs->ty);
+  if (isPointerOp &&
+      (binaryExpr->op == OpCode::add || binaryExpr->op == OpCode::sub)) {
+    return emitPointerArithmetic(binaryExpr, lhs, rhs);
+  }
+  // Vectors are handled element-wise by the same instructions as scalars.
+  if (binaryExpr->lhs->ty->getScalarTy()->isFloating()) {
+    return emitFloatingBinaryOp(binaryExpr->op, lhs, rhs);
+  }
+
+  // Signed overflow is undefined, so arithmetic is always `nsw`. The value
+  // ranges of the operands tell when it doesn't wrap unsigned either, and
+  // when signed division works like unsigned division.
+  ValueRange lhsRange = ranges.getRange(binaryExpr->lhs.get());
+  ValueRange rhsRange = ranges.getRange(binaryExpr->rhs.get());
+  bool isNonNegative = lhsRange.isNonNegative() && rhsRange.isNonNegative();
+  bool isPositiveDivisor = rhsRange.lo > 0;
+
   switch (binaryExpr->op) {
   case OpCode::add:
-    value = builder.CreateNSWAdd(lhs, rhs);
+    value = builder.CreateAdd(lhs, rhs, "", isNonNegative, true);
     break;
   case OpCode::sub:
-    value = builder.CreateNSWSub(lhs, rhs);
+    value = builder.CreateSub(lhs, rhs, "",
+                              isNonNegative && lhsRange.lo >= rhsRange.hi,
+                              true);
     break;
   case OpCode::mul:
-    value = builder.CreateNSWMul(lhs, rhs);
+    // Multiplying by a power of two is a shift, even without optimization.
+    if (int log2 = getPowerOf2Log2(rhs); log2 >= 0) {
+      value = builder.CreateShl(lhs, log2, "", isNonNegative, true);
+    }
+    else if (int log2 = getPowerOf2Log2(lhs); log2 >= 0) {
+      value = builder.CreateShl(rhs, log2, "", isNonNegative, true);
+    }
+    else {
+      value = builder.CreateMul(lhs, rhs, "", isNonNegative, true);
+    }
     break;
   case OpCode::div:
-    value = builder.CreateSDiv(lhs, rhs);
+    if (int log2 = getPowerOf2Log2(rhs); log2 >= 0) {
+      // A multiple of the divisor, or a dividend that can't round towards
+      // zero differently, is just shifted.
+      bool isExact = lhsRange.trailingZeros >= unsigned(log2);
+      if (isExact || lhsRange.isNonNegative()) {
+        value = builder.CreateAShr(lhs, log2, "", isExact);
+      }
+      else {
+        value = emitSDivByPowerOf2(builder, lhs, log2);
+      }
+    }
+    else if (lhsRange.isNonNegative() && isPositiveDivisor) {
+      value = builder.CreateUDiv(lhs, rhs);
+    }
+    else {
+      value = builder.CreateSDiv(lhs, rhs);
+    }
     break; 
+  case OpCode::mod:
+    if (int log2 = getPowerOf2Log2(rhs); log2 >= 0) {
+      if (lhsRange.isNonNegative()) {
+        value = builder.CreateAnd(lhs, (1u << log2) - 1);
+      }
+      else {
+        value = emitSRemByPowerOf2(builder, lhs, log2);
+      }
+    }
+    else if (lhsRange.isNonNegative() && isPositiveDivisor) {
+      value = builder.CreateURem(lhs, rhs);
+    }
+    else {
+      value = builder.CreateSRem(lhs, rhs);
+    }
+    break;
+  case OpCode::bitwiseand:
+    value = builder.CreateAnd(lhs, rhs);
+    break;
+  case OpCode::bitwiseor:
+    value = builder.CreateOr(lhs, rhs);
+    break;
+  case OpCode::bitwisexor:
+    value = builder.CreateXor(lhs, rhs);
+    break;
+  case OpCode::shl: {
+    // Without overflow, the analysis knows the range of the result.
+    bool noWrap = lhsRange.isNonNegative() &&
+                  !ranges.getRange(binaryExpr).isFull();
+    value = builder.CreateShl(lhs, rhs, "", noWrap, noWrap);
+    break;
+  }
+  case OpCode::shr:
+    value = builder.CreateAShr(
+        lhs, rhs, "",
+        rhsRange.lo == rhsRange.hi && rhsRange.lo >= 0 &&
+        lhsRange.trailingZeros >= rhsRange.hi);
+    break;
   case OpCode::equalequal:
     value = builder.CreateICmpEQ(lhs, rhs);
-    value = builder.CreateIntCast(value, builder.getInt32Ty(), true);
+    value = emitCompareResult(value, lhsRange, rhsRange);
     break;
   case OpCode::notequal:
     value = builder.CreateICmpNE(lhs, rhs);
-    value = builder.CreateIntCast(value, builder.getInt32Ty(), true);
+    value = emitCompareResult(value, lhsRange, rhsRange);
     break;
   case OpCode::less:
-    value = builder.CreateICmpSLT(lhs, rhs);
-    value = builder.CreateIntCast(value, builder.getInt32Ty(), true);
+    value = isPointerOp ? builder.CreateICmpULT(lhs, rhs)
+                        : builder.CreateICmpSLT(lhs, rhs);
+    value = emitCompareResult(value, lhsRange, rhsRange);
     break;
   case OpCode::lesseq:
-    value = builder.CreateICmpSLE(lhs, rhs);
-    value = builder.CreateIntCast(value, builder.getInt32Ty(), true);
+    value = isPointerOp ? builder.CreateICmpULE(lhs, rhs)
+                        : builder.CreateICmpSLE(lhs, rhs);
+    value = emitCompareResult(value, lhsRange, rhsRange);
     break;
   case OpCode::greater:
-    value = builder.CreateICmpSGT(lhs, rhs);
-    value = builder.CreateIntCast(value, builder.getInt32Ty(), true);
+    value = isPointerOp ? builder.CreateICmpUGT(lhs, rhs)
+                        : builder.CreateICmpSGT(lhs, rhs);
+    value = emitCompareResult(value, lhsRange, rhsRange);
     break;
   case OpCode::greatereq:
-    value = builder.CreateICmpSGE(lhs, rhs);
-    value = builder.CreateIntCast(value, builder.getInt32Ty(), true);
+    value = isPointerOp ? builder.CreateICmpUGE(lhs, rhs)
+                        : builder.CreateICmpSGE(lhs, rhs);
+    value = emitCompareResult(value, lhsRange, rhsRange);
     break;
+  default:
+    llvm_unreachable("Unexpected binary operator");
   }
 
   return value;
 }
 
+/// Pointer arithmetic counts in elements of the pointee type.
+llvm::Value *CodegenVisitor::emitPointerArithmetic(BinaryExpr *binaryExpr,
+                                                   llvm::Value *lhs,
+                                                   llvm::Value *rhs) {
+  CType *lhsTy = binaryExpr->lhs->ty;
+  CType *rhsTy = binaryExpr->rhs->ty;
+  if (llvm::isa<CPointerType>(lhsTy) && llvm::isa<CPointerType>(rhsTy)) {
+    llvm::Type *elemTy = getLLVMType(llvm::cast<CPointerType>(lhsTy)->getPointeeTy());
+    llvm::Value *diff = builder.CreatePtrDiff(elemTy, lhs, rhs, "sub.ptr");
+    return builder.CreateTrunc(diff, builder.getInt32Ty());
+  }
+
+  // `n + p` is `p + n`.
+  if (llvm::isa<CPointerType>(rhsTy)) {
+    std::swap(lhs, rhs);
+    std::swap(lhsTy, rhsTy);
+  }
+  llvm::Value *index = builder.CreateSExt(rhs, builder.getInt64Ty(), "idx.ext");
+  if (binaryExpr->op == OpCode::sub) {
+    index = builder.CreateNeg(index, "idx.neg");
+  }
+
+  llvm::Type *elemTy = getLLVMType(llvm::cast<CPointerType>(lhsTy)->getPointeeTy());
+  return builder.CreateInBoundsGEP(elemTy, lhs, index, "add.ptr");
+}
+
+/// The operands have the same floating type. The builder adds the fast-math
+/// flags, which let `fadd` and `fmul` chains be reassociated and vectorized.
+llvm::Value *CodegenVisitor::emitFloatingBinaryOp(OpCode op, llvm::Value *lhs,
+                                                  llvm::Value *rhs) {
+  llvm::Value *value;
+  switch (op) {
+  case OpCode::add:
+    return builder.CreateFAdd(lhs, rhs);
+  case OpCode::sub:
+    return builder.CreateFSub(lhs, rhs);
+  case OpCode::mul:
+    return builder.CreateFMul(lhs, rhs);
+  case OpCode::div:
+    return builder.CreateFDiv(lhs, rhs);
+  // Ordered comparisons are false for NaN, except `!=`.
+  case OpCode::equalequal:
+    value = builder.CreateFCmpOEQ(lhs, rhs);
+    break;
+  case OpCode::notequal:
+    value = builder.CreateFCmpUNE(lhs, rhs);
+    break;
+  case OpCode::less:
+    value = builder.CreateFCmpOLT(lhs, rhs);
+    break;
+  case OpCode::lesseq:
+    value = builder.CreateFCmpOLE(lhs, rhs);
+    break;
+  case OpCode::greater:
+    value = builder.CreateFCmpOGT(lhs, rhs);
+    break;
+  case OpCode::greatereq:
+    value = builder.CreateFCmpOGE(lhs, rhs);
+    break;
+  default:
+    llvm_unreachable("Unexpected floating binary operator");
+  }
+
+  return emitCompareResult(value);
+}
+
+/// Comparisons give 1 or 0, and on vectors -1 or 0 in each element like
+/// GCC, so the result can be used as a mask. Operands known to have the
+/// same sign make an integer comparison `samesign`, so InstCombine may use
+/// either a signed or an unsigned predicate.
+llvm::Value *CodegenVisitor::emitCompareResult(llvm::Value *cmp,
+                                               const ValueRange &lhsRange,
+                                               const ValueRange &rhsRange) {
+#if LLVM_VERSION_MAJOR >= 20
+  bool isSameSign = (lhsRange.isNonNegative() && rhsRange.isNonNegative()) ||
+                    (lhsRange.isNegative() && rhsRange.isNegative());
+  if (auto *icmp = llvm::dyn_cast<llvm::ICmpInst>(cmp); icmp && isSameSign) {
+    icmp->setSameSign();
+  }
+#endif
+
+  if (auto *vectorTy = llvm::dyn_cast<llvm::FixedVectorType>(cmp->getType())) {
+    return builder.CreateSExt(
+        cmp, llvm::FixedVectorType::get(builder.getInt32Ty(),
+                                        vectorTy->getNumElements()));
+  }
+  return builder.CreateZExt(cmp, builder.getInt32Ty());
+}
+
+/// Compare a scalar against zero, or a pointer against null.
+llvm::Value *CodegenVisitor::emitCondition(ASTNode *expr) {
+  llvm::Value *val = expr->accept(this);
+  if (val->getType()->isFloatingPointTy()) {
+    return builder.CreateFCmpUNE(val, llvm::ConstantFP::get(val->getType(), 0.0));
+  }
+  return builder.CreateICmpNE(val, llvm::Constant::getNullValue(val->getType()));
+}
+
+llvm::Value *CodegenVisitor::visitUnaryExpr(UnaryExpr *unaryExpr) {
+  DebugLocScope loc(this, unaryExpr);
+  switch (unaryExpr->op) {
+  case OpCode::bitwisenot:
+    return builder.CreateNot(unaryExpr->operand->accept(this));
+  case OpCode::addrof:
+    return getLValueAddr(unaryExpr->operand.get());
+  case OpCode::deref:
+    return emitLoad(unaryExpr, "deref");
+  default:
+    llvm_unreachable("Unexpected unary operator");
+  }
+}
+
+llvm::Value *CodegenVisitor::visitConditionalExpr(ConditionalExpr *condExpr) {
+  DebugLocScope loc(this, condExpr);
+  llvm::Value *condVal = emitCondition(condExpr->condExpr.get());
+
+  // Both arms are cheap to evaluate and can't trap, a select is enough.
+  if (getSpeculationCost(condExpr->thenExpr.get()) >= 0 &&
+      getSpeculationCost(condExpr->elseExpr.get()) >= 0) {
+    llvm::Value *thenVal = condExpr->thenExpr->accept(this);
+    llvm::Value *elseVal = condExpr->elseExpr->accept(this);
+    return builder.CreateSelect(condVal, thenVal, elseVal, "cond");
+  }
+
+  auto thenBB = llvm::BasicBlock::Create(context, "cond.true", currentFunction);
+  auto elseBB = llvm::BasicBlock::Create(context, "cond.false", currentFunction);
+  auto lastBB = llvm::BasicBlock::Create(context, "cond.end", currentFunction);
+  builder.CreateCondBr(condVal, thenBB, elseBB);
+
+  builder.SetInsertPoint(thenBB);
+  llvm::Value *thenVal = condExpr->thenExpr->accept(this);
+  thenBB = builder.GetInsertBlock();
+  builder.CreateBr(lastBB);
+
+  builder.SetInsertPoint(elseBB);
+  llvm::Value *elseVal = condExpr->elseExpr->accept(this);
+  elseBB = builder.GetInsertBlock();
+  builder.CreateBr(lastBB);
+
+  builder.SetInsertPoint(lastBB);
+  llvm::PHINode *phi = builder.CreatePHI(thenVal->getType(), 2, "cond");
+  phi->addIncoming(thenVal, thenBB);
+  phi->addIncoming(elseVal, elseBB);
+
+  return phi;
+}
+
+llvm::Value *CodegenVisitor::createStorage(VariableDecl *variableDecl,
+                                           llvm::Type *ty, llvm::Align align,
+                                           const llvm::Twine &name) {
+  if (variableDecl->symbol->getKind() == SymbolKind::GlobalVariable) {
+    auto *globalVar = new llvm::GlobalVariable(
+        *m, ty, false,
+        variableDecl->isStatic && replEntry.empty()
+            ? llvm::GlobalValue::InternalLinkage
+            : llvm::GlobalValue::ExternalLinkage,
+        declaringExternals ? nullptr : llvm::Constant::getNullValue(ty),
+        name);
+    globalVar->setAlignment(align);
+    return globalVar;
+  }
+
+  auto *alloca = builder.CreateAlloca(ty, nullptr, name);
+  alloca->setAlignment(align);
+  return alloca;
+}
+
 llvm::Value *CodegenVisitor::visitVariableDecl(VariableDecl *variableDecl) {
-  llvm::Type *ty = nullptr;
-  if (variableDecl->ty == CType::getIntTy()) {
-    ty = builder.getInt32Ty();
+  DebugLocScope loc(this, variableDecl);
+  llvm::StringRef name = variableDecl->tok.content;
+  Symbol *symbol = variableDecl->symbol.get();
+
+  // A `soa` array gets one array per field instead, so a loop over a field
+  // reads contiguous memory rather than striding over whole structs.
+  if (symbol->isSoA()) {
+    auto *arrayTy = llvm::cast<CArrayType>(variableDecl->ty);
+    auto *structTy = llvm::cast<CStructType>(arrayTy->getElemTy());
+    auto &fieldAddrs = soaFieldAddrs[symbol];
+    for (const CField &field: structTy->getFields()) {
+      auto *fieldArrayTy = llvm::ArrayType::get(getLLVMType(field.ty),
+                                                arrayTy->getNumElems());
+      size_t fieldAlign = field.ty->getAlign();
+      if (field.ty->getSize() * arrayTy->getNumElems() >= ArrayAlign) {
+        fieldAlign = std::max<size_t>(ArrayAlign, fieldAlign);
+      }
+      fieldAddrs.push_back(createStorage(variableDecl, fieldArrayTy,
+                                         llvm::Align(fieldAlign),
+                                         name + "." + field.name));
+    }
+    return nullptr;
   }
 
-  llvm::Value *declValue =  builder.CreateAlloca(ty, nullptr, variableDecl->tok.content);
-  varAddrMap.insert({variableDecl->tok.content, declValue});
+  llvm::Value *declValue = createStorage(
+      variableDecl, getLLVMType(variableDecl->ty),
+      getAlign(variableDecl->ty), name);
+  varAddrMap.insert({symbol, declValue});
+  emitVariableDebugInfo(variableDecl, declValue);
 
   return declValue;
 }
 
 llvm::Value *CodegenVisitor::visitAssignExpr(AssignExpr *assignExpr) {
-  VariableExpr *varExpr = static_cast<VariableExpr *>(assignExpr->lhs.get());
-  llvm::Value *lhsVar = varAddrMap[varExpr->name];
+  DebugLocScope loc(this, assignExpr);
   llvm::Value *rhsValue =  assignExpr->rhs->accept(this);
 
-  builder.CreateStore(rhsValue, lhsVar);
+  emitStore(rhsValue, assignExpr->lhs.get());
   
   // Fold the assign expression to get the address computation result.
   return rhsValue;
@@ -264,12 +1891,394 @@ llvm::Value *CodegenVisitor::visitNumberExpr(NumberExpr *numberExpr) {
   return builder.getInt32(numberExpr->tok.value);
 }
 
+llvm::Value *CodegenVisitor::visitFloatExpr(FloatExpr *floatExpr) {
+  return llvm::ConstantFP::get(getLLVMType(floatExpr->ty), floatExpr->value);
+}
+
 llvm::Value *CodegenVisitor::visitVariableExpr(VariableExpr *variableExpr) {
-  llvm::Value *varAddr = varAddrMap[variableExpr->name];
-  llvm::Type *ty = nullptr;
-  if (variableExpr->ty == CType::getIntTy()) {
-    ty = builder.getInt32Ty();
+  DebugLocScope loc(this, variableExpr);
+  llvm::LoadInst *load = emitLoad(variableExpr, variableExpr->name);
+  addRangeMetadata(load, ranges.getRange(variableExpr));
+  return load;
+}
+
+/// Tell LLVM the values an `int` load may give. Memory hides what was
+/// stored from it, until SROA turns the variable into a register.
+void CodegenVisitor::addRangeMetadata(llvm::LoadInst *load,
+                                      const ValueRange &range) {
+  if (!load->getType()->isIntegerTy(32) ||
+      (range.lo <= INT32_MIN && range.hi >= INT32_MAX)) {
+    return;
+  }
+  llvm::MDBuilder mdBuilder(context);
+  load->setMetadata(llvm::LLVMContext::MD_range, mdBuilder.createRange(
+      llvm::APInt(32, uint32_t(range.lo)),
+      llvm::APInt(32, uint32_t(range.hi + 1))));
+}
+
+/// The `soa` array whose element `memberExpr` accesses a field of, if any.
+static Symbol *getSoAArray(MemberExpr *memberExpr) {
+  if (memberExpr->isArrow) {
+    return nullptr;
+  }
+  auto *subscriptExpr = llvm::dyn_cast<SubscriptExpr>(memberExpr->base.get());
+  auto *varExpr = subscriptExpr ?
+      llvm::dyn_cast<VariableExpr>(subscriptExpr->base.get()) : nullptr;
+  return varExpr && varExpr->symbol->isSoA() ? varExpr->symbol.get() : nullptr;
+}
+
+/// The address of a variable, of an array element, of a field or of a
+/// dereferenced pointer.
+llvm::Value *CodegenVisitor::getLValueAddr(ASTNode *lvalue) {
+  if (auto *varExpr = llvm::dyn_cast<VariableExpr>(lvalue)) {
+    return varAddrMap[varExpr->symbol.get()];
+  }
+  if (auto *unaryExpr = llvm::dyn_cast<UnaryExpr>(lvalue)) {
+    assert(unaryExpr->op == OpCode::deref && "Not an lvalue");
+    return unaryExpr->operand->accept(this);
+  }
+  if (auto *memberExpr = llvm::dyn_cast<MemberExpr>(lvalue)) {
+    // `a[i].x` of a `soa` array is element i of the array of field x.
+    if (Symbol *soaArray = getSoAArray(memberExpr)) {
+      auto *arrayTy = llvm::cast<CArrayType>(soaArray->getTy());
+      return emitArrayElementAddr(
+          llvm::cast<SubscriptExpr>(memberExpr->base.get()),
+          llvm::ArrayType::get(getLLVMType(memberExpr->ty),
+                               arrayTy->getNumElems()),
+          soaFieldAddrs[soaArray][memberExpr->fieldIdx]);
+    }
+
+    llvm::Value *structAddr = memberExpr->isArrow ?
+                              memberExpr->base->accept(this) :
+                              getLValueAddr(memberExpr->base.get());
+    return builder.CreateStructGEP(getLLVMStructType(memberExpr->structTy),
+                                   structAddr, getFieldElemIndex(memberExpr),
+                                   memberExpr->name);
+  }
+
+  auto *subscriptExpr = llvm::cast<SubscriptExpr>(lvalue);
+  auto emitIndex = [&]() {
+    return emitIndexExt(subscriptExpr->index.get());
+  };
+
+  // Elements of a vector in memory are laid out like an array.
+  if (llvm::isa<CVectorType>(subscriptExpr->base->ty)) {
+    return builder.CreateInBoundsGEP(
+        getLLVMType(subscriptExpr->ty),
+        getLValueAddr(subscriptExpr->base.get()), emitIndex(), "vecidx");
+  }
+
+  auto *arrayTy = llvm::dyn_cast<CArrayType>(subscriptExpr->base->ty);
+  if (!arrayTy) {
+    llvm::Value *base = subscriptExpr->base->accept(this);
+    return builder.CreateInBoundsGEP(
+        getLLVMType(subscriptExpr->ty), base, emitIndex(), "arrayidx");
+  }
+
+  return emitArrayElementAddr(
+      subscriptExpr, llvm::cast<llvm::ArrayType>(getLLVMType(arrayTy)),
+      getLValueAddr(subscriptExpr->base.get()));
+}
+
+/// Index in 64 bits like the address, so the vectorizer doesn't have to
+/// prove that 32-bit arithmetic doesn't wrap. A non-negative index is zero
+/// extended, which IndVarSimplify widens along with an induction variable
+/// that doesn't wrap unsigned.
+llvm::Value *CodegenVisitor::emitIndexExt(ASTNode *indexExpr) {
+  llvm::Value *index = indexExpr->accept(this);
+  if (!ranges.getRange(indexExpr).isNonNegative()) {
+    return builder.CreateSExt(index, builder.getInt64Ty(), "idxprom");
   }
+#if LLVM_VERSION_MAJOR >= 18
+  return builder.CreateZExt(index, builder.getInt64Ty(), "idxprom",
+                            /*IsNonNeg=*/true);
+#else
+  return builder.CreateZExt(index, builder.getInt64Ty(), "idxprom");
+#endif
+}
+
+/// The address of element `subscriptExpr->index` of the array at
+/// `arrayAddr`, checked against its size under -fbounds-check.
+llvm::Value *CodegenVisitor::emitArrayElementAddr(SubscriptExpr *subscriptExpr,
+                                                  llvm::ArrayType *arrayTy,
+                                                  llvm::Value *arrayAddr) {
+  llvm::Value *index = emitIndexExt(subscriptExpr->index.get());
+  ValueRange indexRange = ranges.getRange(subscriptExpr->index.get());
+  bool isInBounds = indexRange.isNonNegative() &&
+                    uint64_t(indexRange.hi) < arrayTy->getNumElements();
+  if (BoundsCheck && !isInBounds && !checkedSubscripts.count(subscriptExpr)) {
+    // Negative indexes are large unsigned values.
+    emitBoundsCheck(builder.CreateICmpULT(
+        index, builder.getInt64(arrayTy->getNumElements()), "inbounds"));
+  }
+
+  return builder.CreateInBoundsGEP(
+      arrayTy, arrayAddr, {builder.getInt64(0), index}, "arrayidx");
+}
+
+/// The alignment `lvalue` is known to have. Fields of packed structs, and
+/// elements of arrays of them, may be less aligned than their type.
+llvm::Align CodegenVisitor::getLValueAlign(ASTNode *lvalue) {
+  if (auto *varExpr = llvm::dyn_cast<VariableExpr>(lvalue)) {
+    return getAlign(varExpr->ty);
+  }
+  if (auto *memberExpr = llvm::dyn_cast<MemberExpr>(lvalue)) {
+    if (getSoAArray(memberExpr)) {
+      return llvm::Align(memberExpr->ty->getAlign());
+    }
+    llvm::Align structAlign = memberExpr->isArrow ?
+        llvm::Align(memberExpr->structTy->getAlign()) :
+        getLValueAlign(memberExpr->base.get());
+    return llvm::commonAlignment(structAlign, memberExpr->getField().offset);
+  }
+  if (auto *subscriptExpr = llvm::dyn_cast<SubscriptExpr>(lvalue)) {
+    CType *baseTy = subscriptExpr->base->ty;
+    if (llvm::isa<CArrayType>(baseTy) || llvm::isa<CVectorType>(baseTy)) {
+      return llvm::commonAlignment(getLValueAlign(subscriptExpr->base.get()),
+                                   subscriptExpr->ty->getSize());
+    }
+  }
+  return llvm::Align(lvalue->ty->getAlign());
+}
+
+llvm::Value *CodegenVisitor::visitMemberExpr(MemberExpr *memberExpr) {
+  DebugLocScope loc(this, memberExpr);
+  if (!isLValueExpr(memberExpr)) {
+    return builder.CreateExtractValue(memberExpr->base->accept(this),
+                                      getFieldElemIndex(memberExpr),
+                                      memberExpr->name);
+  }
+  return emitLoad(memberExpr, memberExpr->name);
+}
 
-  return builder.CreateLoad(ty, varAddr, variableExpr->name);
+llvm::Value *CodegenVisitor::visitSubscriptExpr(SubscriptExpr *subscriptExpr) {
+  DebugLocScope loc(this, subscriptExpr);
+  if (!isLValueExpr(subscriptExpr)) {
+    return builder.CreateExtractElement(subscriptExpr->base->accept(this),
+                                        subscriptExpr->index->accept(this),
+                                        "vecext");
+  }
+  return emitLoad(subscriptExpr, "arrayelem");
+}
+
+llvm::Value *CodegenVisitor::visitImplicitCastExpr(ImplicitCastExpr *castExpr) {
+  DebugLocScope loc(this, castExpr);
+  switch (castExpr->castKind) {
+  case CastKind::ArrayToPointerDecay: {
+    llvm::Value *arrayAddr = getLValueAddr(castExpr->operand.get());
+    return builder.CreateInBoundsGEP(
+        getLLVMType(castExpr->operand->ty), arrayAddr,
+        {builder.getInt64(0), builder.getInt64(0)}, "arraydecay");
+  }
+  case CastKind::NullToPointer:
+    return llvm::Constant::getNullValue(getLLVMType(castExpr->ty));
+  case CastKind::IntegralToFloating:
+    return builder.CreateSIToFP(castExpr->operand->accept(this),
+                                getLLVMType(castExpr->ty), "conv");
+  case CastKind::FloatingToIntegral:
+    return builder.CreateFPToSI(castExpr->operand->accept(this),
+                                getLLVMType(castExpr->ty), "conv");
+  case CastKind::FloatingCast:
+    return builder.CreateFPCast(castExpr->operand->accept(this),
+                                getLLVMType(castExpr->ty), "conv");
+  case CastKind::VectorSplat:
+    return builder.CreateVectorSplat(
+        llvm::cast<CVectorType>(castExpr->ty)->getNumElems(),
+        castExpr->operand->accept(this), "splat");
+  }
+  llvm_unreachable("Unknown cast kind");
+}
+
+llvm::LoadInst *CodegenVisitor::emitLoad(ASTNode *lvalue, const llvm::Twine &name) {
+  llvm::Value *addr = getLValueAddr(lvalue);
+  llvm::LoadInst *load = builder.CreateAlignedLoad(
+      getLLVMType(lvalue->ty), addr, getLValueAlign(lvalue), name);
+  addAliasMetadata(load, lvalue);
+  return load;
+}
+
+llvm::StoreInst *CodegenVisitor::emitStore(llvm::Value *value, ASTNode *lvalue) {
+  llvm::Value *addr = getLValueAddr(lvalue);
+  llvm::StoreInst *store = builder.CreateAlignedStore(
+      value, addr, getLValueAlign(lvalue));
+  addAliasMetadata(store, lvalue);
+  return store;
+}
+
+/// What the address of an access is computed from.
+struct AccessBase {
+  // A variable, which restrict pointers don't point to while they are used.
+  Symbol *object = nullptr;
+  // The pointer variable the address is based on.
+  Symbol *pointer = nullptr;
+};
+
+static AccessBase getPointerBase(ASTNode *ptrExpr);
+
+static AccessBase getAccessBase(ASTNode *lvalue) {
+  if (auto *varExpr = llvm::dyn_cast<VariableExpr>(lvalue)) {
+    return {varExpr->symbol.get(), nullptr};
+  }
+  if (auto *unaryExpr = llvm::dyn_cast<UnaryExpr>(lvalue)) {
+    return getPointerBase(unaryExpr->operand.get());
+  }
+  if (auto *subscriptExpr = llvm::dyn_cast<SubscriptExpr>(lvalue)) {
+    if (llvm::isa<CArrayType>(subscriptExpr->base->ty) ||
+        llvm::isa<CVectorType>(subscriptExpr->base->ty)) {
+      return getAccessBase(subscriptExpr->base.get());
+    }
+    return getPointerBase(subscriptExpr->base.get());
+  }
+  if (auto *memberExpr = llvm::dyn_cast<MemberExpr>(lvalue)) {
+    return memberExpr->isArrow ? getPointerBase(memberExpr->base.get())
+                               : getAccessBase(memberExpr->base.get());
+  }
+  return {};
+}
+
+static AccessBase getPointerBase(ASTNode *ptrExpr) {
+  if (auto *varExpr = llvm::dyn_cast<VariableExpr>(ptrExpr)) {
+    return {nullptr, varExpr->symbol.get()};
+  }
+  if (auto *binaryExpr = llvm::dyn_cast<BinaryExpr>(ptrExpr)) {
+    bool isLhsPointer = llvm::isa<CPointerType>(binaryExpr->lhs->ty);
+    return getPointerBase(isLhsPointer ? binaryExpr->lhs.get()
+                                       : binaryExpr->rhs.get());
+  }
+  if (auto *castExpr = llvm::dyn_cast<ImplicitCastExpr>(ptrExpr)) {
+    if (castExpr->castKind == CastKind::ArrayToPointerDecay) {
+      return getAccessBase(castExpr->operand.get());
+    }
+  }
+  if (auto *unaryExpr = llvm::dyn_cast<UnaryExpr>(ptrExpr)) {
+    if (unaryExpr->op == OpCode::addrof) {
+      return getAccessBase(unaryExpr->operand.get());
+    }
+  }
+  return {};
+}
+
+/// Attach TBAA, and the alias scopes of restrict parameters, to an access.
+void CodegenVisitor::addAliasMetadata(llvm::Instruction *inst, ASTNode *lvalue) {
+  inst->setMetadata(llvm::LLVMContext::MD_tbaa, getTBAATag(lvalue->ty));
+  if (restrictScopes.empty()) {
+    return;
+  }
+
+  AccessBase base = getAccessBase(lvalue);
+  llvm::MDNode *scope = nullptr;
+  for (auto [symbol, restrictScope]: restrictScopes) {
+    if (symbol == base.pointer) {
+      scope = restrictScope;
+    }
+  }
+  // Through a pointer that isn't restrict, anything may be accessed.
+  if (!scope && !base.object) {
+    return;
+  }
+
+  llvm::SmallVector<llvm::Metadata *, 4> noAliasScopes;
+  for (auto [symbol, restrictScope]: restrictScopes) {
+    if (restrictScope != scope) {
+      noAliasScopes.push_back(restrictScope);
+    }
+  }
+
+  if (scope) {
+    inst->setMetadata(llvm::LLVMContext::MD_alias_scope,
+                      llvm::MDNode::get(context, scope));
+  }
+  if (!noAliasScopes.empty()) {
+    inst->setMetadata(llvm::LLVMContext::MD_noalias,
+                      llvm::MDNode::get(context, noAliasScopes));
+  }
+}
+
+/// Scalar types form a flat TBAA tree below `omnipotent char`, so accesses
+/// of different types don't alias.
+llvm::MDNode *CodegenVisitor::getTBAATag(CType *ty) {
+  llvm::MDBuilder mdBuilder(context);
+  if (!tbaaChar) {
+    llvm::MDNode *root = mdBuilder.createTBAARoot("Simple C/C++ TBAA");
+    tbaaChar = mdBuilder.createTBAAScalarTypeNode("omnipotent char", root);
+  }
+
+  // Pointers of all types share one node, like clang does. Vectors and
+  // structs are accessed both whole and by element, so they may alias
+  // anything.
+  std::string name = llvm::isa<CPointerType>(ty) ? "any pointer" : ty->getName();
+  bool isAggregate = llvm::isa<CVectorType>(ty) || llvm::isa<CStructType>(ty);
+  if (isAggregate) {
+    name = "omnipotent char";
+  }
+  llvm::MDNode *&tag = tbaaTags[name];
+  if (!tag) {
+    llvm::MDNode *typeNode = isAggregate ?
+        tbaaChar : mdBuilder.createTBAAScalarTypeNode(name, tbaaChar);
+    tag = mdBuilder.createTBAAStructTagNode(typeNode, typeNode, 0);
+  }
+
+  return tag;
+}
+
+llvm::Value *CodegenVisitor::visitCallExpr(CallExpr *callExpr) {
+  DebugLocScope loc(this, callExpr);
+  llvm::Function *callee = getOrCreateFunction(callExpr->calleeDecl);
+
+  std::vector<llvm::Value *> args;
+  for (auto &arg: callExpr->args) {
+    args.push_back(arg->accept(this));
+  }
+
+  llvm::CallInst *callInst = builder.CreateCall(callee, args);
+  callInst->setCallingConv(callee->getCallingConv());
+
+  return callInst;
+}
+
+llvm::Value *CodegenVisitor::visitBuiltinCallExpr(BuiltinCallExpr *callExpr) {
+  DebugLocScope loc(this, callExpr);
+  llvm::Value *arg = callExpr->args[0]->accept(this);
+  bool isFloating = callExpr->args[0]->ty->getScalarTy()->isFloating();
+
+  switch (callExpr->builtinKind) {
+  case BuiltinKind::ShuffleVector: {
+    llvm::Value *other = callExpr->args[1]->accept(this);
+    llvm::SmallVector<int, 16> mask;
+    for (size_t i = 2; i < callExpr->args.size(); ++i) {
+      mask.push_back(llvm::cast<NumberExpr>(callExpr->args[i].get())->number);
+    }
+    return builder.CreateShuffleVector(arg, other, mask, "shuffle");
+  }
+  case BuiltinKind::Splat: {
+    auto *vectorTy = llvm::cast<CVectorType>(callExpr->ty);
+    return builder.CreateVectorSplat(vectorTy->getNumElems(), arg, "splat");
+  }
+  // Floating reductions are done in order, unless reassociation is allowed.
+  case BuiltinKind::ReduceAdd:
+    if (isFloating) {
+      return builder.CreateFAddReduce(
+          llvm::ConstantFP::getNegativeZero(getLLVMType(callExpr->ty)), arg);
+    }
+    return builder.CreateAddReduce(arg);
+  case BuiltinKind::ReduceMul:
+    if (isFloating) {
+      return builder.CreateFMulReduce(
+          llvm::ConstantFP::get(getLLVMType(callExpr->ty), 1.0), arg);
+    }
+    return builder.CreateMulReduce(arg);
+  case BuiltinKind::ReduceMin:
+    return isFloating ? builder.CreateFPMinReduce(arg)
+                      : builder.CreateIntMinReduce(arg, true);
+  case BuiltinKind::ReduceMax:
+    return isFloating ? builder.CreateFPMaxReduce(arg)
+                      : builder.CreateIntMaxReduce(arg, true);
+  case BuiltinKind::ReduceAnd:
+    return builder.CreateAndReduce(arg);
+  case BuiltinKind::ReduceOr:
+    return builder.CreateOrReduce(arg);
+  case BuiltinKind::ReduceXor:
+    return builder.CreateXorReduce(arg);
+  }
+  llvm_unreachable("Unknown builtin");
 }
\ No newline at end of file
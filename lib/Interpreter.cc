@@ -0,0 +1,1704 @@
+#include "Interpreter.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/bit.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// The frames of calls live above the globals, in as much memory as the
+// default stack of a thread.
+static const size_t StackSize = 8 << 20;
+// A frame starts with the return address and the frame of the caller, the
+// parameters follow.
+static const int32_t FrameHeaderSize = 16;
+// Frames and slots are aligned like the compiled code aligns its variables,
+// up to a cache line, so a compiled loop may use them in place.
+static const int32_t FrameAlign = 64;
+
+/// Arrays of 16 bytes or more are aligned to 16, like Codegen does.
+static size_t getSlotAlign(CType *ty) {
+  size_t align = ty->getAlign();
+  if (llvm::isa<CArrayType>(ty) && ty->getSize() >= 16) {
+    align = std::max<size_t>(align, 16);
+  }
+  return std::min<size_t>(align, FrameAlign);
+}
+
+// Dispatch through a table of label addresses where the compiler has them,
+// so each instruction ends in its own indirect branch.
+#if defined(__GNUC__)
+#define INTERP_COMPUTED_GOTO 1
+#else
+#define INTERP_COMPUTED_GOTO 0
+#endif
+
+namespace {
+
+enum class Op : uint32_t {
+#define OPCODE(NAME) NAME,
+#include "Bytecode.h.inc"
+};
+
+struct Insn {
+  Op op;
+  int32_t a, b, c, d;
+};
+
+struct BytecodeFunction {
+  llvm::StringRef name;
+  // NULL until the definition is seen.
+  FunctionDecl *decl = nullptr;
+  bool isCalled = false;
+  uint32_t entry = 0;
+  // Including the header, the parameters and the temporaries.
+  uint32_t frameSize = 0;
+};
+
+/// Where the object of an lvalue is. Frame and Global are at a fixed slot,
+/// a Pointer at a constant offset from the pointer in slot `base`. Any of
+/// them may add `index * scale`, but a Pointer then has no offset.
+struct LValue {
+  enum Kind { Frame, Global, Pointer };
+
+  Kind kind;
+  int32_t base;
+  int32_t offset = 0;
+  // The slot of an `int` index, -1 if there's none.
+  int32_t index = -1;
+  int32_t scale = 0;
+};
+
+/// The slot a statement leaves its value in, for the implicit main to print.
+struct StmtValue {
+  int32_t slot = -1;
+  CType *ty = nullptr;
+};
+
+/// A loop which counts its trips, to be compiled once it is hot.
+struct HotLoop {
+  ForStmt *loop;
+  std::vector<std::pair<Symbol *, int32_t>> locals;
+  uint32_t trips = 0;
+  CompiledLoop compiled = nullptr;
+};
+
+/// Lower a program to bytecode. Variables get a slot in the frame of their
+/// function at compile time, temporaries are allocated above them and
+/// reused by the next statement.
+class BytecodeCompiler {
+public:
+  BytecodeCompiler(bool countLoops, bool checkpoints)
+      : countLoops(countLoops), checkpoints(checkpoints) {}
+
+  llvm::Error compile(Program &prog, llvm::raw_ostream &os);
+
+  std::vector<Insn> code;
+  std::vector<BytecodeFunction> funcs;
+  // The frame of the start code, which holds the globals.
+  uint32_t globalFrameSize = 0;
+  llvm::DenseMap<Symbol *, int32_t> globalSlots;
+  std::vector<HotLoop> hotLoops;
+  // The value an implicit main prints, in the frame of the start code.
+  StmtValue printedValue;
+  bool hasParallelLoops = false;
+
+private:
+  size_t emit(Op op, int32_t a = 0, int32_t b = 0, int32_t c = 0,
+              int32_t d = 0) {
+    code.push_back({op, a, b, c, d});
+    return code.size() - 1;
+  }
+  // Jumps are emitted before their target is known.
+  void patch(size_t jump) { code[jump].a = code.size(); }
+
+  unsigned getFunctionIndex(FunctionDecl *funcDecl);
+  void compileFunction(unsigned funcIdx);
+  llvm::SmallVector<int32_t, 8> getParamSlots(CFuncType *funcTy);
+
+  int32_t allocLocal(CType *ty);
+  int32_t allocTemp(size_t size, size_t align);
+  int32_t allocTemp(CType *ty) {
+    return allocTemp(ty->getSize(), getSlotAlign(ty));
+  }
+  int32_t getDst(int32_t dst, CType *ty) {
+    return dst >= 0 ? dst : allocTemp(ty);
+  }
+  void emitMove(int32_t dst, int32_t src, CType *ty);
+
+  StmtValue emitStmt(ASTNode *stmt);
+  void emitFor(ForStmt *forStmt);
+  void emitReturn(ReturnStmt *returnStmt);
+  size_t emitBranch(ASTNode *cond, bool jumpIfTrue);
+
+  int32_t emitExpr(ASTNode *expr, int32_t dst = -1);
+  int32_t emitExprImpl(ASTNode *expr, int32_t dst);
+  std::pair<int32_t, int32_t> emitOperands(ASTNode *lhs, ASTNode *rhs);
+  int32_t emitBinary(BinaryExpr *binaryExpr, int32_t dst);
+  int32_t emitPointerArithmetic(BinaryExpr *binaryExpr, int32_t dst);
+  int32_t emitCast(ImplicitCastExpr *castExpr, int32_t dst);
+  int32_t emitSplat(int32_t src, CVectorType *vectorTy, int32_t dst);
+  int32_t emitArgs(CallExpr *callExpr);
+  int32_t emitCall(CallExpr *callExpr, int32_t dst);
+  int32_t emitBuiltin(BuiltinCallExpr *callExpr, int32_t dst);
+
+  LValue getLValue(ASTNode *expr);
+  LValue getBaseLValue(ASTNode *base);
+  LValue addOffset(LValue lv, int32_t offset);
+  LValue addIndex(LValue lv, ASTNode *indexExpr, int32_t scale);
+  LValue toPointer(const LValue &lv);
+  int32_t emitAddr(const LValue &lv, int32_t dst = -1);
+  int32_t emitLoad(const LValue &lv, CType *ty, int32_t dst = -1);
+  void emitStore(const LValue &lv, int32_t src, CType *ty);
+
+  llvm::DenseMap<Symbol *, unsigned> funcIndices;
+  // The variables of the function being compiled, the globals in the
+  // start code.
+  llvm::DenseMap<Symbol *, int32_t> slots;
+  unsigned currentFunc = 0;
+  bool countLoops;
+  bool checkpoints;
+
+  int32_t localTop = 0;
+  int32_t tempTop = 0;
+  int32_t frameSize = 0;
+
+  struct LoopJumps {
+    std::vector<size_t> breaks;
+    std::vector<size_t> continues;
+  };
+  llvm::DenseMap<ASTNode *, LoopJumps> loops;
+};
+
+} // namespace
+
+static bool isComparison(OpCode op) {
+  return op >= OpCode::equalequal && op <= OpCode::greatereq;
+}
+
+static OpCode invertComparison(OpCode op) {
+  switch (op) {
+  case OpCode::equalequal: return OpCode::notequal;
+  case OpCode::notequal: return OpCode::equalequal;
+  case OpCode::less: return OpCode::greatereq;
+  case OpCode::lesseq: return OpCode::greater;
+  case OpCode::greater: return OpCode::lesseq;
+  case OpCode::greatereq: return OpCode::less;
+  default:
+    llvm_unreachable("Not a comparison");
+  }
+}
+
+/// Comparisons are in the order of OpCode in each group of Bytecode.h.inc,
+/// from `first` on.
+static Op getComparisonOp(Op first, OpCode op) {
+  return Op(unsigned(first) + unsigned(op) - unsigned(OpCode::equalequal));
+}
+
+/// The instruction of a binary operator on scalars of type `ty`.
+static Op getBinaryOp(OpCode op, CType *ty) {
+  if (isComparison(op)) {
+    switch (ty->getKind()) {
+    case TypeKind::Int: return getComparisonOp(Op::EQ, op);
+    case TypeKind::Float: return getComparisonOp(Op::FEQ, op);
+    case TypeKind::Double: return getComparisonOp(Op::DEQ, op);
+    case TypeKind::Pointer: return getComparisonOp(Op::PEQ, op);
+    default:
+      llvm_unreachable("Unexpected comparison operand");
+    }
+  }
+
+  if (ty->isFloating()) {
+    bool isFloat = ty->getKind() == TypeKind::Float;
+    switch (op) {
+    case OpCode::add: return isFloat ? Op::FADD : Op::DADD;
+    case OpCode::sub: return isFloat ? Op::FSUB : Op::DSUB;
+    case OpCode::mul: return isFloat ? Op::FMUL : Op::DMUL;
+    case OpCode::div: return isFloat ? Op::FDIV : Op::DDIV;
+    default:
+      llvm_unreachable("Unexpected floating binary operator");
+    }
+  }
+
+  switch (op) {
+  case OpCode::add: return Op::ADD;
+  case OpCode::sub: return Op::SUB;
+  case OpCode::mul: return Op::MUL;
+  case OpCode::div: return Op::DIV;
+  case OpCode::mod: return Op::MOD;
+  case OpCode::bitwiseand: return Op::AND;
+  case OpCode::bitwiseor: return Op::OR;
+  case OpCode::bitwisexor: return Op::XOR;
+  case OpCode::shl: return Op::SHL;
+  case OpCode::shr: return Op::SHR;
+  default:
+    llvm_unreachable("Unexpected binary operator");
+  }
+}
+
+static Op getConversionOp(CType *fromTy, CType *toTy) {
+  switch (fromTy->getKind()) {
+  case TypeKind::Int:
+    return toTy->getKind() == TypeKind::Float ? Op::I2F : Op::I2D;
+  case TypeKind::Float:
+    return toTy->isInteger() ? Op::F2I : Op::F2D;
+  case TypeKind::Double:
+    return toTy->isInteger() ? Op::D2I : Op::D2F;
+  default:
+    llvm_unreachable("Unexpected conversion");
+  }
+}
+
+static unsigned getNumElems(CType *ty) {
+  if (auto *vectorTy = llvm::dyn_cast<CVectorType>(ty)) {
+    return vectorTy->getNumElems();
+  }
+  return 1;
+}
+
+/// Whether evaluating `expr` may write a variable. The operand on its left
+/// is then copied first, instead of being read from the variable's slot.
+static bool hasSideEffects(ASTNode *expr) {
+  if (!expr) {
+    return false;
+  }
+  switch (expr->getNodeKind()) {
+  case ASTNode::NodeKind::CallExpr:
+  case ASTNode::NodeKind::AssignExpr:
+    return true;
+  case ASTNode::NodeKind::BinaryExpr: {
+    auto *binaryExpr = llvm::cast<BinaryExpr>(expr);
+    return hasSideEffects(binaryExpr->lhs.get()) ||
+           hasSideEffects(binaryExpr->rhs.get());
+  }
+  case ASTNode::NodeKind::UnaryExpr:
+    return hasSideEffects(llvm::cast<UnaryExpr>(expr)->operand.get());
+  case ASTNode::NodeKind::ConditionalExpr: {
+    auto *condExpr = llvm::cast<ConditionalExpr>(expr);
+    return hasSideEffects(condExpr->condExpr.get()) ||
+           hasSideEffects(condExpr->thenExpr.get()) ||
+           hasSideEffects(condExpr->elseExpr.get());
+  }
+  case ASTNode::NodeKind::ImplicitCastExpr:
+    return hasSideEffects(llvm::cast<ImplicitCastExpr>(expr)->operand.get());
+  case ASTNode::NodeKind::SubscriptExpr: {
+    auto *subscriptExpr = llvm::cast<SubscriptExpr>(expr);
+    return hasSideEffects(subscriptExpr->base.get()) ||
+           hasSideEffects(subscriptExpr->index.get());
+  }
+  case ASTNode::NodeKind::MemberExpr:
+    return hasSideEffects(llvm::cast<MemberExpr>(expr)->base.get());
+  case ASTNode::NodeKind::BuiltinCallExpr:
+    for (auto &arg: llvm::cast<BuiltinCallExpr>(expr)->args) {
+      if (hasSideEffects(arg.get())) return true;
+    }
+    return false;
+  default:
+    return false;
+  }
+}
+
+/// Whether a loop nest can be compiled on its own and entered at its
+/// header. A `return` would leave the function rather than the loop, and
+/// the compiled code lays `soa` arrays out by field, not like the frame.
+static bool canCompileLoop(ASTNode *node) {
+  if (!node) {
+    return true;
+  }
+  switch (node->getNodeKind()) {
+  case ASTNode::NodeKind::ReturnStmt:
+    return false;
+  case ASTNode::NodeKind::VariableExpr:
+    return !llvm::cast<VariableExpr>(node)->symbol->isSoA();
+  case ASTNode::NodeKind::VariableDecl:
+    return !llvm::cast<VariableDecl>(node)->symbol->isSoA();
+  case ASTNode::NodeKind::BlockStmt:
+    return llvm::all_of(llvm::cast<BlockStmt>(node)->stmtVec,
+                        [](auto &stmt) { return canCompileLoop(stmt.get()); });
+  case ASTNode::NodeKind::DeclStmt:
+    return llvm::all_of(llvm::cast<DeclStmt>(node)->exprVec,
+                        [](auto &expr) { return canCompileLoop(expr.get()); });
+  case ASTNode::NodeKind::IfStmt: {
+    auto *ifStmt = llvm::cast<IfStmt>(node);
+    return canCompileLoop(ifStmt->condExpr.get()) &&
+           canCompileLoop(ifStmt->thenBody.get()) &&
+           canCompileLoop(ifStmt->elseBody.get());
+  }
+  case ASTNode::NodeKind::ForStmt: {
+    auto *forStmt = llvm::cast<ForStmt>(node);
+    return canCompileLoop(forStmt->initExpr.get()) &&
+           canCompileLoop(forStmt->condExpr.get()) &&
+           canCompileLoop(forStmt->incExpr.get()) &&
+           canCompileLoop(forStmt->forBody.get());
+  }
+  case ASTNode::NodeKind::AssignExpr: {
+    auto *assignExpr = llvm::cast<AssignExpr>(node);
+    return canCompileLoop(assignExpr->lhs.get()) &&
+           canCompileLoop(assignExpr->rhs.get());
+  }
+  case ASTNode::NodeKind::BinaryExpr: {
+    auto *binaryExpr = llvm::cast<BinaryExpr>(node);
+    return canCompileLoop(binaryExpr->lhs.get()) &&
+           canCompileLoop(binaryExpr->rhs.get());
+  }
+  case ASTNode::NodeKind::UnaryExpr:
+    return canCompileLoop(llvm::cast<UnaryExpr>(node)->operand.get());
+  case ASTNode::NodeKind::ConditionalExpr: {
+    auto *condExpr = llvm::cast<ConditionalExpr>(node);
+    return canCompileLoop(condExpr->condExpr.get()) &&
+           canCompileLoop(condExpr->thenExpr.get()) &&
+           canCompileLoop(condExpr->elseExpr.get());
+  }
+  case ASTNode::NodeKind::ImplicitCastExpr:
+    return canCompileLoop(llvm::cast<ImplicitCastExpr>(node)->operand.get());
+  case ASTNode::NodeKind::SubscriptExpr: {
+    auto *subscriptExpr = llvm::cast<SubscriptExpr>(node);
+    return canCompileLoop(subscriptExpr->base.get()) &&
+           canCompileLoop(subscriptExpr->index.get());
+  }
+  case ASTNode::NodeKind::MemberExpr:
+    return canCompileLoop(llvm::cast<MemberExpr>(node)->base.get());
+  case ASTNode::NodeKind::CallExpr:
+    return llvm::all_of(llvm::cast<CallExpr>(node)->args,
+                        [](auto &arg) { return canCompileLoop(arg.get()); });
+  case ASTNode::NodeKind::BuiltinCallExpr:
+    return llvm::all_of(llvm::cast<BuiltinCallExpr>(node)->args,
+                        [](auto &arg) { return canCompileLoop(arg.get()); });
+  default:
+    return true;
+  }
+}
+
+llvm::Error BytecodeCompiler::compile(Program &prog, llvm::raw_ostream &os) {
+  // The globals come first in the frame of the start code, so functions
+  // know where they are whatever the order of the definitions.
+  localTop = tempTop = frameSize = FrameHeaderSize;
+  std::vector<unsigned> definitions;
+  for (auto &stmt: prog.stmtVec) {
+    if (auto *funcDecl = llvm::dyn_cast<FunctionDecl>(stmt.get())) {
+      unsigned funcIdx = getFunctionIndex(funcDecl);
+      if (funcDecl->body) {
+        funcs[funcIdx].decl = funcDecl;
+        definitions.push_back(funcIdx);
+      }
+      continue;
+    }
+    auto *declStmt = llvm::dyn_cast<DeclStmt>(stmt.get());
+    if (!declStmt) {
+      continue;
+    }
+    for (auto &expr: declStmt->exprVec) {
+      auto *varDecl = llvm::dyn_cast<VariableDecl>(expr.get());
+      if (varDecl &&
+          varDecl->symbol->getKind() == SymbolKind::GlobalVariable) {
+        int32_t slot = allocLocal(varDecl->ty);
+        globalSlots[varDecl->symbol.get()] = slot;
+        slots[varDecl->symbol.get()] = slot;
+      }
+    }
+  }
+
+  // The start code runs the file scope statements, then `main`.
+  StmtValue finalValue;
+  for (size_t i = 0; i < prog.stmtVec.size(); ++i) {
+    if (llvm::isa<FunctionDecl>(prog.stmtVec[i].get())) {
+      continue;
+    }
+    finalValue = emitStmt(prog.stmtVec[i].get());
+    if (checkpoints) {
+      emit(Op::CHECKPOINT, i + 1);
+    }
+  }
+
+  if (prog.hasImplicitMain) {
+    // Only `int` and floating values are printed, like the compiled code.
+    CType *ty = finalValue.ty;
+    if (finalValue.slot >= 0 && ty->isArithmetic()) {
+      Op print = ty->isInteger() ? Op::PRINT_I32
+                 : ty->getKind() == TypeKind::Float ? Op::PRINT_F32
+                                                    : Op::PRINT_F64;
+      emit(print, finalValue.slot);
+      printedValue = finalValue;
+    }
+    else {
+      os << "Last statement is not a expression statement\n";
+    }
+    int32_t exitCode = allocTemp(4, 4);
+    emit(Op::CONST32, exitCode, 0);
+    emit(Op::HALT, exitCode);
+  }
+  else {
+    auto mainIt = llvm::find_if(definitions, [&](unsigned funcIdx) {
+      return funcs[funcIdx].name == "main";
+    });
+    if (mainIt == definitions.end()) {
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "the program has no `main` to run");
+    }
+    FunctionDecl *mainDecl = funcs[*mainIt].decl;
+    int32_t exitCode =
+        allocTemp(llvm::cast<CFuncType>(mainDecl->ty)->getRetTy());
+    int32_t argBase = llvm::alignTo(tempTop, FrameAlign);
+    funcs[*mainIt].isCalled = true;
+    emit(Op::CALL, exitCode, *mainIt, argBase);
+    emit(Op::HALT, exitCode);
+  }
+  globalFrameSize = llvm::alignTo(frameSize, FrameAlign);
+
+  for (unsigned funcIdx: definitions) {
+    compileFunction(funcIdx);
+  }
+
+  for (const BytecodeFunction &func: funcs) {
+    if (func.isCalled && !func.decl) {
+      return llvm::createStringError(
+          llvm::inconvertibleErrorCode(),
+          "`%s` is called but never defined", func.name.str().c_str());
+    }
+  }
+  return llvm::Error::success();
+}
+
+unsigned BytecodeCompiler::getFunctionIndex(FunctionDecl *funcDecl) {
+  auto [it, inserted] = funcIndices.insert(
+      {funcDecl->symbol.get(), unsigned(funcs.size())});
+  if (inserted) {
+    funcs.push_back({});
+    funcs.back().name = funcDecl->name;
+  }
+  return it->second;
+}
+
+/// The parameters follow the frame header, each aligned like a local.
+llvm::SmallVector<int32_t, 8>
+BytecodeCompiler::getParamSlots(CFuncType *funcTy) {
+  llvm::SmallVector<int32_t, 8> paramSlots;
+  int32_t top = FrameHeaderSize;
+  for (CType *paramTy: funcTy->getParamTys()) {
+    top = llvm::alignTo(top, getSlotAlign(paramTy));
+    paramSlots.push_back(top);
+    top += paramTy->getSize();
+  }
+  paramSlots.push_back(top);
+  return paramSlots;
+}
+
+void BytecodeCompiler::compileFunction(unsigned funcIdx) {
+  FunctionDecl *funcDecl = funcs[funcIdx].decl;
+  currentFunc = funcIdx;
+  funcs[funcIdx].entry = code.size();
+  slots.clear();
+
+  llvm::SmallVector<int32_t, 8> paramSlots =
+      getParamSlots(llvm::cast<CFuncType>(funcDecl->ty));
+  for (auto [param, slot]: llvm::zip(funcDecl->params, paramSlots)) {
+    slots[llvm::cast<VariableDecl>(param.get())->symbol.get()] = slot;
+  }
+  localTop = tempTop = frameSize = paramSlots.back();
+
+  emitStmt(funcDecl->body.get());
+  // Falling off the end returns 0, as C requires for `main`.
+  emitReturn(nullptr);
+
+  funcs[funcIdx].frameSize = llvm::alignTo(frameSize, FrameAlign);
+}
+
+int32_t BytecodeCompiler::allocLocal(CType *ty) {
+  int32_t slot = llvm::alignTo(std::max(localTop, tempTop), getSlotAlign(ty));
+  localTop = tempTop = slot + ty->getSize();
+  frameSize = std::max(frameSize, localTop);
+  return slot;
+}
+
+int32_t BytecodeCompiler::allocTemp(size_t size, size_t align) {
+  int32_t slot = llvm::alignTo(tempTop, std::min<size_t>(align, FrameAlign));
+  tempTop = slot + size;
+  frameSize = std::max(frameSize, tempTop);
+  return slot;
+}
+
+void BytecodeCompiler::emitMove(int32_t dst, int32_t src, CType *ty) {
+  if (dst == src) {
+    return;
+  }
+  switch (ty->getSize()) {
+  case 4:
+    emit(Op::MOV32, dst, src);
+    break;
+  case 8:
+    emit(Op::MOV64, dst, src);
+    break;
+  default:
+    emit(Op::MOVN, dst, src, ty->getSize());
+  }
+}
+
+StmtValue BytecodeCompiler::emitStmt(ASTNode *stmt) {
+  // No temporary lives across statements.
+  tempTop = localTop;
+
+  switch (stmt->getNodeKind()) {
+  case ASTNode::NodeKind::BlockStmt: {
+    StmtValue lastValue;
+    for (auto &child: llvm::cast<BlockStmt>(stmt)->stmtVec) {
+      lastValue = emitStmt(child.get());
+    }
+    return lastValue;
+  }
+  case ASTNode::NodeKind::DeclStmt: {
+    StmtValue lastValue;
+    for (auto &expr: llvm::cast<DeclStmt>(stmt)->exprVec) {
+      if (auto *varDecl = llvm::dyn_cast<VariableDecl>(expr.get())) {
+        // Globals already have a slot.
+        if (!slots.count(varDecl->symbol.get())) {
+          slots[varDecl->symbol.get()] = allocLocal(varDecl->ty);
+        }
+        lastValue = {};
+        continue;
+      }
+      lastValue = {emitExpr(expr.get()), expr->ty};
+    }
+    return lastValue;
+  }
+  case ASTNode::NodeKind::IfStmt: {
+    auto *ifStmt = llvm::cast<IfStmt>(stmt);
+    size_t toElse = emitBranch(ifStmt->condExpr.get(), false);
+    emitStmt(ifStmt->thenBody.get());
+    if (ifStmt->elseBody) {
+      size_t toEnd = emit(Op::JMP);
+      patch(toElse);
+      emitStmt(ifStmt->elseBody.get());
+      patch(toEnd);
+    }
+    else {
+      patch(toElse);
+    }
+    return {};
+  }
+  case ASTNode::NodeKind::ForStmt:
+    emitFor(llvm::cast<ForStmt>(stmt));
+    return {};
+  case ASTNode::NodeKind::BreakStmt:
+    loops[llvm::cast<BreakStmt>(stmt)->target.get()].breaks.push_back(
+        emit(Op::JMP));
+    return {};
+  case ASTNode::NodeKind::ContinueStmt:
+    loops[llvm::cast<ContinueStmt>(stmt)->target.get()].continues.push_back(
+        emit(Op::JMP));
+    return {};
+  case ASTNode::NodeKind::ReturnStmt:
+    emitReturn(llvm::cast<ReturnStmt>(stmt));
+    return {};
+  case ASTNode::NodeKind::FunctionDecl:
+    return {};
+  default:
+    return {emitExpr(stmt), stmt->ty};
+  }
+}
+
+/// Loops are rotated, the condition is tested at the bottom and jumps back
+/// to the body, so an iteration runs a single branch. A loop which may be
+/// compiled starts its header with a HOTLOOP, which every trip runs.
+void BytecodeCompiler::emitFor(ForStmt *forStmt) {
+  // Parallel loops run on this thread, in order.
+  hasParallelLoops |= forStmt->omp != nullptr;
+  if (forStmt->initExpr) {
+    emitStmt(forStmt->initExpr.get());
+  }
+  size_t toCond = forStmt->condExpr ? emit(Op::JMP) : 0;
+
+  // A parallel loop splits its trips from the init on, so it can't be
+  // entered at the header.
+  int32_t hotLoop = -1;
+  if (countLoops && !forStmt->omp && canCompileLoop(forStmt)) {
+    hotLoop = hotLoops.size();
+    hotLoops.push_back({forStmt, {}});
+    for (auto [symbol, slot]: slots) {
+      if (symbol->getKind() == SymbolKind::LocalVariable) {
+        hotLoops.back().locals.push_back({symbol, slot});
+      }
+    }
+  }
+  size_t bodyStart = code.size();
+  // Without a condition, the header is the start of the body.
+  size_t hotLoopInsn = 0;
+  if (hotLoop >= 0 && !forStmt->condExpr) {
+    hotLoopInsn = emit(Op::HOTLOOP, hotLoop);
+  }
+  loops[forStmt] = {};
+  if (forStmt->forBody) {
+    emitStmt(forStmt->forBody.get());
+  }
+  for (size_t jump: loops[forStmt].continues) {
+    patch(jump);
+  }
+  if (forStmt->incExpr) {
+    tempTop = localTop;
+    emitExpr(forStmt->incExpr.get());
+  }
+
+  tempTop = localTop;
+  if (forStmt->condExpr) {
+    patch(toCond);
+    if (hotLoop >= 0) {
+      hotLoopInsn = emit(Op::HOTLOOP, hotLoop);
+    }
+    code[emitBranch(forStmt->condExpr.get(), true)].a = bodyStart;
+  }
+  else {
+    emit(Op::JMP, bodyStart);
+  }
+  for (size_t jump: loops[forStmt].breaks) {
+    patch(jump);
+  }
+  if (hotLoop >= 0) {
+    code[hotLoopInsn].b = code.size();
+  }
+  loops.erase(forStmt);
+}
+
+void BytecodeCompiler::emitReturn(ReturnStmt *returnStmt) {
+  auto *funcDecl = funcs[currentFunc].decl;
+  CType *retTy = llvm::cast<CFuncType>(funcDecl->ty)->getRetTy();
+  ASTNode *expr = returnStmt ? returnStmt->expr.get() : nullptr;
+
+  // Self recursion in tail position reuses the frame, so deep recursion
+  // runs in constant stack like the `musttail` calls of the compiled code.
+  // A frame whose slots may be pointed to has to outlive the call, which
+  // then returns through CALL and RET instead.
+  auto *callExpr = llvm::dyn_cast_or_null<CallExpr>(expr);
+  if (callExpr && callExpr->calleeDecl->symbol == funcDecl->symbol &&
+      !funcDecl->frameAddressTaken) {
+    int32_t argBase = emitArgs(callExpr);
+    int32_t paramSize =
+        getParamSlots(llvm::cast<CFuncType>(funcDecl->ty)).back() -
+        FrameHeaderSize;
+    emit(Op::TAILCALL, argBase, paramSize, funcs[currentFunc].entry);
+    return;
+  }
+
+  int32_t value;
+  if (expr) {
+    value = emitExpr(expr);
+  }
+  else {
+    value = allocTemp(retTy);
+    emit(Op::ZERO, value, retTy->getSize());
+  }
+  emit(Op::RET, value, retTy->getSize());
+}
+
+/// Emit a jump, whose target is left to patch, taken if `cond` is
+/// `jumpIfTrue`. `int` comparisons fuse with the branch.
+size_t BytecodeCompiler::emitBranch(ASTNode *cond, bool jumpIfTrue) {
+  auto *binaryExpr = llvm::dyn_cast<BinaryExpr>(cond);
+  if (binaryExpr && isComparison(binaryExpr->op) &&
+      binaryExpr->lhs->ty->isInteger() && binaryExpr->rhs->ty->isInteger()) {
+    OpCode op = jumpIfTrue ? binaryExpr->op : invertComparison(binaryExpr->op);
+    if (auto *numberExpr =
+            llvm::dyn_cast<NumberExpr>(binaryExpr->rhs.get())) {
+      int32_t lhs = emitExpr(binaryExpr->lhs.get());
+      return emit(getComparisonOp(Op::JEQI, op), 0, lhs,
+                  numberExpr->tok.value);
+    }
+    auto [lhs, rhs] = emitOperands(binaryExpr->lhs.get(),
+                                   binaryExpr->rhs.get());
+    return emit(getComparisonOp(Op::JEQ, op), 0, lhs, rhs);
+  }
+
+  // Compare anything else against zero.
+  int32_t value = emitExpr(cond);
+  CType *ty = cond->ty;
+  if (llvm::isa<CPointerType>(ty)) {
+    return emit(jumpIfTrue ? Op::JNZ64 : Op::JZ64, 0, value);
+  }
+  if (ty->isFloating()) {
+    int32_t zero = allocTemp(ty);
+    int32_t isNonZero = allocTemp(4, 4);
+    if (ty->getKind() == TypeKind::Float) {
+      emit(Op::CONST32, zero, 0);
+      emit(Op::FNE, isNonZero, value, zero);
+    }
+    else {
+      emit(Op::CONST64, zero, 0, 0);
+      emit(Op::DNE, isNonZero, value, zero);
+    }
+    value = isNonZero;
+  }
+  return emit(jumpIfTrue ? Op::JNZ32 : Op::JZ32, 0, value);
+}
+
+/// Evaluate `expr` and return the slot of its value, which is `dst` unless
+/// that is -1. A variable is read from its own slot.
+int32_t BytecodeCompiler::emitExpr(ASTNode *expr, int32_t dst) {
+  int32_t slot = emitExprImpl(expr, dst);
+  if (dst >= 0 && slot != dst) {
+    emitMove(dst, slot, expr->ty);
+    return dst;
+  }
+  return slot;
+}
+
+int32_t BytecodeCompiler::emitExprImpl(ASTNode *expr, int32_t dst) {
+  switch (expr->getNodeKind()) {
+  case ASTNode::NodeKind::NumberExpr:
+    dst = getDst(dst, expr->ty);
+    emit(Op::CONST32, dst, expr->tok.value);
+    return dst;
+  case ASTNode::NodeKind::FloatExpr: {
+    double value = llvm::cast<FloatExpr>(expr)->value;
+    dst = getDst(dst, expr->ty);
+    if (expr->ty->getKind() == TypeKind::Float) {
+      emit(Op::CONST32, dst, llvm::bit_cast<int32_t>(float(value)));
+    }
+    else {
+      uint64_t bits = llvm::bit_cast<uint64_t>(value);
+      emit(Op::CONST64, dst, int32_t(bits), int32_t(bits >> 32));
+    }
+    return dst;
+  }
+  case ASTNode::NodeKind::VariableExpr:
+  case ASTNode::NodeKind::SubscriptExpr:
+  case ASTNode::NodeKind::MemberExpr:
+    return emitLoad(getLValue(expr), expr->ty, dst);
+  case ASTNode::NodeKind::AssignExpr: {
+    auto *assignExpr = llvm::cast<AssignExpr>(expr);
+    auto *varExpr = llvm::dyn_cast<VariableExpr>(assignExpr->lhs.get());
+    if (varExpr && slots.count(varExpr->symbol.get())) {
+      // The value is computed right into the variable.
+      int32_t slot = slots[varExpr->symbol.get()];
+      return emitExpr(assignExpr->rhs.get(), slot);
+    }
+    int32_t value = emitExpr(assignExpr->rhs.get());
+    emitStore(getLValue(assignExpr->lhs.get()), value, expr->ty);
+    return value;
+  }
+  case ASTNode::NodeKind::BinaryExpr:
+    return emitBinary(llvm::cast<BinaryExpr>(expr), dst);
+  case ASTNode::NodeKind::UnaryExpr: {
+    auto *unaryExpr = llvm::cast<UnaryExpr>(expr);
+    switch (unaryExpr->op) {
+    case OpCode::bitwisenot: {
+      int32_t operand = emitExpr(unaryExpr->operand.get());
+      dst = getDst(dst, expr->ty);
+      for (unsigned i = 0; i < getNumElems(expr->ty); ++i) {
+        emit(Op::NOT, dst + i * 4, operand + i * 4);
+      }
+      return dst;
+    }
+    case OpCode::addrof:
+      return emitAddr(getLValue(unaryExpr->operand.get()), dst);
+    case OpCode::deref:
+      return emitLoad(getLValue(expr), expr->ty, dst);
+    default:
+      llvm_unreachable("Unexpected unary operator");
+    }
+  }
+  case ASTNode::NodeKind::ConditionalExpr: {
+    auto *condExpr = llvm::cast<ConditionalExpr>(expr);
+    dst = getDst(dst, expr->ty);
+    size_t toElse = emitBranch(condExpr->condExpr.get(), false);
+    emitExpr(condExpr->thenExpr.get(), dst);
+    size_t toEnd = emit(Op::JMP);
+    patch(toElse);
+    emitExpr(condExpr->elseExpr.get(), dst);
+    patch(toEnd);
+    return dst;
+  }
+  case ASTNode::NodeKind::ImplicitCastExpr:
+    return emitCast(llvm::cast<ImplicitCastExpr>(expr), dst);
+  case ASTNode::NodeKind::CallExpr:
+    return emitCall(llvm::cast<CallExpr>(expr), dst);
+  case ASTNode::NodeKind::BuiltinCallExpr:
+    return emitBuiltin(llvm::cast<BuiltinCallExpr>(expr), dst);
+  default:
+    llvm_unreachable("Unexpected expression");
+  }
+}
+
+std::pair<int32_t, int32_t> BytecodeCompiler::emitOperands(ASTNode *lhs,
+                                                           ASTNode *rhs) {
+  int32_t lhsSlot = hasSideEffects(rhs) ? emitExpr(lhs, allocTemp(lhs->ty))
+                                        : emitExpr(lhs);
+  return {lhsSlot, emitExpr(rhs)};
+}
+
+int32_t BytecodeCompiler::emitBinary(BinaryExpr *binaryExpr, int32_t dst) {
+  CType *lhsTy = binaryExpr->lhs->ty;
+  bool isPointerOp = llvm::isa<CPointerType>(lhsTy) ||
+                     llvm::isa<CPointerType>(binaryExpr->rhs->ty);
+  if (isPointerOp &&
+      (binaryExpr->op == OpCode::add || binaryExpr->op == OpCode::sub)) {
+    return emitPointerArithmetic(binaryExpr, dst);
+  }
+
+  // `i + 1` and `n * 4` take the constant as an immediate, so does `4 * n`.
+  ASTNode *varExpr = binaryExpr->lhs.get();
+  auto *numberExpr = llvm::dyn_cast<NumberExpr>(binaryExpr->rhs.get());
+  if (!numberExpr && binaryExpr->rhs->ty->isInteger() &&
+      (binaryExpr->op == OpCode::add || binaryExpr->op == OpCode::mul)) {
+    numberExpr = llvm::dyn_cast<NumberExpr>(binaryExpr->lhs.get());
+    varExpr = binaryExpr->rhs.get();
+  }
+  if (numberExpr && lhsTy->isInteger() &&
+      (binaryExpr->op == OpCode::add || binaryExpr->op == OpCode::sub ||
+       binaryExpr->op == OpCode::mul)) {
+    int32_t lhs = emitExpr(varExpr);
+    dst = getDst(dst, binaryExpr->ty);
+    int32_t imm = numberExpr->tok.value;
+    if (binaryExpr->op == OpCode::mul) {
+      emit(Op::MULI, dst, lhs, imm);
+    }
+    else {
+      // Negate in unsigned arithmetic, which wraps like the `int` add does.
+      emit(Op::ADDI, dst, lhs,
+           binaryExpr->op == OpCode::add ? imm : int32_t(0u - uint32_t(imm)));
+    }
+    return dst;
+  }
+
+  auto [lhs, rhs] = emitOperands(binaryExpr->lhs.get(),
+                                 binaryExpr->rhs.get());
+  dst = getDst(dst, binaryExpr->ty);
+  CType *scalarTy = lhsTy->getScalarTy();
+  Op op = getBinaryOp(binaryExpr->op, scalarTy);
+  // Vectors are unrolled. Comparisons of doubles give `int` elements.
+  unsigned inSize = scalarTy->getSize();
+  unsigned outSize = binaryExpr->ty->getScalarTy()->getSize();
+  unsigned numElems = getNumElems(lhsTy);
+  for (unsigned i = 0; i < numElems; ++i) {
+    emit(op, dst + i * outSize, lhs + i * inSize, rhs + i * inSize);
+  }
+  // Vector comparisons give -1 rather than 1, like GCC.
+  if (llvm::isa<CVectorType>(lhsTy) && isComparison(binaryExpr->op)) {
+    for (unsigned i = 0; i < numElems; ++i) {
+      emit(Op::NEG, dst + i * 4, dst + i * 4);
+    }
+  }
+  return dst;
+}
+
+/// Pointer arithmetic counts in elements of the pointee type.
+int32_t BytecodeCompiler::emitPointerArithmetic(BinaryExpr *binaryExpr,
+                                                int32_t dst) {
+  ASTNode *ptrExpr = binaryExpr->lhs.get();
+  ASTNode *indexExpr = binaryExpr->rhs.get();
+  if (llvm::isa<CPointerType>(indexExpr->ty)) {
+    if (llvm::isa<CPointerType>(ptrExpr->ty)) {
+      auto [lhs, rhs] = emitOperands(ptrExpr, indexExpr);
+      dst = getDst(dst, binaryExpr->ty);
+      emit(Op::PDIFF, dst, lhs, rhs,
+           llvm::cast<CPointerType>(ptrExpr->ty)->getPointeeTy()->getSize());
+      return dst;
+    }
+    // `n + p` is `p + n`.
+    std::swap(ptrExpr, indexExpr);
+  }
+
+  int32_t scale =
+      llvm::cast<CPointerType>(ptrExpr->ty)->getPointeeTy()->getSize();
+  if (binaryExpr->op == OpCode::sub) {
+    scale = -scale;
+  }
+  if (auto *numberExpr = llvm::dyn_cast<NumberExpr>(indexExpr)) {
+    int32_t ptr = emitExpr(ptrExpr);
+    dst = getDst(dst, binaryExpr->ty);
+    emit(Op::PADDI, dst, ptr, numberExpr->tok.value * scale);
+    return dst;
+  }
+  auto [ptr, index] = emitOperands(ptrExpr, indexExpr);
+  dst = getDst(dst, binaryExpr->ty);
+  emit(Op::PIDX, dst, ptr, index, scale);
+  return dst;
+}
+
+int32_t BytecodeCompiler::emitCast(ImplicitCastExpr *castExpr, int32_t dst) {
+  switch (castExpr->castKind) {
+  case CastKind::ArrayToPointerDecay:
+    return emitAddr(getLValue(castExpr->operand.get()), dst);
+  case CastKind::NullToPointer:
+    dst = getDst(dst, castExpr->ty);
+    emit(Op::CONST64, dst, 0, 0);
+    return dst;
+  case CastKind::VectorSplat:
+    return emitSplat(emitExpr(castExpr->operand.get()),
+                     llvm::cast<CVectorType>(castExpr->ty), dst);
+  case CastKind::IntegralToFloating:
+  case CastKind::FloatingToIntegral:
+  case CastKind::FloatingCast: {
+    CType *fromTy = castExpr->operand->ty->getScalarTy();
+    CType *toTy = castExpr->ty->getScalarTy();
+    int32_t operand = emitExpr(castExpr->operand.get());
+    if (fromTy == toTy) {
+      return operand;
+    }
+    dst = getDst(dst, castExpr->ty);
+    Op op = getConversionOp(fromTy, toTy);
+    for (unsigned i = 0; i < getNumElems(castExpr->ty); ++i) {
+      emit(op, dst + i * toTy->getSize(), operand + i * fromTy->getSize());
+    }
+    return dst;
+  }
+  }
+  llvm_unreachable("Unknown cast kind");
+}
+
+int32_t BytecodeCompiler::emitSplat(int32_t src, CVectorType *vectorTy,
+                                    int32_t dst) {
+  dst = getDst(dst, vectorTy);
+  CType *elemTy = vectorTy->getElemTy();
+  for (unsigned i = 0; i < vectorTy->getNumElems(); ++i) {
+    emitMove(dst + i * elemTy->getSize(), src, elemTy);
+  }
+  return dst;
+}
+
+/// Evaluate the arguments of a call where the frame of the callee will
+/// start, above every live temporary, and return that slot.
+int32_t BytecodeCompiler::emitArgs(CallExpr *callExpr) {
+  llvm::SmallVector<int32_t, 8> paramSlots =
+      getParamSlots(llvm::cast<CFuncType>(callExpr->calleeDecl->ty));
+  int32_t argBase = llvm::alignTo(tempTop, FrameAlign);
+  tempTop = argBase + paramSlots.back();
+  frameSize = std::max(frameSize, tempTop);
+  for (auto [arg, slot]: llvm::zip(callExpr->args, paramSlots)) {
+    emitExpr(arg.get(), argBase + slot);
+  }
+  return argBase;
+}
+
+int32_t BytecodeCompiler::emitCall(CallExpr *callExpr, int32_t dst) {
+  unsigned funcIdx = getFunctionIndex(callExpr->calleeDecl);
+  funcs[funcIdx].isCalled = true;
+  dst = getDst(dst, callExpr->ty);
+  int32_t argBase = emitArgs(callExpr);
+  emit(Op::CALL, dst, funcIdx, argBase);
+  // The arguments are dead once the call returns.
+  tempTop = argBase;
+  return dst;
+}
+
+int32_t BytecodeCompiler::emitBuiltin(BuiltinCallExpr *callExpr,
+                                      int32_t dst) {
+  int32_t arg = emitExpr(callExpr->args[0].get());
+  CType *argTy = callExpr->args[0]->ty;
+  CType *scalarTy = argTy->getScalarTy();
+  unsigned elemSize = scalarTy->getSize();
+  unsigned numElems = getNumElems(argTy);
+
+  Op op;
+  switch (callExpr->builtinKind) {
+  case BuiltinKind::ShuffleVector: {
+    int32_t other = emitExpr(callExpr->args[1].get());
+    // The result may not overwrite an operand it still reads.
+    int32_t result = allocTemp(callExpr->ty);
+    for (size_t i = 2; i < callExpr->args.size(); ++i) {
+      int mask = llvm::cast<NumberExpr>(callExpr->args[i].get())->number;
+      if (mask < 0) {
+        continue;
+      }
+      int32_t src = unsigned(mask) < numElems
+                        ? arg + mask * elemSize
+                        : other + (mask - numElems) * elemSize;
+      emitMove(result + (i - 2) * elemSize, src, scalarTy);
+    }
+    return result;
+  }
+  case BuiltinKind::Splat:
+    return emitSplat(arg, llvm::cast<CVectorType>(callExpr->ty), dst);
+  // Reductions are done in order, from the first element on.
+  case BuiltinKind::ReduceAdd:
+    op = getBinaryOp(OpCode::add, scalarTy);
+    break;
+  case BuiltinKind::ReduceMul:
+    op = getBinaryOp(OpCode::mul, scalarTy);
+    break;
+  case BuiltinKind::ReduceMin:
+    op = scalarTy->isInteger() ? Op::IMIN
+         : scalarTy->getKind() == TypeKind::Float ? Op::FMIN : Op::DMIN;
+    break;
+  case BuiltinKind::ReduceMax:
+    op = scalarTy->isInteger() ? Op::IMAX
+         : scalarTy->getKind() == TypeKind::Float ? Op::FMAX : Op::DMAX;
+    break;
+  case BuiltinKind::ReduceAnd:
+    op = Op::AND;
+    break;
+  case BuiltinKind::ReduceOr:
+    op = Op::OR;
+    break;
+  case BuiltinKind::ReduceXor:
+    op = Op::XOR;
+    break;
+  }
+
+  dst = getDst(dst, callExpr->ty);
+  emitMove(dst, arg, scalarTy);
+  for (unsigned i = 1; i < numElems; ++i) {
+    emit(op, dst, dst, arg + i * elemSize);
+  }
+  return dst;
+}
+
+LValue BytecodeCompiler::getLValue(ASTNode *expr) {
+  if (auto *varExpr = llvm::dyn_cast<VariableExpr>(expr)) {
+    auto it = slots.find(varExpr->symbol.get());
+    if (it != slots.end()) {
+      return {LValue::Frame, it->second};
+    }
+    return {LValue::Global, globalSlots.lookup(varExpr->symbol.get())};
+  }
+  if (auto *unaryExpr = llvm::dyn_cast<UnaryExpr>(expr)) {
+    assert(unaryExpr->op == OpCode::deref && "Not an lvalue");
+    return {LValue::Pointer, emitExpr(unaryExpr->operand.get())};
+  }
+  if (auto *memberExpr = llvm::dyn_cast<MemberExpr>(expr)) {
+    // A `soa` array is laid out like any other array here.
+    int32_t offset = memberExpr->getField().offset;
+    if (memberExpr->isArrow) {
+      return {LValue::Pointer, emitExpr(memberExpr->base.get()), offset};
+    }
+    return addOffset(getBaseLValue(memberExpr->base.get()), offset);
+  }
+
+  auto *subscriptExpr = llvm::cast<SubscriptExpr>(expr);
+  LValue base = llvm::isa<CPointerType>(subscriptExpr->base->ty)
+                    ? LValue{LValue::Pointer,
+                             emitExpr(subscriptExpr->base.get())}
+                    : getBaseLValue(subscriptExpr->base.get());
+  return addIndex(base, subscriptExpr->index.get(),
+                  subscriptExpr->ty->getSize());
+}
+
+/// The struct, array or vector a member or an element is taken from. A
+/// value that isn't an lvalue, like `f().x`, is in a temporary slot.
+LValue BytecodeCompiler::getBaseLValue(ASTNode *base) {
+  if (isLValueExpr(base)) {
+    return getLValue(base);
+  }
+  return {LValue::Frame, emitExpr(base)};
+}
+
+LValue BytecodeCompiler::addOffset(LValue lv, int32_t offset) {
+  if (lv.kind != LValue::Pointer) {
+    lv.base += offset;
+    return lv;
+  }
+  if (lv.index >= 0) {
+    lv = toPointer(lv);
+  }
+  lv.offset += offset;
+  return lv;
+}
+
+LValue BytecodeCompiler::addIndex(LValue lv, ASTNode *indexExpr,
+                                  int32_t scale) {
+  if (auto *numberExpr = llvm::dyn_cast<NumberExpr>(indexExpr)) {
+    return addOffset(lv, numberExpr->tok.value * scale);
+  }
+  int32_t index = emitExpr(indexExpr);
+  if (lv.index >= 0 || (lv.kind == LValue::Pointer && lv.offset != 0)) {
+    lv = toPointer(lv);
+  }
+  lv.index = index;
+  lv.scale = scale;
+  return lv;
+}
+
+/// Compute the address into a pointer with nothing to add.
+LValue BytecodeCompiler::toPointer(const LValue &lv) {
+  return {LValue::Pointer, emitAddr(lv)};
+}
+
+int32_t BytecodeCompiler::emitAddr(const LValue &lv, int32_t dst) {
+  if (lv.kind == LValue::Pointer && lv.index < 0 && lv.offset == 0) {
+    if (dst < 0) {
+      return lv.base;
+    }
+    emit(Op::MOV64, dst, lv.base);
+    return dst;
+  }
+
+  dst = dst >= 0 ? dst : allocTemp(8, 8);
+  int32_t ptr = lv.base;
+  if (lv.kind == LValue::Frame) {
+    emit(Op::FADDR, dst, lv.base);
+    ptr = dst;
+  }
+  else if (lv.kind == LValue::Global) {
+    emit(Op::GADDR, dst, lv.base);
+    ptr = dst;
+  }
+  else if (lv.offset != 0) {
+    emit(Op::PADDI, dst, lv.base, lv.offset);
+    ptr = dst;
+  }
+  if (lv.index >= 0) {
+    emit(Op::PIDX, dst, ptr, lv.index, lv.scale);
+  }
+  return dst;
+}
+
+int32_t BytecodeCompiler::emitLoad(const LValue &lv, CType *ty, int32_t dst) {
+  size_t size = ty->getSize();
+  bool isWord = size == 4 || size == 8;
+  if (lv.kind == LValue::Frame && lv.index < 0) {
+    return lv.base;
+  }
+  if (lv.kind == LValue::Frame && isWord) {
+    dst = getDst(dst, ty);
+    emit(size == 4 ? Op::LDX32 : Op::LDX64, dst, lv.base, lv.index, lv.scale);
+    return dst;
+  }
+  if (lv.kind == LValue::Global && lv.index < 0 && isWord) {
+    dst = getDst(dst, ty);
+    emit(size == 4 ? Op::LDG32 : Op::LDG64, dst, lv.base);
+    return dst;
+  }
+
+  LValue ptr = lv;
+  if (lv.kind != LValue::Pointer || (lv.index >= 0 && !isWord)) {
+    ptr = toPointer(lv);
+  }
+  dst = getDst(dst, ty);
+  if (ptr.index >= 0) {
+    emit(size == 4 ? Op::LDPX32 : Op::LDPX64, dst, ptr.base, ptr.index,
+         ptr.scale);
+  }
+  else if (isWord) {
+    emit(size == 4 ? Op::LDP32 : Op::LDP64, dst, ptr.base, ptr.offset);
+  }
+  else {
+    emit(Op::LDPN, dst, ptr.base, ptr.offset, size);
+  }
+  return dst;
+}
+
+void BytecodeCompiler::emitStore(const LValue &lv, int32_t src, CType *ty) {
+  size_t size = ty->getSize();
+  bool isWord = size == 4 || size == 8;
+  if (lv.kind == LValue::Frame && lv.index < 0) {
+    emitMove(lv.base, src, ty);
+    return;
+  }
+  if (lv.kind == LValue::Frame && isWord) {
+    emit(size == 4 ? Op::STX32 : Op::STX64, lv.base, lv.index, lv.scale, src);
+    return;
+  }
+  if (lv.kind == LValue::Global && lv.index < 0 && isWord) {
+    emit(size == 4 ? Op::STG32 : Op::STG64, lv.base, src);
+    return;
+  }
+
+  LValue ptr = lv;
+  if (lv.kind != LValue::Pointer || (lv.index >= 0 && !isWord)) {
+    ptr = toPointer(lv);
+  }
+  if (ptr.index >= 0) {
+    emit(size == 4 ? Op::STPX32 : Op::STPX64, ptr.base, ptr.index, ptr.scale,
+         src);
+  }
+  else if (isWord) {
+    emit(size == 4 ? Op::STP32 : Op::STP64, ptr.base, ptr.offset, src);
+  }
+  else {
+    emit(Op::STPN, ptr.base, ptr.offset, src, size);
+  }
+}
+
+template <typename T> static inline T load(const uint8_t *p) {
+  T value;
+  std::memcpy(&value, p, sizeof(T));
+  return value;
+}
+
+template <typename T> static inline void store(uint8_t *p, T value) {
+  std::memcpy(p, &value, sizeof(T));
+}
+
+/// The frame of the start code, saved by evaluateProgram after each file
+/// scope statement.
+struct Checkpoint {
+  size_t numStmts = 0;
+  std::vector<uint8_t> frame;
+  bool finished = false;
+};
+
+struct RunOptions {
+  size_t stackSize = StackSize;
+  LoopCompiler compileLoop;
+  unsigned hotLoopThreshold = 0;
+  // The number of instructions to run, if Budgeted.
+  uint64_t steps = 0;
+  // Null unless evaluating at compile time.
+  Checkpoint *checkpoint = nullptr;
+};
+
+/// Execute the bytecode. Budgeted counts down the steps of `opts` in the
+/// dispatch, the other instantiation pays nothing for it.
+template <bool Budgeted>
+static llvm::Expected<int> run(BytecodeCompiler &bc, llvm::raw_ostream &os,
+                               const RunOptions &opts) {
+  // Calloc'ed pages are zero, the value of globals without an initializer.
+  size_t memSize = bc.globalFrameSize + opts.stackSize;
+  std::unique_ptr<uint8_t, decltype(&std::free)> mem(
+      static_cast<uint8_t *>(std::calloc(memSize + FrameAlign, 1)),
+      &std::free);
+  if (!mem) {
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "cannot allocate the globals and stack");
+  }
+
+  uint8_t *const globals = reinterpret_cast<uint8_t *>(
+      llvm::alignTo(reinterpret_cast<uintptr_t>(mem.get()), FrameAlign));
+  uint8_t *const stackEnd = globals + memSize;
+  const Insn *const code = bc.code.data();
+  const BytecodeFunction *const funcs = bc.funcs.data();
+  HotLoop *const hotLoops = bc.hotLoops.data();
+  std::vector<std::pair<Symbol *, void *>> globalAddrs;
+  for (auto [symbol, slot]: bc.globalSlots) {
+    globalAddrs.push_back({symbol, globals + slot});
+  }
+  const Insn *pc = code;
+  uint8_t *fp = globals;
+  const char *trap = nullptr;
+  uint64_t stepsLeft = opts.steps;
+
+#define GET(T, slot) load<T>(fp + (slot))
+#define SET(T, slot, value) store<T>(fp + (slot), (value))
+#define TRAP(msg) do { trap = msg; goto trapped; } while (0)
+
+#if INTERP_COMPUTED_GOTO
+  static const void *const dispatchTable[] = {
+#define OPCODE(NAME) &&op_##NAME,
+#include "Bytecode.h.inc"
+  };
+#define CASE(NAME) op_##NAME:
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    if (Budgeted && stepsLeft-- == 0) TRAP("out of budget");                   \
+    goto *dispatchTable[unsigned(pc->op)];                                     \
+  } while (0)
+#else
+#define CASE(NAME) case Op::NAME:
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    if (Budgeted && stepsLeft-- == 0) TRAP("out of budget");                   \
+    goto dispatch;                                                             \
+  } while (0)
+#endif
+#define NEXT() do { ++pc; DISPATCH(); } while (0)
+#define JUMP(target) do { pc = code + (target); DISPATCH(); } while (0)
+
+// `int` arithmetic wraps, in unsigned.
+#define INT_BINARY(NAME, EXPR)                                                 \
+  CASE(NAME) {                                                                 \
+    uint32_t lhs = GET(uint32_t, pc->b), rhs = GET(uint32_t, pc->c);          \
+    SET(uint32_t, pc->a, EXPR);                                                \
+    NEXT();                                                                    \
+  }
+#define COMPARE(NAME, T, CMP)                                                  \
+  CASE(NAME) {                                                                 \
+    SET(int32_t, pc->a, int32_t(GET(T, pc->b) CMP GET(T, pc->c)));            \
+    NEXT();                                                                    \
+  }
+#define FLOAT_BINARY(NAME, T, EXPR)                                            \
+  CASE(NAME) {                                                                 \
+    T lhs = GET(T, pc->b), rhs = GET(T, pc->c);                                \
+    SET(T, pc->a, EXPR);                                                       \
+    NEXT();                                                                    \
+  }
+#define CONVERT(NAME, FROM, TO)                                                \
+  CASE(NAME) {                                                                 \
+    SET(TO, pc->a, TO(GET(FROM, pc->b)));                                      \
+    NEXT();                                                                    \
+  }
+#define BRANCH(NAME, CMP)                                                      \
+  CASE(NAME) {                                                                 \
+    if (GET(int32_t, pc->b) CMP GET(int32_t, pc->c)) JUMP(pc->a);             \
+    NEXT();                                                                    \
+  }
+#define BRANCH_IMM(NAME, CMP)                                                  \
+  CASE(NAME) {                                                                 \
+    if (GET(int32_t, pc->b) CMP pc->c) JUMP(pc->a);                            \
+    NEXT();                                                                    \
+  }
+
+#if INTERP_COMPUTED_GOTO
+  DISPATCH();
+#else
+dispatch:
+  switch (pc->op) {
+#endif
+
+  CASE(MOV32) { SET(uint32_t, pc->a, GET(uint32_t, pc->b)); NEXT(); }
+  CASE(MOV64) { SET(uint64_t, pc->a, GET(uint64_t, pc->b)); NEXT(); }
+  CASE(MOVN) { std::memmove(fp + pc->a, fp + pc->b, pc->c); NEXT(); }
+  CASE(ZERO) { std::memset(fp + pc->a, 0, pc->b); NEXT(); }
+  CASE(CONST32) { SET(int32_t, pc->a, pc->b); NEXT(); }
+  CASE(CONST64) {
+    SET(uint64_t, pc->a,
+        uint64_t(uint32_t(pc->b)) | uint64_t(uint32_t(pc->c)) << 32);
+    NEXT();
+  }
+
+  CASE(FADDR) { SET(uint8_t *, pc->a, fp + pc->b); NEXT(); }
+  CASE(GADDR) { SET(uint8_t *, pc->a, globals + pc->b); NEXT(); }
+  CASE(PADDI) { SET(uint8_t *, pc->a, GET(uint8_t *, pc->b) + pc->c); NEXT(); }
+  CASE(PIDX) {
+    SET(uint8_t *, pc->a,
+        GET(uint8_t *, pc->b) + int64_t(GET(int32_t, pc->c)) * pc->d);
+    NEXT();
+  }
+  CASE(PDIFF) {
+    SET(int32_t, pc->a,
+        int32_t((GET(uint8_t *, pc->b) - GET(uint8_t *, pc->c)) / pc->d));
+    NEXT();
+  }
+
+  CASE(LDG32) { SET(uint32_t, pc->a, load<uint32_t>(globals + pc->b)); NEXT(); }
+  CASE(LDG64) { SET(uint64_t, pc->a, load<uint64_t>(globals + pc->b)); NEXT(); }
+  CASE(STG32) { store<uint32_t>(globals + pc->a, GET(uint32_t, pc->b)); NEXT(); }
+  CASE(STG64) { store<uint64_t>(globals + pc->a, GET(uint64_t, pc->b)); NEXT(); }
+  CASE(LDP32) {
+    SET(uint32_t, pc->a, load<uint32_t>(GET(uint8_t *, pc->b) + pc->c));
+    NEXT();
+  }
+  CASE(LDP64) {
+    SET(uint64_t, pc->a, load<uint64_t>(GET(uint8_t *, pc->b) + pc->c));
+    NEXT();
+  }
+  CASE(LDPN) {
+    std::memmove(fp + pc->a, GET(uint8_t *, pc->b) + pc->c, pc->d);
+    NEXT();
+  }
+  CASE(STP32) {
+    store<uint32_t>(GET(uint8_t *, pc->a) + pc->b, GET(uint32_t, pc->c));
+    NEXT();
+  }
+  CASE(STP64) {
+    store<uint64_t>(GET(uint8_t *, pc->a) + pc->b, GET(uint64_t, pc->c));
+    NEXT();
+  }
+  CASE(STPN) {
+    std::memmove(GET(uint8_t *, pc->a) + pc->b, fp + pc->c, pc->d);
+    NEXT();
+  }
+  CASE(LDX32) {
+    SET(uint32_t, pc->a,
+        load<uint32_t>(fp + pc->b + int64_t(GET(int32_t, pc->c)) * pc->d));
+    NEXT();
+  }
+  CASE(LDX64) {
+    SET(uint64_t, pc->a,
+        load<uint64_t>(fp + pc->b + int64_t(GET(int32_t, pc->c)) * pc->d));
+    NEXT();
+  }
+  CASE(STX32) {
+    store<uint32_t>(fp + pc->a + int64_t(GET(int32_t, pc->b)) * pc->c,
+                    GET(uint32_t, pc->d));
+    NEXT();
+  }
+  CASE(STX64) {
+    store<uint64_t>(fp + pc->a + int64_t(GET(int32_t, pc->b)) * pc->c,
+                    GET(uint64_t, pc->d));
+    NEXT();
+  }
+  CASE(LDPX32) {
+    SET(uint32_t, pc->a,
+        load<uint32_t>(GET(uint8_t *, pc->b) +
+                       int64_t(GET(int32_t, pc->c)) * pc->d));
+    NEXT();
+  }
+  CASE(LDPX64) {
+    SET(uint64_t, pc->a,
+        load<uint64_t>(GET(uint8_t *, pc->b) +
+                       int64_t(GET(int32_t, pc->c)) * pc->d));
+    NEXT();
+  }
+  CASE(STPX32) {
+    store<uint32_t>(GET(uint8_t *, pc->a) + int64_t(GET(int32_t, pc->b)) * pc->c,
+                    GET(uint32_t, pc->d));
+    NEXT();
+  }
+  CASE(STPX64) {
+    store<uint64_t>(GET(uint8_t *, pc->a) + int64_t(GET(int32_t, pc->b)) * pc->c,
+                    GET(uint64_t, pc->d));
+    NEXT();
+  }
+
+  INT_BINARY(ADD, lhs + rhs)
+  INT_BINARY(SUB, lhs - rhs)
+  INT_BINARY(MUL, lhs * rhs)
+  INT_BINARY(AND, lhs & rhs)
+  INT_BINARY(OR, lhs | rhs)
+  INT_BINARY(XOR, lhs ^ rhs)
+  // The shift amount is taken modulo 32, like x86 does.
+  INT_BINARY(SHL, lhs << (rhs & 31))
+  INT_BINARY(SHR, uint32_t(int32_t(lhs) >> (rhs & 31)))
+  CASE(DIV) {
+    int32_t lhs = GET(int32_t, pc->b), rhs = GET(int32_t, pc->c);
+    if (rhs == 0 || (lhs == INT32_MIN && rhs == -1)) TRAP("integer division by zero or overflow");
+    SET(int32_t, pc->a, lhs / rhs);
+    NEXT();
+  }
+  CASE(MOD) {
+    int32_t lhs = GET(int32_t, pc->b), rhs = GET(int32_t, pc->c);
+    if (rhs == 0 || (lhs == INT32_MIN && rhs == -1)) TRAP("integer division by zero or overflow");
+    SET(int32_t, pc->a, lhs % rhs);
+    NEXT();
+  }
+  CASE(ADDI) {
+    SET(uint32_t, pc->a, GET(uint32_t, pc->b) + uint32_t(pc->c));
+    NEXT();
+  }
+  CASE(MULI) {
+    SET(uint32_t, pc->a, GET(uint32_t, pc->b) * uint32_t(pc->c));
+    NEXT();
+  }
+  CASE(IMIN) {
+    SET(int32_t, pc->a, std::min(GET(int32_t, pc->b), GET(int32_t, pc->c)));
+    NEXT();
+  }
+  CASE(IMAX) {
+    SET(int32_t, pc->a, std::max(GET(int32_t, pc->b), GET(int32_t, pc->c)));
+    NEXT();
+  }
+  CASE(NOT) { SET(uint32_t, pc->a, ~GET(uint32_t, pc->b)); NEXT(); }
+  CASE(NEG) { SET(uint32_t, pc->a, 0u - GET(uint32_t, pc->b)); NEXT(); }
+  COMPARE(EQ, int32_t, ==)
+  COMPARE(NE, int32_t, !=)
+  COMPARE(LT, int32_t, <)
+  COMPARE(LE, int32_t, <=)
+  COMPARE(GT, int32_t, >)
+  COMPARE(GE, int32_t, >=)
+  COMPARE(PEQ, uintptr_t, ==)
+  COMPARE(PNE, uintptr_t, !=)
+  COMPARE(PLT, uintptr_t, <)
+  COMPARE(PLE, uintptr_t, <=)
+  COMPARE(PGT, uintptr_t, >)
+  COMPARE(PGE, uintptr_t, >=)
+
+  FLOAT_BINARY(FADD, float, lhs + rhs)
+  FLOAT_BINARY(FSUB, float, lhs - rhs)
+  FLOAT_BINARY(FMUL, float, lhs * rhs)
+  FLOAT_BINARY(FDIV, float, lhs / rhs)
+  FLOAT_BINARY(FMIN, float, std::fmin(lhs, rhs))
+  FLOAT_BINARY(FMAX, float, std::fmax(lhs, rhs))
+  // Ordered comparisons are false for NaN, except `!=`.
+  COMPARE(FEQ, float, ==)
+  COMPARE(FNE, float, !=)
+  COMPARE(FLT, float, <)
+  COMPARE(FLE, float, <=)
+  COMPARE(FGT, float, >)
+  COMPARE(FGE, float, >=)
+  FLOAT_BINARY(DADD, double, lhs + rhs)
+  FLOAT_BINARY(DSUB, double, lhs - rhs)
+  FLOAT_BINARY(DMUL, double, lhs * rhs)
+  FLOAT_BINARY(DDIV, double, lhs / rhs)
+  FLOAT_BINARY(DMIN, double, std::fmin(lhs, rhs))
+  FLOAT_BINARY(DMAX, double, std::fmax(lhs, rhs))
+  COMPARE(DEQ, double, ==)
+  COMPARE(DNE, double, !=)
+  COMPARE(DLT, double, <)
+  COMPARE(DLE, double, <=)
+  COMPARE(DGT, double, >)
+  COMPARE(DGE, double, >=)
+  CONVERT(I2F, int32_t, float)
+  CONVERT(I2D, int32_t, double)
+  CONVERT(F2I, float, int32_t)
+  CONVERT(D2I, double, int32_t)
+  CONVERT(F2D, float, double)
+  CONVERT(D2F, double, float)
+
+  CASE(JMP) { JUMP(pc->a); }
+  CASE(JZ32) { if (GET(int32_t, pc->b) == 0) JUMP(pc->a); NEXT(); }
+  CASE(JNZ32) { if (GET(int32_t, pc->b) != 0) JUMP(pc->a); NEXT(); }
+  CASE(JZ64) { if (GET(uint64_t, pc->b) == 0) JUMP(pc->a); NEXT(); }
+  CASE(JNZ64) { if (GET(uint64_t, pc->b) != 0) JUMP(pc->a); NEXT(); }
+  BRANCH(JEQ, ==)
+  BRANCH(JNE, !=)
+  BRANCH(JLT, <)
+  BRANCH(JLE, <=)
+  BRANCH(JGT, >)
+  BRANCH(JGE, >=)
+  BRANCH_IMM(JEQI, ==)
+  BRANCH_IMM(JNEI, !=)
+  BRANCH_IMM(JLTI, <)
+  BRANCH_IMM(JLEI, <=)
+  BRANCH_IMM(JGTI, >)
+  BRANCH_IMM(JGEI, >=)
+
+  CASE(HOTLOOP) {
+    HotLoop &loop = hotLoops[pc->a];
+    if (!loop.compiled && ++loop.trips == opts.hotLoopThreshold) {
+      loop.compiled = opts.compileLoop(loop.loop, {loop.locals, globalAddrs});
+    }
+    if (loop.compiled) {
+      loop.compiled(fp);
+      JUMP(pc->b);
+    }
+    NEXT();
+  }
+
+  CASE(CALL) {
+    const BytecodeFunction &callee = funcs[pc->b];
+    uint8_t *calleeFp = fp + pc->c;
+    if (calleeFp + callee.frameSize > stackEnd) TRAP("stack overflow");
+    store<const Insn *>(calleeFp, pc + 1);
+    store<uint8_t *>(calleeFp + 8, fp);
+    fp = calleeFp;
+    JUMP(callee.entry);
+  }
+  CASE(TAILCALL) {
+    std::memmove(fp + FrameHeaderSize, fp + pc->a + FrameHeaderSize, pc->b);
+    JUMP(pc->c);
+  }
+  CASE(RET) {
+    // The CALL before the return address has the slot of the result.
+    const Insn *retPc = load<const Insn *>(fp);
+    uint8_t *callerFp = load<uint8_t *>(fp + 8);
+    std::memmove(callerFp + retPc[-1].a, fp + pc->a, pc->b);
+    fp = callerFp;
+    pc = retPc;
+    DISPATCH();
+  }
+
+  CASE(PRINT_I32) {
+    os << "Expr value = " << GET(int32_t, pc->a) << "\n";
+    NEXT();
+  }
+  CASE(PRINT_F32) {
+    os << "Expr value = " << llvm::format("%f", double(GET(float, pc->a)))
+       << "\n";
+    NEXT();
+  }
+  CASE(PRINT_F64) {
+    os << "Expr value = " << llvm::format("%f", GET(double, pc->a)) << "\n";
+    NEXT();
+  }
+  CASE(HALT) {
+    if (opts.checkpoint) {
+      opts.checkpoint->frame.assign(globals, globals + bc.globalFrameSize);
+      opts.checkpoint->finished = true;
+    }
+    return GET(int32_t, pc->a);
+  }
+  CASE(CHECKPOINT) {
+    opts.checkpoint->numStmts = pc->a;
+    opts.checkpoint->frame.assign(globals, globals + bc.globalFrameSize);
+    NEXT();
+  }
+
+#if !INTERP_COMPUTED_GOTO
+  }
+  llvm_unreachable("Unknown opcode");
+#endif
+
+trapped:
+  return llvm::createStringError(llvm::inconvertibleErrorCode(), trap);
+
+#undef GET
+#undef SET
+#undef TRAP
+#undef CASE
+#undef DISPATCH
+#undef NEXT
+#undef JUMP
+#undef INT_BINARY
+#undef COMPARE
+#undef FLOAT_BINARY
+#undef CONVERT
+#undef BRANCH
+#undef BRANCH_IMM
+}
+
+llvm::Expected<int> interpretProgram(Program &prog, llvm::raw_ostream &os,
+                                     LoopCompiler compileLoop,
+                                     unsigned hotLoopThreshold) {
+  BytecodeCompiler bc(compileLoop != nullptr, /*checkpoints=*/false);
+  if (llvm::Error err = bc.compile(prog, os)) {
+    return std::move(err);
+  }
+  RunOptions opts;
+  opts.compileLoop = std::move(compileLoop);
+  opts.hotLoopThreshold = hotLoopThreshold;
+  return run<false>(bc, os, opts);
+}
+
+static bool containsPointer(CType *ty) {
+  if (llvm::isa<CPointerType>(ty)) {
+    return true;
+  }
+  if (auto *arrayTy = llvm::dyn_cast<CArrayType>(ty)) {
+    return containsPointer(arrayTy->getElemTy());
+  }
+  if (auto *structTy = llvm::dyn_cast<CStructType>(ty)) {
+    return llvm::any_of(structTy->getFields(), [](const CField &field) {
+      return containsPointer(field.ty);
+    });
+  }
+  return false;
+}
+
+ProgramEvaluation evaluateProgram(Program &prog,
+                                  const EvaluationBudget &budget) {
+  ProgramEvaluation result;
+  if (!prog.hasImplicitMain) {
+    return result;
+  }
+  BytecodeCompiler bc(/*countLoops=*/false, /*checkpoints=*/true);
+  if (llvm::Error err = bc.compile(prog, llvm::nulls())) {
+    llvm::consumeError(std::move(err));
+    return result;
+  }
+  if (bc.hasParallelLoops || bc.globalFrameSize >= budget.memory) {
+    return result;
+  }
+
+  // A trap or the end of the budget stops the run, the statements before
+  // are still done.
+  Checkpoint checkpoint;
+  RunOptions opts;
+  opts.stackSize = budget.memory - bc.globalFrameSize;
+  opts.steps = budget.steps;
+  opts.checkpoint = &checkpoint;
+  llvm::consumeError(run<true>(bc, llvm::nulls(), opts).takeError());
+
+  if (checkpoint.finished) {
+    result.numStmts = prog.stmtVec.size();
+    result.finished = true;
+    if (CType *ty = bc.printedValue.ty) {
+      const uint8_t *value = checkpoint.frame.data() + bc.printedValue.slot;
+      result.printedTy = ty;
+      result.printedValue.assign(value, value + ty->getSize());
+    }
+    return result;
+  }
+
+  // The compiled program would place the objects elsewhere, and lays out a
+  // `soa` array by field.
+  for (auto [symbol, slot]: bc.globalSlots) {
+    if (containsPointer(symbol->getTy()) || symbol->isSoA()) {
+      return result;
+    }
+  }
+  result.numStmts = checkpoint.numStmts;
+  for (auto [symbol, slot]: bc.globalSlots) {
+    const uint8_t *value = checkpoint.frame.data() + slot;
+    result.globals[symbol].assign(value,
+                                  value + symbol->getTy()->getSize());
+  }
+  return result;
+}
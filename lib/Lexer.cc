@@ -21,6 +21,15 @@ static bool isLetter(char c) {
          ('A' <= c && c <= 'Z') || c == '_';
 }
 
+/// `int4`, `float8`, `double2`... name a vector of the element type.
+static bool isVectorTypeName(llvm::StringRef name, int32_t &numElems) {
+  if (!name.consume_front("int") && !name.consume_front("float") &&
+      !name.consume_front("double")) {
+    return false;
+  }
+  return !name.getAsInteger(10, numElems) &&
+         CVectorType::isValidNumElems(numElems);
+}
 
 llvm::StringRef Token::getSpellingText(TokenType tokenType) {
   switch (tokenType) {
@@ -44,6 +53,9 @@ void Lexer::nextToken(Token &tok) {
   // Filter the whitespaces.
   while (isWhiteSpace(*BufPtr)) {
     if (*BufPtr == '\n') {
+      if (inDirective) {
+        break;
+      }
       row++;
       LineHeadPtr = BufPtr + 1;
     }
@@ -53,6 +65,13 @@ void Lexer::nextToken(Token &tok) {
   tok.row = row;
   tok.col = BufPtr - LineHeadPtr + 1;
 
+  if (inDirective && (BufPtr >= BufEnd || *BufPtr == '\n')) {
+    inDirective = false;
+    tok.tokenType = TokenType::eod;
+    tok.content = llvm::StringRef(BufPtr, 0);
+    return;
+  }
+
   // Check whether we reach the eod of file.
   if (BufPtr >= BufEnd) {
     tok.tokenType = TokenType::eof;
@@ -63,7 +82,7 @@ void Lexer::nextToken(Token &tok) {
   const char *start = BufPtr;
 
   // Aggregate the number characteristics into a number.
-  if (isDigit(*BufPtr)) {
+  if (isDigit(*BufPtr) || (*BufPtr == '.' && isDigit(*(BufPtr+1)))) {
     int number = 0;
     tok.tokenType = TokenType::number;
     while (isDigit(*BufPtr)) {
@@ -71,7 +90,27 @@ void Lexer::nextToken(Token &tok) {
       BufPtr++; 
     }
     tok.value = number;
-    tok.ty = CType::getIntTy();
+
+    // `1.5`, `.5`, `1e3` and `1.5f` are floating literals.
+    if (*BufPtr == '.') {
+      tok.tokenType = TokenType::floating;
+      BufPtr++;
+      while (isDigit(*BufPtr)) BufPtr++;
+    }
+    if (*BufPtr == 'e' || *BufPtr == 'E') {
+      const char *expPtr = BufPtr + 1;
+      if (*expPtr == '+' || *expPtr == '-') expPtr++;
+      if (isDigit(*expPtr)) {
+        tok.tokenType = TokenType::floating;
+        BufPtr = expPtr;
+        while (isDigit(*BufPtr)) BufPtr++;
+      }
+    }
+    if (tok.tokenType == TokenType::floating) {
+      llvm::StringRef(start, BufPtr-start).getAsDouble(tok.fvalue);
+      if (*BufPtr == 'f' || *BufPtr == 'F') BufPtr++;
+    }
+
     tok.content = llvm::StringRef(start, BufPtr-start);
     return;
   }
@@ -85,6 +124,12 @@ void Lexer::nextToken(Token &tok) {
     if (content == "int") {
       tok.tokenType = TokenType::kw_int;
     }
+    else if (content == "float") {
+      tok.tokenType = TokenType::kw_float;
+    }
+    else if (content == "double") {
+      tok.tokenType = TokenType::kw_double;
+    }
     else if (content == "if") {
       tok.tokenType = TokenType::kw_if;
     }
@@ -100,6 +145,27 @@ void Lexer::nextToken(Token &tok) {
     else if (content == "continue") {
       tok.tokenType = TokenType::kw_continue;
     }
+    else if (content == "return") {
+      tok.tokenType = TokenType::kw_return;
+    }
+    else if (content == "static") {
+      tok.tokenType = TokenType::kw_static;
+    }
+    else if (content == "inline") {
+      tok.tokenType = TokenType::kw_inline;
+    }
+    else if (content == "__attribute__") {
+      tok.tokenType = TokenType::kw_attribute;
+    }
+    else if (content == "struct") {
+      tok.tokenType = TokenType::kw_struct;
+    }
+    else if (content == "restrict" || content == "__restrict") {
+      tok.tokenType = TokenType::kw_restrict;
+    }
+    else if (isVectorTypeName(content, tok.value)) {
+      tok.tokenType = TokenType::vector_type;
+    }
     else {
       tok.tokenType = TokenType::identifier;
     }
@@ -116,8 +182,13 @@ void Lexer::nextToken(Token &tok) {
     tok.content = llvm::StringRef(start, BufPtr-start);
     break;
   case '-':
-    tok.tokenType = TokenType::minus;
-    BufPtr++;
+    if (*(BufPtr+1) == '>') {
+      tok.tokenType = TokenType::arrow;
+      BufPtr += 2;
+    } else {
+      tok.tokenType = TokenType::minus;
+      BufPtr++;
+    }
     tok.content = llvm::StringRef(start, BufPtr-start);
     break;
   case '*':
@@ -130,6 +201,31 @@ void Lexer::nextToken(Token &tok) {
     BufPtr++;
     tok.content = llvm::StringRef(start, BufPtr-start);
     break;
+  case '%':
+    tok.tokenType = TokenType::percent;
+    BufPtr++;
+    tok.content = llvm::StringRef(start, BufPtr-start);
+    break;
+  case '&':
+    tok.tokenType = TokenType::amp;
+    BufPtr++;
+    tok.content = llvm::StringRef(start, BufPtr-start);
+    break;
+  case '|':
+    tok.tokenType = TokenType::pipe;
+    BufPtr++;
+    tok.content = llvm::StringRef(start, BufPtr-start);
+    break;
+  case '^':
+    tok.tokenType = TokenType::caret;
+    BufPtr++;
+    tok.content = llvm::StringRef(start, BufPtr-start);
+    break;
+  case '~':
+    tok.tokenType = TokenType::tilde;
+    BufPtr++;
+    tok.content = llvm::StringRef(start, BufPtr-start);
+    break;
   case '(':
     tok.tokenType = TokenType::lparen;
     BufPtr++;
@@ -140,6 +236,16 @@ void Lexer::nextToken(Token &tok) {
     BufPtr++;
     tok.content = llvm::StringRef(start, BufPtr-start);
     break;
+  case '[':
+    tok.tokenType = TokenType::lbracket;
+    BufPtr++;
+    tok.content = llvm::StringRef(start, BufPtr-start);
+    break;
+  case ']':
+    tok.tokenType = TokenType::rbracket;
+    BufPtr++;
+    tok.content = llvm::StringRef(start, BufPtr-start);
+    break;
   case '{':
     tok.tokenType = TokenType::lbrace;
     BufPtr++;
@@ -155,11 +261,26 @@ void Lexer::nextToken(Token &tok) {
     BufPtr++;
     tok.content = llvm::StringRef(start, BufPtr-start);
     break;
+  case '.':
+    tok.tokenType = TokenType::period;
+    BufPtr++;
+    tok.content = llvm::StringRef(start, BufPtr-start);
+    break;
   case ';':
     tok.tokenType = TokenType::semi;
     BufPtr++;
     tok.content = llvm::StringRef(start, BufPtr-start);
     break;
+  case '?':
+    tok.tokenType = TokenType::question;
+    BufPtr++;
+    tok.content = llvm::StringRef(start, BufPtr-start);
+    break;
+  case ':':
+    tok.tokenType = TokenType::colon;
+    BufPtr++;
+    tok.content = llvm::StringRef(start, BufPtr-start);
+    break;
   case '=':
     if (*(BufPtr+1) == '=') {
       tok.tokenType = TokenType::equalequal;
@@ -179,7 +300,10 @@ void Lexer::nextToken(Token &tok) {
     }
     // else fall back to diagEngine
   case '<':
-    if (*(BufPtr+1) == '=') {
+    if (*(BufPtr+1) == '<') {
+      tok.tokenType = TokenType::lessless;
+      BufPtr += 2;
+    } else if (*(BufPtr+1) == '=') {
       tok.tokenType = TokenType::lesseq;
       BufPtr += 2;
     } else {
@@ -189,7 +313,10 @@ void Lexer::nextToken(Token &tok) {
     tok.content = llvm::StringRef(start, BufPtr-start);
     break;
   case '>':
-    if (*(BufPtr+1) == '=') {
+    if (*(BufPtr+1) == '>') {
+      tok.tokenType = TokenType::greatergreater;
+      BufPtr += 2;
+    } else if (*(BufPtr+1) == '=') {
       tok.tokenType = TokenType::greatereq;
       BufPtr += 2;
     } else {
@@ -198,6 +325,50 @@ void Lexer::nextToken(Token &tok) {
     }
     tok.content = llvm::StringRef(start, BufPtr-start);
     break;
+  case '"': {
+    // Strings only spell attribute arguments, so they have no escapes and
+    // end on their line.
+    const char *end = BufPtr + 1;
+    while (end < BufEnd && *end != '"' && *end != '\n') {
+      end++;
+    }
+    if (end == BufEnd || *end != '"') {
+      diagEngine.report(llvm::SMLoc::getFromPointer(BufPtr),
+                        diag::err_unterminated_string);
+      BufPtr = end;
+      break;
+    }
+    tok.tokenType = TokenType::string_literal;
+    BufPtr = end + 1;
+    break;
+  }
+  case '#': {
+    // `#pragma omp` is lexed as a directive token, other pragmas are
+    // skipped to the end of the line like unknown pragmas in C.
+    const char *lineEnd = BufPtr;
+    while (lineEnd < BufEnd && *lineEnd != '\n') {
+      lineEnd++;
+    }
+    llvm::StringRef directive =
+        llvm::StringRef(BufPtr + 1, lineEnd - BufPtr - 1).ltrim();
+    if (directive.consume_front("pragma") &&
+        (directive.empty() || isWhiteSpace(directive.front()))) {
+      directive = directive.ltrim();
+      if (directive.consume_front("omp") &&
+          (directive.empty() || isWhiteSpace(directive.front()))) {
+        tok.tokenType = TokenType::pragma_omp;
+        BufPtr = directive.data();
+        inDirective = true;
+        break;
+      }
+      BufPtr = lineEnd;
+      nextToken(tok);
+      return;
+    }
+    diagEngine.report(llvm::SMLoc::getFromPointer(BufPtr), diag::err_unknown_char, *BufPtr);
+    BufPtr++;
+    break;
+  }
   default:
     diagEngine.report(llvm::SMLoc::getFromPointer(BufPtr), diag::err_unknown_char, *BufPtr);  
     BufPtr++;
@@ -212,6 +383,7 @@ void Lexer::saveState() {
   state.LineHeadPtr = this->LineHeadPtr;
   state.BufEnd = this->BufEnd;
   state.row = this->row;
+  state.inDirective = this->inDirective;
 }
 
 void Lexer::restoreState() {
@@ -219,4 +391,5 @@ void Lexer::restoreState() {
   this->LineHeadPtr = state.LineHeadPtr;
   this->BufEnd = state.BufEnd;
   this->row = state.row;
+  this->inDirective = state.inDirective;
 }
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "ObjectCache.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+// An entry starts with this magic, then the compression and the size of
+// the output, both little endian.
+const char entryMagic[8] = {'t', 'i', 'n', 'y', 'c', 'c', 'o', '1'};
+const size_t entryHeaderSize = 20;
+
+enum class Compression : uint32_t {
+  None,
+  Zstd,
+};
+
+const char *entryPrefix = "llvmcache-";
+const char *statsFileName = "stats";
+
+/// Decode the entry in `path`, or return null if it isn't a valid entry.
+std::unique_ptr<llvm::MemoryBuffer> readEntry(int fd, llvm::StringRef path) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> file =
+      llvm::MemoryBuffer::getOpenFile(llvm::sys::fs::convertFDToNativeFile(fd),
+                                      path, /*FileSize=*/-1,
+                                      /*RequiresNullTerminator=*/false);
+  if (!file) {
+    return nullptr;
+  }
+  llvm::StringRef data = (*file)->getBuffer();
+  if (data.size() < entryHeaderSize ||
+      data.substr(0, sizeof(entryMagic)) !=
+          llvm::StringRef(entryMagic, sizeof(entryMagic))) {
+    return nullptr;
+  }
+
+  using namespace llvm::support::endian;
+  auto format = static_cast<Compression>(read32le(data.data() + 8));
+  uint64_t size = read64le(data.data() + 12);
+  llvm::StringRef payload = data.drop_front(entryHeaderSize);
+  switch (format) {
+  case Compression::None:
+    if (payload.size() != size) {
+      return nullptr;
+    }
+    return llvm::MemoryBuffer::getMemBufferCopy(payload, path);
+  case Compression::Zstd: {
+#if LLVM_VERSION_MAJOR >= 16
+    if (!llvm::compression::zstd::isAvailable()) {
+      return nullptr;
+    }
+    std::unique_ptr<llvm::WritableMemoryBuffer> output =
+        llvm::WritableMemoryBuffer::getNewUninitMemBuffer(size, path);
+    size_t outputSize = size;
+    if (llvm::Error err = llvm::compression::zstd::decompress(
+            llvm::arrayRefFromStringRef(payload),
+            reinterpret_cast<uint8_t *>(output->getBufferStart()),
+            outputSize)) {
+      llvm::consumeError(std::move(err));
+      return nullptr;
+    }
+    if (outputSize != size) {
+      return nullptr;
+    }
+    return output;
+#else
+    return nullptr;
+#endif
+  }
+  }
+  return nullptr;
+}
+
+/// Read the hit and miss counters from the stats file `fd`, which are zero
+/// in a new file.
+void readCounts(int fd, char (&counts)[16]) {
+  std::memset(counts, 0, sizeof(counts));
+  llvm::Expected<size_t> bytesRead = llvm::sys::fs::readNativeFileSlice(
+      llvm::sys::fs::convertFDToNativeFile(fd), counts, 0);
+  if (!bytesRead) {
+    llvm::consumeError(bytesRead.takeError());
+  }
+}
+
+} // namespace
+
+llvm::Expected<ObjectCache>
+ObjectCache::open(llvm::StringRef dir,
+                  const llvm::CachePruningPolicy &policy) {
+  if (std::error_code ec = llvm::sys::fs::create_directories(dir)) {
+    return llvm::createStringError(ec, "Failed to create the cache " + dir +
+                                           ": " + ec.message());
+  }
+  return ObjectCache(dir, policy);
+}
+
+std::string ObjectCache::computeKey(llvm::ArrayRef<llvm::StringRef> parts) {
+  std::string data;
+  for (llvm::StringRef part: parts) {
+    char size[8];
+    llvm::support::endian::write64le(size, part.size());
+    data.append(size, sizeof(size));
+    data.append(part.begin(), part.end());
+  }
+
+  llvm::ArrayRef<uint8_t> bytes = llvm::arrayRefFromStringRef(data);
+#if LLVM_VERSION_MAJOR >= 18
+  llvm::XXH128_hash_t hash = llvm::xxh3_128bits(bytes);
+  return llvm::utohexstr(hash.high64, /*LowerCase=*/true, 16) +
+         llvm::utohexstr(hash.low64, /*LowerCase=*/true, 16);
+#else
+  return llvm::utohexstr(llvm::xxHash64(bytes), /*LowerCase=*/true, 16);
+#endif
+}
+
+std::string ObjectCache::getEntryPath(llvm::StringRef key) const {
+  llvm::SmallString<128> path(dir);
+  llvm::sys::path::append(path, entryPrefix + key);
+  return std::string(path);
+}
+
+std::unique_ptr<llvm::MemoryBuffer> ObjectCache::lookup(llvm::StringRef key) {
+  std::string path = getEntryPath(key);
+  std::unique_ptr<llvm::MemoryBuffer> output;
+  int fd;
+  if (!llvm::sys::fs::openFileForRead(path, fd)) {
+    output = readEntry(fd, path);
+    // pruneCache removes the entries accessed least recently first.
+    if (output) {
+      llvm::sys::fs::setLastAccessAndModificationTime(
+          fd, std::chrono::system_clock::now());
+    }
+    llvm::sys::fs::file_t file = llvm::sys::fs::convertFDToNativeFile(fd);
+    llvm::sys::fs::closeFile(file);
+  }
+  countLookup(output != nullptr);
+  return output;
+}
+
+llvm::Error ObjectCache::store(llvm::StringRef key, llvm::StringRef output) {
+  Compression format = Compression::None;
+  llvm::StringRef payload = output;
+#if LLVM_VERSION_MAJOR >= 16
+  llvm::SmallVector<uint8_t, 0> compressed;
+  if (llvm::compression::zstd::isAvailable()) {
+    llvm::compression::zstd::compress(llvm::arrayRefFromStringRef(output),
+                                      compressed);
+    format = Compression::Zstd;
+    payload = llvm::toStringRef(compressed);
+  }
+#endif
+
+  char header[entryHeaderSize];
+  std::memcpy(header, entryMagic, sizeof(entryMagic));
+  llvm::support::endian::write32le(header + 8, static_cast<uint32_t>(format));
+  llvm::support::endian::write64le(header + 12, output.size());
+
+  // Written aside, then renamed over the entry in one step.
+  llvm::SmallString<128> model(dir);
+  llvm::sys::path::append(model, "tinycc-%%%%%%%%.tmp");
+  llvm::Expected<llvm::sys::fs::TempFile> temp =
+      llvm::sys::fs::TempFile::create(model);
+  if (!temp) {
+    return temp.takeError();
+  }
+  llvm::raw_fd_ostream os(temp->FD, /*shouldClose=*/false);
+  os.write(header, sizeof(header));
+  os << payload;
+  os.flush();
+  if (os.has_error()) {
+    std::error_code ec = os.error();
+    os.clear_error();
+    return llvm::joinErrors(llvm::errorCodeToError(ec), temp->discard());
+  }
+  return temp->keep(getEntryPath(key));
+}
+
+void ObjectCache::prune() {
+  llvm::pruneCache(dir, policy);
+}
+
+void ObjectCache::countLookup(bool hit) {
+  // Compiles sharing the cache update the counters under a lock. The lock
+  // of the file doesn't exclude the threads of -j, so they take turns first.
+  static std::mutex countMutex;
+  std::lock_guard<std::mutex> lock(countMutex);
+  llvm::SmallString<128> path(dir);
+  llvm::sys::path::append(path, statsFileName);
+  int fd;
+  if (llvm::sys::fs::openFileForReadWrite(path, fd,
+                                          llvm::sys::fs::CD_OpenAlways,
+                                          llvm::sys::fs::OF_None)) {
+    return;
+  }
+  llvm::raw_fd_ostream os(fd, /*shouldClose=*/true);
+  if (llvm::sys::fs::lockFile(fd)) {
+    return;
+  }
+
+  char counts[16];
+  readCounts(fd, counts);
+  char *counter = counts + (hit ? 0 : 8);
+  llvm::support::endian::write64le(
+      counter, llvm::support::endian::read64le(counter) + 1);
+  os.seek(0);
+  os.write(counts, sizeof(counts));
+  os.flush();
+  llvm::sys::fs::unlockFile(fd);
+}
+
+ObjectCache::Stats ObjectCache::getStats() const {
+  Stats stats;
+  llvm::SmallString<128> path(dir);
+  llvm::sys::path::append(path, statsFileName);
+  int fd;
+  if (!llvm::sys::fs::openFileForRead(path, fd)) {
+    char counts[16];
+    readCounts(fd, counts);
+    stats.hits = llvm::support::endian::read64le(counts);
+    stats.misses = llvm::support::endian::read64le(counts + 8);
+    llvm::sys::fs::file_t file = llvm::sys::fs::convertFDToNativeFile(fd);
+    llvm::sys::fs::closeFile(file);
+  }
+
+  std::error_code ec;
+  for (llvm::sys::fs::directory_iterator it(dir, ec), end; it != end && !ec;
+       it.increment(ec)) {
+    llvm::StringRef name = llvm::sys::path::filename(it->path());
+    if (!name.consume_front(entryPrefix)) {
+      continue;
+    }
+    llvm::ErrorOr<llvm::sys::fs::basic_file_status> status = it->status();
+    if (status) {
+      ++stats.entries;
+      stats.bytes += status->getSize();
+    }
+  }
+  return stats;
+}
@@ -5,6 +5,7 @@
 #include "Sema.h"
 
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Casting.h"
 #include "llvm/Support/SMLoc.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -15,24 +16,292 @@
 #include <utility>
 #include <vector>
 
+static bool isTypeName(const Token &tok) {
+  return tok.tokenType == TokenType::kw_int ||
+         tok.tokenType == TokenType::kw_float ||
+         tok.tokenType == TokenType::kw_double ||
+         tok.tokenType == TokenType::vector_type ||
+         tok.tokenType == TokenType::kw_struct;
+}
+
+static bool isDeclSpec(const Token &tok) {
+  return isTypeName(tok) ||
+         tok.tokenType == TokenType::kw_static ||
+         tok.tokenType == TokenType::kw_inline ||
+         tok.tokenType == TokenType::kw_attribute;
+}
+
+/// A declaration whose initializers are literals can be set up statically
+/// rather than by code in `main`.
+static bool isConstantDecl(ASTNode *stmt) {
+  auto *declStmt = llvm::dyn_cast<DeclStmt>(stmt);
+  if (!declStmt) return false;
+
+  for (const auto &expr: declStmt->exprVec) {
+    auto *assignExpr = llvm::dyn_cast<AssignExpr>(expr.get());
+    if (assignExpr && !isLiteralExpr(assignExpr->rhs.get())) {
+      return false;
+    }
+  }
+  return true;
+}
+
 std::shared_ptr<Program> Parser::parseProgram() {
   // Initialize member `tok` to the first token.
   advance();
 
   auto program = std::make_shared<Program>();
+  bool hasMain = false;
+  bool hasFunctionDef = false;
+  // The first token of each file scope statement that has to run in `main`.
+  std::vector<Token> mainStmtToks;
   while (tok.tokenType != TokenType::eof) {
     // Handle null_stmt.
     if (tok.tokenType == TokenType::semi) {
       advance();
       continue;
     }
-    const auto stmt = parseStmt();
+
+    Token stmtTok = tok;
+    const auto stmt = isDeclSpec(tok) ? parseExternalDecl() : parseStmt();
     program->stmtVec.push_back(stmt);
+
+    if (auto *funcDecl = llvm::dyn_cast<FunctionDecl>(stmt.get())) {
+      if (funcDecl->body) {
+        hasFunctionDef = true;
+        hasMain |= funcDecl->name == "main";
+      }
+    }
+    else if (!isConstantDecl(stmt.get())) {
+      mainStmtToks.push_back(stmtTok);
+    }
+  }
+
+  if (hasMain && !mainStmtToks.empty()) {
+    getDiagEngine().report(
+        llvm::SMLoc::getFromPointer(mainStmtToks.front().content.begin()),
+        diag::err_toplevel_stmt);
   }
+  program->hasImplicitMain =
+      !hasMain && (!mainStmtToks.empty() || !hasFunctionDef);
 
   return program;
 }
 
+std::shared_ptr<ASTNode> Parser::parseExternalDecl() {
+  DeclSpec declSpec = parseDeclSpec();
+
+  // `int *name (` starts a function.
+  lexer.saveState();
+  Token tmp = tok;
+  while (tmp.tokenType == TokenType::star ||
+         tmp.tokenType == TokenType::kw_restrict) {
+    lexer.nextToken(tmp);
+  }
+  bool isFunction = false;
+  if (tmp.tokenType == TokenType::identifier) {
+    lexer.nextToken(tmp);
+    isFunction = tmp.tokenType == TokenType::lparen;
+  }
+  lexer.restoreState();
+
+  if (isFunction) {
+    return parseFunctionDecl(declSpec);
+  }
+  return parseDeclStmt(declSpec);
+}
+
+std::shared_ptr<ASTNode> Parser::parseFunctionDecl(DeclSpec declSpec) {
+  declSpec.ty = parsePointer(declSpec.ty);
+  Token nameTok = tok;
+  consume(TokenType::identifier);
+  consume(TokenType::lparen);
+
+  std::vector<Token> paramToks;
+  std::vector<CType *> paramTys;
+  while (tok.tokenType != TokenType::rparen) {
+    if (!paramToks.empty()) {
+      consume(TokenType::comma);
+    }
+    paramTys.push_back(parsePointer(parseTypeSpec()));
+    paramToks.push_back(tok);
+    consume(TokenType::identifier);
+  }
+  consume(TokenType::rparen);
+
+  bool isDefinition = tok.tokenType != TokenType::semi;
+  auto funcDecl = sema.semaFunctionDeclNode(
+      nameTok, declSpec, paramTys, isDefinition);
+  if (!isDefinition) {
+    consume(TokenType::semi);
+    return funcDecl;
+  }
+
+  sema.enterScope();
+  for (size_t i = 0; i < paramToks.size(); ++i) {
+    funcDecl->params.push_back(
+        sema.semaVariableDeclNode(paramToks[i], paramTys[i]));
+  }
+
+  currentFunc = funcDecl;
+  sema.setCurrentFunction(funcDecl.get());
+  funcDecl->body = parseBlockStmt();
+  sema.setCurrentFunction(nullptr);
+  currentFunc = nullptr;
+  sema.exitScope();
+
+  return funcDecl;
+}
+
+DeclSpec Parser::parseDeclSpec() {
+  DeclSpec declSpec;
+  while (true) {
+    if (tok.tokenType == TokenType::kw_static) {
+      declSpec.isStatic = true;
+      advance();
+    }
+    else if (tok.tokenType == TokenType::kw_inline) {
+      declSpec.isInline = true;
+      advance();
+    }
+    else if (tok.tokenType == TokenType::kw_attribute) {
+      parseAttributes(declSpec.attrs);
+    }
+    else {
+      break;
+    }
+  }
+
+  declSpec.ty = parseTypeSpec();
+
+  return declSpec;
+}
+
+CType *Parser::parseTypeSpec() {
+  TypeContext &typeCtx = sema.getTypeContext();
+  CType *ty = typeCtx.getIntTy();
+  if (tok.tokenType == TokenType::kw_float) {
+    ty = typeCtx.getFloatTy();
+  }
+  else if (tok.tokenType == TokenType::kw_double) {
+    ty = typeCtx.getDoubleTy();
+  }
+  else if (tok.tokenType == TokenType::vector_type) {
+    // The lexer only accepts `int`, `float` and `double` names.
+    CType *elemTy = typeCtx.getIntTy();
+    if (tok.content.front() == 'f') {
+      elemTy = typeCtx.getFloatTy();
+    }
+    else if (tok.content.front() == 'd') {
+      elemTy = typeCtx.getDoubleTy();
+    }
+    ty = typeCtx.getVectorTy(elemTy, tok.value);
+  }
+  else if (tok.tokenType == TokenType::kw_struct) {
+    return parseStructSpec();
+  }
+  else {
+    expect(TokenType::kw_int);
+  }
+  advance();
+
+  return ty;
+}
+
+/// `struct name`, `struct name { fields }` or `struct { fields }`. Layout
+/// attributes go right after `struct` or after the closing brace.
+CType *Parser::parseStructSpec() {
+  Token structTok = tok;
+  consume(TokenType::kw_struct);
+
+  std::vector<Attr> attrs;
+  while (tok.tokenType == TokenType::kw_attribute) {
+    parseAttributes(attrs);
+  }
+
+  Token nameTok = tok;
+  bool hasName = tok.tokenType == TokenType::identifier;
+  if (hasName) {
+    advance();
+  }
+  else {
+    expect(TokenType::lbrace);
+  }
+
+  bool isDefinition = tok.tokenType == TokenType::lbrace;
+  CStructType *structTy = hasName ?
+                          sema.semaStructDecl(nameTok, isDefinition) :
+                          sema.getTypeContext().createStructTy("");
+  if (!isDefinition) {
+    return structTy;
+  }
+
+  consume(TokenType::lbrace);
+  std::vector<Token> fieldToks;
+  std::vector<CType *> fieldTys;
+  while (tok.tokenType != TokenType::rbrace) {
+    CType *baseTy = parseTypeSpec();
+    while (true) {
+      CType *ty = parsePointer(baseTy);
+      fieldToks.push_back(tok);
+      consume(TokenType::identifier);
+      fieldTys.push_back(parseArraySuffix(ty));
+
+      if (tok.tokenType != TokenType::comma) {
+        break;
+      }
+      advance();
+    }
+    consume(TokenType::semi);
+  }
+  consume(TokenType::rbrace);
+
+  while (tok.tokenType == TokenType::kw_attribute) {
+    parseAttributes(attrs);
+  }
+  sema.semaStructBody(structTy, hasName ? nameTok : structTok,
+                      fieldToks, fieldTys, attrs);
+
+  return structTy;
+}
+
+void Parser::parseAttributes(std::vector<Attr> &attrs) {
+  consume(TokenType::kw_attribute);
+  consume(TokenType::lparen);
+  consume(TokenType::lparen);
+
+  while (tok.tokenType != TokenType::rparen) {
+    Attr attr;
+    attr.tok = tok;
+    attr.name = tok.content;
+    consume(TokenType::identifier);
+
+    if (tok.tokenType == TokenType::lparen) {
+      advance();
+      while (tok.tokenType != TokenType::rparen) {
+        if (!attr.args.empty()) {
+          consume(TokenType::comma);
+        }
+        if (tok.tokenType == TokenType::eof) {
+          expect(TokenType::rparen);
+        }
+        attr.args.push_back(tok);
+        advance();
+      }
+      consume(TokenType::rparen);
+    }
+    attrs.push_back(attr);
+
+    if (tok.tokenType != TokenType::comma) {
+      break;
+    }
+    advance();
+  }
+
+  consume(TokenType::rparen);
+  consume(TokenType::rparen);
+}
+
 std::shared_ptr<ASTNode> Parser::parseStmt() {
   // Handle null_stmt.
   if (tok.tokenType == TokenType::semi) {
@@ -41,7 +310,7 @@ std::shared_ptr<ASTNode> Parser::parseStmt() {
   }
   
   // Handle decl_stmt.
-  if (tok.tokenType == TokenType::kw_int) {
+  if (isTypeName(tok) || tok.tokenType == TokenType::kw_attribute) {
     return parseDeclStmt();
   }
   else if (tok.tokenType == TokenType::kw_if) {
@@ -53,12 +322,18 @@ std::shared_ptr<ASTNode> Parser::parseStmt() {
   else if (tok.tokenType == TokenType::kw_for) {
     return parseForStmt();
   }
+  else if (tok.tokenType == TokenType::pragma_omp) {
+    return parseOmpParallelFor();
+  }
   else if (tok.tokenType == TokenType::kw_break) {
     return parseBreakStmt();
   }
   else if (tok.tokenType == TokenType::kw_continue) {
     return parseContinueStmt();
   }
+  else if (tok.tokenType == TokenType::kw_return) {
+    return parseReturnStmt();
+  }
   else { // handle expr_stmt
     const auto stmt = parseExprStmt();
     return stmt;
@@ -84,8 +359,17 @@ std::shared_ptr<ASTNode> Parser::parseBlockStmt() {
 }
 
 std::shared_ptr<ASTNode> Parser::parseDeclStmt() {
-  consume(TokenType::kw_int);
-  CType *baseType = CType::getIntTy();
+  DeclSpec declSpec;
+  while (tok.tokenType == TokenType::kw_attribute) {
+    parseAttributes(declSpec.attrs);
+  }
+  declSpec.ty = parseTypeSpec();
+
+  return parseDeclStmt(declSpec);
+}
+
+std::shared_ptr<ASTNode> Parser::parseDeclStmt(const DeclSpec &declSpec) {
+  CType *baseType = declSpec.ty;
   auto declStmt = std::make_shared<DeclStmt>();
   auto &astVec = declStmt->exprVec;
 
@@ -95,14 +379,28 @@ std::shared_ptr<ASTNode> Parser::parseDeclStmt() {
       consume(TokenType::comma);      
     }
     
+    CType *ty = parsePointer(baseType);
     Token tmp = tok;
-    auto varDecl = sema.semaVariableDeclNode(tmp, baseType);
+    consume(TokenType::identifier);
+    ty = parseArraySuffix(ty);
+
+    // Attributes may also follow the declarator, for this variable only.
+    std::vector<Attr> attrs = declSpec.attrs;
+    while (tok.tokenType == TokenType::kw_attribute) {
+      parseAttributes(attrs);
+    }
+
+    auto varDecl = sema.semaVariableDeclNode(tmp, ty, declSpec.isStatic,
+                                             attrs);
     // int a = 1; <=> int a; a = 1;
     astVec.push_back(varDecl);
 
-    consume(TokenType::identifier);
-
     if (tok.tokenType == TokenType::equal) {
+      if (llvm::isa<CArrayType>(ty)) {
+        getDiagEngine().report(
+            llvm::SMLoc::getFromPointer(tok.content.begin()),
+            diag::err_array_init, tmp.content);
+      }
       advance();
       auto rhs = parseExpr();
       auto varExpr = sema.semaVariableExprNode(tmp);
@@ -118,7 +416,48 @@ std::shared_ptr<ASTNode> Parser::parseDeclStmt() {
   return declStmt;
 }
 
+/// `int * restrict *p` makes `p` a pointer to a restrict pointer to int.
+CType *Parser::parsePointer(CType *ty) {
+  while (tok.tokenType == TokenType::star) {
+    advance();
+    bool isRestrict = false;
+    if (tok.tokenType == TokenType::kw_restrict) {
+      isRestrict = true;
+      advance();
+    }
+    ty = sema.getTypeContext().getPointerTy(ty, isRestrict);
+  }
+
+  return ty;
+}
+
+/// `int a[2][3]` is an array of 2 arrays of 3 ints, so the type is built
+/// from the last dimension outwards.
+CType *Parser::parseArraySuffix(CType *elemTy) {
+  std::vector<Token> sizeToks;
+  while (tok.tokenType == TokenType::lbracket) {
+    advance();
+    expect(TokenType::number);
+    if (tok.value <= 0) {
+      getDiagEngine().report(
+          llvm::SMLoc::getFromPointer(tok.content.begin()),
+          diag::err_array_size);
+    }
+    sizeToks.push_back(tok);
+    advance();
+    consume(TokenType::rbracket);
+  }
+
+  CType *ty = elemTy;
+  for (auto it = sizeToks.rbegin(); it != sizeToks.rend(); ++it) {
+    ty = sema.getTypeContext().getArrayTy(ty, it->value);
+  }
+
+  return ty;
+}
+
 std::shared_ptr<ASTNode> Parser::parseIfStmt() { 
+  Token ifTok = tok;
   consume(TokenType::kw_if);
   consume(TokenType::lparen);
   const auto condExpr = parseExpr();
@@ -130,18 +469,11 @@ std::shared_ptr<ASTNode> Parser::parseIfStmt() {
     elseStmt = parseStmt();
   }
 
-  return sema.semaIfStmtNode(condExpr, thenStmt, elseStmt);
-}
-
-static bool isTypeName(Token &tok) {
-  if (tok.tokenType == TokenType::kw_int) {
-    return true;
-  }
-
-  return false;
+  return sema.semaIfStmtNode(ifTok, condExpr, thenStmt, elseStmt);
 }
 
 std::shared_ptr<ASTNode> Parser::parseForStmt() {
+  Token forTok = tok;
   consume(TokenType::kw_for);
   consume(TokenType::lparen);
 
@@ -152,6 +484,7 @@ std::shared_ptr<ASTNode> Parser::parseForStmt() {
 
   sema.enterScope();
   auto forStmt = std::make_shared<ForStmt>();
+  forStmt->tok = forTok;
   breakableStmts.push_back(forStmt);
   continableStmts.push_back(forStmt);
 
@@ -164,7 +497,10 @@ std::shared_ptr<ASTNode> Parser::parseForStmt() {
     consume(TokenType::semi);
   }
 
-  if (tok.tokenType != TokenType::semi) condExpr = parseExpr();
+  if (tok.tokenType != TokenType::semi) {
+    condExpr = parseExpr();
+    sema.checkCondition(condExpr.get());
+  }
   consume(TokenType::semi);
   if (tok.tokenType != TokenType::rparen) incExpr = parseExpr();
   consume(TokenType::rparen);
@@ -183,6 +519,77 @@ std::shared_ptr<ASTNode> Parser::parseForStmt() {
   return forStmt;
 }
 
+/// `#pragma omp parallel for` with `reduction(+: vars)`,
+/// `schedule(static|dynamic[, chunk])` and `num_threads(n)` clauses,
+/// followed by the loop.
+std::shared_ptr<ASTNode> Parser::parseOmpParallelFor() {
+  Token pragmaTok = tok;
+  consume(TokenType::pragma_omp);
+  if (tok.content != "parallel") {
+    getDiagEngine().report(
+        llvm::SMLoc::getFromPointer(tok.content.begin()),
+        diag::err_omp_directive, tok.content);
+  }
+  advance();
+  consume(TokenType::kw_for);
+
+  auto omp = std::make_shared<OmpParallelFor>();
+  std::vector<Token> reductionToks;
+  while (tok.tokenType != TokenType::eod) {
+    Token clauseTok = tok;
+    llvm::StringRef clause = tok.content;
+    consume(TokenType::identifier);
+    consume(TokenType::lparen);
+
+    if (clause == "reduction") {
+      consume(TokenType::plus);
+      consume(TokenType::colon);
+      while (true) {
+        reductionToks.push_back(tok);
+        consume(TokenType::identifier);
+        if (tok.tokenType != TokenType::comma) {
+          break;
+        }
+        advance();
+      }
+    }
+    else if (clause == "schedule") {
+      if (tok.content == "dynamic") {
+        omp->schedule = OmpSchedule::Dynamic;
+      }
+      else if (tok.tokenType != TokenType::kw_static) {
+        getDiagEngine().report(
+            llvm::SMLoc::getFromPointer(tok.content.begin()),
+            diag::err_omp_schedule, tok.content);
+      }
+      advance();
+      if (tok.tokenType == TokenType::comma) {
+        advance();
+        omp->chunk = parseExpr();
+      }
+    }
+    else if (clause == "num_threads") {
+      omp->numThreads = parseExpr();
+    }
+    else {
+      getDiagEngine().report(
+          llvm::SMLoc::getFromPointer(clauseTok.content.begin()),
+          diag::err_omp_clause, clause);
+    }
+    consume(TokenType::rparen);
+
+    // Clauses may be separated by commas.
+    if (tok.tokenType == TokenType::comma) {
+      advance();
+    }
+  }
+  consume(TokenType::eod);
+
+  expect(TokenType::kw_for);
+  return sema.semaOmpParallelForNode(pragmaTok, parseForStmt(),
+                                     reductionToks, omp);
+}
+
 std::shared_ptr<ASTNode> Parser::parseBreakStmt() {
   if (breakableStmts.size() == 0) {
     getDiagEngine().report(
@@ -190,8 +597,9 @@ std::shared_ptr<ASTNode> Parser::parseBreakStmt() {
         diag::err_break_stmt);
   }
   
-  consume(TokenType::kw_break);
   auto breakStmt = std::make_shared<BreakStmt>();
+  breakStmt->tok = tok;
+  consume(TokenType::kw_break);
   breakStmt->target = breakableStmts.back();
   consume(TokenType::semi);
   return breakStmt;
@@ -204,21 +612,37 @@ std::shared_ptr<ASTNode> Parser::parseContinueStmt() {
         diag::err_continue_stmt);
   }
 
-  consume(TokenType::kw_continue);
   auto continueStmt = std::make_shared<ContinueStmt>();
+  continueStmt->tok = tok;
+  consume(TokenType::kw_continue);
   continueStmt->target = continableStmts.back();
   consume(TokenType::semi);
   return continueStmt;
 }
 
-std::shared_ptr<ASTNode> Parser::parseAssignExpr() {
-  expect(TokenType::identifier); 
-  auto lhsExpr = sema.semaVariableExprNode(tok);
-  advance();
+std::shared_ptr<ASTNode> Parser::parseReturnStmt() {
+  Token returnTok = tok;
+  if (!currentFunc) {
+    getDiagEngine().report(
+        llvm::SMLoc::getFromPointer(tok.content.begin()), 
+        diag::err_return_stmt);
+  }
+
+  consume(TokenType::kw_return);
+  std::shared_ptr<ASTNode> expr = nullptr;
+  if (tok.tokenType != TokenType::semi) {
+    expr = parseExpr();
+  }
+  consume(TokenType::semi);
+
+  return sema.semaReturnStmtNode(returnTok, expr, currentFunc.get());
+}
+
+std::shared_ptr<ASTNode> Parser::parseAssignExpr(std::shared_ptr<ASTNode> lhs) {
   consume(TokenType::equal); 
-  auto rhs = parseAddsubExpr();
+  auto rhs = parseExpr();
 
-  return sema.semaAssignExprNode(lhsExpr, rhs);
+  return sema.semaAssignExprNode(lhs, rhs);
 }
 
 std::shared_ptr<ASTNode> Parser::parseExprStmt() {
@@ -229,25 +653,69 @@ std::shared_ptr<ASTNode> Parser::parseExprStmt() {
 }
 
 std::shared_ptr<ASTNode> Parser::parseExpr() {
-  bool isAssignExpr = false;
+  // The left-hand side of an assignment is parsed as an expression, and Sema
+  // checks it is an lvalue.
+  auto expr = parseConditionalExpr();
+  if (tok.tokenType == TokenType::equal) {
+    return parseAssignExpr(expr);
+  }
 
-  lexer.saveState();
-  if (tok.tokenType == TokenType::identifier) {
-    Token tmp;
-    lexer.nextToken(tmp);
-    if (tmp.tokenType == TokenType::equal) {
-      isAssignExpr = true;
-    }
+  return expr;
+}
+
+std::shared_ptr<ASTNode> Parser::parseConditionalExpr() {
+  auto condExpr = parseBitOrExpr();
+  if (tok.tokenType != TokenType::question) {
+    return condExpr;
   }
-  lexer.restoreState();
+  advance();
+
+  // Like C, the middle operand is parsed as a full expression and the
+  // conditional operator is right associative.
+  auto thenExpr = parseExpr();
+  consume(TokenType::colon);
+  auto elseExpr = parseConditionalExpr();
 
-  if (!isAssignExpr) {
-    return parseEqualExpr();
+  return sema.semaConditionalExprNode(condExpr, thenExpr, elseExpr);
+}
+
+std::shared_ptr<ASTNode> Parser::parseBitOrExpr() {
+  auto lhs = parseBitXorExpr();
+  while (tok.tokenType == TokenType::pipe) {
+    advance();
+
+    auto rhs = parseBitXorExpr();
+    auto binaryExpr = sema.semaBinaryExprNode(OpCode::bitwiseor, lhs, rhs);
+    lhs = binaryExpr;
   }
-  else {
-    return parseAssignExpr();
+
+  return lhs;
+}
+
+std::shared_ptr<ASTNode> Parser::parseBitXorExpr() {
+  auto lhs = parseBitAndExpr();
+  while (tok.tokenType == TokenType::caret) {
+    advance();
+
+    auto rhs = parseBitAndExpr();
+    auto binaryExpr = sema.semaBinaryExprNode(OpCode::bitwisexor, lhs, rhs);
+    lhs = binaryExpr;
   }
 
+  return lhs;
+}
+
+std::shared_ptr<ASTNode> Parser::parseBitAndExpr() {
+  auto lhs = parseEqualExpr();
+  while (tok.tokenType == TokenType::amp) {
+    advance();
+
+    auto rhs = parseEqualExpr();
+    auto binaryExpr = sema.semaBinaryExprNode(OpCode::bitwiseand, lhs, rhs);
+    lhs = binaryExpr;
+  }
+
+  return lhs;
 }
 
 std::shared_ptr<ASTNode> Parser::parseEqualExpr() {
@@ -267,7 +735,7 @@ std::shared_ptr<ASTNode> Parser::parseEqualExpr() {
 }
 
 std::shared_ptr<ASTNode> Parser::parseRelationExpr() {
-  auto lhs = parseAddsubExpr();
+  auto lhs = parseShiftExpr();
   if (tok.tokenType == TokenType::less ||
       tok.tokenType == TokenType::lesseq ||
       tok.tokenType == TokenType::greater ||
@@ -279,6 +747,22 @@ std::shared_ptr<ASTNode> Parser::parseRelationExpr() {
     else op = OpCode::greatereq;
     advance();
 
+    auto rhs = parseShiftExpr();
+    auto binaryExpr = sema.semaBinaryExprNode(op, lhs, rhs);
+    lhs = binaryExpr;
+  }
+
+  return lhs;
+}
+
+std::shared_ptr<ASTNode> Parser::parseShiftExpr() {
+  auto lhs = parseAddsubExpr();
+  while (tok.tokenType == TokenType::lessless ||
+         tok.tokenType == TokenType::greatergreater) {
+    OpCode op = tok.tokenType == TokenType::lessless ?
+                OpCode::shl : OpCode::shr;
+    advance();
+
     auto rhs = parseAddsubExpr();
     auto binaryExpr = sema.semaBinaryExprNode(op, lhs, rhs);
     lhs = binaryExpr;
@@ -304,13 +788,17 @@ std::shared_ptr<ASTNode> Parser::parseAddsubExpr() {
 }
 
 std::shared_ptr<ASTNode> Parser::parseMuldivExpr() {
-  auto lhs = parsePrimaryExpr();
-  while (tok.tokenType == TokenType::star || tok.tokenType == TokenType::slash) {
-    OpCode op = tok.tokenType == TokenType::star ? 
-                OpCode::mul : OpCode::div;
+  auto lhs = parseUnaryExpr();
+  while (tok.tokenType == TokenType::star ||
+         tok.tokenType == TokenType::slash ||
+         tok.tokenType == TokenType::percent) {
+    OpCode op;
+    if (tok.tokenType == TokenType::star) op = OpCode::mul;
+    else if (tok.tokenType == TokenType::slash) op = OpCode::div;
+    else op = OpCode::mod;
     advance();
     
-    auto rhs = parsePrimaryExpr();
+    auto rhs = parseUnaryExpr();
     auto binaryExpr = sema.semaBinaryExprNode(op, lhs, rhs); 
 
     lhs = binaryExpr;
@@ -319,6 +807,49 @@ std::shared_ptr<ASTNode> Parser::parseMuldivExpr() {
   return lhs;
 }
 
+std::shared_ptr<ASTNode> Parser::parseUnaryExpr() {
+  if (tok.tokenType == TokenType::tilde ||
+      tok.tokenType == TokenType::amp ||
+      tok.tokenType == TokenType::star) {
+    Token opTok = tok;
+    OpCode op;
+    if (tok.tokenType == TokenType::tilde) op = OpCode::bitwisenot;
+    else if (tok.tokenType == TokenType::amp) op = OpCode::addrof;
+    else op = OpCode::deref;
+    advance();
+
+    auto operand = parseUnaryExpr();
+    return sema.semaUnaryExprNode(opTok, op, operand);
+  }
+
+  return parsePostfixExpr();
+}
+
+std::shared_ptr<ASTNode> Parser::parsePostfixExpr() {
+  auto expr = parsePrimaryExpr();
+  while (true) {
+    if (tok.tokenType == TokenType::lbracket) {
+      advance();
+      auto index = parseExpr();
+      consume(TokenType::rbracket);
+      expr = sema.semaSubscriptExprNode(expr, index);
+    }
+    else if (tok.tokenType == TokenType::period ||
+             tok.tokenType == TokenType::arrow) {
+      bool isArrow = tok.tokenType == TokenType::arrow;
+      advance();
+      Token memberTok = tok;
+      consume(TokenType::identifier);
+      expr = sema.semaMemberExprNode(expr, memberTok, isArrow);
+    }
+    else {
+      break;
+    }
+  }
+
+  return sema.semaDecayNode(expr);
+}
+
 std::shared_ptr<ASTNode> Parser::parsePrimaryExpr() {
   if (tok.tokenType == TokenType::lparen) {
     advance();
@@ -328,18 +859,45 @@ std::shared_ptr<ASTNode> Parser::parsePrimaryExpr() {
     return expr;
   }
   else if (tok.tokenType == TokenType::identifier) {
-    auto expr = sema.semaVariableExprNode(tok);
+    Token idTok = tok;
     advance();
-    return expr;
+    if (tok.tokenType == TokenType::lparen) {
+      return parseCallExpr(idTok);
+    }
+    return sema.semaVariableExprNode(idTok);
+  }
+  else if (tok.tokenType == TokenType::floating) {
+    auto factor = sema.semaFloatExprNode(tok);
+    advance();
+    return factor;
   }
   else {
     expect(TokenType::number);
-    auto factor = sema.semaNumberExprNode(tok, tok.ty);
+    auto factor = sema.semaNumberExprNode(tok);
     advance();
     return factor;
   }
 }
 
+std::shared_ptr<ASTNode> Parser::parseCallExpr(const Token &calleeTok) {
+  consume(TokenType::lparen);
+
+  std::vector<std::shared_ptr<ASTNode>> args;
+  while (tok.tokenType != TokenType::rparen) {
+    if (!args.empty()) {
+      consume(TokenType::comma);
+    }
+    args.push_back(parseExpr());
+  }
+  consume(TokenType::rparen);
+
+  llvm::StringRef name = calleeTok.content;
+  if (name.consume_front("__builtin_")) {
+    return sema.semaBuiltinCallExprNode(calleeTok, std::move(args));
+  }
+  return sema.semaCallExprNode(calleeTok, std::move(args));
+}
+
 bool Parser::expect(TokenType tokenType) {
   if (tok.tokenType == tokenType) return true;
 
@@ -1,9 +1,11 @@
 #include "PrintVisitor.h"
 #include "AST.h"
 #include "llvm/IR/Value.h"
+#include "llvm/Support/Casting.h"
 #include "llvm/Support/PointerLikeTypeTraits.h"
 #include "llvm/Support/raw_ostream.h"
 #include <cstdio>
+#include <string>
 
 PrintVisitor::PrintVisitor(std::shared_ptr<Program> prog) {
   visitProgram(prog.get());
@@ -91,6 +93,40 @@ llvm::Value *PrintVisitor::visitContinueStmt(ContinueStmt *continueStmt) {
   return nullptr;
 }
 
+llvm::Value *PrintVisitor::visitReturnStmt(ReturnStmt *returnStmt) {
+  llvm::outs() << "return";
+  if (returnStmt->expr) {
+    llvm::outs() << " ";
+    returnStmt->expr->accept(this);
+  }
+  return nullptr;
+}
+
+llvm::Value *PrintVisitor::visitFunctionDecl(FunctionDecl *funcDecl) {
+  if (funcDecl->isStatic) {
+    llvm::outs() << "static ";
+  }
+  if (funcDecl->isInline) {
+    llvm::outs() << "inline ";
+  }
+  llvm::outs() << "int " << funcDecl->name << "(";
+  int paramIdx = 0;
+  for (const auto &param: funcDecl->params) {
+    if (paramIdx++ > 0) {
+      llvm::outs() << ", ";
+    }
+    param->accept(this);
+  }
+  llvm::outs() << ")";
+
+  if (funcDecl->body) {
+    llvm::outs() << " ";
+    funcDecl->body->accept(this);
+  }
+
+  return nullptr;
+}
+
 llvm::Value *PrintVisitor::visitBinaryExpr(BinaryExpr *binaryExpr) {
 
   llvm::outs() << "(";
@@ -109,6 +145,24 @@ llvm::Value *PrintVisitor::visitBinaryExpr(BinaryExpr *binaryExpr) {
   case OpCode::div:
     llvm::outs() << " / ";
     break;
+  case OpCode::mod:
+    llvm::outs() << " % ";
+    break;
+  case OpCode::bitwiseand:
+    llvm::outs() << " & ";
+    break;
+  case OpCode::bitwiseor:
+    llvm::outs() << " | ";
+    break;
+  case OpCode::bitwisexor:
+    llvm::outs() << " ^ ";
+    break;
+  case OpCode::shl:
+    llvm::outs() << " << ";
+    break;
+  case OpCode::shr:
+    llvm::outs() << " >> ";
+    break;
   case OpCode::equalequal:
     llvm::outs() << " == ";
     break;
@@ -127,6 +181,8 @@ llvm::Value *PrintVisitor::visitBinaryExpr(BinaryExpr *binaryExpr) {
   case OpCode::greatereq:
     llvm::outs() << " >= ";
     break;
+  default:
+    break;
   }
 
   binaryExpr->rhs->accept(this);
@@ -135,18 +191,58 @@ llvm::Value *PrintVisitor::visitBinaryExpr(BinaryExpr *binaryExpr) {
   return nullptr;
 }
 
+llvm::Value *PrintVisitor::visitUnaryExpr(UnaryExpr *unaryExpr) {
+  if (unaryExpr->op == OpCode::bitwisenot) {
+    llvm::outs() << "~";
+  }
+  else if (unaryExpr->op == OpCode::addrof) {
+    llvm::outs() << "&";
+  }
+  else if (unaryExpr->op == OpCode::deref) {
+    llvm::outs() << "*";
+  }
+  unaryExpr->operand->accept(this);
+
+  return nullptr;
+}
+
+llvm::Value *PrintVisitor::visitConditionalExpr(ConditionalExpr *condExpr) {
+  llvm::outs() << "(";
+  condExpr->condExpr->accept(this);
+  llvm::outs() << " ? ";
+  condExpr->thenExpr->accept(this);
+  llvm::outs() << " : ";
+  condExpr->elseExpr->accept(this);
+  llvm::outs() << ")";
+
+  return nullptr;
+}
+
 llvm::Value *PrintVisitor::visitNumberExpr(NumberExpr *numExpr) {
   llvm::outs() << numExpr->tok.value;
 
   return nullptr;
 }
 
+llvm::Value *PrintVisitor::visitFloatExpr(FloatExpr *floatExpr) {
+  llvm::outs() << floatExpr->tok.content;
+
+  return nullptr;
+}
+
 
 llvm::Value *PrintVisitor::visitVariableDecl(VariableDecl *variableDecl) {
-  if (variableDecl->ty == CType::getIntTy()) {
-    llvm::outs() << "int " << variableDecl->tok.content;
+  CType *ty = variableDecl->ty;
+  std::string dims;
+  while (auto *arrayTy = llvm::dyn_cast<CArrayType>(ty)) {
+    dims += "[" + std::to_string(arrayTy->getNumElems()) + "]";
+    ty = arrayTy->getElemTy();
   }
 
+  std::string tyName = ty->getName();
+  llvm::outs() << tyName << (tyName.back() == '*' ? "" : " ")
+               << variableDecl->tok.content << dims;
+
   return nullptr;
 }
 
@@ -164,4 +260,49 @@ llvm::Value *PrintVisitor::visitAssignExpr(AssignExpr *assignExpr) {
 llvm::Value *PrintVisitor::visitVariableExpr(VariableExpr *variableExpr) {
   llvm::outs() << variableExpr->name;
   return nullptr;
+}
+
+llvm::Value *PrintVisitor::visitSubscriptExpr(SubscriptExpr *subscriptExpr) {
+  subscriptExpr->base->accept(this);
+  llvm::outs() << "[";
+  subscriptExpr->index->accept(this);
+  llvm::outs() << "]";
+  return nullptr;
+}
+
+llvm::Value *PrintVisitor::visitMemberExpr(MemberExpr *memberExpr) {
+  memberExpr->base->accept(this);
+  llvm::outs() << (memberExpr->isArrow ? "->" : ".") << memberExpr->name;
+  return nullptr;
+}
+
+llvm::Value *PrintVisitor::visitImplicitCastExpr(ImplicitCastExpr *castExpr) {
+  castExpr->operand->accept(this);
+  return nullptr;
+}
+
+llvm::Value *PrintVisitor::visitBuiltinCallExpr(BuiltinCallExpr *callExpr) {
+  llvm::outs() << callExpr->tok.content << "(";
+  int argIdx = 0;
+  for (const auto &arg: callExpr->args) {
+    if (argIdx++ > 0) {
+      llvm::outs() << ", ";
+    }
+    arg->accept(this);
+  }
+  llvm::outs() << ")";
+  return nullptr;
+}
+
+llvm::Value *PrintVisitor::visitCallExpr(CallExpr *callExpr) {
+  llvm::outs() << callExpr->callee << "(";
+  int argIdx = 0;
+  for (const auto &arg: callExpr->args) {
+    if (argIdx++ > 0) {
+      llvm::outs() << ", ";
+    }
+    arg->accept(this);
+  }
+  llvm::outs() << ")";
+  return nullptr;
 }
\ No newline at end of file
@@ -13,6 +13,20 @@ void Scope::exitScope() {
   envs.pop_back();
 }
 
+void Scope::saveState() {
+  savedEnvs.clear();
+  for (auto &env: envs) {
+    savedEnvs.push_back(*env);
+  }
+}
+
+void Scope::restoreState() {
+  envs.clear();
+  for (auto &env: savedEnvs) {
+    envs.push_back(std::make_shared<Env>(env));
+  }
+}
+
 std::shared_ptr<Symbol> 
 Scope::findVarSymbol(llvm::StringRef name) {
   for (auto it = envs.rbegin(); it != envs.rend(); ++it) {
@@ -35,9 +49,12 @@ Scope::findVarSymbolInCurEnv(llvm::StringRef name) {
   return nullptr;
 }
 
-void Scope::addSymbol(SymbolKind kind, CType *ty, llvm::StringRef name) {
+std::shared_ptr<Symbol> 
+Scope::addSymbol(SymbolKind kind, CType *ty, llvm::StringRef name) {
   auto symbol = std::make_shared<Symbol>(kind, ty, name);
   
   auto &table = envs.back()->symbolTable;
   table.insert({name, symbol});
+
+  return symbol;
 }
\ No newline at end of file
@@ -2,8 +2,12 @@
 #include "AST.h"
 #include "DiagEngine.h"
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/Support/Casting.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/SMLoc.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/raw_ostream.h"
@@ -12,15 +16,134 @@
 #include <memory>
 #include <optional>
 
+static llvm::cl::opt<bool> WarnPadding(
+    "Wpadding",
+    llvm::cl::desc("Warn when a struct needs padding between its fields or "
+                   "at its end"),
+    llvm::cl::init(false));
+
+std::string Sema::getWarningOptions() {
+  return WarnPadding ? "-Wpadding" : "";
+}
+
+void Sema::saveState() {
+  scope.saveState();
+  state.tagScopes = tagScopes;
+  state.functionDecls = functionDecls;
+}
+
+void Sema::restoreState() {
+  scope.restoreState();
+  tagScopes = state.tagScopes;
+  functionDecls = state.functionDecls;
+  currentFunc = nullptr;
+}
+
+static bool isNullPointerConstant(ASTNode *expr) {
+  auto *numberExpr = llvm::dyn_cast<NumberExpr>(expr);
+  return numberExpr && numberExpr->number == 0;
+}
+
+/// Operators which only apply to integers.
+static bool isIntegerOp(OpCode op) {
+  return op == OpCode::mod || op == OpCode::bitwiseand ||
+         op == OpCode::bitwiseor || op == OpCode::bitwisexor ||
+         op == OpCode::shl || op == OpCode::shr;
+}
+
+/// A struct without a body, or an array of them, has no size.
+static bool isIncompleteTy(CType *ty) {
+  if (auto *arrayTy = llvm::dyn_cast<CArrayType>(ty)) {
+    return isIncompleteTy(arrayTy->getElemTy());
+  }
+  auto *structTy = llvm::dyn_cast<CStructType>(ty);
+  return structTy && !structTy->isComplete();
+}
+
+static bool isComparison(OpCode op) {
+  return op == OpCode::equalequal || op == OpCode::notequal ||
+         op == OpCode::less || op == OpCode::lesseq ||
+         op == OpCode::greater || op == OpCode::greatereq;
+}
+
+std::shared_ptr<ASTNode> Sema::createImplicitCast(
+    CastKind castKind, CType *ty, std::shared_ptr<ASTNode> operand) {
+  auto castExpr = std::make_shared<ImplicitCastExpr>();
+  castExpr->tok = operand->tok;
+  castExpr->ty = ty;
+  castExpr->castKind = castKind;
+  castExpr->operand = operand;
+
+  return castExpr;
+}
+
+/// Convert an arithmetic `expr` to the arithmetic type `ty`.
+std::shared_ptr<ASTNode> Sema::convertArithmetic(
+    CType *ty, std::shared_ptr<ASTNode> expr) {
+  if (expr->ty == ty) {
+    return expr;
+  }
+
+  CastKind castKind = CastKind::FloatingCast;
+  if (expr->ty->isInteger()) {
+    castKind = CastKind::IntegralToFloating;
+  }
+  else if (ty->isInteger()) {
+    castKind = CastKind::FloatingToIntegral;
+  }
+  return createImplicitCast(castKind, ty, expr);
+}
+
+/// Convert both operands to their common type, `double` before `float`
+/// before `int`, and return it.
+CType *Sema::usualArithmeticConversions(std::shared_ptr<ASTNode> &lhs,
+                                        std::shared_ptr<ASTNode> &rhs) {
+  CType *ty = typeCtx.getIntTy();
+  if (lhs->ty == typeCtx.getDoubleTy() || rhs->ty == typeCtx.getDoubleTy()) {
+    ty = typeCtx.getDoubleTy();
+  }
+  else if (lhs->ty == typeCtx.getFloatTy() || rhs->ty == typeCtx.getFloatTy()) {
+    ty = typeCtx.getFloatTy();
+  }
+
+  lhs = convertArithmetic(ty, lhs);
+  rhs = convertArithmetic(ty, rhs);
+  return ty;
+}
+
+/// Check `expr` can be assigned, passed or returned as `ty`.
+std::shared_ptr<ASTNode> Sema::convertForAssignment(
+    CType *ty, std::shared_ptr<ASTNode> expr) {
+  if (llvm::isa<CPointerType>(ty) && isNullPointerConstant(expr.get())) {
+    return createImplicitCast(CastKind::NullToPointer,
+                              typeCtx.getUnqualifiedTy(ty), expr);
+  }
+  if (ty->isArithmetic() && expr->ty->isArithmetic()) {
+    return convertArithmetic(ty, expr);
+  }
+
+  if (typeCtx.getUnqualifiedTy(ty) != typeCtx.getUnqualifiedTy(expr->ty)) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(expr->tok.content.begin()),
+        diag::err_incompatible_types,
+        ty->getName(), expr->ty->getName());
+  }
+
+  return expr;
+}
+
 std::shared_ptr<ASTNode>
 Sema::semaIfStmtNode(
+    const Token &tok,
     std::shared_ptr<ASTNode> condExpr, 
     std::shared_ptr<ASTNode> thenBody, 
     std::shared_ptr<ASTNode> elseBody) {
   assert((condExpr && thenBody) && 
          "The condition expression or then body of if statement is NULL\n");
+  checkCondition(condExpr.get());
   
   auto ifStmt = std::make_shared<IfStmt>();
+  ifStmt->tok = tok;
   ifStmt->condExpr = condExpr;
   ifStmt->thenBody = thenBody;
   ifStmt->elseBody = elseBody;
@@ -29,7 +152,8 @@ Sema::semaIfStmtNode(
 }
 
 std::shared_ptr<ASTNode> 
-Sema::semaVariableDeclNode(const Token &tok, CType *ty) {
+Sema::semaVariableDeclNode(const Token &tok, CType *ty, bool isStatic,
+                           llvm::ArrayRef<Attr> attrs) {
   llvm::StringRef name = tok.content;
   std::shared_ptr<Symbol> symbol = scope.findVarSymbolInCurEnv(name);
   
@@ -40,16 +164,335 @@ Sema::semaVariableDeclNode(const Token &tok, CType *ty) {
       tok.content);
   }
 
-  scope.addSymbol(SymbolKind::LocalVariable, ty, name);
+  SymbolKind kind = scope.isGlobalScope() ?
+                    SymbolKind::GlobalVariable : SymbolKind::LocalVariable;
+  symbol = scope.addSymbol(kind, ty, name);
+
+  if (isIncompleteTy(ty)) {
+    diagEngine.report(
+      llvm::SMLoc::getFromPointer(tok.content.begin()),
+      diag::err_incomplete_type,
+      name, ty->getName());
+  }
+
+  for (const auto &attr: attrs) {
+    if (attr.name != "soa") {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(attr.tok.content.begin()),
+          diag::warn_unknown_attribute,
+          attr.name);
+      continue;
+    }
 
+    auto *arrayTy = llvm::dyn_cast<CArrayType>(ty);
+    if (!arrayTy || !llvm::isa<CStructType>(arrayTy->getElemTy())) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(attr.tok.content.begin()),
+          diag::err_soa_type,
+          ty->getName());
+    }
+    symbol->setSoA();
+  }
 
   auto variableDecl = std::make_shared<VariableDecl>();
-  variableDecl->tok.content = name;
+  variableDecl->tok = tok;
   variableDecl->ty = ty;
+  variableDecl->symbol = symbol;
+  variableDecl->isStatic = isStatic;
   
   return variableDecl;
 }
 
+/// `target_clones("avx2", "default")` names CPU features from
+/// CPUFeature.h.inc, and the default target for other CPUs.
+void Sema::semaTargetClones(const Attr &attr, FunctionDecl *funcDecl) {
+  static const llvm::StringRef features[] = {
+#define CPU_FEATURE(NAME) NAME,
+#include "CPUFeature.h.inc"
+  };
+
+  bool hasDefault = false;
+  for (const Token &argTok: attr.args) {
+    if (argTok.tokenType != TokenType::string_literal) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(argTok.content.begin()),
+          diag::err_target_clones_arg);
+      continue;
+    }
+
+    llvm::StringRef target = argTok.content.drop_front().drop_back();
+    if (target != "default" && !llvm::is_contained(features, target)) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(argTok.content.begin()),
+          diag::err_target_clones_target,
+          target);
+      continue;
+    }
+    if (llvm::is_contained(funcDecl->targetClones, target)) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(argTok.content.begin()),
+          diag::warn_target_clones_duplicate,
+          target);
+      continue;
+    }
+    hasDefault |= target == "default";
+    funcDecl->targetClones.push_back(target);
+  }
+
+  if (!hasDefault) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(attr.tok.content.begin()),
+        diag::err_target_clones_default);
+  }
+}
+
+std::shared_ptr<FunctionDecl>
+Sema::semaFunctionDeclNode(const Token &tok, const DeclSpec &declSpec,
+                           llvm::ArrayRef<CType *> paramTys,
+                           bool isDefinition) {
+  llvm::StringRef name = tok.content;
+  CFuncType *funcTy = typeCtx.getFuncTy(declSpec.ty, paramTys);
+
+  auto funcDecl = std::make_shared<FunctionDecl>();
+  funcDecl->tok = tok;
+  funcDecl->name = name;
+  funcDecl->ty = funcTy;
+  funcDecl->isStatic = declSpec.isStatic;
+  funcDecl->isInline = declSpec.isInline;
+
+  for (const auto &attr: declSpec.attrs) {
+    if (attr.name == "target_clones") {
+      semaTargetClones(attr, funcDecl.get());
+    }
+    else if (attr.name != "noinline" && attr.name != "always_inline" &&
+             attr.name != "hot") {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(attr.tok.content.begin()),
+          diag::warn_unknown_attribute,
+          attr.name);
+      continue;
+    }
+    funcDecl->attrs.push_back(attr);
+  }
+
+  if (funcDecl->hasAttr("noinline") && funcDecl->hasAttr("always_inline")) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(tok.content.begin()),
+        diag::warn_attribute_conflict,
+        "noinline", "always_inline");
+  }
+  // Calls to a multiversioned function go through its resolver.
+  if (funcDecl->hasAttr("target_clones") &&
+      funcDecl->hasAttr("always_inline")) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(tok.content.begin()),
+        diag::warn_attribute_conflict,
+        "target_clones", "always_inline");
+  }
+
+  // A function may be declared many times but defined only once, and all
+  // declarations have to agree on its type.
+  std::shared_ptr<Symbol> symbol = scope.findVarSymbolInCurEnv(name);
+  if (symbol) {
+    if (symbol->getKind() != SymbolKind::Function) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(tok.content.begin()),
+          diag::err_redefined,
+          name);
+    }
+    if (symbol->getTy() != funcTy) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(tok.content.begin()),
+          diag::err_conflicting_types,
+          name);
+    }
+
+    const auto &prevDecl = functionDecls[symbol.get()];
+    if (isDefinition && prevDecl->body) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(tok.content.begin()),
+          diag::err_redefined,
+          name);
+    }
+    // `static` sticks to the function once any declaration has it.
+    funcDecl->isStatic |= prevDecl->isStatic;
+    funcDecl->isInline |= prevDecl->isInline;
+  }
+  else {
+    symbol = scope.addSymbol(SymbolKind::Function, funcTy, name);
+  }
+
+  funcDecl->symbol = symbol;
+  functionDecls[symbol.get()] = funcDecl;
+
+  return funcDecl;
+}
+
+CStructType *Sema::semaStructDecl(const Token &nameTok, bool isDefinition) {
+  llvm::StringRef name = nameTok.content;
+  llvm::StringMap<CStructType *> &curTags = tagScopes.back();
+
+  // A definition completes a struct declared in the same scope, and hides
+  // any struct of an outer scope.
+  if (isDefinition) {
+    auto it = curTags.find(name);
+    if (it == curTags.end()) {
+      return curTags[name] = typeCtx.createStructTy(name);
+    }
+    if (it->second->isComplete()) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(nameTok.content.begin()),
+          diag::err_redefined,
+          name);
+    }
+    return it->second;
+  }
+
+  for (auto it = tagScopes.rbegin(); it != tagScopes.rend(); ++it) {
+    auto tagIt = it->find(name);
+    if (tagIt != it->end()) {
+      return tagIt->second;
+    }
+  }
+  return curTags[name] = typeCtx.createStructTy(name);
+}
+
+void Sema::semaStructBody(CStructType *structTy, const Token &tok,
+                          llvm::ArrayRef<Token> fieldToks,
+                          llvm::ArrayRef<CType *> fieldTys,
+                          llvm::ArrayRef<Attr> attrs) {
+  bool isPacked = false;
+  size_t minAlign = 1;
+  for (const auto &attr: attrs) {
+    if (attr.name == "packed") {
+      isPacked = true;
+    }
+    else if (attr.name == "aligned") {
+      // Without an argument, the largest alignment any type needs.
+      minAlign = 16;
+      if (!attr.args.empty()) {
+        const Token &argTok = attr.args.front();
+        if (argTok.tokenType != TokenType::number ||
+            !llvm::isPowerOf2_32(argTok.value)) {
+          diagEngine.report(
+              llvm::SMLoc::getFromPointer(argTok.content.begin()),
+              diag::err_attribute_aligned);
+        }
+        minAlign = argTok.value;
+      }
+    }
+    else {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(attr.tok.content.begin()),
+          diag::warn_unknown_attribute,
+          attr.name);
+    }
+  }
+
+  std::vector<CField> fields;
+  for (size_t i = 0; i < fieldToks.size(); ++i) {
+    llvm::StringRef name = fieldToks[i].content;
+    if (isIncompleteTy(fieldTys[i])) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(fieldToks[i].content.begin()),
+          diag::err_incomplete_field,
+          name, fieldTys[i]->getName());
+    }
+    for (const CField &field: fields) {
+      if (field.name == name) {
+        diagEngine.report(
+            llvm::SMLoc::getFromPointer(fieldToks[i].content.begin()),
+            diag::err_duplicate_member,
+            name);
+      }
+    }
+    fields.push_back({name, fieldTys[i]});
+  }
+
+  structTy->setBody(std::move(fields), isPacked, minAlign);
+  if (WarnPadding) {
+    reportPadding(structTy, tok, fieldToks);
+  }
+}
+
+/// Warn about each hole the layout left before a field, and at the end.
+void Sema::reportPadding(CStructType *structTy, const Token &tok,
+                         llvm::ArrayRef<Token> fieldToks) {
+  size_t end = 0;
+  for (size_t i = 0; i < fieldToks.size(); ++i) {
+    const CField &field = structTy->getFields()[i];
+    if (field.offset > end) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(fieldToks[i].content.begin()),
+          diag::warn_padding_field,
+          structTy->getName(), field.offset - end, field.name);
+    }
+    end = field.offset + field.ty->getSize();
+  }
+
+  if (structTy->getSize() > end) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(tok.content.begin()),
+        diag::warn_padding_tail,
+        structTy->getName(), structTy->getSize() - end);
+  }
+}
+
+std::shared_ptr<ASTNode>
+Sema::semaReturnStmtNode(const Token &tok, std::shared_ptr<ASTNode> expr,
+                         FunctionDecl *funcDecl) {
+  if (expr) {
+    expr = convertForAssignment(
+        llvm::cast<CFuncType>(funcDecl->ty)->getRetTy(), expr);
+  }
+
+  auto returnStmt = std::make_shared<ReturnStmt>();
+  returnStmt->tok = tok;
+  returnStmt->expr = expr;
+
+  return returnStmt;
+}
+
+std::shared_ptr<ASTNode> Sema::semaCallExprNode(
+    const Token &tok, std::vector<std::shared_ptr<ASTNode>> args) {
+  llvm::StringRef name = tok.content;
+  std::shared_ptr<Symbol> symbol = scope.findVarSymbol(name);
+  if (!symbol) {
+    diagEngine.report(
+      llvm::SMLoc::getFromPointer(tok.content.begin()),
+      diag::err_undefined,
+      name);
+  }
+  if (symbol->getKind() != SymbolKind::Function) {
+    diagEngine.report(
+      llvm::SMLoc::getFromPointer(tok.content.begin()),
+      diag::err_not_function,
+      name);
+  }
+
+  auto *funcTy = llvm::cast<CFuncType>(symbol->getTy());
+  size_t expected = funcTy->getParamTys().size();
+  if (args.size() != expected) {
+    diagEngine.report(
+      llvm::SMLoc::getFromPointer(tok.content.begin()),
+      diag::err_call_args,
+      args.size() > expected ? "many" : "few",
+      expected, args.size());
+  }
+  for (size_t i = 0; i < args.size(); ++i) {
+    args[i] = convertForAssignment(funcTy->getParamTys()[i], args[i]);
+  }
+
+  auto callExpr = std::make_shared<CallExpr>();
+  callExpr->tok = tok;
+  callExpr->callee = name;
+  callExpr->calleeDecl = functionDecls[symbol.get()].get();
+  callExpr->args = std::move(args);
+  callExpr->ty = funcTy->getRetTy();
+
+  return callExpr;
+}
+
 std::shared_ptr<ASTNode> 
 Sema::semaVariableExprNode(const Token &tok) {
   llvm::StringRef name = tok.content;
@@ -61,31 +504,246 @@ Sema::semaVariableExprNode(const Token &tok) {
       tok.content);
   }
 
+  if (symbol->getKind() == SymbolKind::Function) {
+    diagEngine.report(
+      llvm::SMLoc::getFromPointer(tok.content.begin()),
+      diag::err_function_value,
+      tok.content);
+  }
+
   auto variableExpr = std::make_shared<VariableExpr>();
+  variableExpr->tok = tok;
   variableExpr->name = name;
   variableExpr->ty = symbol->getTy();
+  variableExpr->symbol = symbol;
 
   return variableExpr;
 }
 
+std::shared_ptr<ASTNode> Sema::semaSubscriptExprNode(
+    std::shared_ptr<ASTNode> base, std::shared_ptr<ASTNode> index) {
+  CType *elemTy = nullptr;
+  if (auto *arrayTy = llvm::dyn_cast<CArrayType>(base->ty)) {
+    elemTy = arrayTy->getElemTy();
+
+    auto *numberExpr = llvm::dyn_cast<NumberExpr>(index.get());
+    if (numberExpr && size_t(numberExpr->number) >= arrayTy->getNumElems()) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(index->tok.content.begin()),
+          diag::warn_array_index_out_of_bounds,
+          numberExpr->number, arrayTy->getNumElems());
+    }
+  }
+  else if (auto *pointerTy = llvm::dyn_cast<CPointerType>(base->ty)) {
+    elemTy = pointerTy->getPointeeTy();
+  }
+  else if (auto *vectorTy = llvm::dyn_cast<CVectorType>(base->ty)) {
+    elemTy = vectorTy->getElemTy();
+
+    auto *numberExpr = llvm::dyn_cast<NumberExpr>(index.get());
+    if (numberExpr && size_t(numberExpr->number) >= vectorTy->getNumElems()) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(index->tok.content.begin()),
+          diag::warn_array_index_out_of_bounds,
+          numberExpr->number, vectorTy->getNumElems());
+    }
+  }
+  else {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(base->tok.content.begin()),
+        diag::err_subscript_not_array);
+  }
+
+  if (index->ty != typeCtx.getIntTy()) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(index->tok.content.begin()),
+        diag::err_subscript_not_integer);
+  }
+
+  auto subscriptExpr = std::make_shared<SubscriptExpr>();
+  subscriptExpr->tok = base->tok;
+  subscriptExpr->ty = elemTy;
+  subscriptExpr->base = base;
+  subscriptExpr->index = index;
+
+  return subscriptExpr;
+}
+
+std::shared_ptr<ASTNode> Sema::semaMemberExprNode(
+    std::shared_ptr<ASTNode> base, const Token &memberTok, bool isArrow) {
+  CType *baseTy = base->ty;
+  if (isArrow) {
+    base = semaDecayNode(base);
+    auto *pointerTy = llvm::dyn_cast<CPointerType>(base->ty);
+    baseTy = pointerTy ? pointerTy->getPointeeTy() : nullptr;
+  }
+
+  auto *structTy = llvm::dyn_cast_or_null<CStructType>(baseTy);
+  if (!structTy) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(memberTok.content.begin()),
+        diag::err_member_base,
+        base->ty->getName(), isArrow ? "pointer to a struct" : "struct");
+  }
+
+  int fieldIdx = structTy->getFieldIndex(memberTok.content);
+  if (fieldIdx < 0) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(memberTok.content.begin()),
+        diag::err_no_member,
+        memberTok.content, structTy->getName());
+  }
+
+  auto memberExpr = std::make_shared<MemberExpr>();
+  memberExpr->tok = base->tok;
+  memberExpr->ty = structTy->getFields()[fieldIdx].ty;
+  memberExpr->base = base;
+  memberExpr->structTy = structTy;
+  memberExpr->name = memberTok.content;
+  memberExpr->fieldIdx = fieldIdx;
+  memberExpr->isArrow = isArrow;
+
+  // Such an array has no address to decay to.
+  if (llvm::isa<CArrayType>(memberExpr->ty) &&
+      !isLValueExpr(memberExpr.get())) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(memberTok.content.begin()),
+        diag::err_member_array_rvalue,
+        memberTok.content);
+  }
+
+  return memberExpr;
+}
+
+/// Mark the current function when `expr` is stored in its frame, so that
+/// its address must not reach a call that reuses the frame.
+void Sema::noteFrameAddress(ASTNode *expr) {
+  while (true) {
+    auto *memberExpr = llvm::dyn_cast<MemberExpr>(expr);
+    auto *subscriptExpr = llvm::dyn_cast<SubscriptExpr>(expr);
+    if (memberExpr && !memberExpr->isArrow) {
+      expr = memberExpr->base.get();
+    }
+    else if (subscriptExpr && llvm::isa<CArrayType>(subscriptExpr->base->ty)) {
+      expr = subscriptExpr->base.get();
+    }
+    else {
+      break;
+    }
+  }
+
+  auto *varExpr = llvm::dyn_cast<VariableExpr>(expr);
+  if (currentFunc && varExpr &&
+      varExpr->symbol->getKind() == SymbolKind::LocalVariable) {
+    currentFunc->frameAddressTaken = true;
+  }
+}
+
+std::shared_ptr<ASTNode> Sema::semaDecayNode(std::shared_ptr<ASTNode> expr) {
+  // A `soa` array stores its fields apart, so neither the array nor its
+  // elements exist as a whole.
+  ASTNode *arrayExpr = expr.get();
+  if (auto *subscriptExpr = llvm::dyn_cast<SubscriptExpr>(arrayExpr)) {
+    arrayExpr = subscriptExpr->base.get();
+  }
+  auto *varExpr = llvm::dyn_cast<VariableExpr>(arrayExpr);
+  if (varExpr && varExpr->symbol->isSoA()) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(expr->tok.content.begin()),
+        diag::err_soa_element,
+        varExpr->symbol->getName());
+  }
+
+  auto *arrayTy = llvm::dyn_cast<CArrayType>(expr->ty);
+  if (!arrayTy) {
+    return expr;
+  }
+
+  noteFrameAddress(expr.get());
+  return createImplicitCast(CastKind::ArrayToPointerDecay,
+                            typeCtx.getPointerTy(arrayTy->getElemTy()), expr);
+}
+
 std::shared_ptr<ASTNode> Sema::semaAssignExprNode(
     std::shared_ptr<ASTNode> lhs, std::shared_ptr<ASTNode> rhs) {
   assert((lhs && rhs) && 
          "Left or right of assignment expression can't be resolved\n");
 
-  if (!llvm::isa<VariableExpr>(lhs.get())) {
+  if (!isLValueExpr(lhs.get())) {
     diagEngine.report(
         llvm::SMLoc::getFromPointer(lhs->tok.content.begin()),
         diag::err_lvalue);
   }
 
   auto assignExpr = std::make_shared<AssignExpr>();
+  assignExpr->tok = lhs->tok;
+  assignExpr->ty = lhs->ty;
   assignExpr->lhs = lhs;
-  assignExpr->rhs = rhs;
+  assignExpr->rhs = convertForAssignment(lhs->ty, rhs);
 
   return assignExpr;
 }
 
+/// Return NULL if `op` doesn't apply to the operand types.
+CType *Sema::getBinaryExprTy(OpCode op, ASTNode *lhs, ASTNode *rhs) {
+  CType *intTy = typeCtx.getIntTy();
+  CType *lhsTy = typeCtx.getUnqualifiedTy(lhs->ty);
+  CType *rhsTy = typeCtx.getUnqualifiedTy(rhs->ty);
+  if (lhsTy == intTy && rhsTy == intTy) {
+    return intTy;
+  }
+  // The operands went through the usual arithmetic conversions.
+  if (lhsTy == rhsTy && lhsTy->isFloating()) {
+    if (isIntegerOp(op)) return nullptr;
+    return isComparison(op) ? intTy : lhsTy;
+  }
+
+  bool isLhsPointer = llvm::isa<CPointerType>(lhsTy);
+  bool isRhsPointer = llvm::isa<CPointerType>(rhsTy);
+  if (op == OpCode::add) {
+    if (isLhsPointer && rhsTy == intTy) return lhsTy;
+    if (lhsTy == intTy && isRhsPointer) return rhsTy;
+  }
+  else if (op == OpCode::sub) {
+    if (isLhsPointer && rhsTy == intTy) return lhsTy;
+    // The distance in elements between two pointers.
+    if (isLhsPointer && lhsTy == rhsTy) return intTy;
+  }
+  else if (isComparison(op) && isLhsPointer && lhsTy == rhsTy) {
+    return intTy;
+  }
+
+  return nullptr;
+}
+
+/// Element-wise operators need operands of the same vector type. A scalar
+/// operand is converted to the element type and splatted, like GCC does.
+/// Comparisons give a vector of `int`, -1 where true and 0 where false.
+CType *Sema::getVectorBinaryExprTy(OpCode op, std::shared_ptr<ASTNode> &lhs,
+                                   std::shared_ptr<ASTNode> &rhs) {
+  auto *vectorTy = llvm::dyn_cast<CVectorType>(lhs->ty);
+  if (!vectorTy) {
+    vectorTy = llvm::cast<CVectorType>(rhs->ty);
+  }
+
+  for (auto *operand: {&lhs, &rhs}) {
+    if ((*operand)->ty->isArithmetic()) {
+      *operand = createImplicitCast(
+          CastKind::VectorSplat, vectorTy,
+          convertArithmetic(vectorTy->getElemTy(), *operand));
+    }
+  }
+
+  if (lhs->ty != rhs->ty ||
+      (isIntegerOp(op) && !vectorTy->getElemTy()->isInteger())) {
+    return nullptr;
+  }
+  if (isComparison(op)) {
+    return typeCtx.getVectorTy(typeCtx.getIntTy(), vectorTy->getNumElems());
+  }
+  return vectorTy;
+}
+
 std::shared_ptr<ASTNode> Sema::semaBinaryExprNode(
     OpCode op, 
     std::shared_ptr<ASTNode> lhs, 
@@ -93,19 +751,399 @@ std::shared_ptr<ASTNode> Sema::semaBinaryExprNode(
   assert((lhs && rhs) && 
          "Left or right of assignment expression can't be resolved\n");
 
+  auto *numberExpr = llvm::dyn_cast<NumberExpr>(rhs.get());
+  if (numberExpr && lhs->ty->isInteger()) {
+    if ((op == OpCode::div || op == OpCode::mod) && numberExpr->number == 0) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(numberExpr->tok.content.begin()),
+          diag::warn_division_by_zero,
+          op == OpCode::div ? "division" : "remainder");
+    }
+
+    if (op == OpCode::shl || op == OpCode::shr) {
+      if (numberExpr->number < 0) {
+        diagEngine.report(
+            llvm::SMLoc::getFromPointer(numberExpr->tok.content.begin()),
+            diag::warn_shift_count_negative);
+      }
+      else if (numberExpr->number >= 32) {
+        diagEngine.report(
+            llvm::SMLoc::getFromPointer(numberExpr->tok.content.begin()),
+            diag::warn_shift_count_overflow);
+      }
+    }
+  }
+
+  // `p == 0` compares against the null pointer.
+  if (op == OpCode::equalequal || op == OpCode::notequal) {
+    if (llvm::isa<CPointerType>(lhs->ty) && isNullPointerConstant(rhs.get())) {
+      rhs = createImplicitCast(CastKind::NullToPointer,
+                               typeCtx.getUnqualifiedTy(lhs->ty), rhs);
+    }
+    else if (llvm::isa<CPointerType>(rhs->ty) &&
+             isNullPointerConstant(lhs.get())) {
+      lhs = createImplicitCast(CastKind::NullToPointer,
+                               typeCtx.getUnqualifiedTy(rhs->ty), lhs);
+    }
+  }
+
+  CType *ty = nullptr;
+  if (llvm::isa<CVectorType>(lhs->ty) || llvm::isa<CVectorType>(rhs->ty)) {
+    ty = getVectorBinaryExprTy(op, lhs, rhs);
+  }
+  else {
+    if (lhs->ty->isArithmetic() && rhs->ty->isArithmetic() &&
+        !isIntegerOp(op)) {
+      usualArithmeticConversions(lhs, rhs);
+    }
+    ty = getBinaryExprTy(op, lhs.get(), rhs.get());
+  }
+  if (!ty) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(lhs->tok.content.begin()),
+        diag::err_invalid_operands,
+        lhs->ty->getName(), rhs->ty->getName());
+  }
+
   auto binaryExpr = std::make_shared<BinaryExpr>();
+  binaryExpr->tok = lhs->tok;
   binaryExpr->op = op;
   binaryExpr->lhs = lhs;
   binaryExpr->rhs = rhs;
+  binaryExpr->ty = ty;
 
   return binaryExpr;
 }
 
-std::shared_ptr<ASTNode> Sema::semaNumberExprNode(const Token &tok, CType *ty) {
+std::shared_ptr<ASTNode> Sema::semaUnaryExprNode(
+    const Token &tok, OpCode op, std::shared_ptr<ASTNode> operand) {
+  assert(operand && "Operand of unary expression can't be resolved\n");
+
+  CType *ty = operand->ty;
+  if (op == OpCode::deref) {
+    auto *pointerTy = llvm::dyn_cast<CPointerType>(operand->ty);
+    if (!pointerTy) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(tok.content.begin()),
+          diag::err_deref_non_pointer,
+          operand->ty->getName());
+    }
+    ty = pointerTy->getPointeeTy();
+  }
+  else if (op == OpCode::addrof) {
+    // `&a` points to the whole array rather than to its first element.
+    auto *castExpr = llvm::dyn_cast<ImplicitCastExpr>(operand.get());
+    if (castExpr && castExpr->castKind == CastKind::ArrayToPointerDecay) {
+      operand = castExpr->operand;
+    }
+
+    if (!isLValueExpr(operand.get())) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(tok.content.begin()),
+          diag::err_addrof_rvalue,
+          operand->ty->getName());
+    }
+    if (auto *varExpr = llvm::dyn_cast<VariableExpr>(operand.get())) {
+      varExpr->symbol->setAddressTaken();
+    }
+    noteFrameAddress(operand.get());
+    ty = typeCtx.getPointerTy(operand->ty);
+  }
+  else if (operand->ty->getScalarTy() != typeCtx.getIntTy()) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(tok.content.begin()),
+        diag::err_invalid_unary_operand,
+        operand->ty->getName());
+  }
+
+  auto unaryExpr = std::make_shared<UnaryExpr>();
+  unaryExpr->tok = tok;
+  unaryExpr->op = op;
+  unaryExpr->operand = operand;
+  unaryExpr->ty = ty;
+
+  // `*p` with `p` pointing to an array is itself an array.
+  return op == OpCode::deref ? semaDecayNode(unaryExpr) : unaryExpr;
+}
+
+std::shared_ptr<ASTNode> Sema::semaConditionalExprNode(
+    std::shared_ptr<ASTNode> condExpr,
+    std::shared_ptr<ASTNode> thenExpr,
+    std::shared_ptr<ASTNode> elseExpr) {
+  assert((condExpr && thenExpr && elseExpr) &&
+         "Operands of conditional expression can't be resolved\n");
+  checkCondition(condExpr.get());
+
+  if (thenExpr->ty->isArithmetic() && elseExpr->ty->isArithmetic()) {
+    usualArithmeticConversions(thenExpr, elseExpr);
+  }
+  else if (llvm::isa<CPointerType>(thenExpr->ty)) {
+    elseExpr = convertForAssignment(thenExpr->ty, elseExpr);
+  }
+  else {
+    thenExpr = convertForAssignment(elseExpr->ty, thenExpr);
+  }
+
+  auto conditionalExpr = std::make_shared<ConditionalExpr>();
+  conditionalExpr->tok = condExpr->tok;
+  conditionalExpr->condExpr = condExpr;
+  conditionalExpr->thenExpr = thenExpr;
+  conditionalExpr->elseExpr = elseExpr;
+  conditionalExpr->ty = typeCtx.getUnqualifiedTy(thenExpr->ty);
+
+  return conditionalExpr;
+}
+
+std::shared_ptr<ASTNode> Sema::semaNumberExprNode(const Token &tok) {
   auto numberExpr = std::make_shared<NumberExpr>();
   numberExpr->tok = tok;
   numberExpr->number = tok.value;
-  numberExpr->ty = ty;
+  numberExpr->ty = typeCtx.getIntTy();
 
   return numberExpr;
+}
+
+std::shared_ptr<ASTNode> Sema::semaFloatExprNode(const Token &tok) {
+  auto floatExpr = std::make_shared<FloatExpr>();
+  floatExpr->tok = tok;
+  floatExpr->value = tok.fvalue;
+  bool isFloat = tok.content.back() == 'f' || tok.content.back() == 'F';
+  floatExpr->ty = isFloat ? typeCtx.getFloatTy() : typeCtx.getDoubleTy();
+
+  return floatExpr;
+}
+
+/// A `break` out of `loop`, or a `return` in it, if there's one.
+static ASTNode *findLoopExit(ASTNode *stmt, ASTNode *loop) {
+  if (!stmt) {
+    return nullptr;
+  }
+
+  switch (stmt->getNodeKind()) {
+  case ASTNode::NodeKind::BlockStmt:
+    for (auto &child: llvm::cast<BlockStmt>(stmt)->stmtVec) {
+      if (ASTNode *exit = findLoopExit(child.get(), loop)) {
+        return exit;
+      }
+    }
+    return nullptr;
+  case ASTNode::NodeKind::IfStmt: {
+    auto *ifStmt = llvm::cast<IfStmt>(stmt);
+    ASTNode *exit = findLoopExit(ifStmt->thenBody.get(), loop);
+    return exit ? exit : findLoopExit(ifStmt->elseBody.get(), loop);
+  }
+  case ASTNode::NodeKind::ForStmt:
+    return findLoopExit(llvm::cast<ForStmt>(stmt)->forBody.get(), loop);
+  case ASTNode::NodeKind::BreakStmt:
+    return llvm::cast<BreakStmt>(stmt)->target.get() == loop ? stmt : nullptr;
+  case ASTNode::NodeKind::ReturnStmt:
+    return stmt;
+  default:
+    return nullptr;
+  }
+}
+
+/// Match `for (i = lower; i < upper; i = i + step)`, or `int i = lower`
+/// and `i <= upper`, and record the parts in `omp`.
+static bool matchOmpLoop(ForStmt *forStmt, OmpParallelFor &omp) {
+  ASTNode *init = forStmt->initExpr.get();
+  if (auto *declStmt = llvm::dyn_cast_or_null<DeclStmt>(init)) {
+    init = declStmt->exprVec.empty() ? nullptr
+                                     : declStmt->exprVec.back().get();
+  }
+  auto *initExpr = llvm::dyn_cast_or_null<AssignExpr>(init);
+  auto *ivExpr = initExpr ?
+      llvm::dyn_cast<VariableExpr>(initExpr->lhs.get()) : nullptr;
+  if (!ivExpr || !ivExpr->ty->isInteger()) {
+    return false;
+  }
+  omp.iv = ivExpr->symbol;
+
+  auto isIV = [&](ASTNode *expr) {
+    auto *varExpr = llvm::dyn_cast<VariableExpr>(expr);
+    return varExpr && varExpr->symbol == omp.iv;
+  };
+
+  auto *condExpr = llvm::dyn_cast_or_null<BinaryExpr>(forStmt->condExpr.get());
+  if (!condExpr || !isIV(condExpr->lhs.get()) ||
+      (condExpr->op != OpCode::less && condExpr->op != OpCode::lesseq)) {
+    return false;
+  }
+  omp.upper = condExpr->rhs;
+  omp.isInclusive = condExpr->op == OpCode::lesseq;
+
+  auto *incExpr = llvm::dyn_cast_or_null<AssignExpr>(forStmt->incExpr.get());
+  auto *stepExpr = incExpr ?
+      llvm::dyn_cast<BinaryExpr>(incExpr->rhs.get()) : nullptr;
+  if (!stepExpr || !isIV(incExpr->lhs.get()) || stepExpr->op != OpCode::add ||
+      !isIV(stepExpr->lhs.get())) {
+    return false;
+  }
+  auto *stepNum = llvm::dyn_cast<NumberExpr>(stepExpr->rhs.get());
+  if (!stepNum || stepNum->number <= 0) {
+    return false;
+  }
+  omp.step = stepNum->number;
+  return true;
+}
+
+std::shared_ptr<ASTNode> Sema::semaOmpParallelForNode(
+    const Token &tok, std::shared_ptr<ASTNode> loop,
+    llvm::ArrayRef<Token> reductionToks, std::shared_ptr<OmpParallelFor> omp) {
+  auto *forStmt = llvm::cast<ForStmt>(loop.get());
+  if (!matchOmpLoop(forStmt, *omp)) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(tok.content.begin()),
+        diag::err_omp_loop_form);
+  }
+
+  // The iterations run on other threads, which can't return or break out.
+  if (ASTNode *exit = findLoopExit(forStmt->forBody.get(), forStmt)) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(exit->tok.content.begin()),
+        diag::err_omp_loop_exit,
+        exit->tok.content);
+  }
+
+  for (const Token &reductionTok: reductionToks) {
+    std::shared_ptr<Symbol> symbol = scope.findVarSymbol(reductionTok.content);
+    if (!symbol || symbol->getKind() == SymbolKind::Function) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(reductionTok.content.begin()),
+          diag::err_undefined,
+          reductionTok.content);
+    }
+    if (!symbol->getTy()->isArithmetic()) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(reductionTok.content.begin()),
+          diag::err_omp_reduction_type,
+          reductionTok.content, symbol->getTy()->getName());
+    }
+    if (symbol == omp->iv) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(reductionTok.content.begin()),
+          diag::err_omp_reduction_iv,
+          reductionTok.content);
+    }
+    omp->reductions.push_back(symbol);
+  }
+
+  auto checkIntegerClause = [&](llvm::StringRef clause, ASTNode *expr) {
+    if (expr && !expr->ty->isInteger()) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(expr->tok.content.begin()),
+          diag::err_omp_clause_integer,
+          clause);
+    }
+  };
+  checkIntegerClause("schedule", omp->chunk.get());
+  checkIntegerClause("num_threads", omp->numThreads.get());
+
+  forStmt->omp = omp;
+  return loop;
+}
+
+void Sema::checkCondition(ASTNode *condExpr) {
+  if (condExpr->ty->isArithmetic() || llvm::isa<CPointerType>(condExpr->ty)) {
+    return;
+  }
+  diagEngine.report(
+      llvm::SMLoc::getFromPointer(condExpr->tok.content.begin()),
+      diag::err_scalar_condition,
+      condExpr->ty->getName());
+}
+
+std::shared_ptr<ASTNode> Sema::semaBuiltinCallExprNode(
+    const Token &tok, std::vector<std::shared_ptr<ASTNode>> args) {
+  llvm::StringRef name = tok.content;
+  auto builtinKind =
+      llvm::StringSwitch<std::optional<BuiltinKind>>(name)
+          .Case("__builtin_shufflevector", BuiltinKind::ShuffleVector)
+          .Case("__builtin_splat", BuiltinKind::Splat)
+          .Case("__builtin_reduce_add", BuiltinKind::ReduceAdd)
+          .Case("__builtin_reduce_mul", BuiltinKind::ReduceMul)
+          .Case("__builtin_reduce_min", BuiltinKind::ReduceMin)
+          .Case("__builtin_reduce_max", BuiltinKind::ReduceMax)
+          .Case("__builtin_reduce_and", BuiltinKind::ReduceAnd)
+          .Case("__builtin_reduce_or", BuiltinKind::ReduceOr)
+          .Case("__builtin_reduce_xor", BuiltinKind::ReduceXor)
+          .Default(std::nullopt);
+  if (!builtinKind) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(tok.content.begin()),
+        diag::err_unknown_builtin,
+        name);
+  }
+
+  // __builtin_shufflevector(a, b, indexes...) takes at least one index.
+  size_t expected = 1;
+  if (*builtinKind == BuiltinKind::Splat) {
+    expected = 2;
+  }
+  else if (*builtinKind == BuiltinKind::ShuffleVector) {
+    expected = std::max<size_t>(args.size(), 3);
+  }
+  if (args.size() != expected) {
+    diagEngine.report(
+        llvm::SMLoc::getFromPointer(tok.content.begin()),
+        diag::err_call_args,
+        args.size() > expected ? "many" : "few",
+        expected, args.size());
+  }
+
+  auto checkArg = [&](size_t idx, bool isValid, llvm::StringRef what) {
+    if (!isValid) {
+      diagEngine.report(
+          llvm::SMLoc::getFromPointer(args[idx]->tok.content.begin()),
+          diag::err_builtin_arg,
+          idx + 1, name, what);
+    }
+  };
+
+  CType *ty = nullptr;
+  auto *vectorTy = llvm::dyn_cast<CVectorType>(args[0]->ty);
+  switch (*builtinKind) {
+  case BuiltinKind::ShuffleVector: {
+    // Indexes pick from the elements of `a` followed by those of `b`.
+    checkArg(0, vectorTy, "a vector");
+    checkArg(1, args[1]->ty == vectorTy, "a vector of the same type");
+    for (size_t i = 2; i < args.size(); ++i) {
+      auto *numberExpr = llvm::dyn_cast<NumberExpr>(args[i].get());
+      checkArg(i, numberExpr && size_t(numberExpr->number) <
+                                    2 * vectorTy->getNumElems(),
+               "a constant index into the vectors");
+    }
+    checkArg(2, CVectorType::isValidNumElems(args.size() - 2),
+             "followed by 2, 4, 8 or 16 indexes");
+    ty = typeCtx.getVectorTy(vectorTy->getElemTy(), args.size() - 2);
+    break;
+  }
+  case BuiltinKind::Splat: {
+    checkArg(0, args[0]->ty->isArithmetic(), "an arithmetic value");
+    auto *numberExpr = llvm::dyn_cast<NumberExpr>(args[1].get());
+    checkArg(1, numberExpr && CVectorType::isValidNumElems(numberExpr->number),
+             "2, 4, 8 or 16");
+    ty = typeCtx.getVectorTy(args[0]->ty, numberExpr->number);
+    break;
+  }
+  case BuiltinKind::ReduceAnd:
+  case BuiltinKind::ReduceOr:
+  case BuiltinKind::ReduceXor:
+    checkArg(0, vectorTy && vectorTy->getElemTy()->isInteger(),
+             "a vector of integers");
+    ty = vectorTy->getElemTy();
+    break;
+  default:
+    checkArg(0, vectorTy, "a vector");
+    ty = vectorTy->getElemTy();
+    break;
+  }
+
+  auto builtinCallExpr = std::make_shared<BuiltinCallExpr>();
+  builtinCallExpr->tok = tok;
+  builtinCallExpr->builtinKind = *builtinKind;
+  builtinCallExpr->args = std::move(args);
+  builtinCallExpr->ty = ty;
+
+  return builtinCallExpr;
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "ThinLTO.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/Support/Caching.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+llvm::Expected<std::vector<llvm::SmallString<0>>>
+thinLink(llvm::ArrayRef<llvm::MemoryBufferRef> inputs,
+         const llvm::TargetMachine &tm, unsigned optLevel, unsigned jobs) {
+  llvm::lto::Config conf;
+  conf.CPU = tm.getTargetCPU().str();
+  llvm::SmallVector<llvm::StringRef, 8> features;
+  tm.getTargetFeatureString().split(features, ',', /*MaxSplit=*/-1,
+                                    /*KeepEmpty=*/false);
+  for (llvm::StringRef feature: features) {
+    conf.MAttrs.push_back(feature.str());
+  }
+  conf.Options = tm.Options;
+  conf.RelocModel = tm.getRelocationModel();
+  conf.CodeModel = tm.getCodeModel();
+  conf.CGOptLevel = tm.getOptLevel();
+  conf.OptLevel = optLevel;
+
+  llvm::lto::LTO lto(std::move(conf),
+                     llvm::lto::createInProcessThinBackend(
+                         llvm::heavyweight_hardware_concurrency(jobs)));
+
+  // The first definition of a name prevails. Only `main` is called from
+  // outside, so the rest can be internalized once the imports are done.
+  llvm::StringSet<> defined;
+  for (llvm::MemoryBufferRef input: inputs) {
+    llvm::Expected<std::unique_ptr<llvm::lto::InputFile>> file =
+        llvm::lto::InputFile::create(input);
+    if (!file) {
+      return file.takeError();
+    }
+
+    llvm::ArrayRef<llvm::lto::InputFile::Symbol> symbols = (*file)->symbols();
+    std::vector<llvm::lto::SymbolResolution> resolutions(symbols.size());
+    for (size_t i = 0; i < symbols.size(); ++i) {
+      const llvm::lto::InputFile::Symbol &symbol = symbols[i];
+      llvm::lto::SymbolResolution &resolution = resolutions[i];
+      if (!symbol.isUndefined()) {
+        resolution.Prevailing = defined.insert(symbol.getName()).second;
+        resolution.FinalDefinitionInLinkageUnit = true;
+      }
+      resolution.VisibleToRegularObj =
+          symbol.getName() == "main" || symbol.isUsed();
+    }
+    if (llvm::Error err = lto.add(std::move(*file), resolutions)) {
+      return std::move(err);
+    }
+  }
+
+  // Each task writes its own object, so the threads share nothing.
+  std::vector<llvm::SmallString<0>> objects(lto.getMaxTasks());
+  // Newer versions of LLVM pass the name of the module as well.
+  auto addStream = [&objects](unsigned task, const auto &...)
+      -> llvm::Expected<std::unique_ptr<llvm::CachedFileStream>> {
+    return std::make_unique<llvm::CachedFileStream>(
+        std::make_unique<llvm::raw_svector_ostream>(objects[task]));
+  };
+  if (llvm::Error err = lto.run(addStream)) {
+    return std::move(err);
+  }
+
+  // The task of the inputs without a summary writes nothing without them.
+  objects.erase(std::remove_if(objects.begin(), objects.end(),
+                               [](const llvm::SmallString<0> &object) {
+                                 return object.empty();
+                               }),
+                objects.end());
+  return objects;
+}
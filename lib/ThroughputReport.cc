@@ -0,0 +1,475 @@
+#include "ThroughputReport.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/MCAsmInfo.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrAnalysis.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCObjectFileInfo.h"
+#include "llvm/MC/MCParser/MCAsmParser.h"
+#include "llvm/MC/MCParser/MCTargetAsmParser.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/MCTargetOptions.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/MCA/Context.h"
+#include "llvm/MCA/CustomBehaviour.h"
+#include "llvm/MCA/HWEventListener.h"
+#include "llvm/MCA/InstrBuilder.h"
+#include "llvm/MCA/Pipeline.h"
+#include "llvm/MCA/SourceMgr.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+// The iterations llvm-mca simulates by default.
+static const unsigned Iterations = 100;
+
+namespace {
+
+/// A machine basic block in the verbose assembly of a function.
+struct AsmBlock {
+  // `BB0_3` for `.LBB0_3:`, empty for blocks nothing branches to.
+  std::string label;
+  // The IR block it was selected from.
+  std::string irName;
+  // The header of the innermost loop around the block.
+  std::string header;
+  bool isInnermostHeader = false;
+  std::vector<std::string> insts;
+};
+
+struct AsmFunction {
+  std::string name;
+  std::vector<AsmBlock> blocks;
+};
+
+/// What the report prints for an innermost loop.
+struct LoopReport {
+  std::string file;
+  unsigned line = 0;
+  std::string funcName;
+  unsigned numInsts = 0;
+  unsigned cycles = 0;
+  std::string bottleneck;
+  // The cycles each resource unit is busy over all iterations.
+  std::vector<std::pair<std::string, double>> pressure;
+  std::string error;
+};
+
+/// Collects the instructions the assembly parser emits.
+class InstCollector : public llvm::MCStreamer {
+public:
+  InstCollector(llvm::MCContext &ctx) : llvm::MCStreamer(ctx) {}
+
+  void emitInstruction(const llvm::MCInst &inst,
+                       const llvm::MCSubtargetInfo &) override {
+    insts.push_back(inst);
+  }
+  bool emitSymbolAttribute(llvm::MCSymbol *, llvm::MCSymbolAttr) override {
+    return true;
+  }
+#if LLVM_VERSION_MAJOR >= 16
+  void emitCommonSymbol(llvm::MCSymbol *, uint64_t, llvm::Align) override {}
+  void emitZerofill(llvm::MCSection *, llvm::MCSymbol *, uint64_t,
+                    llvm::Align, llvm::SMLoc) override {}
+#else
+  void emitCommonSymbol(llvm::MCSymbol *, uint64_t, unsigned) override {}
+  void emitZerofill(llvm::MCSection *, llvm::MCSymbol *, uint64_t, unsigned,
+                    llvm::SMLoc) override {}
+#endif
+
+  std::vector<llvm::MCInst> insts;
+};
+
+/// Sums up the resource usage and the backend pressure of a simulation.
+class ThroughputListener : public llvm::mca::HWEventListener {
+public:
+  void onEvent(const llvm::mca::HWInstructionEvent &event) override {
+    if (event.Type != llvm::mca::HWInstructionEvent::Issued) {
+      return;
+    }
+    const auto &issued =
+        static_cast<const llvm::mca::HWInstructionIssuedEvent &>(event);
+    for (const auto &[resource, cycles]: issued.UsedResources) {
+      // The second half of a resource is the mask of the unit used.
+      unsigned unit = llvm::Log2_64(resource.second);
+      usage[{resource.first, unit}] += double(cycles);
+    }
+  }
+
+  // Sent at most once per cycle for each reason.
+  void onEvent(const llvm::mca::HWPressureEvent &event) override {
+    ++pressureCycles[event.Reason];
+  }
+
+  std::map<std::pair<uint64_t, unsigned>, double> usage;
+  unsigned pressureCycles[llvm::mca::HWPressureEvent::MEMORY_DEPS + 1] = {};
+};
+
+} // namespace
+
+/// Split the verbose assembly of a module into functions and blocks. The
+/// loops come from the comments AsmPrinter puts on each block of a loop:
+/// `=>This Inner Loop Header: Depth=1` on the header of an innermost loop,
+/// `=>This Loop Header: Depth=1` on other headers, and
+/// `in Loop: Header=BB0_1 Depth=1` on the other blocks.
+static std::vector<AsmFunction> scanAssembly(llvm::StringRef asmText,
+                                             const llvm::MCAsmInfo &mai) {
+  llvm::StringRef commentString = mai.getCommentString();
+  std::vector<AsmFunction> funcs;
+  auto getBlock = [&funcs]() -> AsmBlock & {
+    if (funcs.back().blocks.empty()) {
+      funcs.back().blocks.emplace_back();
+    }
+    return funcs.back().blocks.back();
+  };
+
+  llvm::SmallVector<llvm::StringRef, 0> lines;
+  asmText.split(lines, '\n');
+  for (llvm::StringRef line: lines) {
+    auto [code, comment] = line.split(commentString);
+    code = code.trim();
+    comment = comment.trim();
+
+    if (!code.empty() && code.back() == ':') {
+      llvm::StringRef label = code.drop_back();
+      if (!label.consume_front(mai.getPrivateLabelPrefix())) {
+        funcs.push_back({label.str(), {}});
+      }
+      else if (label.consume_front("BB") && !funcs.empty()) {
+        AsmBlock block;
+        block.label = ("BB" + label).str();
+        if (comment.consume_front("%")) {
+          block.irName = comment.str();
+        }
+        funcs.back().blocks.push_back(std::move(block));
+      }
+      continue;
+    }
+    if (funcs.empty()) {
+      continue;
+    }
+
+    if (code.empty()) {
+      // `# %bb.2:  # %for.body` starts a block without a label.
+      if (comment.consume_front("%bb.")) {
+        AsmBlock block;
+        comment = comment.split(commentString).second.trim();
+        if (comment.consume_front("%")) {
+          block.irName = comment.str();
+        }
+        funcs.back().blocks.push_back(std::move(block));
+      }
+      // Nested headers are indented by their depth after the arrow.
+      else if (comment.consume_front("=>")) {
+        comment = comment.ltrim();
+        getBlock().header = getBlock().label;
+        getBlock().isInnermostHeader =
+            comment.consume_front("This Inner Loop Header:");
+      }
+      else if (comment.consume_front("in Loop: Header=")) {
+        getBlock().header = comment.split(' ').first.str();
+      }
+      continue;
+    }
+
+    // Skip directives, keep instructions.
+    if (code.front() != '.') {
+      getBlock().insts.push_back(code.str());
+    }
+  }
+  return funcs;
+}
+
+/// Parse the assembly of a loop into the instructions llvm-mca simulates.
+static llvm::Error parseInstructions(llvm::StringRef text,
+                                     llvm::TargetMachine &tm,
+                                     std::vector<llvm::MCInst> &insts) {
+  const llvm::Target &target = tm.getTarget();
+  const llvm::MCAsmInfo &mai = *tm.getMCAsmInfo();
+  const llvm::MCSubtargetInfo &sti = *tm.getMCSubtargetInfo();
+
+  std::string diag;
+  llvm::raw_string_ostream diagOS(diag);
+  llvm::SourceMgr srcMgr;
+  srcMgr.AddNewSourceBuffer(llvm::MemoryBuffer::getMemBufferCopy(text),
+                            llvm::SMLoc());
+  srcMgr.setDiagHandler(
+      [](const llvm::SMDiagnostic &d, void *os) {
+        d.print(nullptr, *static_cast<llvm::raw_ostream *>(os), false);
+      },
+      &diagOS);
+
+  llvm::MCContext ctx(tm.getTargetTriple(), &mai, tm.getMCRegisterInfo(),
+                      &sti, &srcMgr);
+  std::unique_ptr<llvm::MCObjectFileInfo> mofi(
+      target.createMCObjectFileInfo(ctx, /*PIC=*/false));
+  ctx.setObjectFileInfo(mofi.get());
+
+  InstCollector collector(ctx);
+  std::unique_ptr<llvm::MCAsmParser> parser(
+      llvm::createMCAsmParser(srcMgr, ctx, collector, mai));
+  llvm::MCTargetOptions options;
+  std::unique_ptr<llvm::MCTargetAsmParser> targetParser(
+      target.createMCAsmParser(sti, *parser, *tm.getMCInstrInfo(), options));
+  if (!targetParser) {
+    return llvm::createStringError(
+        llvm::inconvertibleErrorCode(),
+        "no assembly parser for " + tm.getTargetTriple().str());
+  }
+  parser->setAssemblerDialect(mai.getAssemblerDialect());
+  parser->setTargetParser(*targetParser);
+  if (parser->Run(/*NoInitialTextSection=*/false)) {
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   diagOS.str());
+  }
+
+  insts = std::move(collector.insts);
+  return llvm::Error::success();
+}
+
+/// The pressure that stalls the loop most, when it stalls more than one
+/// cycle in ten. Otherwise the loop issues as fast as the CPU dispatches.
+static std::string getBottleneck(const ThroughputListener &listener,
+                                 unsigned cycles,
+                                 const LoopReport &report) {
+  using PressureEvent = llvm::mca::HWPressureEvent;
+  unsigned resources = listener.pressureCycles[PressureEvent::RESOURCES];
+  unsigned registers = listener.pressureCycles[PressureEvent::REGISTER_DEPS];
+  unsigned memory = listener.pressureCycles[PressureEvent::MEMORY_DEPS];
+  unsigned worst = std::max({resources, registers, memory});
+  if (worst * 10 < cycles) {
+    return "dispatch width";
+  }
+
+  std::string percent = llvm::formatv(" ({0}% of cycles)",
+                                      worst * 100 / cycles).str();
+  if (worst == resources && !report.pressure.empty()) {
+    return "resource pressure on " + report.pressure.front().first + percent;
+  }
+  if (worst == registers) {
+    return "register dependencies" + percent;
+  }
+  return "memory dependencies" + percent;
+}
+
+/// Simulate `Iterations` iterations of a loop.
+static llvm::Error simulate(llvm::ArrayRef<llvm::MCInst> insts,
+                            llvm::TargetMachine &tm, LoopReport &report) {
+  const llvm::MCSubtargetInfo &sti = *tm.getMCSubtargetInfo();
+  const llvm::MCInstrInfo &mcii = *tm.getMCInstrInfo();
+  const llvm::MCRegisterInfo &mri = *tm.getMCRegisterInfo();
+  const llvm::MCSchedModel &sm = sti.getSchedModel();
+  std::unique_ptr<llvm::MCInstrAnalysis> mcia(
+      tm.getTarget().createMCInstrAnalysis(&mcii));
+
+#if LLVM_VERSION_MAJOR >= 19
+  llvm::mca::InstrumentManager im(sti, mcii);
+  llvm::mca::InstrBuilder ib(sti, mcii, mri, mcia.get(), im,
+                             /*CallLatency=*/100);
+#elif LLVM_VERSION_MAJOR >= 17
+  llvm::mca::InstrumentManager im(sti, mcii);
+  llvm::mca::InstrBuilder ib(sti, mcii, mri, mcia.get(), im);
+#else
+  llvm::mca::InstrBuilder ib(sti, mcii, mri, mcia.get());
+#endif
+
+  std::vector<std::unique_ptr<llvm::mca::Instruction>> sequence;
+  for (const llvm::MCInst &inst: insts) {
+#if LLVM_VERSION_MAJOR >= 17
+    auto mcaInst = ib.createInstruction(inst, {});
+#else
+    auto mcaInst = ib.createInstruction(inst);
+#endif
+    if (!mcaInst) {
+      return mcaInst.takeError();
+    }
+    sequence.push_back(std::move(*mcaInst));
+  }
+
+#if LLVM_VERSION_MAJOR >= 17
+  llvm::mca::CircularSourceMgr srcMgr(sequence, Iterations);
+#else
+  llvm::mca::SourceMgr srcMgr(sequence, Iterations);
+#endif
+  llvm::mca::CustomBehaviour cb(sti, srcMgr, mcii);
+  llvm::mca::Context mca(mri, sti);
+  llvm::mca::PipelineOptions options(
+      /*UOPQSize=*/0, /*DecThr=*/0, /*DW=*/0, /*RFS=*/0, /*LQS=*/0,
+      /*SQS=*/0, /*NoAlias=*/true, /*ShouldEnableBottleneckAnalysis=*/true);
+  std::unique_ptr<llvm::mca::Pipeline> pipeline =
+      sm.isOutOfOrder() ? mca.createDefaultPipeline(options, srcMgr, cb)
+                        : mca.createInOrderPipeline(options, srcMgr, cb);
+  ThroughputListener listener;
+  pipeline->addEventListener(&listener);
+  llvm::Expected<unsigned> cycles = pipeline->run();
+  if (!cycles) {
+    return cycles.takeError();
+  }
+
+  report.numInsts = insts.size();
+  report.cycles = *cycles;
+  for (auto &[unit, usage]: listener.usage) {
+    const llvm::MCProcResourceDesc *desc = sm.getProcResource(unit.first);
+    std::string name = desc->Name;
+    if (desc->NumUnits > 1) {
+      name += "." + std::to_string(unit.second);
+    }
+    report.pressure.push_back({name, usage});
+  }
+  std::stable_sort(report.pressure.begin(), report.pressure.end(),
+                   [](const auto &lhs, const auto &rhs) {
+                     return lhs.second > rhs.second;
+                   });
+  report.bottleneck = getBottleneck(listener, *cycles, report);
+  return llvm::Error::success();
+}
+
+/// Find the `for` of the loop around the IR block `irName`, from the
+/// location codegen puts in its loop ID.
+static void findSourceLine(llvm::Function &func, llvm::StringRef irName,
+                           const llvm::LoopInfo &loopInfo,
+                           LoopReport &report) {
+  for (llvm::BasicBlock &bb: func) {
+    if (bb.getName() != irName) {
+      continue;
+    }
+    if (llvm::Loop *loop = loopInfo.getLoopFor(&bb)) {
+      if (llvm::DebugLoc loc = loop->getStartLoc()) {
+        report.file = loc->getFilename().str();
+        report.line = loc.getLine();
+      }
+    }
+    return;
+  }
+}
+
+static void printReport(const LoopReport &report, llvm::raw_ostream &os) {
+  os << (report.file.empty() ? "<unknown>" : report.file) << ":"
+     << report.line << ": loop in '" << report.funcName << "'";
+  if (!report.error.empty()) {
+    os << ": not simulated: " << report.error << "\n";
+    return;
+  }
+
+  double cyclesPerIteration = double(report.cycles) / Iterations;
+  os << ": " << report.numInsts << " instructions, "
+     << llvm::format("%.2f", cyclesPerIteration) << " cycles per iteration, "
+     << "IPC "
+     << llvm::format("%.2f", report.numInsts / cyclesPerIteration) << "\n";
+  os << "  bottleneck: " << report.bottleneck << "\n";
+  os << "  resource pressure per iteration:";
+  for (auto &[name, usage]: report.pressure) {
+    os << " " << name << " " << llvm::format("%.2f", usage / Iterations);
+  }
+  os << "\n";
+}
+
+llvm::Error reportLoopThroughput(const llvm::Module &m, llvm::TargetMachine &tm,
+                                 llvm::raw_ostream &os) {
+  const llvm::MCSubtargetInfo &sti = *tm.getMCSubtargetInfo();
+  if (!sti.getSchedModel().hasInstrSchedModel()) {
+    return llvm::createStringError(
+        llvm::inconvertibleErrorCode(),
+        "the CPU '" + sti.getCPU().str() +
+            "' has no scheduling model, select one with -mcpu");
+  }
+
+  // Instruction selection changes the IR, so the assembly is generated from
+  // a copy, whose blocks are the ones the assembly comments name.
+  std::unique_ptr<llvm::Module> clone = llvm::CloneModule(m);
+  llvm::SmallString<0> asmText;
+  llvm::raw_svector_ostream asmOS(asmText);
+  bool wasVerbose = tm.Options.MCOptions.AsmVerbose;
+  tm.Options.MCOptions.AsmVerbose = true;
+  llvm::legacy::PassManager pm;
+#if LLVM_VERSION_MAJOR >= 18
+  bool failed = tm.addPassesToEmitFile(pm, asmOS, nullptr,
+                                       llvm::CodeGenFileType::AssemblyFile);
+#else
+  bool failed = tm.addPassesToEmitFile(pm, asmOS, nullptr,
+                                       llvm::CGFT_AssemblyFile);
+#endif
+  if (!failed) {
+    pm.run(*clone);
+  }
+  tm.Options.MCOptions.AsmVerbose = wasVerbose;
+  if (failed) {
+    return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                   "the target can't emit assembly");
+  }
+
+  std::vector<LoopReport> reports;
+  for (AsmFunction &asmFunc: scanAssembly(asmText, *tm.getMCAsmInfo())) {
+    llvm::Function *func = clone->getFunction(asmFunc.name);
+    if (!func || func->isDeclaration()) {
+      continue;
+    }
+    llvm::DominatorTree domTree(*func);
+    llvm::LoopInfo loopInfo(domTree);
+
+    for (const AsmBlock &header: asmFunc.blocks) {
+      if (!header.isInnermostHeader || header.label.empty()) {
+        continue;
+      }
+
+      LoopReport report;
+      report.funcName = asmFunc.name;
+      findSourceLine(*func, header.irName, loopInfo, report);
+      std::string text;
+      for (const AsmBlock &block: asmFunc.blocks) {
+        if (block.header == header.label) {
+          for (const std::string &inst: block.insts) {
+            text += inst + "\n";
+          }
+        }
+      }
+
+      std::vector<llvm::MCInst> insts;
+      llvm::Error error = parseInstructions(text, tm, insts);
+      if (!error) {
+        error = simulate(insts, tm, report);
+      }
+      if (error) {
+        report.error = llvm::toString(std::move(error));
+      }
+      reports.push_back(std::move(report));
+    }
+  }
+
+  std::stable_sort(reports.begin(), reports.end(),
+                   [](const LoopReport &lhs, const LoopReport &rhs) {
+                     return std::tie(lhs.file, lhs.line) <
+                            std::tie(rhs.file, rhs.line);
+                   });
+  os << "Throughput of the innermost loops on '" << sti.getCPU() << "' over "
+     << Iterations << " simulated iterations:\n";
+  if (reports.empty()) {
+    os << "no innermost loops\n";
+  }
+  for (const LoopReport &report: reports) {
+    printReport(report, os);
+  }
+  return llvm::Error::success();
+}
\ No newline at end of file
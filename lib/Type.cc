@@ -1,6 +1,156 @@
 #include "Type.h"
 
-CType *CType::getIntTy() {
-  static CType ctype(TypeKind::Int, 4, 4);
-  return &ctype;
+#include "llvm/Support/Casting.h"
+#include "llvm/Support/MathExtras.h"
+
+#include <algorithm>
+
+#include <memory>
+#include <string>
+
+std::string CType::getName() const {
+  switch (kind) {
+  case TypeKind::Int:
+    return "int";
+  case TypeKind::Float:
+    return "float";
+  case TypeKind::Double:
+    return "double";
+  case TypeKind::Pointer: {
+    auto *pointerTy = llvm::cast<CPointerType>(this);
+    std::string name = pointerTy->getPointeeTy()->getName() + " *";
+    return pointerTy->isRestrict() ? name + "restrict" : name;
+  }
+  case TypeKind::Array: {
+    auto *arrayTy = llvm::cast<CArrayType>(this);
+    return arrayTy->getElemTy()->getName() + "[" +
+           std::to_string(arrayTy->getNumElems()) + "]";
+  }
+  case TypeKind::Vector: {
+    auto *vectorTy = llvm::cast<CVectorType>(this);
+    return vectorTy->getElemTy()->getName() +
+           std::to_string(vectorTy->getNumElems());
+  }
+  case TypeKind::Struct: {
+    llvm::StringRef structName = llvm::cast<CStructType>(this)->getStructName();
+    return "struct " + (structName.empty() ? "<anonymous>" : structName.str());
+  }
+  case TypeKind::Func: {
+    auto *funcTy = llvm::cast<CFuncType>(this);
+    std::string name = funcTy->getRetTy()->getName() + " (";
+    for (size_t i = 0; i < funcTy->getParamTys().size(); ++i) {
+      name += (i > 0 ? ", " : "") + funcTy->getParamTys()[i]->getName();
+    }
+    return name + ")";
+  }
+  }
+  return "";
+}
+
+CType *CType::getScalarTy() {
+  if (auto *vectorTy = llvm::dyn_cast<CVectorType>(this)) {
+    return vectorTy->getElemTy();
+  }
+  return this;
+}
+
+int CStructType::getFieldIndex(llvm::StringRef fieldName) const {
+  for (size_t i = 0; i < fields.size(); ++i) {
+    if (fields[i].name == fieldName) return i;
+  }
+  return -1;
+}
+
+void CStructType::setBody(std::vector<CField> newFields, bool isPacked,
+                          size_t minAlign) {
+  size_t offset = 0;
+  size_t structAlign = 1;
+  for (CField &field: newFields) {
+    size_t fieldAlign = isPacked ? 1 : field.ty->getAlign();
+    offset = llvm::alignTo(offset, fieldAlign);
+    field.offset = offset;
+    offset += field.ty->getSize();
+    structAlign = std::max(structAlign, fieldAlign);
+  }
+  structAlign = std::max(structAlign, minAlign);
+
+  fields = std::move(newFields);
+  packed = isPacked;
+  complete = true;
+  setLayout(llvm::alignTo(offset, structAlign), structAlign);
+}
+
+CPointerType *TypeContext::getPointerTy(CType *pointeeTy, bool isRestrict) {
+  llvm::FoldingSetNodeID id;
+  CPointerType::Profile(id, pointeeTy, isRestrict);
+
+  void *insertPos = nullptr;
+  if (auto *pointerTy = pointerTys.FindNodeOrInsertPos(id, insertPos)) {
+    return pointerTy;
+  }
+
+  auto *pointerTy = new CPointerType(pointeeTy, isRestrict);
+  ownedTys.emplace_back(pointerTy);
+  pointerTys.InsertNode(pointerTy, insertPos);
+  return pointerTy;
+}
+
+CArrayType *TypeContext::getArrayTy(CType *elemTy, size_t numElems) {
+  llvm::FoldingSetNodeID id;
+  CArrayType::Profile(id, elemTy, numElems);
+
+  void *insertPos = nullptr;
+  if (auto *arrayTy = arrayTys.FindNodeOrInsertPos(id, insertPos)) {
+    return arrayTy;
+  }
+
+  auto *arrayTy = new CArrayType(elemTy, numElems);
+  ownedTys.emplace_back(arrayTy);
+  arrayTys.InsertNode(arrayTy, insertPos);
+  return arrayTy;
+}
+
+CVectorType *TypeContext::getVectorTy(CType *elemTy, size_t numElems) {
+  llvm::FoldingSetNodeID id;
+  CVectorType::Profile(id, elemTy, numElems);
+
+  void *insertPos = nullptr;
+  if (auto *vectorTy = vectorTys.FindNodeOrInsertPos(id, insertPos)) {
+    return vectorTy;
+  }
+
+  auto *vectorTy = new CVectorType(elemTy, numElems);
+  ownedTys.emplace_back(vectorTy);
+  vectorTys.InsertNode(vectorTy, insertPos);
+  return vectorTy;
+}
+
+CFuncType *TypeContext::getFuncTy(CType *retTy,
+                                  llvm::ArrayRef<CType *> paramTys) {
+  llvm::FoldingSetNodeID id;
+  CFuncType::Profile(id, retTy, paramTys);
+
+  void *insertPos = nullptr;
+  if (auto *funcTy = funcTys.FindNodeOrInsertPos(id, insertPos)) {
+    return funcTy;
+  }
+
+  auto *funcTy = new CFuncType(retTy, paramTys);
+  ownedTys.emplace_back(funcTy);
+  funcTys.InsertNode(funcTy, insertPos);
+  return funcTy;
+}
+
+CStructType *TypeContext::createStructTy(llvm::StringRef name) {
+  auto *structTy = new CStructType(name);
+  ownedTys.emplace_back(structTy);
+  return structTy;
+}
+
+CType *TypeContext::getUnqualifiedTy(CType *ty) {
+  auto *pointerTy = llvm::dyn_cast<CPointerType>(ty);
+  if (!pointerTy || !pointerTy->isRestrict()) {
+    return ty;
+  }
+  return getPointerTy(pointerTy->getPointeeTy());
 }
\ No newline at end of file
@@ -0,0 +1,671 @@
+#include "ValueRange.h"
+
+#include "llvm/Support/Casting.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <initializer_list>
+
+void scanLoopBody(ASTNode *node, ForStmt *loop, bool isConditional,
+                  LoopBodyInfo &info) {
+  if (!node) {
+    return;
+  }
+
+  switch (node->getNodeKind()) {
+  case ASTNode::NodeKind::BlockStmt:
+    for (auto &stmt: llvm::cast<BlockStmt>(node)->stmtVec) {
+      scanLoopBody(stmt.get(), loop, isConditional, info);
+    }
+    break;
+  case ASTNode::NodeKind::DeclStmt:
+    for (auto &expr: llvm::cast<DeclStmt>(node)->exprVec) {
+      scanLoopBody(expr.get(), loop, isConditional, info);
+    }
+    break;
+  case ASTNode::NodeKind::IfStmt: {
+    auto *ifStmt = llvm::cast<IfStmt>(node);
+    scanLoopBody(ifStmt->condExpr.get(), loop, isConditional, info);
+    scanLoopBody(ifStmt->thenBody.get(), loop, true, info);
+    scanLoopBody(ifStmt->elseBody.get(), loop, true, info);
+    break;
+  }
+  case ASTNode::NodeKind::ForStmt: {
+    auto *forStmt = llvm::cast<ForStmt>(node);
+    scanLoopBody(forStmt->initExpr.get(), loop, isConditional, info);
+    scanLoopBody(forStmt->condExpr.get(), loop, isConditional, info);
+    scanLoopBody(forStmt->incExpr.get(), loop, true, info);
+    scanLoopBody(forStmt->forBody.get(), loop, true, info);
+    break;
+  }
+  case ASTNode::NodeKind::BreakStmt:
+    info.hasEarlyExit |= llvm::cast<BreakStmt>(node)->target.get() == loop;
+    break;
+  case ASTNode::NodeKind::ContinueStmt:
+    info.hasEarlyExit |= llvm::cast<ContinueStmt>(node)->target.get() == loop;
+    break;
+  case ASTNode::NodeKind::ReturnStmt:
+    scanLoopBody(llvm::cast<ReturnStmt>(node)->expr.get(), loop,
+                 isConditional, info);
+    info.hasEarlyExit = true;
+    break;
+  case ASTNode::NodeKind::AssignExpr: {
+    auto *assignExpr = llvm::cast<AssignExpr>(node);
+    if (auto *varExpr = llvm::dyn_cast<VariableExpr>(assignExpr->lhs.get())) {
+      info.assignedSymbols.insert(varExpr->symbol.get());
+    }
+    scanLoopBody(assignExpr->lhs.get(), loop, isConditional, info);
+    scanLoopBody(assignExpr->rhs.get(), loop, isConditional, info);
+    break;
+  }
+  case ASTNode::NodeKind::BinaryExpr: {
+    auto *binaryExpr = llvm::cast<BinaryExpr>(node);
+    scanLoopBody(binaryExpr->lhs.get(), loop, isConditional, info);
+    scanLoopBody(binaryExpr->rhs.get(), loop, isConditional, info);
+    break;
+  }
+  case ASTNode::NodeKind::UnaryExpr:
+    scanLoopBody(llvm::cast<UnaryExpr>(node)->operand.get(), loop,
+                 isConditional, info);
+    break;
+  case ASTNode::NodeKind::ConditionalExpr: {
+    auto *condExpr = llvm::cast<ConditionalExpr>(node);
+    scanLoopBody(condExpr->condExpr.get(), loop, isConditional, info);
+    scanLoopBody(condExpr->thenExpr.get(), loop, true, info);
+    scanLoopBody(condExpr->elseExpr.get(), loop, true, info);
+    break;
+  }
+  case ASTNode::NodeKind::SubscriptExpr: {
+    auto *subscriptExpr = llvm::cast<SubscriptExpr>(node);
+    info.subscripts.push_back({subscriptExpr, !isConditional});
+    scanLoopBody(subscriptExpr->base.get(), loop, isConditional, info);
+    scanLoopBody(subscriptExpr->index.get(), loop, isConditional, info);
+    break;
+  }
+  case ASTNode::NodeKind::MemberExpr:
+    scanLoopBody(llvm::cast<MemberExpr>(node)->base.get(), loop,
+                 isConditional, info);
+    break;
+  case ASTNode::NodeKind::ImplicitCastExpr:
+    scanLoopBody(llvm::cast<ImplicitCastExpr>(node)->operand.get(), loop,
+                 isConditional, info);
+    break;
+  case ASTNode::NodeKind::CallExpr:
+    for (auto &arg: llvm::cast<CallExpr>(node)->args) {
+      scanLoopBody(arg.get(), loop, isConditional, info);
+    }
+    break;
+  case ASTNode::NodeKind::BuiltinCallExpr:
+    for (auto &arg: llvm::cast<BuiltinCallExpr>(node)->args) {
+      scanLoopBody(arg.get(), loop, isConditional, info);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+bool getOffsetFrom(ASTNode *expr, Symbol *symbol, int64_t &offset) {
+  if (auto *varExpr = llvm::dyn_cast<VariableExpr>(expr)) {
+    offset = 0;
+    return varExpr->symbol.get() == symbol;
+  }
+
+  auto *binaryExpr = llvm::dyn_cast<BinaryExpr>(expr);
+  if (!binaryExpr ||
+      (binaryExpr->op != OpCode::add && binaryExpr->op != OpCode::sub)) {
+    return false;
+  }
+  auto *varExpr = llvm::dyn_cast<VariableExpr>(binaryExpr->lhs.get());
+  auto *numberExpr = llvm::dyn_cast<NumberExpr>(binaryExpr->rhs.get());
+  if (!varExpr || !numberExpr || varExpr->symbol.get() != symbol) {
+    return false;
+  }
+
+  offset = binaryExpr->op == OpCode::add ? numberExpr->number
+                                         : -int64_t(numberExpr->number);
+  return true;
+}
+
+bool getInductionRange(ForStmt *forStmt, const LoopBodyInfo &info,
+                       InductionRange &range) {
+  auto *condExpr = llvm::dyn_cast_or_null<BinaryExpr>(forStmt->condExpr.get());
+  if (!condExpr ||
+      (condExpr->op != OpCode::less && condExpr->op != OpCode::lesseq)) {
+    return false;
+  }
+  auto *ivExpr = llvm::dyn_cast<VariableExpr>(condExpr->lhs.get());
+  // Pointers could change variables whose address is taken.
+  if (!ivExpr || !ivExpr->ty->isInteger() ||
+      ivExpr->symbol->getKind() != SymbolKind::LocalVariable ||
+      ivExpr->symbol->isAddressTaken()) {
+    return false;
+  }
+  range.iv = ivExpr->symbol.get();
+  range.upper = condExpr->rhs.get();
+  range.isInclusive = condExpr->op == OpCode::lesseq;
+
+  if (auto *upperExpr = llvm::dyn_cast<VariableExpr>(range.upper)) {
+    Symbol *upperSymbol = upperExpr->symbol.get();
+    if (upperSymbol->getKind() != SymbolKind::LocalVariable ||
+        upperSymbol->isAddressTaken() || upperSymbol == range.iv || info.assignedSymbols.count(upperSymbol)) {
+      return false;
+    }
+  }
+  else if (!llvm::isa<NumberExpr>(range.upper)) {
+    return false;
+  }
+
+  // The last literal assigned to i by the init part is the lower bound.
+  std::vector<ASTNode *> inits;
+  if (auto *declStmt = llvm::dyn_cast_or_null<DeclStmt>(forStmt->initExpr.get())) {
+    for (auto &expr: declStmt->exprVec) {
+      inits.push_back(expr.get());
+    }
+  }
+  else if (forStmt->initExpr) {
+    inits.push_back(forStmt->initExpr.get());
+  }
+
+  bool hasLower = false;
+  for (ASTNode *init: inits) {
+    auto *assignExpr = llvm::dyn_cast<AssignExpr>(init);
+    auto *varExpr = assignExpr ?
+        llvm::dyn_cast<VariableExpr>(assignExpr->lhs.get()) : nullptr;
+    if (!varExpr || varExpr->symbol.get() != range.iv) {
+      continue;
+    }
+    auto *numberExpr = llvm::dyn_cast<NumberExpr>(assignExpr->rhs.get());
+    if (!numberExpr) {
+      return false;
+    }
+    range.lower = numberExpr->number;
+    hasLower = true;
+  }
+  if (!hasLower) {
+    return false;
+  }
+
+  // i only grows, by the increment and nothing else.
+  auto *incExpr = llvm::dyn_cast_or_null<AssignExpr>(forStmt->incExpr.get());
+  if (!incExpr || info.assignedSymbols.count(range.iv)) {
+    return false;
+  }
+  auto *incVar = llvm::dyn_cast<VariableExpr>(incExpr->lhs.get());
+  int64_t step = 0;
+  return incVar && incVar->symbol.get() == range.iv &&
+         getOffsetFrom(incExpr->rhs.get(), range.iv, step) && step > 0;
+}
+
+static unsigned getTrailingZeros(int64_t value) {
+  auto bits = static_cast<uint32_t>(value);
+  if (bits == 0) {
+    return 32;
+  }
+  unsigned count = 0;
+  for (; !(bits & 1); bits >>= 1) {
+    ++count;
+  }
+  return count;
+}
+
+/// The range of [lo, hi]. Values beyond `int` would overflow, which the
+/// `nsw` arithmetic codegen emits makes undefined, so they are dropped.
+static ValueRange makeRange(int64_t lo, int64_t hi, unsigned trailingZeros) {
+  return {std::max<int64_t>(lo, INT32_MIN), std::min<int64_t>(hi, INT32_MAX),
+          std::min(trailingZeros, 32u)};
+}
+
+/// The smallest and the largest of `values`.
+static std::pair<int64_t, int64_t> getBounds(
+    std::initializer_list<int64_t> values) {
+  return {std::min(values), std::max(values)};
+}
+
+ValueRange ValueRange::getConstant(int64_t value) {
+  return {value, value, getTrailingZeros(value)};
+}
+
+ValueRange ValueRange::unionWith(const ValueRange &other) const {
+  if (isEmpty()) {
+    return other;
+  }
+  if (other.isEmpty()) {
+    return *this;
+  }
+  return {std::min(lo, other.lo), std::max(hi, other.hi),
+          std::min(trailingZeros, other.trailingZeros)};
+}
+
+ValueRange ValueRange::intersectWith(const ValueRange &other) const {
+  ValueRange range = {std::max(lo, other.lo), std::min(hi, other.hi),
+                      std::max(trailingZeros, other.trailingZeros)};
+  return range.isEmpty() ? getEmpty() : range;
+}
+
+void ValueRangeAnalysis::analyze(Program *prog, bool wholeProgram) {
+  for (auto &stmt: prog->stmtVec) {
+    auto *funcDecl = llvm::dyn_cast<FunctionDecl>(stmt.get());
+    if (funcDecl && funcDecl->body) {
+      definedFunctions.insert(funcDecl->symbol.get());
+    }
+  }
+  isWholeProgram = wholeProgram;
+
+  // Variables only grow, and are widened when they keep growing, so the
+  // rounds end.
+  do {
+    changed = false;
+    for (auto &stmt: prog->stmtVec) {
+      analyzeStmt(stmt.get());
+    }
+    if (changed) {
+      continue;
+    }
+
+    // Nothing is known about a variable that is read but never assigned.
+    std::vector<Symbol *> unassigned;
+    for (auto &[symbol, range]: varRanges) {
+      if (range.isEmpty()) {
+        unassigned.push_back(symbol);
+      }
+    }
+    for (Symbol *symbol: unassigned) {
+      untrack(symbol);
+    }
+  } while (changed);
+}
+
+ValueRange ValueRangeAnalysis::getRange(ASTNode *expr) const {
+  auto it = exprRanges.find(expr);
+  if (it == exprRanges.end() || it->second.isEmpty()) {
+    return ValueRange::getFull();
+  }
+  return it->second;
+}
+
+void ValueRangeAnalysis::untrack(Symbol *symbol) {
+  if (untracked.insert(symbol).second) {
+    varRanges.erase(symbol);
+    changed = true;
+  }
+}
+
+void ValueRangeAnalysis::declareVariable(VariableDecl *variableDecl) {
+  Symbol *symbol = variableDecl->symbol.get();
+  bool isGlobal = symbol->getKind() == SymbolKind::GlobalVariable;
+  if (!variableDecl->ty->isInteger() || symbol->isAddressTaken() ||
+      (isGlobal && !isWholeProgram) || untracked.count(symbol) ||
+      varRanges.count(symbol)) {
+    return;
+  }
+
+  // Variables with static storage start out as 0.
+  varRanges[symbol] = isGlobal || variableDecl->isStatic ?
+      ValueRange::getConstant(0) : ValueRange::getEmpty();
+}
+
+void ValueRangeAnalysis::assignVariable(Symbol *symbol,
+                                        const ValueRange &range) {
+  auto it = varRanges.find(symbol);
+  if (it == varRanges.end()) {
+    return;
+  }
+
+  ValueRange &current = it->second;
+  ValueRange grown = current.unionWith(range);
+  if (grown == current) {
+    return;
+  }
+  // A variable that keeps growing, like a sum, grows to the limits of `int`
+  // rather than by one iteration per round.
+  if (++growCounts[symbol] > 2) {
+    if (grown.lo < current.lo) {
+      grown.lo = INT32_MIN;
+    }
+    if (grown.hi > current.hi) {
+      grown.hi = INT32_MAX;
+    }
+    if (grown.trailingZeros < current.trailingZeros) {
+      grown.trailingZeros = 0;
+    }
+  }
+  current = grown;
+  changed = true;
+}
+
+ValueRange ValueRangeAnalysis::getVariableRange(Symbol *symbol) const {
+  // The loop bounds hold the induction variable, whatever else it is
+  // assigned. They don't depend on the values found by earlier rounds.
+  auto ivIt = inductionRanges.find(symbol);
+  if (ivIt != inductionRanges.end()) {
+    return ivIt->second;
+  }
+  auto it = varRanges.find(symbol);
+  return it == varRanges.end() ? ValueRange::getFull() : it->second;
+}
+
+/// In the body and the increment of a canonical loop, `lower <= i < upper`.
+/// Return the induction variable, or null if the loop isn't canonical.
+Symbol *ValueRangeAnalysis::getInductionValues(ForStmt *forStmt,
+                                               ValueRange &values) {
+  auto [it, isNew] = loopInductions.insert({forStmt, std::nullopt});
+  if (isNew) {
+    LoopBodyInfo info;
+    scanLoopBody(forStmt->forBody.get(), forStmt, false, info);
+    InductionRange range;
+    if (getInductionRange(forStmt, info, range)) {
+      it->second = range;
+    }
+  }
+  if (!it->second) {
+    return nullptr;
+  }
+
+  const InductionRange &range = *it->second;
+  int64_t upper = 0;
+  if (auto *numberExpr = llvm::dyn_cast<NumberExpr>(range.upper)) {
+    upper = numberExpr->number;
+  }
+  else {
+    upper = getVariableRange(
+        llvm::cast<VariableExpr>(range.upper)->symbol.get()).hi;
+  }
+  values = makeRange(range.lower, upper - !range.isInclusive, 0);
+  if (values.isEmpty()) {
+    values = ValueRange::getEmpty();
+  }
+  return range.iv;
+}
+
+void ValueRangeAnalysis::analyzeStmt(ASTNode *node) {
+  if (!node) {
+    return;
+  }
+
+  switch (node->getNodeKind()) {
+  case ASTNode::NodeKind::BlockStmt:
+    for (auto &stmt: llvm::cast<BlockStmt>(node)->stmtVec) {
+      analyzeStmt(stmt.get());
+    }
+    break;
+  case ASTNode::NodeKind::DeclStmt:
+    for (auto &expr: llvm::cast<DeclStmt>(node)->exprVec) {
+      analyzeStmt(expr.get());
+    }
+    break;
+  case ASTNode::NodeKind::VariableDecl:
+    declareVariable(llvm::cast<VariableDecl>(node));
+    break;
+  case ASTNode::NodeKind::IfStmt: {
+    auto *ifStmt = llvm::cast<IfStmt>(node);
+    analyzeExpr(ifStmt->condExpr.get());
+    analyzeStmt(ifStmt->thenBody.get());
+    analyzeStmt(ifStmt->elseBody.get());
+    break;
+  }
+  case ASTNode::NodeKind::ForStmt: {
+    auto *forStmt = llvm::cast<ForStmt>(node);
+    analyzeStmt(forStmt->initExpr.get());
+    // Each thread sums into its own copy of a reduction variable.
+    if (forStmt->omp) {
+      for (auto &symbol: forStmt->omp->reductions) {
+        untrack(symbol.get());
+      }
+    }
+    if (forStmt->condExpr) {
+      analyzeExpr(forStmt->condExpr.get());
+    }
+
+    ValueRange ivValues;
+    Symbol *iv = getInductionValues(forStmt, ivValues);
+    if (iv) {
+      inductionRanges[iv] = ivValues;
+    }
+    analyzeStmt(forStmt->forBody.get());
+    if (forStmt->incExpr) {
+      analyzeExpr(forStmt->incExpr.get());
+    }
+    if (iv) {
+      inductionRanges.erase(iv);
+    }
+    break;
+  }
+  case ASTNode::NodeKind::ReturnStmt:
+    if (auto &expr = llvm::cast<ReturnStmt>(node)->expr) {
+      analyzeExpr(expr.get());
+    }
+    break;
+  case ASTNode::NodeKind::FunctionDecl:
+    // Parameters are never tracked, callers may pass anything.
+    analyzeStmt(llvm::cast<FunctionDecl>(node)->body.get());
+    break;
+  case ASTNode::NodeKind::BreakStmt:
+  case ASTNode::NodeKind::ContinueStmt:
+    break;
+  default:
+    analyzeExpr(node);
+    break;
+  }
+}
+
+ValueRange ValueRangeAnalysis::analyzeExpr(ASTNode *node) {
+  if (!node) {
+    return ValueRange::getFull();
+  }
+
+  ValueRange range = ValueRange::getFull();
+  switch (node->getNodeKind()) {
+  case ASTNode::NodeKind::NumberExpr:
+    range = ValueRange::getConstant(llvm::cast<NumberExpr>(node)->number);
+    break;
+  case ASTNode::NodeKind::VariableExpr:
+    if (node->ty->isInteger()) {
+      range = getVariableRange(llvm::cast<VariableExpr>(node)->symbol.get());
+    }
+    break;
+  case ASTNode::NodeKind::AssignExpr: {
+    auto *assignExpr = llvm::cast<AssignExpr>(node);
+    range = analyzeExpr(assignExpr->rhs.get());
+    if (auto *varExpr = llvm::dyn_cast<VariableExpr>(assignExpr->lhs.get())) {
+      if (varExpr->ty->isInteger()) {
+        assignVariable(varExpr->symbol.get(), range);
+      }
+    }
+    else {
+      analyzeExpr(assignExpr->lhs.get());
+    }
+    if (!node->ty->isInteger()) {
+      range = ValueRange::getFull();
+    }
+    break;
+  }
+  case ASTNode::NodeKind::BinaryExpr:
+    range = analyzeBinaryExpr(llvm::cast<BinaryExpr>(node));
+    break;
+  case ASTNode::NodeKind::UnaryExpr: {
+    auto *unaryExpr = llvm::cast<UnaryExpr>(node);
+    ValueRange operand = analyzeExpr(unaryExpr->operand.get());
+    if (unaryExpr->op == OpCode::bitwisenot && node->ty->isInteger() &&
+        !operand.isEmpty()) {
+      range = {-operand.hi - 1, -operand.lo - 1, 0};
+    }
+    break;
+  }
+  case ASTNode::NodeKind::ConditionalExpr: {
+    auto *condExpr = llvm::cast<ConditionalExpr>(node);
+    analyzeExpr(condExpr->condExpr.get());
+    ValueRange thenRange = analyzeExpr(condExpr->thenExpr.get());
+    ValueRange elseRange = analyzeExpr(condExpr->elseExpr.get());
+    if (node->ty->isInteger()) {
+      range = thenRange.unionWith(elseRange);
+    }
+    break;
+  }
+  case ASTNode::NodeKind::SubscriptExpr: {
+    auto *subscriptExpr = llvm::cast<SubscriptExpr>(node);
+    analyzeExpr(subscriptExpr->base.get());
+    analyzeExpr(subscriptExpr->index.get());
+    break;
+  }
+  case ASTNode::NodeKind::MemberExpr:
+    analyzeExpr(llvm::cast<MemberExpr>(node)->base.get());
+    break;
+  case ASTNode::NodeKind::ImplicitCastExpr:
+    analyzeExpr(llvm::cast<ImplicitCastExpr>(node)->operand.get());
+    break;
+  case ASTNode::NodeKind::CallExpr: {
+    auto *callExpr = llvm::cast<CallExpr>(node);
+    // A function of another translation unit may change any global.
+    if (isWholeProgram &&
+        !definedFunctions.count(callExpr->calleeDecl->symbol.get())) {
+      isWholeProgram = false;
+      std::vector<Symbol *> globals;
+      for (auto &[symbol, range]: varRanges) {
+        if (symbol->getKind() == SymbolKind::GlobalVariable) {
+          globals.push_back(symbol);
+        }
+      }
+      for (Symbol *symbol: globals) {
+        untrack(symbol);
+      }
+    }
+    for (auto &arg: callExpr->args) {
+      analyzeExpr(arg.get());
+    }
+    break;
+  }
+  case ASTNode::NodeKind::BuiltinCallExpr:
+    for (auto &arg: llvm::cast<BuiltinCallExpr>(node)->args) {
+      analyzeExpr(arg.get());
+    }
+    break;
+  default:
+    break;
+  }
+
+  exprRanges[node] = range;
+  return range;
+}
+
+ValueRange ValueRangeAnalysis::analyzeBinaryExpr(BinaryExpr *binaryExpr) {
+  ValueRange lhs = analyzeExpr(binaryExpr->lhs.get());
+  ValueRange rhs = analyzeExpr(binaryExpr->rhs.get());
+  if (!binaryExpr->ty->isInteger()) {
+    return ValueRange::getFull();
+  }
+
+  switch (binaryExpr->op) {
+  case OpCode::equalequal:
+  case OpCode::notequal:
+  case OpCode::less:
+  case OpCode::lesseq:
+  case OpCode::greater:
+  case OpCode::greatereq:
+    return {0, 1, 0};
+  default:
+    break;
+  }
+
+  if (!binaryExpr->lhs->ty->isInteger() || !binaryExpr->rhs->ty->isInteger()) {
+    return ValueRange::getFull();
+  }
+  if (lhs.isEmpty() || rhs.isEmpty()) {
+    return ValueRange::getEmpty();
+  }
+
+  unsigned minZeros = std::min(lhs.trailingZeros, rhs.trailingZeros);
+  switch (binaryExpr->op) {
+  case OpCode::add:
+    return makeRange(lhs.lo + rhs.lo, lhs.hi + rhs.hi, minZeros);
+  case OpCode::sub:
+    return makeRange(lhs.lo - rhs.hi, lhs.hi - rhs.lo, minZeros);
+  case OpCode::mul: {
+    auto [lo, hi] = getBounds({lhs.lo * rhs.lo, lhs.lo * rhs.hi,
+                               lhs.hi * rhs.lo, lhs.hi * rhs.hi});
+    return makeRange(lo, hi, lhs.trailingZeros + rhs.trailingZeros);
+  }
+  case OpCode::div: {
+    // Division by zero is undefined, a divisor of either sign is too hard.
+    if (rhs.lo <= 0 && rhs.hi >= 0) {
+      return ValueRange::getFull();
+    }
+    auto [lo, hi] = getBounds({lhs.lo / rhs.lo, lhs.lo / rhs.hi,
+                               lhs.hi / rhs.lo, lhs.hi / rhs.hi});
+    unsigned zeros = 0;
+    if (rhs.lo == rhs.hi && rhs.lo > 0 && rhs.trailingZeros < 32 &&
+        rhs.lo == int64_t(1) << rhs.trailingZeros &&
+        lhs.trailingZeros >= rhs.trailingZeros) {
+      zeros = lhs.trailingZeros - rhs.trailingZeros;
+    }
+    return makeRange(lo, hi, zeros);
+  }
+  case OpCode::mod: {
+    if (rhs.lo <= 0 && rhs.hi >= 0) {
+      return ValueRange::getFull();
+    }
+    // The remainder has the sign of the dividend and is smaller than the
+    // divisor. It is `lhs - q * rhs`, a multiple of what both are.
+    int64_t maxRem = std::max(std::abs(rhs.lo), std::abs(rhs.hi)) - 1;
+    int64_t lo = lhs.isNonNegative() ? 0 : std::max(lhs.lo, -maxRem);
+    int64_t hi = lhs.hi <= 0 ? 0 : std::min(lhs.hi, maxRem);
+    return makeRange(lo, hi, minZeros);
+  }
+  case OpCode::bitwiseand: {
+    // A non-negative operand bounds the result.
+    unsigned zeros = std::max(lhs.trailingZeros, rhs.trailingZeros);
+    if (lhs.isNonNegative() || rhs.isNonNegative()) {
+      int64_t hi = INT32_MAX;
+      if (lhs.isNonNegative()) {
+        hi = lhs.hi;
+      }
+      if (rhs.isNonNegative()) {
+        hi = std::min(hi, rhs.hi);
+      }
+      return makeRange(0, hi, zeros);
+    }
+    return makeRange(INT32_MIN, INT32_MAX, zeros);
+  }
+  case OpCode::bitwiseor:
+  case OpCode::bitwisexor: {
+    if (!lhs.isNonNegative() || !rhs.isNonNegative()) {
+      return makeRange(INT32_MIN, INT32_MAX, minZeros);
+    }
+    // The result has no bit above the highest bit of the operands.
+    int64_t mask = 1;
+    while (mask <= std::max(lhs.hi, rhs.hi)) {
+      mask <<= 1;
+    }
+    int64_t lo = binaryExpr->op == OpCode::bitwiseor ?
+        std::max(lhs.lo, rhs.lo) : 0;
+    return makeRange(lo, mask - 1, minZeros);
+  }
+  case OpCode::shl: {
+    // `shl` may wrap, the result is only known if it never does.
+    if (rhs.lo < 0 || rhs.hi > 31) {
+      return ValueRange::getFull();
+    }
+    int64_t minScale = int64_t(1) << rhs.lo;
+    int64_t maxScale = int64_t(1) << rhs.hi;
+    auto [lo, hi] = getBounds({lhs.lo * minScale, lhs.lo * maxScale,
+                               lhs.hi * minScale, lhs.hi * maxScale});
+    if (lo < INT32_MIN || hi > INT32_MAX) {
+      return ValueRange::getFull();
+    }
+    return makeRange(lo, hi, lhs.trailingZeros + rhs.lo);
+  }
+  case OpCode::shr: {
+    if (rhs.lo < 0 || rhs.hi > 31) {
+      return ValueRange::getFull();
+    }
+    auto [lo, hi] = getBounds({lhs.lo >> rhs.lo, lhs.lo >> rhs.hi,
+                               lhs.hi >> rhs.lo, lhs.hi >> rhs.hi});
+    unsigned zeros = lhs.trailingZeros >= rhs.hi ?
+        lhs.trailingZeros - rhs.hi : 0;
+    return makeRange(lo, hi, zeros);
+  }
+  default:
+    return ValueRange::getFull();
+  }
+}
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "AST.h"
+#include "ASTFile.h"
 #include "Lexer.h"
 #include "Parser.h"
 #include "PrintVisitor.h"
@@ -6,47 +7,100 @@
 #include "Sema.h"
 #include "DiagEngine.h"
 #include "Basic.h"
+#include "Interpreter.h"
+#include "ObjectCache.h"
+#include "ThinLTO.h"
+#include "ThroughputReport.h"
 
 #include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Analysis/ModuleSummaryAnalysis.h"
+#include "llvm/Analysis/ProfileSummaryInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/CodeGen/CommandFlags.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/TargetExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/GlobalIFunc.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMRemarkStreamer.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IRPrintingPasses.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/LegacyPassManagers.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/LineEditor/LineEditor.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/CachePruning.h"
 #include "llvm/Support/CodeGen.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/Error.h"
 #include "llvm/Support/SMLoc.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Regex.h"
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/VirtualFileSystem.h"
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/WithColor.h"
+#include "llvm/Support/xxhash.h"
 #include "llvm/Support/InitLLVM.h"
 #include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/PGOOptions.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/TargetParser/Triple.h"
 #include "llvm/TargetParser/Host.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Transforms/Utils/NameAnonGlobals.h"
+#if LLVM_VERSION_MAJOR >= 18
+#include "llvm/ExecutionEngine/Orc/Debugging/PerfSupportPlugin.h"
+#include "llvm/ExecutionEngine/Orc/TargetProcess/JITLoaderPerf.h"
+#endif
 
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdlib>
+#include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
 #include <string>
 #include <system_error>
+#include <thread>
 
 static llvm::codegen::RegisterCodeGenFlags CGF;
 
-static llvm::cl::opt<std::string>
-    InputFile(llvm::cl::Positional, 
-              llvm::cl::desc("<input-files>"),
-              llvm::cl::init("-"));
+static llvm::cl::list<std::string>
+    InputFiles(llvm::cl::Positional, 
+               llvm::cl::desc("<input-files>"));
+
+// The input compiled, "-" for the standard input.
+static std::string InputFile;
 
 static llvm::cl::opt<std::string>
     OutputFile("o",
@@ -62,6 +116,163 @@ static llvm::cl::opt<bool> EmitLLVM(
     llvm::cl::desc("Emit IR code instread of assembler"),
     llvm::cl::init(false));
 
+static llvm::cl::opt<bool> CompileOnly(
+    "c",
+    llvm::cl::desc("Emit an object file, or bitcode with -emit-llvm"),
+    llvm::cl::init(false));
+
+enum class LTOKind { None, Thin };
+
+static llvm::cl::opt<LTOKind> LTOMode(
+    "flto",
+    llvm::cl::desc("Emit bitcode for link time optimization by -flto-link"),
+    llvm::cl::values(clEnumValN(LTOKind::Thin, "thin",
+                                "Bitcode with a summary of each function, "
+                                "to import across files")),
+    llvm::cl::init(LTOKind::None));
+
+static llvm::cl::opt<bool> LTOLink(
+    "flto-link",
+    llvm::cl::desc("Link the bitcode of -flto=thin with ThinLTO, importing "
+                   "functions across the inputs, and write their objects"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> LTOJobs(
+    "flto-jobs", llvm::cl::init(0),
+    llvm::cl::desc("Threads of -flto-link, 0 for one per core"));
+
+static llvm::cl::opt<std::string> RuntimeBC(
+    "runtime-bc",
+    llvm::cl::desc("Bitcode of the runtime to link into the module, "
+                   "empty to link against libtinycc_rt instead"),
+    llvm::cl::value_desc("filename"),
+    llvm::cl::init(TINYCC_RUNTIME_BC));
+
+static llvm::cl::opt<char> OptLevel(
+    "O",
+    llvm::cl::desc("Optimization level. [-O0, -O1, -O2, or -O3] "
+                   "(default = '-O0')"),
+    llvm::cl::Prefix,
+    llvm::cl::init('0'));
+
+static llvm::cl::opt<bool> ProfileGenerate(
+    "fprofile-generate",
+    llvm::cl::desc("Instrument the program to write a .profraw file, "
+                   "named by LLVM_PROFILE_FILE, when it exits"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<std::string> ProfileUse(
+    "fprofile-use",
+    llvm::cl::desc("Optimize with the profile merged by llvm-profdata"),
+    llvm::cl::value_desc("filename"));
+
+static llvm::cl::opt<std::string> RemarksPassed(
+    "Rpass",
+    llvm::cl::desc("Report the optimizations done by the passes whose name "
+                   "matches the regex"),
+    llvm::cl::value_desc("regex"));
+
+static llvm::cl::opt<std::string> RemarksMissed(
+    "Rpass-missed",
+    llvm::cl::desc("Report the optimizations missed by the passes whose "
+                   "name matches the regex"),
+    llvm::cl::value_desc("regex"));
+
+static llvm::cl::opt<std::string> RemarksAnalysis(
+    "Rpass-analysis",
+    llvm::cl::desc("Report the analysis of the passes whose name matches "
+                   "the regex, such as why a loop is not vectorized"),
+    llvm::cl::value_desc("regex"));
+
+static llvm::cl::opt<bool> SaveOptimizationRecord(
+    "fsave-optimization-record",
+    llvm::cl::desc("Write every optimization remark to <output>.opt.yaml"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> ReportThroughput(
+    "report-throughput",
+    llvm::cl::desc("Print the cycles per iteration, resource pressure and "
+                   "bottleneck of each innermost loop, simulated by llvm-mca "
+                   "for -mcpu"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> DebugInfo(
+    "g",
+    llvm::cl::desc("Emit debug info for the source lines, types and "
+                   "variables"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> LineTablesOnly(
+    "gline-tables-only",
+    llvm::cl::desc("Emit only the debug line tables, enough for profilers "
+                   "to attribute samples to source lines"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Run(
+    "run",
+    llvm::cl::desc("Run the program in-process with the ORC JIT and exit "
+                   "with its exit code, instead of writing the output"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Repl(
+    "repl",
+    llvm::cl::desc("Read statements from the terminal and run each line "
+                   "with the ORC JIT, keeping the declarations"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> PerfSupport(
+    "perf-support",
+    llvm::cl::desc("Let perf symbolize the code compiled by -run, through a "
+                   "jitdump file for `perf inject --jit`"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Interp(
+    "interp",
+    llvm::cl::desc("Run the program with the bytecode interpreter, without "
+                   "generating LLVM IR, and exit with its exit code"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<bool> Tiered(
+    "tiered",
+    llvm::cl::desc("Start the program in the bytecode interpreter and "
+                   "compile its hot loops with the ORC JIT at the `-O` "
+                   "level, entering them at the loop header"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> TierUpThreshold(
+    "tier-up-threshold", llvm::cl::init(100000),
+    llvm::cl::desc("Trips of a loop under -tiered before it is compiled"));
+
+static llvm::cl::opt<std::string> CacheDir(
+    "cache-dir",
+    llvm::cl::desc("Serve the output from the cache in this directory when "
+                   "the same source was compiled with the same flags, and "
+                   "store it there otherwise"),
+    llvm::cl::value_desc("directory"));
+
+static llvm::cl::opt<std::string> CachePolicy(
+    "cache-policy",
+    llvm::cl::desc("When to remove the least recently used outputs from "
+                   "-cache-dir, such as cache_size_bytes=1g:prune_after=7d"),
+    llvm::cl::init("cache_size_bytes=1g"));
+
+static llvm::cl::opt<bool> ASTCache(
+    "ast-cache",
+    llvm::cl::desc("Save the checked AST of the input to <input>.ast, or to "
+                   "-cache-dir, and load it instead of parsing while the "
+                   "source doesn't change"),
+    llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned> Jobs(
+    "j", llvm::cl::init(1),
+    llvm::cl::desc("Compile several inputs on this many threads in one "
+                   "process, 0 for one per core"));
+
+static llvm::cl::opt<bool> CacheStats(
+    "cache-stats",
+    llvm::cl::desc("Print the hits, misses and size of -cache-dir and exit"),
+    llvm::cl::init(false));
+
 static const char* Head = "tinycc - A simple C compiler";
 
 void printVersion(llvm::raw_ostream &OS) {
@@ -72,6 +283,7 @@ void printVersion(llvm::raw_ostream &OS) {
   std::string CPU(llvm::sys::getHostCPUName());
   OS << "  Host CPU: " << CPU << "\n\n";
   OS.flush();
+  llvm::InitializeAllTargetInfos();
   llvm::TargetRegistry::printRegisteredTargetsForVersion(OS);
   exit(EXIT_SUCCESS);
 }
@@ -100,93 +312,1370 @@ createTargetMachine(const char *Argv0) {
     return nullptr;
   }
 
+  auto OL = llvm::CodeGenOpt::getLevel(OptLevel - '0');
+  if (!OL) {
+    llvm::WithColor::error(llvm::errs(), Argv0)
+        << "Invalid optimization level -O" << OptLevel << "\n";
+    return nullptr;
+  }
   llvm::TargetMachine *TM = Target->createTargetMachine(
       Triple.getTriple(), CPUStr, FeatureStr, TargetOptions,
       std::optional<llvm::Reloc::Model>(
-          codegen::getRelocModel()));
+          codegen::getRelocModel()),
+      codegen::getExplicitCodeModel(), *OL);
   return TM;
 }
 
-bool emit(llvm::StringRef Argv0, llvm::Module *M,
-          llvm::TargetMachine *TM,
-          llvm::StringRef InputFileName) {
-  llvm::CodeGenFileType FT = llvm::codegen::getFileType();
-  
-  if (OutputFile.empty()) {
-    if (InputFileName == "-") {
-      OutputFile = "-";
+/// Prints the optimization remarks selected by -Rpass, -Rpass-missed and
+/// -Rpass-analysis at their location in the tinycc source.
+struct RemarkHandler : llvm::DiagnosticHandler {
+  RemarkHandler(llvm::SourceMgr &Mgr, llvm::raw_ostream &OS = llvm::errs())
+      : Mgr(Mgr), OS(OS) {
+    for (auto [Opt, Filter]: {std::make_pair(&RemarksPassed, &Passed),
+                              std::make_pair(&RemarksMissed, &Missed),
+                              std::make_pair(&RemarksAnalysis, &Analysis)}) {
+      if (!Opt->empty()) {
+        *Filter = std::make_unique<llvm::Regex>(*Opt);
+      }
+    }
+  }
+
+  bool isAnalysisRemarkEnabled(llvm::StringRef PassName) const override {
+    return Analysis && Analysis->match(PassName);
+  }
+  bool isMissedOptRemarkEnabled(llvm::StringRef PassName) const override {
+    return Missed && Missed->match(PassName);
+  }
+  bool isPassedOptRemarkEnabled(llvm::StringRef PassName) const override {
+    return Passed && Passed->match(PassName);
+  }
+  bool isAnyRemarkEnabled() const override {
+    return Passed || Missed || Analysis;
+  }
+
+  bool handleDiagnostics(const llvm::DiagnosticInfo &DI) override {
+    auto *Remark = llvm::dyn_cast<llvm::DiagnosticInfoOptimizationBase>(&DI);
+    if (!Remark) {
+      return false;
+    }
+    if (!Remark->isEnabled()) {
+      return true;
+    }
+
+    std::string Msg = (Remark->getMsg() + " [" + getFlag(DI.getKind()) + "=" +
+                       Remark->getPassName() + "]").str();
+    llvm::SMLoc Loc;
+    if (Remark->isLocationAvailable()) {
+      llvm::DiagnosticLocation DL = Remark->getLocation();
+      Loc = Mgr.FindLocForLineAndColumn(Mgr.getMainFileID(), DL.getLine(),
+                                        DL.getColumn());
+    }
+    if (Loc.isValid()) {
+      Mgr.PrintMessage(OS, Loc, llvm::SourceMgr::DK_Remark, Msg);
     }
     else {
-      if (InputFileName.ends_with(".c")) {
-        OutputFile = InputFileName.drop_back(2).str();
-      } 
-      else if (InputFileName.ends_with(".txt")) {
-        OutputFile = InputFileName.drop_back(4).str();
-      }
-      else {
-        OutputFile = InputFileName.str();
-      }  
-
-      switch (FT) {
-      case llvm::CGFT_AssemblyFile:
-        OutputFile.append(EmitLLVM ? ".ll" : ".s");
-        break;
-      case llvm::CGFT_ObjectFile:
-        OutputFile.append(".o");
-        break;
-      case llvm::CGFT_Null:
-        OutputFile.append("null");
+      llvm::WithColor::remark(OS) << Msg << "\n";
+    }
+    return true;
+  }
+
+private:
+  static llvm::StringRef getFlag(int Kind) {
+    switch (Kind) {
+    case llvm::DK_OptimizationRemark:
+    case llvm::DK_MachineOptimizationRemark:
+      return "-Rpass";
+    case llvm::DK_OptimizationRemarkMissed:
+    case llvm::DK_MachineOptimizationRemarkMissed:
+      return "-Rpass-missed";
+    default:
+      return "-Rpass-analysis";
+    }
+  }
+
+  llvm::SourceMgr &Mgr;
+  llvm::raw_ostream &OS;
+  std::unique_ptr<llvm::Regex> Passed, Missed, Analysis;
+};
+
+/// Check the regexes of the remark filters.
+bool checkRemarkFilters(llvm::StringRef Argv0) {
+  for (auto *Opt: {&RemarksPassed, &RemarksMissed, &RemarksAnalysis}) {
+    std::string Error;
+    if (!Opt->empty() && !llvm::Regex(*Opt).isValid(Error)) {
+      llvm::WithColor::error(llvm::errs(), Argv0)
+          << "Invalid regex for -" << Opt->ArgStr << ": " << Error << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Read the bitcode of the tinycc runtime, see runtime/Runtime.c.
+std::unique_ptr<llvm::Module> loadRuntime(llvm::StringRef Argv0,
+                                          llvm::LLVMContext &Ctx,
+                                          llvm::raw_ostream &ErrOS =
+                                              llvm::errs()) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> RuntimeBuf =
+      llvm::MemoryBuffer::getFile(RuntimeBC);
+  if (!RuntimeBuf) {
+    llvm::WithColor::error(ErrOS, Argv0)
+        << "Failed to open the runtime " << RuntimeBC << ": "
+        << RuntimeBuf.getError().message() << "\n";
+    return nullptr;
+  }
+
+  llvm::Expected<std::unique_ptr<llvm::Module>> Runtime =
+      llvm::parseBitcodeFile(**RuntimeBuf, Ctx);
+  if (!Runtime) {
+    llvm::WithColor::error(ErrOS, Argv0)
+        << "Failed to read the runtime " << RuntimeBC << ": "
+        << llvm::toString(Runtime.takeError()) << "\n";
+    return nullptr;
+  }
+  return std::move(*Runtime);
+}
+
+/// Link the definitions of the runtime functions the module calls. They
+/// become internal, so they can be inlined and the rest is dropped.
+bool linkRuntime(llvm::StringRef Argv0, llvm::Module *M,
+                 llvm::raw_ostream &ErrOS = llvm::errs()) {
+  if (RuntimeBC.empty()) {
+    return true;
+  }
+
+  std::unique_ptr<llvm::Module> Runtime = loadRuntime(Argv0, M->getContext(), ErrOS);
+  if (!Runtime) {
+    return false;
+  }
+
+  return !llvm::Linker::linkModules(
+      *M, std::move(Runtime), llvm::Linker::LinkOnlyNeeded,
+      [](llvm::Module &M, const llvm::StringSet<> &Linked) {
+        llvm::internalizeModule(M, [&Linked](const llvm::GlobalValue &GV) {
+          return !GV.hasName() || !Linked.count(GV.getName());
+        });
+      });
+}
+
+std::optional<llvm::PGOOptions> getPGOOptions() {
+  if (!ProfileGenerate && ProfileUse.empty()) {
+    return std::nullopt;
+  }
+
+  // Empty for -fprofile-generate, whose runtime names the .profraw file
+  // when the program exits.
+  std::string ProfileFile = ProfileUse;
+  llvm::PGOOptions::PGOAction Action = ProfileGenerate
+                                           ? llvm::PGOOptions::IRInstr
+                                           : llvm::PGOOptions::IRUse;
+#if LLVM_VERSION_MAJOR >= 19
+  return llvm::PGOOptions(ProfileFile, "", "", "",
+                          llvm::vfs::getRealFileSystem(), Action,
+                          llvm::PGOOptions::NoCSAction,
+                          llvm::PGOOptions::ColdFuncOpt::Default);
+#elif LLVM_VERSION_MAJOR >= 18
+  return llvm::PGOOptions(ProfileFile, "", "", "",
+                          llvm::vfs::getRealFileSystem(), Action);
+#else
+  return llvm::PGOOptions(ProfileFile, "", "",
+                          llvm::vfs::getRealFileSystem(), Action);
+#endif
+}
+
+/// Run the optimization pipeline of `-O`, which also instruments the
+/// module for `-fprofile-generate` or annotates it with the branch weights
+/// and function counts of `-fprofile-use`.
+bool optimize(llvm::StringRef Argv0, llvm::Module *M,
+              llvm::TargetMachine *TM,
+              llvm::raw_ostream &ErrOS = llvm::errs()) {
+  if (OptLevel < '0' || OptLevel > '3') {
+    llvm::WithColor::error(ErrOS, Argv0)
+        << "Invalid optimization level -O" << OptLevel << "\n";
+    return false;
+  }
+  if (ProfileGenerate && !ProfileUse.empty()) {
+    llvm::WithColor::error(ErrOS, Argv0)
+        << "-fprofile-generate and -fprofile-use are mutually exclusive\n";
+    return false;
+  }
+  if (!ProfileUse.empty() && !llvm::sys::fs::exists(ProfileUse)) {
+    llvm::WithColor::error(ErrOS, Argv0)
+        << "Failed to open the profile " << ProfileUse << "\n";
+    return false;
+  }
+
+  static const llvm::OptimizationLevel Levels[] = {
+      llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1,
+      llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3};
+  llvm::OptimizationLevel Level = Levels[OptLevel - '0'];
+
+  llvm::LoopAnalysisManager LAM;
+  llvm::FunctionAnalysisManager FAM;
+  llvm::CGSCCAnalysisManager CGAM;
+  llvm::ModuleAnalysisManager MAM;
+
+  llvm::PassBuilder PB(TM, llvm::PipelineTuningOptions(), getPGOOptions());
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  // -flto=thin leaves the passes that work better on the whole program to
+  // -flto-link.
+  llvm::ModulePassManager MPM;
+  if (Level == llvm::OptimizationLevel::O0) {
+    MPM = PB.buildO0DefaultPipeline(Level);
+    // The summary refers to globals by name, and so do the other pipelines.
+    if (LTOMode == LTOKind::Thin) {
+      MPM.addPass(llvm::NameAnonGlobalPass());
+    }
+  }
+  else if (LTOMode == LTOKind::Thin) {
+    MPM = PB.buildThinLTOPreLinkDefaultPipeline(Level);
+  }
+  else {
+    MPM = PB.buildPerModuleDefaultPipeline(Level);
+  }
+  MPM.run(*M, MAM);
+  return true;
+}
+
+#if LLVM_VERSION_MAJOR >= 18
+// The jitdump entry points that PerfSupportPlugin looks up in the tinycc
+// executable. Taking their addresses keeps the linker from dropping them.
+LLVM_ATTRIBUTE_USED static void *const PerfSupportEntryPoints[] = {
+    reinterpret_cast<void *>(&llvm_orc_registerJITLoaderPerfStart),
+    reinterpret_cast<void *>(&llvm_orc_registerJITLoaderPerfEnd),
+    reinterpret_cast<void *>(&llvm_orc_registerJITLoaderPerfImpl),
+};
+#endif
+
+/// Make the code compiled by the JIT visible to perf. JITLink writes a
+/// jitdump file with PerfSupportPlugin, and RuntimeDyld notifies the perf
+/// JIT listener when LLVM is built with it.
+bool enablePerfSupport(llvm::StringRef Argv0, llvm::orc::LLJIT &J) {
+  llvm::orc::ObjectLayer &ObjLayer = J.getObjLinkingLayer();
+#if LLVM_VERSION_MAJOR >= 18
+  if (auto *ObjLinkingLayer =
+          llvm::dyn_cast<llvm::orc::ObjectLinkingLayer>(&ObjLayer)) {
+    auto Plugin = llvm::orc::PerfSupportPlugin::Create(
+        J.getExecutionSession().getExecutorProcessControl(),
+        *J.getProcessSymbolsJITDylib(), /*EmitDebugInfo=*/true,
+        /*EmitUnwindInfo=*/true);
+    if (!Plugin) {
+      llvm::WithColor::error(llvm::errs(), Argv0)
+          << llvm::toString(Plugin.takeError()) << "\n";
+      return false;
+    }
+    ObjLinkingLayer->addPlugin(std::move(*Plugin));
+    return true;
+  }
+#endif
+
+  auto *RTDyldLayer =
+      llvm::dyn_cast<llvm::orc::RTDyldObjectLinkingLayer>(&ObjLayer);
+  llvm::JITEventListener *Listener =
+      llvm::JITEventListener::createPerfJITEventListener();
+  if (!RTDyldLayer || !Listener) {
+    llvm::WithColor::error(llvm::errs(), Argv0)
+        << "-perf-support is not available with this build of LLVM\n";
+    return false;
+  }
+  RTDyldLayer->registerJITEventListener(*Listener);
+  return true;
+}
+
+bool checkError(llvm::StringRef Argv0, llvm::Error Err) {
+  if (!Err) {
+    return true;
+  }
+  llvm::WithColor::error(llvm::errs(), Argv0)
+      << llvm::toString(std::move(Err)) << "\n";
+  return false;
+}
+
+/// The JIT of -run and -repl, which compiles for the host at the `-O`
+/// level. `TM` targets the same host, to optimize the modules before.
+/// Libraries and the process itself resolve the symbols of the modules.
+std::unique_ptr<llvm::orc::LLJIT>
+createJIT(llvm::StringRef Argv0, std::unique_ptr<llvm::TargetMachine> &TM) {
+  auto JTMB = llvm::orc::JITTargetMachineBuilder::detectHost();
+  if (!JTMB) {
+    checkError(Argv0, JTMB.takeError());
+    return nullptr;
+  }
+  auto OL = llvm::CodeGenOpt::getLevel(OptLevel - '0');
+  if (!OL) {
+    llvm::WithColor::error(llvm::errs(), Argv0)
+        << "Invalid optimization level -O" << OptLevel << "\n";
+    return nullptr;
+  }
+  JTMB->setCodeGenOptLevel(*OL);
+
+  auto HostTM = JTMB->createTargetMachine();
+  if (!HostTM) {
+    checkError(Argv0, HostTM.takeError());
+    return nullptr;
+  }
+  TM = std::move(*HostTM);
+
+  auto J = llvm::orc::LLJITBuilder()
+               .setJITTargetMachineBuilder(std::move(*JTMB))
+               .create();
+  if (!J) {
+    checkError(Argv0, J.takeError());
+    return nullptr;
+  }
+  if (PerfSupport && !enablePerfSupport(Argv0, **J)) {
+    return nullptr;
+  }
+  auto ProcessSymbols =
+      llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          (*J)->getDataLayout().getGlobalPrefix());
+  if (!ProcessSymbols) {
+    checkError(Argv0, ProcessSymbols.takeError());
+    return nullptr;
+  }
+  (*J)->getMainJITDylib().addGenerator(std::move(*ProcessSymbols));
+  return std::move(*J);
+}
+
+/// Replace the ifuncs of `target_clones` in `M`, which the JIT doesn't
+/// resolve, by functions that call the resolver on their first call, keep
+/// the clone it picks, and call that clone.
+void lowerIFuncs(llvm::Module &M) {
+  llvm::LLVMContext &Ctx = M.getContext();
+  for (llvm::GlobalIFunc &IFunc: llvm::make_early_inc_range(M.ifuncs())) {
+    auto *FTy = llvm::cast<llvm::FunctionType>(IFunc.getValueType());
+    auto *Resolver =
+        llvm::cast<llvm::Function>(IFunc.getResolver()->stripPointerCasts());
+    auto *PtrTy = llvm::cast<llvm::PointerType>(Resolver->getReturnType());
+    auto *Clone = new llvm::GlobalVariable(
+        M, PtrTy, /*isConstant=*/false, llvm::GlobalValue::InternalLinkage,
+        llvm::ConstantPointerNull::get(PtrTy), IFunc.getName() + ".clone");
+    llvm::Function *Stub =
+        llvm::Function::Create(FTy, IFunc.getLinkage(), "", &M);
+    Stub->takeName(&IFunc);
+
+    llvm::BasicBlock *EntryBB = llvm::BasicBlock::Create(Ctx, "entry", Stub);
+    llvm::BasicBlock *ResolveBB =
+        llvm::BasicBlock::Create(Ctx, "resolve", Stub);
+    llvm::BasicBlock *CallBB = llvm::BasicBlock::Create(Ctx, "call", Stub);
+    // The threads of `parallel for` may race to resolve, to the same clone.
+    llvm::IRBuilder<> Builder(EntryBB);
+    llvm::LoadInst *Cached = Builder.CreateLoad(PtrTy, Clone);
+    Cached->setAtomic(llvm::AtomicOrdering::Monotonic);
+    Builder.CreateCondBr(Builder.CreateIsNull(Cached), ResolveBB, CallBB);
+    Builder.SetInsertPoint(ResolveBB);
+    llvm::CallInst *Resolved = Builder.CreateCall(Resolver);
+    Builder.CreateStore(Resolved, Clone)
+        ->setAtomic(llvm::AtomicOrdering::Monotonic);
+    Builder.CreateBr(CallBB);
+    Builder.SetInsertPoint(CallBB);
+    llvm::PHINode *Callee = Builder.CreatePHI(PtrTy, 2);
+    Callee->addIncoming(Cached, EntryBB);
+    Callee->addIncoming(Resolved, ResolveBB);
+    llvm::SmallVector<llvm::Value *, 8> Args;
+    for (llvm::Argument &Arg: Stub->args()) {
+      Args.push_back(&Arg);
+    }
+    llvm::CallInst *Call = Builder.CreateCall(FTy, Callee, Args);
+    Call->setTailCall();
+    if (FTy->getReturnType()->isVoidTy()) {
+      Builder.CreateRetVoid();
+    }
+    else {
+      Builder.CreateRet(Call);
+    }
+
+    IFunc.replaceAllUsesWith(Stub);
+    IFunc.eraseFromParent();
+  }
+}
+
+/// Optimize `M` for the host and add it to the JIT.
+bool addModuleToJIT(llvm::StringRef Argv0, llvm::orc::LLJIT &J,
+                    llvm::TargetMachine &TM, llvm::Module *M) {
+  M->setDataLayout(J.getDataLayout());
+  M->setTargetTriple(J.getTargetTriple().str());
+  lowerIFuncs(*M);
+  if (!optimize(Argv0, M, &TM)) {
+    return false;
+  }
+
+  // `#pragma omp parallel for` calls into the OpenMP runtime.
+  if (M->getFunction("__kmpc_fork_call")) {
+    std::string Err;
+    if (llvm::sys::DynamicLibrary::LoadLibraryPermanently("libomp.so", &Err)) {
+      llvm::WithColor::error(llvm::errs(), Argv0)
+          << "Failed to load the OpenMP runtime: " << Err << "\n";
+      return false;
+    }
+  }
+
+  // The JIT owns the context of its modules, so the module moves to a
+  // fresh context through its bitcode in memory.
+  llvm::SmallVector<char, 0> Bitcode;
+  llvm::raw_svector_ostream BitcodeOS(Bitcode);
+  llvm::WriteBitcodeToFile(*M, BitcodeOS);
+  auto Ctx = std::make_unique<llvm::LLVMContext>();
+  auto JITModule = llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(llvm::StringRef(Bitcode.data(), Bitcode.size()),
+                            M->getModuleIdentifier()),
+      *Ctx);
+  if (!JITModule) {
+    return checkError(Argv0, JITModule.takeError());
+  }
+  llvm::orc::ThreadSafeModule TSM(std::move(*JITModule), std::move(Ctx));
+  return checkError(Argv0, J.addIRModule(std::move(TSM)));
+}
+
+/// Compile the module with the `-O` pipeline and run its main in-process.
+bool runJIT(llvm::StringRef Argv0, llvm::Module *M, int &ExitCode) {
+  std::unique_ptr<llvm::TargetMachine> TM;
+  std::unique_ptr<llvm::orc::LLJIT> J = createJIT(Argv0, TM);
+  if (!J || !addModuleToJIT(Argv0, *J, *TM, M)) {
+    return false;
+  }
+
+  if (!checkError(Argv0, J->initialize(J->getMainJITDylib()))) {
+    return false;
+  }
+  auto MainSym = J->lookup("main");
+  if (!MainSym) {
+    return checkError(Argv0, MainSym.takeError());
+  }
+#if LLVM_VERSION_MAJOR >= 15
+  auto *Main = MainSym->toPtr<int (*)(int, char *[])>();
+#else
+  auto *Main = (int (*)(int, char *[]))MainSym->getAddress();
+#endif
+  ExitCode = llvm::orc::runAsMain(Main, {}, llvm::StringRef(InputFile));
+  return checkError(Argv0, J->deinitialize(J->getMainJITDylib()));
+}
+
+/// Read statements line by line, and run them once their braces balance.
+/// The chunks share the Sema, so each sees the declarations of the ones
+/// before, and each is compiled to a small module of its own in one JIT,
+/// with its file scope variables as globals. A chunk with errors is
+/// dropped, along with its declarations, and the session goes on.
+bool runRepl(llvm::StringRef Argv0) {
+  std::unique_ptr<llvm::TargetMachine> TM;
+  std::unique_ptr<llvm::orc::LLJIT> J = createJIT(Argv0, TM);
+  if (!J) {
+    return false;
+  }
+
+  // One runtime for the session, rather than a copy in every chunk.
+  if (!RuntimeBC.empty()) {
+    llvm::LLVMContext Ctx;
+    std::unique_ptr<llvm::Module> Runtime = loadRuntime(Argv0, Ctx);
+    if (!Runtime || !addModuleToJIT(Argv0, *J, *TM, Runtime.get())) {
+      return false;
+    }
+  }
+
+  llvm::SourceMgr Mgr;
+  DiagEngine Diags(Mgr);
+  Sema S(Diags);
+  // The parser can't return from an error, so each chunk is parsed on a
+  // thread of its own, which an error leaves waiting for good.
+  std::promise<std::shared_ptr<Program>> *Parsed = nullptr;
+  Diags.setErrorHandler([&Parsed] {
+    Parsed->set_value(nullptr);
+    std::promise<void>().get_future().wait();
+  });
+  std::vector<std::shared_ptr<Program>> Chunks;
+  llvm::LineEditor LE("tinycc");
+  std::string Text;
+  while (auto Line = LE.readLine()) {
+    Text += *Line;
+    Text += '\n';
+    // Wait for the end of a block, and for the loop of a `#pragma`.
+    if (llvm::count(Text, '{') > llvm::count(Text, '}') ||
+        llvm::StringRef(*Line).ltrim().starts_with("#")) {
+      LE.setPrompt("...> ");
+      continue;
+    }
+    LE.setPrompt("tinycc> ");
+    llvm::StringRef Trimmed = llvm::StringRef(Text).trim();
+    if (Trimmed.empty()) {
+      Text.clear();
+      continue;
+    }
+    // `a + 1` is short for the statement `a + 1;`.
+    if (!Trimmed.ends_with(";") && !Trimmed.ends_with("}")) {
+      Text += ";";
+    }
+
+    unsigned BufferID = Mgr.AddNewSourceBuffer(
+        llvm::MemoryBuffer::getMemBufferCopy(Text, "<repl>"), llvm::SMLoc());
+    Text.clear();
+    S.saveState();
+    std::promise<std::shared_ptr<Program>> Promise;
+    Parsed = &Promise;
+    std::thread ParseThread([&Mgr, &Diags, &S, &Promise, BufferID] {
+      Lexer Lex(Mgr, Diags, BufferID);
+      Parser P(Lex, S);
+      Promise.set_value(P.parseProgram());
+    });
+    std::shared_ptr<Program> Chunk = Promise.get_future().get();
+    if (!Chunk) {
+      ParseThread.detach();
+      S.restoreState();
+      continue;
+    }
+    ParseThread.join();
+
+    std::string EntryName = "__tinycc_repl_" + std::to_string(Chunks.size());
+    CodegenVisitor CG(Chunk, Chunks, EntryName);
+    Chunks.push_back(Chunk);
+    if (!addModuleToJIT(Argv0, *J, *TM, CG.getModule()) ||
+        !Chunk->hasImplicitMain ||
+        !checkError(Argv0, J->initialize(J->getMainJITDylib()))) {
+      continue;
+    }
+
+    auto EntrySym = J->lookup(EntryName);
+    if (!EntrySym) {
+      checkError(Argv0, EntrySym.takeError());
+      continue;
+    }
+#if LLVM_VERSION_MAJOR >= 15
+    auto *Entry = EntrySym->toPtr<int (*)()>();
+#else
+    auto *Entry = (int (*)())EntrySym->getAddress();
+#endif
+    (void)Entry();
+  }
+  return checkError(Argv0, J->deinitialize(J->getMainJITDylib()));
+}
+
+/// The JIT of -tiered. Each hot loop is a module of its own, with internal
+/// copies of the functions it may call, and the globals resolve to their
+/// slots in the memory of the interpreter.
+class TieredLoopCompiler {
+public:
+  TieredLoopCompiler(llvm::StringRef Argv0, std::shared_ptr<Program> Prog)
+      : Argv0(Argv0), Prog(std::move(Prog)) {}
+
+  CompiledLoop compile(ForStmt *Loop, const LoopFrame &Frame);
+
+private:
+  bool defineGlobals(llvm::ArrayRef<std::pair<Symbol *, void *>> Globals);
+
+  std::string Argv0;
+  std::shared_ptr<Program> Prog;
+  std::unique_ptr<llvm::TargetMachine> TM;
+  std::unique_ptr<llvm::orc::LLJIT> J;
+  unsigned NumLoops = 0;
+  bool Disabled = false;
+};
+
+CompiledLoop TieredLoopCompiler::compile(ForStmt *Loop,
+                                         const LoopFrame &Frame) {
+  if (Disabled) {
+    return nullptr;
+  }
+  // The first hot loop creates the JIT, a short program never pays for it.
+  if (!J) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    J = createJIT(Argv0, TM);
+    if (!J || !defineGlobals(Frame.globals)) {
+      Disabled = true;
+      return nullptr;
+    }
+  }
+
+  std::string EntryName = "__tinycc_loop_" + std::to_string(NumLoops++);
+  CodegenVisitor CG(Prog, Loop, Frame.locals, EntryName);
+  if (!addModuleToJIT(Argv0, *J, *TM, CG.getModule())) {
+    return nullptr;
+  }
+  auto EntrySym = J->lookup(EntryName);
+  if (!EntrySym) {
+    checkError(Argv0, EntrySym.takeError());
+    return nullptr;
+  }
+#if LLVM_VERSION_MAJOR >= 15
+  return EntrySym->toPtr<CompiledLoop>();
+#else
+  return (CompiledLoop)EntrySym->getAddress();
+#endif
+}
+
+bool TieredLoopCompiler::defineGlobals(
+    llvm::ArrayRef<std::pair<Symbol *, void *>> Globals) {
+  llvm::orc::SymbolMap Symbols;
+  for (auto [Sym, Addr]: Globals) {
+    // The interpreter keeps a `soa` array like any other array, the
+    // compiled code would read it field by field.
+    if (Sym->isSoA()) {
+      return false;
+    }
+#if LLVM_VERSION_MAJOR >= 17
+    Symbols[J->mangleAndIntern(Sym->getName())] = {
+        llvm::orc::ExecutorAddr::fromPtr(Addr),
+        llvm::JITSymbolFlags::Exported};
+#else
+    Symbols[J->mangleAndIntern(Sym->getName())] = llvm::JITEvaluatedSymbol(
+        llvm::pointerToJITTargetAddress(Addr),
+        llvm::JITSymbolFlags::Exported);
+#endif
+  }
+  return checkError(Argv0, J->getMainJITDylib().define(
+                               llvm::orc::absoluteSymbols(std::move(Symbols))));
+}
+
+/// Open -cache-dir with the pruning policy of -cache-policy.
+std::optional<ObjectCache> openCache(llvm::StringRef Argv0) {
+  llvm::Expected<llvm::CachePruningPolicy> Policy =
+      llvm::parseCachePruningPolicy(CachePolicy);
+  if (!Policy) {
+    llvm::WithColor::error(llvm::errs(), Argv0)
+        << "Invalid -cache-policy: " << llvm::toString(Policy.takeError())
+        << "\n";
+    return std::nullopt;
+  }
+  llvm::Expected<ObjectCache> Cache = ObjectCache::open(CacheDir, *Policy);
+  if (!Cache) {
+    llvm::WithColor::error(llvm::errs(), Argv0)
+        << llvm::toString(Cache.takeError()) << "\n";
+    return std::nullopt;
+  }
+  return std::move(*Cache);
+}
+
+bool printCacheStats(llvm::StringRef Argv0) {
+  if (CacheDir.empty()) {
+    llvm::WithColor::error(llvm::errs(), Argv0)
+        << "-cache-stats needs -cache-dir\n";
+    return false;
+  }
+  std::optional<ObjectCache> Cache = openCache(Argv0);
+  if (!Cache) {
+    return false;
+  }
+
+  ObjectCache::Stats Stats = Cache->getStats();
+  uint64_t Lookups = Stats.hits + Stats.misses;
+  llvm::outs() << "cache directory  " << Cache->getDirectory() << "\n"
+               << "hits             " << Stats.hits << "\n"
+               << "misses           " << Stats.misses << "\n"
+               << "hit rate         "
+               << llvm::format("%.1f%%", Lookups ? 100.0 * Stats.hits / Lookups
+                                                 : 0.0)
+               << "\n"
+               << "entries          " << Stats.entries << "\n"
+               << "size             "
+               << llvm::format("%.1f KiB", Stats.bytes / 1024.0) << "\n";
+  return true;
+}
+
+/// Hash everything the output depends on: the source, the version of
+/// tinycc, the target, the files it reads besides the source and every
+/// flag but the names of the input and output. The name of the input only
+/// counts with debug info, which records it.
+std::string getCacheKey(int Argc, const char **Argv, llvm::StringRef InputName,
+                        llvm::StringRef Source, llvm::TargetMachine *TM) {
+  std::string Version = getTinyccVeriosn();
+  std::string Triple = TM->getTargetTriple().str();
+  llvm::SmallVector<llvm::StringRef, 32> Parts = {
+      Source, Version, Triple, TM->getTargetCPU(),
+      TM->getTargetFeatureString()};
+
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> Inputs;
+  for (const std::string &Name: {RuntimeBC.getValue(), ProfileUse.getValue()}) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buf =
+        Name.empty() ? nullptr : llvm::MemoryBuffer::getFile(Name);
+    Inputs.push_back(Buf ? std::move(*Buf) : nullptr);
+    Parts.push_back(Inputs.back() ? Inputs.back()->getBuffer() : "");
+  }
+  if (DebugInfo || LineTablesOnly) {
+    Parts.push_back(InputName);
+  }
+
+  // The flags as given, without the inputs, -o, -j and the cache flags.
+  static const llvm::StringRef Ignored[] = {"o", "j", "cache-dir",
+                                            "cache-policy"};
+  for (int I = 1; I < Argc; ++I) {
+    llvm::StringRef Arg = Argv[I];
+    if (llvm::is_contained(InputFiles, Arg)) {
+      continue;
+    }
+    llvm::StringRef Name = Arg.ltrim('-').split('=').first;
+    if (llvm::is_contained(Ignored, Name)) {
+      if (!Arg.contains('=')) {
+        ++I;
       }
+      continue;
     }
+    Parts.push_back(Arg);
+  }
+  return ObjectCache::computeKey(Parts);
+}
+
+/// Where -ast-cache keeps the AST of `Source`: in -cache-dir, named after
+/// the source and the warning options so pruning drops it with the
+/// outputs, or next to the input. Empty for the standard input without
+/// -cache-dir.
+std::string getASTPath(llvm::StringRef InputName, llvm::StringRef Source) {
+  if (!CacheDir.empty()) {
+    llvm::SmallString<128> Path(CacheDir);
+    llvm::sys::path::append(
+        Path, "llvmcache-ast-" + ObjectCache::computeKey(
+                                     {Source, Sema::getWarningOptions()}));
+    return std::string(Path);
+  }
+  if (InputName == "-") {
+    return "";
   }
+  return (InputName + ".ast").str();
+}
 
+/// The -filetype, or an object with -c.
+llvm::CodeGenFileType getFileType() {
+  return CompileOnly ? llvm::CGFT_ObjectFile : llvm::codegen::getFileType();
+}
+
+/// Whether the output is bitcode: an object with -emit-llvm, or anything
+/// but textual IR with -flto=thin.
+bool emitsBitcode(llvm::CodeGenFileType FT) {
+  if (LTOMode == LTOKind::Thin) {
+    return FT != llvm::CGFT_AssemblyFile || !EmitLLVM;
+  }
+  return FT == llvm::CGFT_ObjectFile && EmitLLVM;
+}
+
+/// Name the output after the input, unless -o did.
+std::string getOutputFile(llvm::StringRef InputFileName,
+                          llvm::CodeGenFileType FT) {
+  if (!OutputFile.empty()) {
+    return OutputFile;
+  }
+  if (InputFileName == "-") {
+    return "-";
+  }
+
+  std::string Name;
+  if (InputFileName.ends_with(".c")) {
+    Name = InputFileName.drop_back(2).str();
+  } 
+  else if (InputFileName.ends_with(".txt")) {
+    Name = InputFileName.drop_back(4).str();
+  }
+  else {
+    Name = InputFileName.str();
+  }  
+
+  if (emitsBitcode(FT)) {
+    return Name + ".bc";
+  }
+  switch (FT) {
+  case llvm::CGFT_AssemblyFile:
+    Name.append(EmitLLVM ? ".ll" : ".s");
+    break;
+  case llvm::CGFT_ObjectFile:
+    Name.append(".o");
+    break;
+  case llvm::CGFT_Null:
+    Name.append("null");
+  }
+  return Name;
+}
+
+std::unique_ptr<llvm::ToolOutputFile>
+openOutputFile(llvm::StringRef Argv0, llvm::StringRef Name,
+               llvm::CodeGenFileType FT, llvm::raw_ostream &ErrOS) {
   std::error_code EC;
   llvm::sys::fs::OpenFlags OF = llvm::sys::fs::OF_None;
   if (FT == llvm::CGFT_AssemblyFile) {
     OF |= llvm::sys::fs::OF_TextWithCRLF;
   }
   auto Out = std::make_unique<llvm::ToolOutputFile>(
-    OutputFile, EC, OF);
+    Name, EC, OF);
   
   if (EC) {
-    llvm::WithColor::error(llvm::errs(), Argv0)
+    llvm::WithColor::error(ErrOS, Argv0)
         << EC.message() << "\n";
   
+    return nullptr;
+  }
+  return Out;
+}
+
+/// A cache entry holds what the code generation printed, which a hit prints
+/// again, then the output: the size of the first, followed by both.
+std::string packCacheEntry(llvm::StringRef Printed, llvm::StringRef Output) {
+  std::string Entry(sizeof(uint64_t), '\0');
+  llvm::support::endian::write64le(Entry.data(), Printed.size());
+  Entry += Printed;
+  Entry += Output;
+  return Entry;
+}
+
+/// Split a cache entry into what was printed and the output. Fail on an
+/// entry too short for the size it starts with.
+bool unpackCacheEntry(llvm::StringRef Entry, llvm::StringRef &Printed,
+                      llvm::StringRef &Output) {
+  if (Entry.size() < sizeof(uint64_t)) {
+    return false;
+  }
+  uint64_t Size = llvm::support::endian::read64le(Entry.data());
+  Entry = Entry.drop_front(sizeof(uint64_t));
+  if (Size > Entry.size()) {
+    return false;
+  }
+  Printed = Entry.take_front(Size);
+  Output = Entry.drop_front(Size);
+  return true;
+}
+
+/// Write the output a previous compile stored in the cache.
+bool emitCached(llvm::StringRef Argv0, llvm::StringRef InputFileName,
+                llvm::StringRef Output, llvm::raw_ostream &ErrOS) {
+  llvm::CodeGenFileType FT = getFileType();
+  std::unique_ptr<llvm::ToolOutputFile> Out = openOutputFile(
+      Argv0, getOutputFile(InputFileName, FT), FT, ErrOS);
+  if (!Out) {
+    return false;
+  }
+  Out->os() << Output;
+  Out->keep();
+  return true;
+}
+
+/// Write the output of `M`, and store it under `CacheKey` with a `Cache`,
+/// along with what was `Printed` while generating `M`.
+bool emit(llvm::StringRef Argv0, llvm::Module *M,
+          llvm::TargetMachine *TM,
+          llvm::StringRef InputFileName,
+          llvm::raw_ostream &ErrOS,
+          ObjectCache *Cache = nullptr,
+          llvm::StringRef CacheKey = "",
+          llvm::StringRef Printed = "") {
+  llvm::CodeGenFileType FT = getFileType();
+  std::unique_ptr<llvm::ToolOutputFile> Out = openOutputFile(
+      Argv0, getOutputFile(InputFileName, FT), FT, ErrOS);
+  if (!Out) {
     return false;
   }
   
+  if (ReportThroughput) {
+    if (llvm::Error Err = reportLoopThroughput(*M, *TM, ErrOS)) {
+      llvm::WithColor::error(ErrOS, Argv0)
+          << llvm::toString(std::move(Err)) << "\n";
+      return false;
+    }
+  }
+
+  // The output goes to a buffer first to be stored in the cache.
+  llvm::SmallVector<char, 0> Buffer;
+  llvm::raw_svector_ostream BufferOS(Buffer);
+  llvm::raw_pwrite_stream &OS =
+      Cache ? static_cast<llvm::raw_pwrite_stream &>(BufferOS) : Out->os();
+
   llvm::legacy::PassManager PM;
-  if (FT == llvm::CGFT_AssemblyFile && EmitLLVM) {
-    PM.add(llvm::createPrintModulePass(Out->os()));
+  if (emitsBitcode(FT)) {
+    // The summary lists what each function calls and references, which
+    // -flto-link reads to choose the functions to import.
+    if (LTOMode == LTOKind::Thin) {
+      // The summary doesn't follow the ifuncs of target_clones to their
+      // resolvers, which would look dead to -flto-link otherwise.
+      llvm::SmallVector<llvm::GlobalValue *, 4> Resolvers;
+      for (llvm::GlobalIFunc &IFunc: M->ifuncs()) {
+        Resolvers.push_back(IFunc.getResolverFunction());
+      }
+      llvm::appendToCompilerUsed(*M, Resolvers);
+      llvm::ProfileSummaryInfo PSI(*M);
+      llvm::ModuleSummaryIndex Index =
+          llvm::buildModuleSummaryIndex(*M, nullptr, &PSI);
+      llvm::WriteBitcodeToFile(*M, OS, /*ShouldPreserveUseListOrder=*/false,
+                               &Index);
+    }
+    else {
+      llvm::WriteBitcodeToFile(*M, OS);
+    }
+  }
+  else if (FT == llvm::CGFT_AssemblyFile && EmitLLVM) {
+    PM.add(llvm::createPrintModulePass(OS));
   }
   else { // TODO: Only support the generation for .ll file now.
-    if (TM->addPassesToEmitFile(PM, Out->os(), nullptr, FT)) {
-      llvm::WithColor::error(llvm::errs(), Argv0)
+    if (TM->addPassesToEmitFile(PM, OS, nullptr, FT)) {
+      llvm::WithColor::error(ErrOS, Argv0)
           << "No support for file type\n";
       return false;
     }
   }
 
   PM.run(*M);
+  if (Cache) {
+    Out->os() << BufferOS.str();
+    if (llvm::Error Err = Cache->store(
+            CacheKey, packCacheEntry(Printed, BufferOS.str()))) {
+      llvm::WithColor::warning(ErrOS, Argv0)
+          << "Failed to store the output in the cache: "
+          << llvm::toString(std::move(Err)) << "\n";
+    }
+    Cache->prune();
+  }
   Out->keep();
   return true;
 }
 
+/// Link the bitcode of -flto=thin given as inputs with ThinLTO and write
+/// their objects: to -o if there is one, else to <output>.<n>.o each.
+bool linkThinLTO(const char *Argv0) {
+  std::vector<std::unique_ptr<llvm::MemoryBuffer>> Buffers;
+  std::vector<llvm::MemoryBufferRef> Inputs;
+  for (const std::string &Name: InputFiles) {
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buf =
+        llvm::MemoryBuffer::getFile(Name);
+    if (!Buf) {
+      llvm::WithColor::error(llvm::errs(), Argv0)
+          << "Failed to open the file " << Name << ": "
+          << Buf.getError().message() << "\n";
+      return false;
+    }
+    Inputs.push_back((*Buf)->getMemBufferRef());
+    Buffers.push_back(std::move(*Buf));
+  }
+
+  std::unique_ptr<llvm::TargetMachine> TM(createTargetMachine(Argv0));
+  if (!TM) {
+    return false;
+  }
+  llvm::Expected<std::vector<llvm::SmallString<0>>> Objects =
+      thinLink(Inputs, *TM, OptLevel - '0', LTOJobs);
+  if (!Objects) {
+    llvm::WithColor::error(llvm::errs(), Argv0)
+        << llvm::toString(Objects.takeError()) << "\n";
+    return false;
+  }
+
+  if (OutputFile.empty()) {
+    OutputFile = "a.o";
+  }
+  for (size_t I = 0; I < Objects->size(); ++I) {
+    llvm::SmallString<128> Name(OutputFile);
+    if (Objects->size() > 1) {
+      llvm::StringRef Ext = llvm::sys::path::extension(OutputFile);
+      llvm::sys::path::replace_extension(Name, llvm::Twine(I) + Ext);
+    }
+    std::error_code EC;
+    llvm::ToolOutputFile Out(Name, EC, llvm::sys::fs::OF_None);
+    if (EC) {
+      llvm::WithColor::error(llvm::errs(), Argv0)
+          << "Failed to open " << Name << ": " << EC.message() << "\n";
+      return false;
+    }
+    Out.os() << (*Objects)[I];
+    Out.keep();
+  }
+  return true;
+}
+
+/// An input and its program, parsed or loaded by -ast-cache. The program
+/// uses the types of `Sem` or of `SavedAST`, so they live as long.
+struct Input {
+  Input(std::unique_ptr<llvm::MemoryBuffer> Buf, llvm::raw_ostream &ErrOS)
+      : Diags(Mgr, ErrOS), Sem(Diags) {
+    Mgr.AddNewSourceBuffer(std::move(Buf), llvm::SMLoc());
+  }
+
+  llvm::StringRef getSource() const {
+    return Mgr.getMemoryBuffer(Mgr.getMainFileID())->getBuffer();
+  }
+
+  llvm::SourceMgr Mgr;
+  DiagEngine Diags;
+  Sema Sem;
+  std::unique_ptr<ASTFile> SavedAST;
+  std::shared_ptr<Program> Prog;
+};
+
+/// Parse `In`. With -ast-cache, load the AST saved for the same source
+/// instead, which skips lexing, parsing and Sema, or save it after parsing.
+void parseInput(llvm::StringRef Argv0, llvm::StringRef InputName, Input &In,
+                llvm::raw_ostream &ErrOS) {
+  std::string ASTPath;
+  uint64_t SourceHash = 0;
+  if (ASTCache) {
+    ASTPath = getASTPath(InputName, In.getSource());
+    // The saved warnings depend on the options of Sema as well.
+    SourceHash = llvm::xxHash64(In.getSource()) ^
+                 llvm::xxHash64(Sema::getWarningOptions());
+    if (!ASTPath.empty() && !CacheDir.empty()) {
+      llvm::sys::fs::create_directories(CacheDir);
+    }
+  }
+  if (!ASTPath.empty()) {
+    llvm::Expected<std::unique_ptr<ASTFile>> File =
+        readASTFile(ASTPath, SourceHash);
+    if (File) {
+      In.SavedAST = std::move(*File);
+      In.Prog = In.SavedAST->program;
+      llvm::StringRef Source = In.getSource();
+      for (const SavedDiagnostic &Diag: In.SavedAST->diagnostics) {
+        llvm::SMLoc Loc;
+        if (Diag.offset <= Source.size()) {
+          Loc = llvm::SMLoc::getFromPointer(Source.data() + Diag.offset);
+        }
+        In.Diags.replay(Loc, Diag.kind, Diag.message);
+      }
+      return;
+    }
+    llvm::consumeError(File.takeError());
+  }
+
+  Lexer lexer(In.Mgr, In.Diags);
+  Parser parser(lexer, In.Sem);
+  In.Prog = parser.parseProgram();
+  if (!ASTPath.empty()) {
+    const char *Start = In.getSource().data();
+    std::vector<SavedDiagnostic> Diagnostics;
+    for (const DiagEngine::Diagnostic &Diag: In.Diags.getDiagnostics()) {
+      // A warning without a location gets an offset past the source.
+      uint32_t Offset = Diag.loc.isValid()
+                            ? uint32_t(Diag.loc.getPointer() - Start)
+                            : ~0u;
+      Diagnostics.push_back({Offset, Diag.kind, Diag.message});
+    }
+    if (llvm::Error Err =
+            writeASTFile(*In.Prog, Diagnostics, SourceHash, ASTPath)) {
+      llvm::WithColor::warning(ErrOS, Argv0)
+          << "Failed to save the AST to " << ASTPath << ": "
+          << llvm::toString(std::move(Err)) << "\n";
+    }
+  }
+}
+
+/// Whether remarks or the throughput report need the source locations of
+/// the IR.
+bool tracksLocations() {
+  return !RemarksPassed.empty() || !RemarksMissed.empty() ||
+         !RemarksAnalysis.empty() || SaveOptimizationRecord ||
+         ReportThroughput;
+}
+
+/// Generate the code of `In`, optimize it and write the output, served from
+/// `Cache` if it has it. With -run, run it instead and set `ExitCode` to its
+/// exit code. The module printed while generating goes to `OutOS`, the
+/// diagnostics to `ErrOS`.
+bool generate(const char *Argv0, int Argc, const char **Argv,
+              llvm::StringRef InputName, Input &In, llvm::TargetMachine *TM,
+              ObjectCache *Cache, llvm::raw_ostream &OutOS,
+              llvm::raw_ostream &ErrOS, int &ExitCode) {
+  ExitCode = EXIT_SUCCESS;
+  DebugInfoKind DIKind = DebugInfoKind::None;
+  if (DebugInfo) {
+    DIKind = DebugInfoKind::Full;
+  }
+  else if (LineTablesOnly) {
+    DIKind = DebugInfoKind::LineTablesOnly;
+  }
+  else if (tracksLocations()) {
+    DIKind = DebugInfoKind::LocTrackingOnly;
+  }
+
+  // A hit skips the code generation, but prints what it printed.
+  std::string CacheKey;
+  if (Cache) {
+    CacheKey = getCacheKey(Argc, Argv, InputName, In.getSource(), TM);
+    llvm::StringRef Printed, Output;
+    if (std::unique_ptr<llvm::MemoryBuffer> Cached =
+            Cache->lookup(CacheKey)) {
+      if (unpackCacheEntry(Cached->getBuffer(), Printed, Output)) {
+        OutOS << Printed;
+        return emitCached(Argv0, InputName, Output, ErrOS);
+      }
+    }
+  }
+
+  // -run prints only what the program prints, like -interp.
+  std::string Printed;
+  llvm::raw_string_ostream PrintedOS(Printed);
+  llvm::raw_ostream &IROS =
+      Run ? llvm::nulls() : Cache ? PrintedOS : OutOS;
+  CodegenVisitor cg(In.Prog, InputName, DIKind, IROS);
+  OutOS << PrintedOS.str();
+
+  llvm::Module *M = cg.getModule();
+  M->getContext().setDiagnosticHandler(
+      std::make_unique<RemarkHandler>(In.Mgr, ErrOS));
+
+  std::unique_ptr<llvm::ToolOutputFile> RecordFile;
+  if (SaveOptimizationRecord) {
+    llvm::SmallString<128> RecordName(OutputFile.empty() || OutputFile == "-"
+                                          ? InputName
+                                          : llvm::StringRef(OutputFile));
+    llvm::sys::path::replace_extension(RecordName, "opt.yaml");
+    llvm::Expected<std::unique_ptr<llvm::ToolOutputFile>> File =
+        llvm::setupLLVMOptimizationRemarks(
+            M->getContext(), RecordName, /*RemarksPasses=*/"", "yaml",
+            /*RemarksWithHotness=*/!ProfileUse.empty());
+    if (!File) {
+      llvm::WithColor::error(ErrOS, Argv0)
+          << llvm::toString(File.takeError()) << "\n";
+      return false;
+    }
+    RecordFile = std::move(*File);
+  }
+
+  // Bitcode for -flto-link needs the target, and the optimizer uses its
+  // layout. -run replaces them with those of the JIT.
+  M->setTargetTriple(TM->getTargetTriple().str());
+  M->setDataLayout(TM->createDataLayout());
+  if (!linkRuntime(Argv0, M, ErrOS)) {
+    return false;
+  }
+  if (Run) {
+    if (!runJIT(Argv0, M, ExitCode)) {
+      return false;
+    }
+    if (RecordFile) {
+      RecordFile->keep();
+    }
+    return true;
+  }
+  if (!optimize(Argv0, M, TM, ErrOS)) {
+    return false;
+  }
+  if (!emit(Argv0, M, TM, InputName, ErrOS, Cache, CacheKey, Printed)) {
+    llvm::WithColor::error(ErrOS, Argv0)
+      << "Error writing output\n";
+  }
+  if (RecordFile) {
+    RecordFile->keep();
+  }
+  return true;
+}
+
+/// What the compiles of -j print, kept per input and printed in the order
+/// of the inputs once those before are done, as if they ran in turn. Every
+/// input is compiled, whether or not those before it failed.
+class BatchLog {
+public:
+  struct Entry {
+    std::string Out;
+    std::string Err;
+    bool Done = false;
+    // The exit code, if the compile failed.
+    std::optional<int> Failure;
+  };
+
+  BatchLog(size_t NumInputs, unsigned NumWorkers)
+      : Entries(NumInputs), Running(NumWorkers) {}
+
+  Entry &get(size_t I) { return Entries[I]; }
+
+  /// Record that the compile of input `I` is done, and print the inputs
+  /// that are now in order.
+  void finish(size_t I, std::optional<int> Failure) {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    Entries[I].Done = true;
+    Entries[I].Failure = Failure;
+    for (; Printed < Entries.size() && Entries[Printed].Done; ++Printed) {
+      llvm::outs() << Entries[Printed].Out;
+      llvm::outs().flush();
+      llvm::errs() << Entries[Printed].Err;
+    }
+  }
+
+  /// A worker is out of inputs.
+  void stop() {
+    std::lock_guard<std::mutex> Lock(Mutex);
+    --Running;
+    Stopped.notify_all();
+  }
+
+  /// Finish input `I` with `ExitCode`, from a compile that can't go on or
+  /// return. The worker waits until the process exits, and a new thread
+  /// runs `Rest` in its place to compile the remaining inputs.
+  [[noreturn]] void abandon(size_t I, int ExitCode,
+                            std::function<void()> Rest) {
+    finish(I, ExitCode);
+    std::thread(std::move(Rest)).detach();
+    std::unique_lock<std::mutex> Lock(Mutex);
+    for (;;) {
+      Stopped.wait(Lock);
+    }
+  }
+
+  /// Wait for the workers to stop, and return the exit code of the first
+  /// input that failed.
+  std::optional<int> wait() {
+    std::unique_lock<std::mutex> Lock(Mutex);
+    Stopped.wait(Lock, [this] { return Running == 0; });
+    for (const Entry &E: Entries) {
+      if (E.Failure) {
+        return E.Failure;
+      }
+    }
+    return std::nullopt;
+  }
+
+private:
+  std::vector<Entry> Entries;
+  size_t Printed = 0;
+  unsigned Running;
+  std::mutex Mutex;
+  std::condition_variable Stopped;
+};
+
+/// Compile input `I` of -j with `TM`, printing to its entry in `Log`.
+/// `Rest` compiles the inputs that the worker would take after this one.
+void compileBatchInput(const char *Argv0, int Argc, const char **Argv,
+                       size_t I, llvm::TargetMachine *TM, ObjectCache *Cache,
+                       BatchLog &Log, const std::function<void()> &Rest) {
+  const std::string &Name = InputFiles[I];
+  BatchLog::Entry &Entry = Log.get(I);
+  llvm::raw_string_ostream OutOS(Entry.Out);
+  llvm::raw_string_ostream ErrOS(Entry.Err);
+  ErrOS.enable_colors(llvm::errs().has_colors());
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> Buf =
+      llvm::MemoryBuffer::getFile(Name);
+  if (!Buf) {
+    llvm::WithColor::error(ErrOS, Argv0)
+        << "Failed to open the file " << Name << ": "
+        << Buf.getError().message() << "\n";
+    ErrOS.flush();
+    Log.finish(I, EXIT_FAILURE);
+    return;
+  }
+
+  Input In(std::move(*Buf), ErrOS);
+  // The parser stops at the first error and can't return, so the input
+  // fails and another thread goes on with the rest. A compile of its own
+  // would exit with 0, but then later inputs would be left uncompiled.
+  In.Diags.setErrorHandler([&] {
+    OutOS.flush();
+    ErrOS.flush();
+    Log.abandon(I, EXIT_FAILURE, Rest);
+  });
+  parseInput(Argv0, Name, In, ErrOS);
+
+  int ExitCode;
+  bool Success = generate(Argv0, Argc, Argv, Name, In, TM, Cache, OutOS,
+                          ErrOS, ExitCode);
+  OutOS.flush();
+  ErrOS.flush();
+  Log.finish(I, Success ? std::nullopt : std::optional<int>(EXIT_FAILURE));
+}
+
+/// Compile several inputs in one process, on -j threads that each have a
+/// target machine and take the next input when done, the largest first so
+/// that a big one doesn't start last. Every input gets a context of its own
+/// and the same output as if it were compiled alone.
+int compileBatch(const char *Argv0, int Argc, const char **Argv) {
+  if (!OutputFile.empty()) {
+    llvm::WithColor::error(llvm::errs(), Argv0)
+        << "-o names one output, but there are several inputs\n";
+    return EXIT_FAILURE;
+  }
+  if (Run || Interp || Tiered) {
+    llvm::WithColor::error(llvm::errs(), Argv0)
+        << "-run, -interp and -tiered take a single input\n";
+    return EXIT_FAILURE;
+  }
+  if (!checkRemarkFilters(Argv0)) {
+    return EXIT_FAILURE;
+  }
+  std::optional<ObjectCache> Cache;
+  if (!CacheDir.empty() && !tracksLocations()) {
+    Cache = openCache(Argv0);
+    if (!Cache) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  // An input that can't be read fails when its turn comes.
+  size_t NumInputs = InputFiles.size();
+  std::vector<uint64_t> Sizes(NumInputs, 0);
+  for (size_t I = 0; I < NumInputs; ++I) {
+    llvm::sys::fs::file_size(InputFiles[I], Sizes[I]);
+  }
+  std::vector<size_t> Order(NumInputs);
+  std::iota(Order.begin(), Order.end(), 0);
+  std::stable_sort(Order.begin(), Order.end(), [&Sizes](size_t A, size_t B) {
+    return Sizes[A] > Sizes[B];
+  });
+
+  unsigned NumWorkers =
+      Jobs ? Jobs : llvm::hardware_concurrency().compute_thread_count();
+  NumWorkers = std::min<size_t>(NumWorkers, NumInputs);
+  std::vector<std::unique_ptr<llvm::TargetMachine>> TMs;
+  for (unsigned I = 0; I < NumWorkers; ++I) {
+    TMs.emplace_back(createTargetMachine(Argv0));
+    if (!TMs.back()) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  BatchLog Log(NumInputs, NumWorkers);
+  std::atomic<size_t> Next(0);
+  // A thread that takes over from an abandoned worker also takes over its
+  // target machine, which the worker no longer uses.
+  std::function<void(llvm::TargetMachine *)> Work =
+      [&](llvm::TargetMachine *TM) {
+        std::function<void()> Rest = [&Work, TM] { Work(TM); };
+        for (size_t K; (K = Next++) < NumInputs;) {
+          compileBatchInput(Argv0, Argc, Argv, Order[K], TM,
+                            Cache ? &*Cache : nullptr, Log, Rest);
+        }
+        Log.stop();
+      };
+  std::vector<std::thread> Workers;
+  for (std::unique_ptr<llvm::TargetMachine> &TM: TMs) {
+    Workers.emplace_back(Work, TM.get());
+  }
+
+  // A worker left waiting in an input with errors can't be joined.
+  if (std::optional<int> Failure = Log.wait()) {
+    llvm::outs().flush();
+    llvm::errs().flush();
+    std::_Exit(*Failure);
+  }
+  for (std::thread &Worker: Workers) {
+    Worker.join();
+  }
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, const char **argv) {
   llvm::InitLLVM X(argc, argv);
 
-  llvm::InitializeAllTargets();
-  llvm::InitializeAllTargetMCs();
-  llvm::InitializeAllAsmParsers();
-  llvm::InitializeAllAsmPrinters();
-
   llvm::cl::SetVersionPrinter(&printVersion);
   llvm::cl::ParseCommandLineOptions(argc, argv, Head);
+  InputFile = InputFiles.empty() ? "-" : InputFiles.front();
 
-  llvm::TargetMachine *TM = createTargetMachine(argv[0]);
-  if (!TM) exit(EXIT_FAILURE);
+  // The interpreter runs without any target, -tiered sets up the host once
+  // a loop gets hot.
+  if (!Interp && !Tiered) {
+    llvm::InitializeAllTargets();
+    llvm::InitializeAllTargetMCs();
+    llvm::InitializeAllAsmParsers();
+    llvm::InitializeAllAsmPrinters();
+  }
 
-  static llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buf =
+  if (Repl) {
+    return runRepl(argv[0]) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (CacheStats) {
+    return printCacheStats(argv[0]) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (LTOLink) {
+    return linkThinLTO(argv[0]) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  if (InputFiles.size() > 1) {
+    return compileBatch(argv[0], argc, argv);
+  }
+
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buf =
       llvm::MemoryBuffer::getFile(InputFile);
   
   if (!buf) {
@@ -196,33 +1685,53 @@ int main(int argc, const char **argv) {
     exit(EXIT_FAILURE);
   }
 
-  llvm::SourceMgr mgr;
-  DiagEngine diagEngine(mgr);
-  mgr.AddNewSourceBuffer(std::move(*buf), llvm::SMLoc());
+  Input In(std::move(*buf), llvm::errs());
+  parseInput(argv[0], InputFile, In, llvm::errs());
+  std::shared_ptr<Program> prog = In.Prog;
+  //PrintVisitor pv(prog);
 
-  Lexer lexer(mgr, diagEngine);
-  Token tok;
-  //while (true) {
-  //  lexer.nextToken(tok);
-  //  if (tok.tokenType == TokenType::eof) {
-  //    break;
-  //  }
-  //  tok.dump();
-  //}
-  
-  Sema sema(diagEngine);
-  Parser parser(lexer, sema);
+  if (Interp || Tiered) {
+    std::optional<TieredLoopCompiler> Loops;
+    LoopCompiler CompileLoop;
+    if (Tiered) {
+      Loops.emplace(argv[0], prog);
+      CompileLoop = [&](ForStmt *Loop, const LoopFrame &Frame) {
+        return Loops->compile(Loop, Frame);
+      };
+    }
+    llvm::Expected<int> ExitCode =
+        interpretProgram(*prog, llvm::outs(), CompileLoop, TierUpThreshold);
+    if (!ExitCode) {
+      llvm::outs().flush();
+      llvm::WithColor::error(llvm::errs(), argv[0])
+          << llvm::toString(ExitCode.takeError()) << "\n";
+      exit(EXIT_FAILURE);
+    }
+    return *ExitCode;
+  }
 
-  auto prog = parser.parseProgram();
-  //PrintVisitor pv(prog);
+  llvm::TargetMachine *TM = createTargetMachine(argv[0]);
+  if (!TM) exit(EXIT_FAILURE);
 
-  CodegenVisitor cg(prog);
+  if (!checkRemarkFilters(argv[0])) {
+    exit(EXIT_FAILURE);
+  }
 
-  llvm::Module *M = cg.getModule();
-  if (!emit(argv[0], M, TM, InputFile)) {
-    llvm::WithColor::error(llvm::errs(), argv[0])
-      << "Error writing output\n";
+  // Remarks and the throughput report are printed while generating the
+  // code, so they always miss.
+  std::optional<ObjectCache> Cache;
+  if (!CacheDir.empty() && !Run && !tracksLocations()) {
+    Cache = openCache(argv[0]);
+    if (!Cache) {
+      exit(EXIT_FAILURE);
+    }
   }
 
-  return 0;
-}
\ No newline at end of file
+  int ExitCode;
+  if (!generate(argv[0], argc, argv, InputFile, In, TM,
+                Cache ? &*Cache : nullptr, llvm::outs(), llvm::errs(),
+                ExitCode)) {
+    exit(EXIT_FAILURE);
+  }
+  return ExitCode;
+}
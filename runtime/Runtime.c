@@ -0,0 +1,118 @@
+// The runtime of the programs compiled by tinycc. Output goes to a large
+// buffer, which is written to stdout when it is full and when the program
+// returns from main. The entry points are typed, so printing a value
+// neither passes varargs nor parses a format string.
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TINYCC_BUFFER_SIZE (64 * 1024)
+
+static char buffer[TINYCC_BUFFER_SIZE];
+static unsigned bufferLen = 0;
+
+// The decimal digits of 0 to 99, two characters each.
+static const char digitPairs[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static void writeAll(const char *data, unsigned len) {
+  while (len > 0) {
+    ssize_t n = write(STDOUT_FILENO, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    data += n;
+    len -= n;
+  }
+}
+
+void __tinycc_flush(void) {
+  writeAll(buffer, bufferLen);
+  bufferLen = 0;
+}
+
+// Make room for `len` more characters.
+static inline char *reserve(unsigned len) {
+  if (bufferLen + len > TINYCC_BUFFER_SIZE) {
+    __tinycc_flush();
+  }
+  char *out = buffer + bufferLen;
+  bufferLen += len;
+  return out;
+}
+
+void __tinycc_print_str(const char *str, unsigned len) {
+  if (len > TINYCC_BUFFER_SIZE) {
+    __tinycc_flush();
+    writeAll(str, len);
+    return;
+  }
+  memcpy(reserve(len), str, len);
+}
+
+void __tinycc_print_char(int c) {
+  *reserve(1) = (char)c;
+}
+
+// Convert two digits at a time from the end, so the number takes half the
+// divisions of a digit by digit conversion.
+void __tinycc_print_i32(int value) {
+  char digits[11];
+  char *end = digits + sizeof(digits);
+  char *p = end;
+  unsigned u = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+  while (u >= 100) {
+    unsigned pair = u % 100;
+    u /= 100;
+    p -= 2;
+    memcpy(p, digitPairs + pair * 2, 2);
+  }
+  if (u >= 10) {
+    p -= 2;
+    memcpy(p, digitPairs + u * 2, 2);
+  }
+  else {
+    *--p = (char)('0' + u);
+  }
+  if (value < 0) {
+    *--p = '-';
+  }
+  memcpy(reserve(end - p), p, end - p);
+}
+
+static int equals(const char *a, const char *b) {
+  while (*a && *a == *b) {
+    ++a;
+    ++b;
+  }
+  return *a == *b;
+}
+
+// Whether the CPU has `feature`, for the resolvers of `target_clones`
+// functions. They run while the program is loaded, before any constructor
+// has set up the CPU model and possibly before the PLT is bound, so this
+// calls nothing from libc.
+int __tinycc_cpu_supports(const char *feature) {
+  __builtin_cpu_init();
+#define CPU_FEATURE(NAME)                                                      \
+  if (equals(feature, NAME)) {                                                 \
+    return __builtin_cpu_supports(NAME);                                       \
+  }
+#include "CPUFeature.h.inc"
+  return 0;
+}
+
+// Doubles keep the "%f" format of printf, which DBL_MAX fits in.
+void __tinycc_print_f64(double value) {
+  char digits[320];
+  int len = snprintf(digits, sizeof(digits), "%f", value);
+  __tinycc_print_str(digits, (unsigned)len);
+}
\ No newline at end of file